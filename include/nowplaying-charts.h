@@ -0,0 +1,143 @@
+#ifndef nowplaying_charts_h
+#define nowplaying_charts_h
+
+#include "nowplaying-snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * What a chart ranks.
+ */
+typedef enum {
+    kMRTopChartsCategoryArtist,     /*!< Ranks artists. */
+    kMRTopChartsCategoryAlbum,      /*!< Ranks albums, told apart by their artist. */
+    kMRTopChartsCategoryTrack       /*!< Ranks tracks, told apart by their artist and album. */
+} MRTopChartsCategory;
+
+/**
+ * The period a chart covers. Periods are calendar ones (this hour, today), not sliding.
+ */
+typedef enum {
+    kMRTopChartsWindowHour,         /*!< The current hour. */
+    kMRTopChartsWindowDay,          /*!< The current day. */
+    kMRTopChartsWindowAllTime       /*!< Since the creation of the instance. */
+} MRTopChartsWindow;
+
+/**
+ * The limits of MRTopCharts.
+ */
+struct MRTopChartsConfig {
+    size_t capacity;            /*!< Counters kept by each chart (3 categories x 3 windows). Bounds the memory and the error, see MRTopChartsInterface. */
+    double utcOffset;           /*!< Offset of the local time from UTC (seconds), for days to start at local midnight. */
+
+    MRTopChartsConfig() : capacity(1024), utcOffset(0.0) {}
+};
+
+/**
+ * A line of a chart.
+ * The true number of plays is between `count - error` and `count`.
+ */
+struct MRTopChartsEntry {
+    std::string artist;
+    std::string albumTitle;     /*!< Empty for artist charts. */
+    std::string title;          /*!< Empty for artist and album charts. */
+    uint64_t count;
+    uint64_t error;
+
+    MRTopChartsEntry() : count(0), error(0) {}
+};
+
+/**
+ * Ranks the most played artists, albums and tracks of this hour, this day and all time, in bounded memory.
+ *
+ * Feed it with each snapshot, for example from the callback of MRNowPlayingInfoInterface::registerAutoUpdate().
+ * A play is counted when a track starts playing. Resuming or re-reporting the same track does not count again.
+ * To count plays by other rules, for example those of MRScrobblerInterface, call \ref addPlay() instead.
+ *
+ * Each chart is a Space-Saving sketch of `capacity` counters, whatever the number of distinct artists, albums or tracks.
+ * With N plays in the window and m = capacity:
+ * - counts are never underestimated, and overestimated by at most N / m (see \ref getErrorBound());
+ * - anything played more than N / m times is in the chart.
+ * Updates cost O(log m), top-K queries O(m log K).
+ *
+ * An instance is not thread-safe.
+ */
+class MRTopChartsInterface {
+
+public:
+
+    /**
+     * Create an instance of MRTopCharts.
+     *
+     * @param config The memory limits.
+     * @return A pointer to the MRTopChartsInterface instance created.
+     */
+    static MRTopChartsInterface* Create(const MRTopChartsConfig& config = MRTopChartsConfig());
+
+    /**
+     * Delete an instance of MRTopCharts.
+     */
+    static void Delete(MRTopChartsInterface* instance);
+
+    /// Destructor
+    virtual ~MRTopChartsInterface() {}
+
+    /**
+     * Take a new snapshot, counting a play if a new track started playing.
+     *
+     * @param snapshot The now playing information. Stale and provisional snapshots are ignored.
+     * @param now The UNIX time (with fraction) the snapshot was received.
+     * @return 1 if a play was counted, 0 if not.
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot, double now) = 0;
+
+    /**
+     * Count a play.
+     *
+     * @param artist UTF-8 name of the artist.
+     * @param albumTitle UTF-8 title of the album.
+     * @param title UTF-8 title of the track.
+     * @param now The UNIX time (with fraction) of the play.
+     */
+    virtual void addPlay(const std::string& artist, const std::string& albumTitle, const std::string& title, double now) = 0;
+
+    /**
+     * Get the top of a chart.
+     *
+     * @param category What to rank.
+     * @param window The period to rank.
+     * @param k The maximum number of entries.
+     * @param now The UNIX time (with fraction) of now. The hour and day charts are empty once their period is over.
+     * @return Up to `k` entries, most played first.
+     */
+    virtual std::vector<MRTopChartsEntry> getTop(MRTopChartsCategory category, MRTopChartsWindow window, size_t k, double now) = 0;
+
+    /**
+     * Get the number of plays counted in a period.
+     *
+     * @return The number of plays (N) in `window` at `now`.
+     */
+    virtual uint64_t getPlayCount(MRTopChartsWindow window, double now) = 0;
+
+    /**
+     * Get the largest possible overestimation of the counts of a chart.
+     *
+     * @return N / m, or 0 if the chart never had to forget anything (its counts are then exact).
+     */
+    virtual uint64_t getErrorBound(MRTopChartsCategory category, MRTopChartsWindow window, double now) = 0;
+
+    /**
+     * Get an estimate of the memory used by all the charts.
+     *
+     * @return The memory used, in bytes.
+     */
+    virtual size_t getMemoryUsage() = 0;
+};
+
+}
+
+#endif /* nowplaying_charts_h */
@@ -0,0 +1,131 @@
+#ifndef nowplaying_events_h
+#define nowplaying_events_h
+
+#include "nowplaying-snapshot.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace NowPlaying {
+
+/**
+ * What happened to the playback. Values are bits, so they can be combined to subscribe to several types.
+ */
+typedef enum {
+    kMRPlaybackEventTrackChanged = 1 << 0,  /*!< Another track (or no track) is now playing. */
+    kMRPlaybackEventStarted = 1 << 1,       /*!< The playback started or resumed. */
+    kMRPlaybackEventPaused = 1 << 2,        /*!< The playback paused or stopped, including when the track is gone. */
+    kMRPlaybackEventSeeked = 1 << 3,        /*!< The position jumped within the same track. */
+    kMRPlaybackEventEnded = 1 << 4,         /*!< The track played to its end. Comes before the event that ended it. */
+    kMRPlaybackEventAll = (1 << 5) - 1
+} MRPlaybackEventType;
+
+/**
+ * An event derived from the snapshots.
+ */
+struct MRPlaybackEvent {
+    MRPlaybackEventType type;
+    double time;                            /*!< UNIX time of the snapshot causing the event. */
+    double position;                        /*!< Elapsed time (seconds) reported at `time`. 0 if there is no track. */
+    double previousPosition;                /*!< Elapsed time (seconds) predicted at `time` from the previous snapshot. 0 if there was no track. */
+    const MRNowPlayingSnapshot* snapshot;   /*!< The snapshot causing the event. Valid during the callback only. */
+    const MRNowPlayingSnapshot* previous;   /*!< The snapshot before it. Valid during the callback only. */
+};
+
+/**
+ * The rules deciding what counts as a seek or as the end of a track.
+ */
+struct MREventStreamConfig {
+    double seekTolerance;   /*!< A reported position farther than this (seconds) from the predicted one is a seek. */
+    double endTolerance;    /*!< A track whose position comes this close (seconds) to its duration has ended. */
+
+    MREventStreamConfig() : seekTolerance(1.0), endTolerance(1.5) {}
+};
+
+/**
+ * Called by MREventStream from \ref MREventStreamInterface::feed().
+ *
+ * @param event What happened.
+ * @param context The `context` given when subscribing.
+ */
+typedef void (*MRPlaybackEventCallback)(const MRPlaybackEvent& event, void* context);
+
+/**
+ * Derives what happened to the playback (track changes, starts, pauses, seeks, ends) from the now playing snapshots, once for all consumers.
+ *
+ * Feed it with each snapshot, for example from the callback of MRNowPlayingInfoInterface::registerAutoUpdate():
+ *
+ *     events->feed(info->getSnapshot(), now);
+ *
+ * and subscribe to the types of events needed. Each snapshot is compared with the state left by the previous one in constant time:
+ * the position reported is compared with the one predicted from the previous snapshot, so a seek is told from the normal progress of the playback.
+ * Snapshots changing nothing, for example the same notification delivered twice, emit no events.
+ *
+ * The events of one snapshot come in order: ended, track changed, seeked, then paused or started.
+ * A track repeating emits ended, then seeked back to its start.
+ *
+ * An instance is not thread-safe. Stale and provisional snapshots (see MRNowPlayingInfoInterface::isStale() and isProvisional()) are ignored.
+ */
+class MREventStreamInterface {
+
+public:
+
+    /**
+     * Create an instance of MREventStream.
+     *
+     * @param config The rules deciding what counts as a seek or as the end of a track.
+     * @return A pointer to the MREventStreamInterface instance created.
+     */
+    static MREventStreamInterface* Create(const MREventStreamConfig& config = MREventStreamConfig());
+
+    /**
+     * Delete an instance of MREventStream.
+     */
+    static void Delete(MREventStreamInterface* instance);
+
+    /// Destructor
+    virtual ~MREventStreamInterface() {}
+
+    /**
+     * Take a new snapshot, and call the subscribers of the events it causes.
+     *
+     * @param snapshot The now playing information.
+     * @param now The UNIX time (with fraction) the snapshot was received. Must not go backwards.
+     * @return The number of events emitted.
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot, double now) = 0;
+
+    /**
+     * Subscribe to some types of events. Callbacks may subscribe and unsubscribe.
+     *
+     * @param types The types of events wanted, a combination of MRPlaybackEventType values.
+     * @param callback The function to call with each event.
+     * @param context Passed to `callback`.
+     * @return The identifier of the subscription, or 0 for invalid arguments.
+     */
+    virtual uint64_t subscribe(unsigned types, MRPlaybackEventCallback callback, void* context) = 0;
+
+    /**
+     * Cancel a subscription. Its callback is never called after this returns.
+     *
+     * @return 0 for success, -1 for unknown subscription.
+     */
+    virtual int unsubscribe(uint64_t id) = 0;
+
+    /**
+     * Get to know whether the playback is going on, as of the latest snapshot.
+     *
+     * @return true if a track is playing.
+     */
+    virtual bool isPlaying() = 0;
+
+    /**
+     * Get to know how many snapshots were deduplicated: notifications delivered twice, or changes of other fields such as the artwork.
+     *
+     * @return The number of snapshots which emitted no event.
+     */
+    virtual uint64_t getDuplicateCount() = 0;
+};
+
+}
+
+#endif /* nowplaying_events_h */
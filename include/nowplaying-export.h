@@ -0,0 +1,88 @@
+#ifndef nowplaying_export_h
+#define nowplaying_export_h
+
+#include "nowplaying-snapshot.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace NowPlaying {
+
+/**
+ * Writes the history of the now playing information to an Arrow IPC file (also known as Feather version 2),
+ * which analytics tools (pandas, Polars, DuckDB, Spark...) load directly.
+ *
+ * Each snapshot is a row with the columns:
+ *
+ * | Column                    | Arrow type                    | Null when                 |
+ * | ------------------------- | ----------------------------- | ------------------------- |
+ * | version                   | uint64                        |                           |
+ * | timestamp                 | timestamp[us, UTC]            | unknown                   |
+ * | has_info, stale, provisional | bool                       |                           |
+ * | title, artist, album_title, composer, genre, media_type, content_item_identifier | dictionary<int32, utf8> | empty |
+ * | duration                  | float64                       | unknown (0)               |
+ * | elapsed_time              | float64                       | no information            |
+ * | playback_rate             | float64                       | unknown (-1)              |
+ * | track_number, queue_index | int32                         | no information            |
+ * | unique_identifier, itunes_store_identifier | uint64       | 0                         |
+ * | repeat_mode, shuffle_mode | dictionary<int8, utf8>        | unknown                   |
+ *
+ * Rows are buffered and written as one record batch every `batchSize` rows, so memory stays bounded whatever the length of the history,
+ * apart from the dictionaries, which hold each distinct string once. Strings new to a batch are written before it as dictionary deltas.
+ * The file is complete and readable after each \ref flush(). Opening an existing file of this exporter appends to it.
+ * If the process stopped while writing a batch, the batches written whole are kept, and the file is finished again when opened.
+ *
+ * Feed it with the versions of MRNowPlayingInfoInterface::getSnapshotsSince(), for example:
+ *
+ *     info->getSnapshotsSince(exported, &snapshots);
+ *     for(size_t i = 0; i < snapshots.size(); i++) exporter->write(snapshots[i]);
+ *     exporter->flush();
+ *
+ * An instance is not thread-safe. The file must not be written by anything else while opened.
+ */
+class MRArrowExporterInterface {
+
+public:
+
+    /**
+     * Open a file to export to, creating it if missing.
+     *
+     * @param path Path of the file, in UTF-8. An existing file is appended to.
+     * @param batchSize The number of rows of each record batch. At least 1.
+     * @return A pointer to the MRArrowExporterInterface instance created,
+     *         or NULL if the file cannot be opened, or exists and is not an export of this version of the library.
+     */
+    static MRArrowExporterInterface* Create(const char* path, size_t batchSize = 65536);
+
+    /**
+     * Flush and close the file, then delete the instance.
+     */
+    static void Delete(MRArrowExporterInterface* instance);
+
+    /// Destructor
+    virtual ~MRArrowExporterInterface() {}
+
+    /**
+     * Add a row. Writes a record batch if `batchSize` rows are buffered.
+     *
+     * @param snapshot The snapshot, with its version.
+     * @return 0 for success, -1 for a failure to write. The instance then fails from now on.
+     */
+    virtual int write(const MRVersionedSnapshot& snapshot) = 0;
+
+    /**
+     * Write the rows buffered as a record batch, and finish the file so it can be read.
+     *
+     * @return 0 for success, -1 for a failure to write.
+     */
+    virtual int flush() = 0;
+
+    /// @return The number of rows of the file, including the ones buffered.
+    virtual uint64_t getRowCount() = 0;
+
+    /// @return The number of record batches written to the file.
+    virtual size_t getBatchCount() = 0;
+};
+
+}
+
+#endif /* nowplaying_export_h */
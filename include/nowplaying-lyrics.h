@@ -0,0 +1,149 @@
+#ifndef nowplaying_lyrics_h
+#define nowplaying_lyrics_h
+
+#include "nowplaying-snapshot.h"
+#include <cstddef>
+#include <string>
+
+namespace NowPlaying {
+
+typedef enum {
+    kMRLyricsEventLine,             /*!< A line starts. */
+    kMRLyricsEventWord              /*!< A word of the current line starts (enhanced LRC only). */
+} MRLyricsEventType;
+
+/**
+ * A line or word reached by the playback.
+ */
+struct MRLyricsEvent {
+    MRLyricsEventType type;
+    int line;                       /*!< Index of the line, -1 before the first line (only after a jump). */
+    int word;                       /*!< Index of the word in its line, -1 for line events. */
+    double time;                    /*!< Position (seconds of media) of the line or word. 0 if `line` is -1. */
+    const char* text;               /*!< The text of the line or word, without time tags. Not NUL-terminated. Valid until the next load. */
+    size_t length;                  /*!< Length of `text` in bytes. */
+    bool jumped;                    /*!< The position jumped (seek, another track, new lyrics) to within this line or word. */
+};
+
+/**
+ * A line of lyrics.
+ */
+struct MRLyricsLine {
+    double time;                    /*!< Position (seconds of media) the line starts. */
+    double endTime;                 /*!< Position the next line starts, or HUGE_VAL for the last line. */
+    std::string text;               /*!< Without time tags. May be empty (a pause). */
+    size_t wordCount;               /*!< Number of timed words (enhanced LRC), 0 for plain LRC. */
+
+    MRLyricsLine() : time(0.0), endTime(0.0), wordCount(0) {}
+};
+
+/**
+ * Called by MRLyrics from \ref MRLyricsInterface::advance().
+ *
+ * @param event The line or word reached.
+ * @param context The `context` given to \ref MRLyricsInterface::advance().
+ */
+typedef void (*MRLyricsCallback)(const MRLyricsEvent& event, void* context);
+
+/**
+ * Follows time-synced lyrics along the playback, for karaoke-style display.
+ *
+ * Lyrics are given in LRC, optionally enhanced with word times:
+ *
+ *     [ti:Title]
+ *     [offset:+250]
+ *     [00:12.00]First line
+ *     [00:17.20][01:05.40]Chorus, repeated
+ *     [00:21.10]<00:21.10>Word <00:21.60>by <00:22.05>word
+ *
+ * They are parsed once into arrays sorted by time. While playing, a cursor steps to the next line or word in constant time,
+ * and jumps (seek, another track, new lyrics) find the position again by binary search.
+ *
+ * The owner feeds the snapshots, sleeps until \ref nextDeadline() and then calls \ref advance(), which emits the lines and words reached,
+ * so events come right at their boundaries without polling:
+ *
+ *     lyrics->feed(info->getSnapshot(), now);
+ *     ...
+ *     lyrics->advance(now, onLyricsEvent, context);
+ *
+ * Times are UNIX times (with fraction), so it can run on a simulated clock. An instance is not thread-safe.
+ */
+class MRLyricsInterface {
+
+public:
+
+    /**
+     * Create an instance of MRLyrics, without lyrics.
+     *
+     * @return A pointer to the MRLyricsInterface instance created.
+     */
+    static MRLyricsInterface* Create();
+
+    /**
+     * Delete an instance of MRLyrics.
+     */
+    static void Delete(MRLyricsInterface* instance);
+
+    /// Destructor
+    virtual ~MRLyricsInterface() {}
+
+    /**
+     * Replace the lyrics, for example when another track starts. The next \ref advance() emits the current line at once.
+     *
+     * @param text The lyrics in (enhanced) LRC, in UTF-8. Lines without a time tag are ignored.
+     * @param length Length of `text` in bytes.
+     * @return 0 for success, -1 for no timed line (the instance then has no lyrics).
+     */
+    virtual int load(const char* text, size_t length) = 0;
+
+    /**
+     * Take a new snapshot.
+     *
+     * @param snapshot The now playing information. Nothing is emitted for stale snapshots or snapshots without information.
+     * @param now The UNIX time (with fraction) the snapshot was received.
+     * @return 1 if the position jumped (and the next \ref advance() emits the current line at once), 0 if not.
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot, double now) = 0;
+
+    /**
+     * Emit the lines and words reached by `now`, in order, or after a jump only the current line and word.
+     *
+     * @param now The UNIX time (with fraction) of now.
+     * @param callback The function to call with each event. May be NULL to only move the cursor.
+     * @param context Passed to `callback`.
+     * @return The number of events emitted.
+     */
+    virtual size_t advance(double now, MRLyricsCallback callback, void* context) = 0;
+
+    /**
+     * Get the time the next event is due.
+     *
+     * @return The UNIX time (with fraction), a time already passed if the current line is due at once,
+     *         or HUGE_VAL if nothing will be emitted until the next snapshot (paused, or after the last word).
+     */
+    virtual double nextDeadline() = 0;
+
+    /// @return The number of lines.
+    virtual size_t getLineCount() = 0;
+
+    /**
+     * Get a line of the lyrics.
+     *
+     * @param index The index of the line, from 0 to \ref getLineCount() - 1.
+     * @param line Receives the line.
+     * @return 0 for success, -1 for an index out of range.
+     */
+    virtual int getLine(size_t index, MRLyricsLine* line) = 0;
+
+    /**
+     * Find the line shown at a position.
+     *
+     * @param position The position (seconds of media).
+     * @return The index of the last line starting at or before `position`, or -1 if before the first line.
+     */
+    virtual int getLineAt(double position) = 0;
+};
+
+}
+
+#endif /* nowplaying_lyrics_h */
@@ -0,0 +1,142 @@
+#ifndef nowplaying_scheduler_h
+#define nowplaying_scheduler_h
+
+#include "nowplaying-snapshot.h"
+#include <cstdint>
+
+namespace NowPlaying {
+
+class MRCommanderInterface;
+
+/**
+ * The commands MRCommandScheduler can send.
+ */
+typedef enum {
+    kMRScheduledCommandPlay,
+    kMRScheduledCommandPause,
+    kMRScheduledCommandTogglePlayPause,
+    kMRScheduledCommandNextTrack,
+    kMRScheduledCommandPreviousTrack,
+    kMRScheduledCommandSeek
+} MRScheduledCommand;
+
+/**
+ * What became of a scheduled command.
+ */
+typedef enum {
+    kMRScheduledCommandFired,       /*!< Sent when the media reached the position. */
+    kMRScheduledCommandMissed       /*!< Never sent: the media jumped over the position, or another track (or nothing) is playing. */
+} MRScheduledCommandOutcome;
+
+/**
+ * Reported once for each scheduled command, fired or missed.
+ */
+struct MRScheduledCommandReport {
+    uint64_t id;                        /*!< As returned by MRCommandSchedulerInterface::schedule(). */
+    MRScheduledCommand command;
+    MRScheduledCommandOutcome outcome;
+    double targetPosition;              /*!< The position it was scheduled at (seconds of media), counted from the start of the track. */
+    double time;                        /*!< UNIX time it was fired or missed. */
+    double position;                    /*!< Position of the media (seconds) at `time`, as extrapolated from the latest snapshot. */
+    double error;                       /*!< `position - targetPosition`: how late (or early, if negative) it was fired, in seconds of media. */
+    bool result;                        /*!< The result of the call to MRCommander. false if missed. */
+
+    MRScheduledCommandReport() : id(0), command(kMRScheduledCommandPlay), outcome(kMRScheduledCommandMissed), targetPosition(0.0), time(0.0), position(0.0), error(0.0), result(false) {}
+};
+
+/**
+ * How accurately the commands of an MRCommandScheduler were fired.
+ */
+struct MRCommandSchedulerStatistics {
+    uint64_t fired;
+    uint64_t missed;
+    double meanError;               /*!< Mean of the absolute `error` of the commands fired (seconds of media). */
+    double maxError;                /*!< Largest absolute `error` of the commands fired (seconds of media). */
+
+    MRCommandSchedulerStatistics() : fired(0), missed(0), meanError(0.0), maxError(0.0) {}
+};
+
+/**
+ * Called by MRCommandScheduler on its thread, once the command was fired or missed.
+ *
+ * @param report What became of the command.
+ * @param context The `context` given when scheduling.
+ */
+typedef void (*MRCommandSchedulerCallback)(const MRScheduledCommandReport& report, void* context);
+
+/**
+ * Sends commands when the media playing now reaches a position, for example "pause at 2:30" or "next track 5 seconds before the end".
+ *
+ * A command is keyed to the position of the track playing when it was scheduled, not to a wall clock time.
+ * Its deadline is recomputed from each snapshot, so it follows pauses, seeks and playback rate changes.
+ * It is missed (and reported so) if another track starts, or if the media jumps over the position.
+ *
+ * The thread sleeps until shortly before the next deadline and spins for the rest, for sub-millisecond accuracy.
+ * Each command is reported with its error: how far the media was from the target position when it was sent.
+ *
+ * Feed it with each snapshot, for example from the callback of MRNowPlayingInfoInterface::registerAutoUpdate():
+ *
+ *     scheduler->feed(info->getSnapshot());
+ *
+ * After a command is sent, its expected effect (paused, seeked...) is assumed until the next snapshot.
+ * Methods may be called from any thread, including from the callbacks.
+ */
+class MRCommandSchedulerInterface {
+
+public:
+
+    /**
+     * Create an instance of MRCommandScheduler, starting its thread.
+     *
+     * @param commander Sends the commands. Must outlive the instance.
+     * @return A pointer to the MRCommandSchedulerInterface instance created.
+     */
+    static MRCommandSchedulerInterface* Create(MRCommanderInterface* commander);
+
+    /**
+     * Delete an instance of MRCommandScheduler, stopping its thread. Must not be called from a callback.
+     * Commands still scheduled are dropped without being reported.
+     */
+    static void Delete(MRCommandSchedulerInterface* instance);
+
+    /// Destructor
+    virtual ~MRCommandSchedulerInterface() {}
+
+    /**
+     * Take a new snapshot. Stale snapshots are ignored.
+     *
+     * @param snapshot The now playing information.
+     * @return The number of commands missed because of this snapshot.
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot) = 0;
+
+    /**
+     * Schedule a command on the track playing now, as known from the latest snapshot.
+     *
+     * @param command The command to send.
+     * @param position The position (seconds) to send it at. Negative for a position from the end of the track, for example -5.
+     * @param seekTime Where to seek to, for \ref kMRScheduledCommandSeek. Ignored for the other commands.
+     * @param callback Called once the command was fired or missed. May be NULL.
+     * @param context Passed to `callback`.
+     * @return The identifier of the command, or 0 if no track is known or the position has already passed.
+     */
+    virtual uint64_t schedule(MRScheduledCommand command, double position, double seekTime, MRCommandSchedulerCallback callback, void* context) = 0;
+
+    /**
+     * Cancel a command. It is neither sent nor reported after this returns.
+     *
+     * @return 0 for success, -1 for unknown command (or already fired or missed).
+     */
+    virtual int cancel(uint64_t id) = 0;
+
+    /**
+     * Get to know how accurately the commands were fired.
+     *
+     * @return The counts and errors since the creation of the instance.
+     */
+    virtual MRCommandSchedulerStatistics getStatistics() = 0;
+};
+
+}
+
+#endif /* nowplaying_scheduler_h */
@@ -0,0 +1,120 @@
+#ifndef nowplaying_scrobbler_h
+#define nowplaying_scrobbler_h
+
+#include "nowplaying-snapshot.h"
+#include <cstddef>
+#include <string>
+
+namespace NowPlaying {
+
+/**
+ * The rules deciding when a listening session counts as a play.
+ * The defaults are the usual scrobbling rules: half of the track or four minutes, whichever comes first, for tracks longer than 30 seconds.
+ */
+struct MRScrobblerConfig {
+    double minimumDuration;     /*!< Tracks shorter than this (seconds) never count. Ignored if the duration is unknown. */
+    double playedFraction;      /*!< A track counts after this fraction of its duration has been listened to. */
+    double maximumThreshold;    /*!< A track always counts after this many seconds listened, whatever its duration. */
+    double seekTolerance;       /*!< A position farther than this (seconds) from the expected one is a seek. */
+
+    MRScrobblerConfig() : minimumDuration(30.0), playedFraction(0.5), maximumThreshold(240.0), seekTolerance(2.0) {}
+};
+
+/**
+ * The listening of one track, from when it started to when another one (or nothing) was played.
+ */
+struct MRListeningSession {
+    std::string contentItemIdentifier;
+    std::string title;
+    std::string artist;
+    std::string albumTitle;
+    double duration;        /*!< Duration of the track (seconds). 0 for unknown. */
+    double startTime;       /*!< UNIX time the session started. */
+    double endTime;         /*!< UNIX time of the last event of the session. */
+    double listenedTime;    /*!< Seconds actually spent playing, excluding pauses. */
+    double position;        /*!< Elapsed time in the track at `endTime` (seconds). */
+    int pauseCount;
+    int seekCount;
+    bool playing;           /*!< Whether it was playing at `endTime`. */
+
+    MRListeningSession() : duration(0.0), startTime(0.0), endTime(0.0), listenedTime(0.0), position(0.0), pauseCount(0), seekCount(0), playing(false) {}
+};
+
+/**
+ * Derives listening sessions and completed plays ("scrobbles") from the now playing snapshots.
+ *
+ * Feed it with each snapshot, for example from the callback of MRNowPlayingInfoInterface::registerAutoUpdate():
+ *
+ *     scrobbler->feed(info->getSnapshot(), now);
+ *
+ * Every snapshot costs constant time, whatever the length of the session.
+ * A session ends when another track (or nothing) is playing, or when a track restarts from its beginning (repeat).
+ * Sessions meeting the thresholds of MRScrobblerConfig are then queued as plays, see \ref popPlay().
+ *
+ * An instance is not thread-safe. Stale and provisional snapshots (see MRNowPlayingInfoInterface::isStale() and isProvisional()) are ignored.
+ */
+class MRScrobblerInterface {
+
+public:
+
+    /**
+     * Create an instance of MRScrobbler.
+     *
+     * @param config The rules deciding when a session counts as a play.
+     * @return A pointer to the MRScrobblerInterface instance created.
+     */
+    static MRScrobblerInterface* Create(const MRScrobblerConfig& config = MRScrobblerConfig());
+
+    /**
+     * Delete an instance of MRScrobbler.
+     */
+    static void Delete(MRScrobblerInterface* instance);
+
+    /// Destructor
+    virtual ~MRScrobblerInterface() {}
+
+    /**
+     * Take a new snapshot.
+     *
+     * @param snapshot The now playing information.
+     * @param now The UNIX time (with fraction) the snapshot was received. Must not go backwards.
+     * @return The number of plays completed by this snapshot (0 or 1).
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot, double now) = 0;
+
+    /**
+     * End the current session, for example when quitting.
+     *
+     * @param now The UNIX time (with fraction) of now.
+     * @return The number of plays completed (0 or 1).
+     */
+    virtual int flush(double now) = 0;
+
+    /**
+     * Get the session in progress.
+     *
+     * @param session Receives the session, extrapolated to `now` if playing.
+     * @param now The UNIX time (with fraction) of now.
+     * @return 0 for success, -1 for no session in progress.
+     */
+    virtual int getCurrentSession(MRListeningSession* session, double now) = 0;
+
+    /**
+     * Get to know how many completed plays are waiting to be taken by \ref popPlay().
+     *
+     * @return The number of plays queued.
+     */
+    virtual size_t getPlayCount() = 0;
+
+    /**
+     * Take the oldest completed play.
+     *
+     * @param play Receives the session which counted as a play.
+     * @return 0 for success, -1 for no play queued.
+     */
+    virtual int popPlay(MRListeningSession* play) = 0;
+};
+
+}
+
+#endif /* nowplaying_scrobbler_h */
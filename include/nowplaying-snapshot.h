@@ -0,0 +1,148 @@
+#ifndef nowplaying_snapshot_h
+#define nowplaying_snapshot_h
+
+#include <cstdint>
+#include <string>
+
+namespace NowPlaying {
+
+/**
+ * Represents the repeat mode of playing status.
+ */
+typedef enum {
+    kMRNowPlayingInfoRepeatModeRepeatOff,       /*!< Represents the repeat mode is off. */
+    kMRNowPlayingInfoRepeatModeRepeatAll,       /*!< Represents the repeat mode is to repeat all songs in the current view (for example, a playlist). */
+    kMRNowPlayingInfoRepeatModeRepeatCurrent,   /*!< Represents the repeat mode is to repeat the current playing song. */
+    kMRNowPlayingInfoRepeatModeUnknown          /*!< Represents the repeat mode is unknown. */
+} MRNowPlayingInfoRepeatMode;
+
+/**
+ * Represents the shuffle mode of playing status.
+ */
+typedef enum {
+    kMRNowPlayingInfoShuffleModeOff,            /*!< Represents the shuffle mode is off. */
+    kMRNowPlayingInfoShuffleModeOn,             /*!< Represents the shuffle mode is on. */
+    kMRNowPlayingInfoShuffleModeUnknown         /*!< Represents the shuffle mode is unknown. */
+} MRNowPlayingInfoShuffleMode;
+
+/**
+ * A copy of the now playing information at one moment, in plain C++ types.
+ *
+ * Every field has the same meaning and the same "unknown" value as the getter of MRNowPlayingInfoInterface with the same name.
+ * The artwork itself is not part of the snapshot, only its identifier and description.
+ */
+struct MRNowPlayingSnapshot {
+    bool hasInfo;                   /*!< false if the system knows nothing about the media playing now. All other fields are then unknown. */
+    bool stale;                     /*!< true if served from an earlier moment (for example, a previous run) and not confirmed by the system yet. */
+    bool provisional;               /*!< true if predicted from a command sent by this process, and not confirmed by the system yet. See MRCommanderInterface::SetOptimisticUpdates(). */
+
+    std::string title;
+    std::string artist;
+    std::string albumTitle;
+    std::string composer;
+    std::string genre;
+    std::string mediaType;          /*!< Without the "MRMediaRemoteMediaType" prefix, as returned by getMediaType(). */
+    std::string contentItemIdentifier;
+    std::string artworkIdentifier;
+    std::string artworkMIMEType;
+
+    int artworkWidth;
+    int artworkHeight;
+    int queueIndex;
+    int totalQueueCount;
+    int totalTrackCount;
+    int trackNumber;
+    bool isMusicApp;
+
+    double duration;                /*!< Seconds. */
+    double elapsedTime;             /*!< Seconds, at the moment of `timestamp`. */
+    double playbackRate;            /*!< 1 as playing, 0 as paused, -1 as unknown. */
+    double timestamp;               /*!< UNIX time (with fraction) of when the playing status changed. 0 for unknown. */
+
+    uint64_t uniqueIdentifier;
+    uint64_t iTunesStoreIdentifier;
+    uint64_t iTunesStoreSubscriptionAdamIdentifier;
+    uint64_t albumiTunesStoreAdamIdentifier;
+    uint64_t artistiTunesStoreAdamIdentifier;
+
+    MRNowPlayingInfoRepeatMode repeatMode;
+    MRNowPlayingInfoShuffleMode shuffleMode;
+
+    MRNowPlayingSnapshot() :
+        hasInfo(false), stale(false), provisional(false),
+        artworkWidth(0), artworkHeight(0), queueIndex(0), totalQueueCount(0), totalTrackCount(0), trackNumber(0), isMusicApp(false),
+        duration(0.0), elapsedTime(0.0), playbackRate(-1.0), timestamp(0.0),
+        uniqueIdentifier(0), iTunesStoreIdentifier(0), iTunesStoreSubscriptionAdamIdentifier(0), albumiTunesStoreAdamIdentifier(0), artistiTunesStoreAdamIdentifier(0),
+        repeatMode(kMRNowPlayingInfoRepeatModeUnknown), shuffleMode(kMRNowPlayingInfoShuffleModeUnknown) {}
+
+    /**
+     * Get the elapsed time at another moment, extrapolated from `elapsedTime`, `timestamp` and `playbackRate`.
+     *
+     * @param now UNIX time (with fraction) of the moment.
+     * @return The elapsed time (seconds) at `now`, clamped to the duration when it is known.
+     */
+    double elapsedTimeAt(double now) const {
+        double elapsed = elapsedTime;
+        if(timestamp > 0 && playbackRate > 0 && now > timestamp) elapsed += (now - timestamp) * playbackRate;
+        if(duration > 0 && elapsed > duration) elapsed = duration;
+        return elapsed;
+    }
+};
+
+/**
+ * A snapshot with its version in the history of an MRNowPlayingInfo instance, see MRNowPlayingInfoInterface::SetHistoryCapacity().
+ */
+struct MRVersionedSnapshot {
+    uint64_t version;               /*!< Increases by 1 with each update of the instance, from 1. */
+    MRNowPlayingSnapshot snapshot;
+
+    MRVersionedSnapshot() : version(0) {}
+};
+
+/**
+ * How the optimistic updates of MRCommander turned out, see MRCommanderInterface::SetOptimisticUpdates().
+ */
+struct MROptimisticStatistics {
+    uint64_t speculations;          /*!< Provisional snapshots published. */
+    uint64_t confirmations;         /*!< Confirmed by the system. */
+    uint64_t rollbacks;             /*!< Contradicted by the system or timed out, including `timeouts`. */
+    uint64_t timeouts;              /*!< Neither confirmed nor contradicted in time. */
+    uint64_t superseded;            /*!< Replaced by another command before being settled. */
+    double meanConfirmationTime;    /*!< Seconds from the command to its confirmation, on average. */
+    double maxConfirmationTime;     /*!< Seconds from the command to its confirmation, at worst. */
+
+    MROptimisticStatistics() : speculations(0), confirmations(0), rollbacks(0), timeouts(0), superseded(0), meanConfirmationTime(0.0), maxConfirmationTime(0.0) {}
+};
+
+/**
+ * How the fetches of now playing information from the system went, see MRNowPlayingInfoInterface::SetFetchDeadline().
+ */
+struct MRFetchStatistics {
+    uint64_t fetches;               /*!< Fetches issued to the system, including retries. */
+    uint64_t stuckFetches;          /*!< Fetches not answered by their deadline. */
+    uint64_t retries;               /*!< Fetches issued again because one got stuck. */
+    uint64_t lateReplies;           /*!< Answers to fetches which had been retried already. Ignored if a retry was answered first. */
+    double staleSince;              /*!< UNIX time (with fraction) of the stuck fetch the system has not answered since, 0 while it answers. */
+
+    MRFetchStatistics() : fetches(0), stuckFetches(0), retries(0), lateReplies(0), staleSince(0.0) {}
+};
+
+/**
+ * How the change notifications of the system were turned into callbacks, see MRNowPlayingInfoInterface::SetNotificationFastPath().
+ */
+struct MRNotificationStatistics {
+    uint64_t notifications;         /*!< Change notifications received. */
+    uint64_t applied;               /*!< Applied from the notification itself, without a fetch. */
+    uint64_t deferredFetches;       /*!< Fetches issued later to check what was applied. One covers all the notifications applied meanwhile. */
+    uint64_t fetchesAvoided;        /*!< `applied` less `deferredFetches`. */
+    double meanAppliedLatency;      /*!< Seconds from a notification applied without a fetch to the callbacks, on average. */
+    double meanFetchedLatency;      /*!< Seconds from a notification needing a fetch to the callbacks, on average. */
+    double maxLatency;              /*!< Seconds from a notification to the callbacks, at worst. */
+
+    MRNotificationStatistics() : notifications(0), applied(0), deferredFetches(0), fetchesAvoided(0),
+                                 meanAppliedLatency(0.0), meanFetchedLatency(0.0), maxLatency(0.0) {}
+};
+
+}
+
+#endif /* nowplaying_snapshot_h */
@@ -0,0 +1,89 @@
+#ifndef nowplaying_ticker_h
+#define nowplaying_ticker_h
+
+#include "nowplaying-snapshot.h"
+#include <cstdint>
+
+namespace NowPlaying {
+
+/**
+ * Called by MRProgressTicker on its thread.
+ *
+ * @param position The elapsed time (seconds) of the media.
+ * @param context The `context` given when subscribing.
+ */
+typedef void (*MRProgressTickerCallback)(double position, void* context);
+
+/**
+ * Ticks the progress of the media playing now to many subscribers, from one thread.
+ *
+ * Instead of each progress bar or label running its own timer, subscribe them here with the resolution they need.
+ * A subscriber with an interval of `i` seconds ticks each time the position of the media crosses a multiple of `i`:
+ * an interval of 1 ticks on the whole seconds of the position, right when a "m:ss" label changes, and an interval of 0.1 ticks at 10 Hz.
+ * Ticks follow the playback rate, stop while paused (rate 0) and after the end of the track.
+ * When the position jumps (seek, pause, resume, another track) every subscriber ticks at once with the exact position.
+ *
+ * Subscribers with the same interval share one timer, and all timers live in one hierarchical timer wheel of 1 ms resolution,
+ * so the thread only wakes up when at least one subscriber is due.
+ *
+ * Feed it with each snapshot, for example from the callback of MRNowPlayingInfoInterface::registerAutoUpdate():
+ *
+ *     ticker->feed(info->getSnapshot());
+ *
+ * Methods may be called from any thread, including from the callbacks.
+ */
+class MRProgressTickerInterface {
+
+public:
+
+    /**
+     * Create an instance of MRProgressTicker, starting its thread.
+     *
+     * @return A pointer to the MRProgressTickerInterface instance created.
+     */
+    static MRProgressTickerInterface* Create();
+
+    /**
+     * Delete an instance of MRProgressTicker, stopping its thread. Must not be called from a callback.
+     */
+    static void Delete(MRProgressTickerInterface* instance);
+
+    /// Destructor
+    virtual ~MRProgressTickerInterface() {}
+
+    /**
+     * Take a new snapshot.
+     *
+     * @param snapshot The now playing information. Nothing ticks for stale snapshots or snapshots without information.
+     * @return 1 if the position jumped (and every subscriber will tick at once), 0 if not.
+     */
+    virtual int feed(const MRNowPlayingSnapshot& snapshot) = 0;
+
+    /**
+     * Subscribe to the ticks.
+     *
+     * @param interval The resolution (seconds of media), for example 1 for whole seconds or 0.1 for 10 Hz. At least 0.001.
+     * @param callback The function to call on each tick.
+     * @param context Passed to `callback`.
+     * @return The identifier of the subscription, or 0 for invalid arguments.
+     */
+    virtual uint64_t subscribe(double interval, MRProgressTickerCallback callback, void* context) = 0;
+
+    /**
+     * Cancel a subscription. Its callback is never called after this returns.
+     *
+     * @return 0 for success, -1 for unknown subscription.
+     */
+    virtual int unsubscribe(uint64_t id) = 0;
+
+    /**
+     * Get to know how many times the thread woke up, to see what the ticker costs.
+     *
+     * @return The number of wakeups since the creation of the instance.
+     */
+    virtual uint64_t getWakeupCount() = 0;
+};
+
+}
+
+#endif /* nowplaying_ticker_h */
@@ -0,0 +1,69 @@
+#ifndef nowplaying_trace_h
+#define nowplaying_trace_h
+
+#include <cstdint>
+#include <string>
+
+namespace NowPlaying {
+
+/**
+ * Timing of the update pipeline, exported as Chrome trace events (open it in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Shows where the time between a change and the callback goes: the notification (`MRNotificationObserver onChange:`),
+ * the round trip of `MRMediaRemoteGetNowPlayingInfo`, the copy of the dictionary, waiting for the lock of an MRNowPlayingInfo
+ * instance, its getters, the callbacks, and the calls of MRCommander.
+ *
+ * The spans are only compiled in when the library is built with `NOWPLAYING_TRACING` defined (see \ref IsCompiled()),
+ * as the Xcode project does for all its configurations, and only recorded while enabled. Otherwise they cost nothing.
+ * Each thread records into its own fixed-size buffer without locking, keeping its latest 8192 events.
+ */
+class MRTrace {
+
+public:
+
+    /**
+     * Get to know whether the library was built with the spans.
+     *
+     * @return true if built with `NOWPLAYING_TRACING`, false if the spans were compiled out.
+     */
+    static bool IsCompiled();
+
+    /**
+     * Start or stop recording. Stopped by default.
+     */
+    static void SetEnabled(bool enabled);
+
+    static bool IsEnabled();
+
+    /**
+     * Forget all the events recorded so far.
+     */
+    static void Clear();
+
+    /**
+     * Get the events recorded, in the Chrome trace event format (JSON object with a `traceEvents` array).
+     * May be called while recording, from any thread.
+     *
+     * @return The JSON document.
+     */
+    static std::string ExportJSON();
+
+    /**
+     * Write \ref ExportJSON() to a file.
+     *
+     * @param path Path of the file, in UTF-8.
+     * @return 0 for success, -1 for failure.
+     */
+    static int WriteJSON(const char* path);
+
+    /**
+     * Get to know how many events were lost because a thread recorded more than its buffer keeps.
+     *
+     * @return The number of events overwritten since the last \ref Clear().
+     */
+    static uint64_t GetOverwrittenCount();
+};
+
+}
+
+#endif /* nowplaying_trace_h */
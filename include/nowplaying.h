@@ -2,28 +2,20 @@
 #define nowplaying_h
 
 #include <Foundation/Foundation.h>
+#include "nowplaying-snapshot.h"
+#include "nowplaying-scrobbler.h"
+#include "nowplaying-charts.h"
+#include "nowplaying-ticker.h"
+#include "nowplaying-scheduler.h"
+#include "nowplaying-trace.h"
+#include "nowplaying-catalog.h"
+#include "nowplaying-lyrics.h"
+#include "nowplaying-events.h"
+#include "nowplaying-export.h"
+#include <vector>
 
 namespace NowPlaying {
 
-/**
- * Represents the repeat mode of playing status.
- */
-typedef enum {
-    kMRNowPlayingInfoRepeatModeRepeatOff,       /*!< Represents the repeat mode is off. */
-    kMRNowPlayingInfoRepeatModeRepeatAll,       /*!< Represents the repeat mode is to repeat all songs in the current view (for example, a playlist). */
-    kMRNowPlayingInfoRepeatModeRepeatCurrent,   /*!< Represents the repeat mode is to repeat the current playing song. */
-    kMRNowPlayingInfoRepeatModeUnknown          /*!< Represents the repeat mode is unknown. */
-} MRNowPlayingInfoRepeatMode;
-
-/**
- * Represents the shuffle mode of playing status.
- */
-typedef enum {
-    kMRNowPlayingInfoShuffleModeOff,            /*!< Represents the shuffle mode is off. */
-    kMRNowPlayingInfoShuffleModeOn,             /*!< Represents the shuffle mode is on. */
-    kMRNowPlayingInfoShuffleModeUnknown         /*!< Represents the shuffle mode is unknown. */
-} MRNowPlayingInfoShuffleMode;
-
 /**
  * The manager to communicate with the MediaRemote bundle to adjust the status of the currently playing media.
  * This allows you to control the media playing status of the system.
@@ -51,6 +43,26 @@ public:
      */
     static void Delete(MRCommanderInterface* instance);
     
+    /**
+     * Show the expected result of commands at once, before the system confirms it. Disabled by default.
+     *
+     * When enabled, a successful play(), pause(), togglePlayPause() or seekTo() immediately hands a provisional snapshot
+     * (playback rate flipped or elapsed time set, with the timestamp moved to now) to the MRNowPlayingInfo instances registered
+     * for auto update, and runs their callbacks. See MRNowPlayingInfoInterface::isProvisional().
+     * It is replaced by the information of the system once this confirms or contradicts it, or after `timeout` if the system says nothing.
+     *
+     * @param enabled true to publish provisional snapshots, false not to.
+     * @param timeout Seconds to wait for the system before rolling back.
+     */
+    static void SetOptimisticUpdates(bool enabled, double timeout = 2.0);
+
+    /**
+     * Get to know how the optimistic updates of this process turned out.
+     *
+     * @return The counts and confirmation times since the process started.
+     */
+    static MROptimisticStatistics GetOptimisticStatistics();
+    
     /// Destructor
     virtual ~MRCommanderInterface() {}
 
@@ -129,6 +141,87 @@ public:
      */
     static void Delete(MRNowPlayingInfoInterface* instance);
     
+    /**
+     * Keep the latest information in a file, so that the next run can show it before the system answers.
+     * Should be called before creating the first MRNowPlayingInfo instance of the process.
+     *
+     * When enabled, each update from the system is written to `path`, with the artwork referenced by its identifier only.
+     * A new instance serves the information of the file (or the latest fetched by another instance) at once, marked stale.
+     * See \ref isStale().
+     *
+     * @param path Path of the file, in UTF-8. NULL to disable (the default).
+     */
+    static void SetSnapshotCache(const char* path);
+    
+    /**
+     * Poll the system when its change notifications get lost, which happens on some machines.
+     * Disabled by default. Applies the next time auto update is registered with no other instance registered.
+     *
+     * While auto updating, a fetch finding a change which was not notified turns polling on.
+     * It then polls rarely when paused, more often while playing, and right after the predicted end of the track,
+     * and stops as soon as notifications come again. The auto update callbacks are also run after a poll finding a change.
+     * While notifications work, it only checks once after the predicted end of a track if nothing was notified.
+     *
+     * @param enabled true to poll when notifications get lost, false to rely on notifications only.
+     */
+    static void SetPollingFallback(bool enabled);
+    
+    /**
+     * Keep the latest versions of the information of each instance, readable from any thread without locking.
+     * Applies to the instances created afterwards.
+     *
+     * Each update applied to an instance (including the stale information it starts with) is a new version, numbered from 1.
+     * The last `capacity` versions can be read with \ref getSnapshotAt() and \ref getSnapshotsSince(),
+     * for example to see what changed since a version a consumer has already seen.
+     *
+     * Up to 64 threads read the versions of an instance at the same time without waiting. More wait for one of them to finish.
+     * A version replaced is freed once no thread can be reading it. If a thread is preempted in the middle of a read,
+     * up to 256 replaced versions are kept, then applying an update waits for that read to finish.
+     *
+     * @param capacity How many versions each instance keeps. 0 to disable (the default).
+     */
+    static void SetHistoryCapacity(size_t capacity);
+    
+    /**
+     * Set how long the system has to answer a fetch of the information. Disabled by default, so a fetch is never retried.
+     * Should be called before creating the first MRNowPlayingInfo instance of the process.
+     *
+     * The system sometimes never answers a fetch, which would leave the information, and the callbacks waiting for it, stuck.
+     * A fetch not answered in time is issued again, after a backoff growing with each retry (up to 30 seconds, with jitter),
+     * until the system answers. Whatever waited for the stuck fetch is then run with the first answer. An answer coming after it
+     * is older than the information applied, and is ignored. See \ref GetFetchStatistics() for how long the information has been stale.
+     *
+     * @param timeout Seconds, 3 being a reasonable value. 0 to never retry (the default).
+     */
+    static void SetFetchDeadline(double timeout);
+    
+    /**
+     * Get to know how the fetches of this process went.
+     *
+     * @return The counts since the process started, and since when the system has not answered, if it does not.
+     */
+    static MRFetchStatistics GetFetchStatistics();
+    
+    /**
+     * Apply the change notifications of the system which describe the whole change without fetching the information. Disabled by default.
+     * Should be called before creating the first MRNowPlayingInfo instance of the process.
+     *
+     * While auto updating, the system notifies each change, then the information is fetched, which takes a round trip and copies
+     * the whole information, artwork included. When enabled, a notification carrying only the playback status (rate, elapsed time)
+     * of the track shown is applied at once, and the auto update callbacks run without waiting for a fetch.
+     * Any other notification is fetched as before. A single fetch still checks the information 10 seconds after notifications were applied.
+     *
+     * @param enabled true to apply such notifications without a fetch, false to fetch on every notification.
+     */
+    static void SetNotificationFastPath(bool enabled);
+    
+    /**
+     * Get to know how the change notifications of this process were handled, fast path enabled or not.
+     *
+     * @return The counts since the process started, and the times from the notifications to the auto update callbacks.
+     */
+    static MRNotificationStatistics GetNotificationStatistics();
+    
     /// Destructor
     virtual ~MRNowPlayingInfoInterface() {}
     
@@ -152,8 +245,9 @@ public:
      * @note
      * This method communicates asynchronously with the system API.
      * You may need to wait for the system to send back updated information after calling this method.
-     * Your `callback` function will be executed in the system global dispatch queue (in brief, another thread hosted by system).
+     * Your `callback` function will be executed in the serial dispatch queue shared by all instances (in brief, another thread hosted by system).
      * Therefore, you program may need an event loop like [NSApp run].
+     * If a fetch is already in progress (for any instance), this call joins it and `callback` runs when it completes.
      */
     virtual void update(void (*callback)(MRNowPlayingInfoInterface*)) = 0;
     
@@ -170,7 +264,7 @@ public:
      * and call `callback` after each update.
      * Each MRNowPlayingInfo instance can only register once. Calling this method again after registeration will cause error.
      *
-     * @param callback The callback function to run after each update. It will be executed in the system dispatch queue.
+     * @param callback The callback function to run after each update. It will be executed in the serial dispatch queue shared by all instances.
      * @return 0 for success, -1 for already registered.
      */
     virtual int registerAutoUpdate(void (*callback)(MRNowPlayingInfoInterface*)) = 0;
@@ -196,6 +290,59 @@ public:
      */
     virtual bool hasInfo() = 0;
     
+    /**
+     * Get to know whether the information is stale or not.
+     * Stale information was served when this instance was created (see \ref SetSnapshotCache()),
+     * and has not been replaced by an update from the system yet.
+     *
+     * @note While stale, the artwork data is not available. Its identifier, MIME type and size are.
+     * @return true for stale information, false for information received from the system.
+     */
+    virtual bool isStale() = 0;
+    
+    /**
+     * Get to know whether the information is provisional or not.
+     * Provisional information is what a command of MRCommander is expected to result in (see MRCommanderInterface::SetOptimisticUpdates()),
+     * and has not been confirmed or contradicted by the system yet.
+     *
+     * @return true for provisional information, false for information received from the system.
+     */
+    virtual bool isProvisional() = 0;
+    
+    /**
+     * Get all the information at once, in plain C++ types.
+     * Cheaper than calling each getter, and consistent: all fields come from the same update.
+     *
+     * @return A copy of the information. `hasInfo` is false if no info.
+     */
+    virtual MRNowPlayingSnapshot getSnapshot() = 0;
+    
+    /**
+     * Get the version of the information, see \ref SetHistoryCapacity().
+     *
+     * @return The latest version. 0 if the history is disabled or nothing was applied yet.
+     */
+    virtual uint64_t getVersion() = 0;
+    
+    /**
+     * Get one version of the information, see \ref SetHistoryCapacity(). Does not wait, unless more than 64 threads read at once.
+     *
+     * @param version The version to get.
+     * @param snapshot Receives the information.
+     * @return 0 for success, -1 if the version is not kept (too old, not applied yet, or the history is disabled).
+     */
+    virtual int getSnapshotAt(uint64_t version, MRNowPlayingSnapshot* snapshot) = 0;
+    
+    /**
+     * Get the versions newer than one, oldest first, see \ref SetHistoryCapacity(). Does not wait, unless more than 64 threads read at once.
+     * Versions no longer kept are skipped, so a gap in the versions returned means some were missed.
+     *
+     * @param version The latest version already seen. 0 for all the versions kept.
+     * @param snapshots Receives the versions, appended.
+     * @return The number of versions appended.
+     */
+    virtual size_t getSnapshotsSince(uint64_t version, std::vector<MRVersionedSnapshot>* snapshots) = 0;
+    
     /**
      * Get the information in raw NSDictionary format.
      *
@@ -0,0 +1,613 @@
+#include "MRArrowExporter.h"
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace NowPlaying {
+
+namespace {
+
+const char kMagic[] = "ARROW1";
+const uint32_t kContinuation = 0xFFFFFFFFu;
+
+// Values of the Arrow schema (Schema.fbs, Message.fbs and File.fbs of the Arrow format).
+const uint64_t kMetadataVersionV5 = 4;
+const uint8_t kTypeInt = 2;
+const uint8_t kTypeFloatingPoint = 3;
+const uint8_t kTypeUtf8 = 5;
+const uint8_t kTypeBool = 6;
+const uint8_t kTypeTimestamp = 10;
+const uint64_t kPrecisionDouble = 2;
+const uint64_t kTimeUnitMicrosecond = 2;
+const uint8_t kHeaderSchema = 1;
+const uint8_t kHeaderDictionaryBatch = 2;
+const uint8_t kHeaderRecordBatch = 3;
+
+// The values of the mode dictionaries, in the order of their enums.
+const char* const kRepeatModes[] = {"off", "all", "current"};
+const char* const kShuffleModes[] = {"off", "on"};
+const int kRepeatModeCount = sizeof(kRepeatModes) / sizeof(kRepeatModes[0]);
+const int kShuffleModeCount = sizeof(kShuffleModes) / sizeof(kShuffleModes[0]);
+
+void appendLittleEndian(std::string& buffer, uint64_t value, size_t size) {
+    char bytes[8];
+    for(size_t i = 0; i < size; i++) bytes[i] = (char)(value >> (8 * i));
+    buffer.append(bytes, size);
+}
+
+uint64_t readLittleEndian(const char* bytes, size_t size) {
+    uint64_t value = 0;
+    for(size_t i = 0; i < size; i++) value |= (uint64_t)(uint8_t)bytes[i] << (8 * i);
+    return value;
+}
+
+uint64_t doubleBits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+void padTo8(std::string& buffer) {
+    buffer.resize((buffer.size() + 7) / 8 * 8, '\0');
+}
+
+// An Int table of the schema.
+size_t intType(MRFlatBufferBuilder& builder, int bitWidth, bool isSigned) {
+    MRFlatBufferBuilder::Table type;
+    type.scalar(0, bitWidth, 4);
+    type.scalar(1, isSigned ? 1 : 0, 1);
+    return builder.table(type);
+}
+
+// A RecordBatch table, with its nodes (length, null count) and buffers (offset, length).
+size_t recordBatch(MRFlatBufferBuilder& builder, uint64_t length, const std::vector<std::pair<uint64_t, uint64_t>>& nodes,
+                   const std::vector<std::pair<uint64_t, uint64_t>>& buffers) {
+    MRFlatBufferBuilder::Table batch;
+    batch.scalar(0, length, 8);
+    batch.offset(1);
+    batch.offset(2);
+    size_t position = builder.table(batch);
+    const std::vector<std::pair<uint64_t, uint64_t>>* structs[] = {&nodes, &buffers};
+    for(int i = 0; i < 2; i++) {
+        size_t vector = builder.vector(structs[i]->size(), 16, 8);
+        builder.patch(batch.at(i + 1), vector);
+        for(size_t j = 0; j < structs[i]->size(); j++) {
+            builder.put(vector + 4 + 16 * j, (*structs[i])[j].first, 8);
+            builder.put(vector + 4 + 16 * j + 8, (*structs[i])[j].second, 8);
+        }
+    }
+    return position;
+}
+
+// A Message table pointing to a header written next. Returns the position of the offset to the header.
+size_t message(MRFlatBufferBuilder& builder, uint8_t headerType, uint64_t bodyLength) {
+    MRFlatBufferBuilder::Table message;
+    message.scalar(0, kMetadataVersionV5, 2);
+    message.scalar(1, headerType, 1);
+    message.offset(2);
+    message.scalar(3, bodyLength, 8);
+    builder.setRoot(builder.table(message));
+    return message.at(2);
+}
+
+// Add a buffer to a message body, padded to 8 bytes as the format requires.
+void addBuffer(std::string& body, std::vector<std::pair<uint64_t, uint64_t>>& buffers, const std::string& data) {
+    buffers.push_back(std::make_pair((uint64_t)body.size(), (uint64_t)data.size()));
+    body += data;
+    padTo8(body);
+}
+
+}
+
+const MRArrowExporter::ColumnSpec MRArrowExporter::kColumns[] = {
+    {"version", kColumnUInt64, kFieldVersion},
+    {"timestamp", kColumnTimestamp, kFieldTimestamp},
+    {"has_info", kColumnBool, kFieldHasInfo},
+    {"stale", kColumnBool, kFieldStale},
+    {"provisional", kColumnBool, kFieldProvisional},
+    {"title", kColumnString, kFieldTitle},
+    {"artist", kColumnString, kFieldArtist},
+    {"album_title", kColumnString, kFieldAlbumTitle},
+    {"composer", kColumnString, kFieldComposer},
+    {"genre", kColumnString, kFieldGenre},
+    {"media_type", kColumnString, kFieldMediaType},
+    {"content_item_identifier", kColumnString, kFieldContentItemIdentifier},
+    {"duration", kColumnDouble, kFieldDuration},
+    {"elapsed_time", kColumnDouble, kFieldElapsedTime},
+    {"playback_rate", kColumnDouble, kFieldPlaybackRate},
+    {"track_number", kColumnInt32, kFieldTrackNumber},
+    {"queue_index", kColumnInt32, kFieldQueueIndex},
+    {"unique_identifier", kColumnUInt64, kFieldUniqueIdentifier},
+    {"itunes_store_identifier", kColumnUInt64, kFieldITunesStoreIdentifier},
+    {"repeat_mode", kColumnMode, kFieldRepeatMode},
+    {"shuffle_mode", kColumnMode, kFieldShuffleMode},
+};
+
+MRArrowExporterInterface* MRArrowExporterInterface::Create(const char* path, size_t batchSize) {
+    if(!path || batchSize == 0) return 0;
+    MRArrowExporter* exporter = new MRArrowExporter(batchSize);
+    if(exporter->open(path) != 0) {
+        delete exporter;
+        return 0;
+    }
+    return exporter;
+}
+
+void MRArrowExporterInterface::Delete(MRArrowExporterInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRArrowExporter::MRArrowExporter(size_t batchSize) : _fd(-1), _batchSize(batchSize), _failed(false), _end(0), _rows(0), _rowsInFile(0) {
+    for(size_t i = 0; i < sizeof(kColumns) / sizeof(kColumns[0]); i++) {
+        Column column;
+        column.type = kColumns[i].type;
+        column.nulls = 0;
+        column.dictionary = -1;
+        column.lastIndex = -1;
+        if(column.type == kColumnString || column.type == kColumnMode) {
+            column.dictionary = (int)_dictionaries.size();
+            Dictionary dictionary;
+            dictionary.count = 0;
+            dictionary.written = 0;
+            dictionary.inFile = false;
+            dictionary.pendingOffsets.push_back(0);
+            _dictionaries.push_back(dictionary);
+        }
+        _columns.push_back(column);
+    }
+    // The modes have fixed values.
+    for(size_t i = 0; i < _columns.size(); i++) {
+        if(_columns[i].type != kColumnMode) continue;
+        bool repeat = kColumns[i].field == kFieldRepeatMode;
+        const char* const* modes = repeat ? kRepeatModes : kShuffleModes;
+        int count = repeat ? kRepeatModeCount : kShuffleModeCount;
+        for(int j = 0; j < count; j++) indexOf(_dictionaries[_columns[i].dictionary], modes[j]);
+    }
+}
+
+MRArrowExporter::~MRArrowExporter() {
+    if(_fd < 0) return;
+    flush();
+    close(_fd);
+}
+
+int MRArrowExporter::open(const std::string& path) {
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(_fd < 0) return -1;
+    struct stat status;
+    int ret = fstat(_fd, &status) == 0 ? (status.st_size == 0 ? create() : recover((uint64_t)status.st_size)) : -1;
+    if(ret != 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    return ret;
+}
+
+size_t MRArrowExporter::schema(MRFlatBufferBuilder& builder) const {
+    MRFlatBufferBuilder::Table schema;
+    schema.scalar(0, 0, 2);                                     // Little-endian
+    schema.offset(1);
+    size_t position = builder.table(schema);
+    size_t fields = builder.vector(_columns.size(), 4, 4);
+    builder.patch(schema.at(1), fields);
+
+    for(size_t i = 0; i < _columns.size(); i++) {
+        ColumnType type = kColumns[i].type;
+        static const uint8_t kTypes[] = {kTypeInt, kTypeInt, kTypeFloatingPoint, kTypeBool, kTypeTimestamp, kTypeUtf8, kTypeUtf8};
+        bool isDictionary = _columns[i].dictionary >= 0;
+
+        MRFlatBufferBuilder::Table field;
+        field.offset(0);
+        field.scalar(1, kColumns[i].field == kFieldVersion ? 0 : 1, 1);     // Only the version is never null
+        field.scalar(2, kTypes[type], 1);
+        field.offset(3);
+        if(isDictionary) field.offset(4);
+        field.offset(5);
+        builder.patch(fields + 4 + 4 * i, builder.table(field));
+        builder.patch(field.at(0), builder.string(kColumns[i].name));
+
+        MRFlatBufferBuilder::Table valueType;
+        if(type == kColumnUInt64 || type == kColumnInt32) {
+            builder.patch(field.at(3), intType(builder, type == kColumnUInt64 ? 64 : 32, type == kColumnInt32));
+        }
+        else {
+            if(type == kColumnDouble) valueType.scalar(0, kPrecisionDouble, 2);
+            if(type == kColumnTimestamp) {
+                valueType.scalar(0, kTimeUnitMicrosecond, 2);
+                valueType.offset(1);
+            }
+            builder.patch(field.at(3), builder.table(valueType));
+            if(type == kColumnTimestamp) builder.patch(valueType.at(1), builder.string("UTC"));
+        }
+        if(isDictionary) {
+            MRFlatBufferBuilder::Table encoding;
+            encoding.scalar(0, _columns[i].dictionary, 8);
+            encoding.offset(1);
+            encoding.scalar(2, 0, 1);
+            builder.patch(field.at(4), builder.table(encoding));
+            builder.patch(encoding.at(1), intType(builder, type == kColumnMode ? 8 : 32, true));
+        }
+        builder.patch(field.at(5), builder.vector(0, 4, 4));
+    }
+    return position;
+}
+
+std::string MRArrowExporter::schemaMessage() const {
+    MRFlatBufferBuilder builder;
+    size_t header = message(builder, kHeaderSchema, 0);
+    builder.patch(header, schema(builder));
+    return builder.finish();
+}
+
+int MRArrowExporter::writeAt(uint64_t offset, const std::string& data) {
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t ret = pwrite(_fd, data.data() + written, data.size() - written, (off_t)(offset + written));
+        if(ret <= 0) return -1;
+        written += (size_t)ret;
+    }
+    return 0;
+}
+
+int MRArrowExporter::writeMessage(const std::string& metadata, const std::string& body, std::vector<Block>& blocks) {
+    std::string prefix;
+    appendLittleEndian(prefix, kContinuation, 4);
+    appendLittleEndian(prefix, metadata.size(), 4);
+    // The prefix last: until it is written, the end-of-stream marker is still there, so a stopped write leaves no half message.
+    if(writeAt(_end + 8, metadata) != 0 || writeAt(_end + 8 + metadata.size(), body) != 0 || writeAt(_end, prefix) != 0) return -1;
+    Block block = {_end, (uint32_t)(8 + metadata.size()), body.size()};
+    blocks.push_back(block);
+    _end += 8 + metadata.size() + body.size();
+    return 0;
+}
+
+int MRArrowExporter::create() {
+    std::string head(kMagic, 6);
+    head.append(2, '\0');
+    std::string prefix;
+    std::string schema = schemaMessage();
+    appendLittleEndian(prefix, kContinuation, 4);
+    appendLittleEndian(prefix, schema.size(), 4);
+    if(writeAt(0, head + prefix + schema) != 0) return -1;
+    _end = head.size() + prefix.size() + schema.size();
+    return flush();
+}
+
+int MRArrowExporter::recover(uint64_t size) {
+    // The file must start as this version would write it.
+    std::string head(kMagic, 6);
+    head.append(2, '\0');
+    std::string schema = schemaMessage();
+    appendLittleEndian(head, kContinuation, 4);
+    appendLittleEndian(head, schema.size(), 4);
+    head += schema;
+    if(size < head.size()) return -1;
+    std::string bytes(head.size(), '\0');
+    if(pread(_fd, &bytes[0], bytes.size(), 0) != (ssize_t)bytes.size() || bytes != head) return -1;
+
+    // The messages are read from the stream rather than from the footer, which a batch being written when the process
+    // stopped has overwritten. The stream ends at the end-of-stream marker, or at the first message not written whole.
+    _end = head.size();
+    while(_end + 8 <= size) {
+        char prefix[8];
+        if(pread(_fd, prefix, sizeof(prefix), (off_t)_end) != 8 || readLittleEndian(prefix, 4) != kContinuation) break;
+        uint64_t metadataLength = readLittleEndian(prefix + 4, 4);
+        if(metadataLength == 0 || _end + 8 + metadataLength > size) break;
+        std::string metadata(metadataLength, '\0');
+        if(pread(_fd, &metadata[0], metadata.size(), (off_t)(_end + 8)) != (ssize_t)metadata.size()) break;
+        MRFlatBufferTable message = MRFlatBufferTable::Root(reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size());
+        uint64_t type = message.scalar(1, 1, 0);
+        Block block = {_end, (uint32_t)(8 + metadataLength), message.scalar(3, 8, 0)};
+        if(!message.isValid() || message.scalar(0, 2, 0) != kMetadataVersionV5 || (type != kHeaderDictionaryBatch && type != kHeaderRecordBatch) ||
+           block.offset + block.metaDataLength + block.bodyLength > size) break;
+        if(recoverMessage(block, type == kHeaderDictionaryBatch) != 0) return -1;
+        (type == kHeaderDictionaryBatch ? _dictionaryBlocks : _recordBatchBlocks).push_back(block);
+        _end += block.metaDataLength + block.bodyLength;
+    }
+    for(size_t i = 0; i < _dictionaries.size(); i++) {
+        // The fixed values of the modes must all be there. Dictionaries missing from the file are written by the next flush.
+        if(_dictionaries[i].inFile && _dictionaries[i].written != _dictionaries[i].count) return -1;
+    }
+
+    // Write the footer again if it is not the one of these messages.
+    std::string expected = trailer();
+    if(size == _end + expected.size()) {
+        bytes.assign(expected.size(), '\0');
+        if(pread(_fd, &bytes[0], bytes.size(), (off_t)_end) == (ssize_t)bytes.size() && bytes == expected) return 0;
+    }
+    return flush();
+}
+
+int MRArrowExporter::recoverMessage(const Block& block, bool isDictionary) {
+    if(block.metaDataLength < 8) return -1;
+    std::string metadata(block.metaDataLength, '\0');
+    if(pread(_fd, &metadata[0], metadata.size(), (off_t)block.offset) != (ssize_t)metadata.size()) return -1;
+    MRFlatBufferTable message = MRFlatBufferTable::Root(reinterpret_cast<const uint8_t*>(metadata.data()) + 8, metadata.size() - 8);
+    if(!message.isValid() || message.scalar(1, 1, 0) != (isDictionary ? kHeaderDictionaryBatch : kHeaderRecordBatch)) return -1;
+    MRFlatBufferTable header = message.table(2);
+    if(!isDictionary) {
+        MRFlatBufferTable batch = header;
+        if(!batch.isValid()) return -1;
+        _rowsInFile += batch.scalar(0, 8, 0);
+        return 0;
+    }
+
+    uint64_t id = header.scalar(0, 8, UINT64_MAX);
+    MRFlatBufferTable batch = header.table(1);
+    size_t elements, count;
+    if(id >= _dictionaries.size() || !batch.isValid() || !batch.vector(2, 16, elements, count) || count != 3) return -1;
+    Dictionary& dictionary = _dictionaries[id];
+    bool isDelta = header.scalar(2, 1, 0) != 0;
+    if(isDelta != dictionary.inFile) return -1;
+    uint64_t length = batch.scalar(0, 8, 0);
+    uint64_t offsetsStart = batch.read(elements + 16, 8);
+    uint64_t offsetsLength = batch.read(elements + 16 + 8, 8);
+    uint64_t valuesStart = batch.read(elements + 32, 8);
+    uint64_t valuesLength = batch.read(elements + 32 + 8, 8);
+    if(offsetsLength < (length + 1) * 4 || offsetsStart + offsetsLength > block.bodyLength || valuesStart + valuesLength > block.bodyLength) return -1;
+    std::string body(block.bodyLength, '\0');
+    if(pread(_fd, &body[0], body.size(), (off_t)(block.offset + block.metaDataLength)) != (ssize_t)body.size()) return -1;
+
+    // The fixed values of the modes are already known, and must be the same.
+    size_t known = dictionary.count;
+    for(uint64_t i = 0; i < length; i++) {
+        uint64_t begin = readLittleEndian(body.data() + offsetsStart + 4 * i, 4);
+        uint64_t end = readLittleEndian(body.data() + offsetsStart + 4 * i + 4, 4);
+        if(begin > end || end > valuesLength) return -1;
+        std::string value(body.data() + valuesStart + begin, end - begin);
+        if(dictionary.written < known) {
+            std::unordered_map<std::string, int32_t>::const_iterator it = dictionary.indices.find(value);
+            if(it == dictionary.indices.end() || (size_t)it->second != dictionary.written) return -1;
+        }
+        else {
+            dictionary.indices[value] = (int32_t)dictionary.count++;
+        }
+        dictionary.written++;
+    }
+    dictionary.inFile = true;
+    dictionary.pendingValues.clear();
+    dictionary.pendingOffsets.assign(1, 0);
+    return 0;
+}
+
+void MRArrowExporter::appendValidity(Column& column, bool valid) {
+    if(_rows % 8 == 0) column.validity += '\0';
+    if(valid) column.validity[_rows / 8] |= (char)(1 << (_rows % 8));
+    else column.nulls++;
+}
+
+int32_t MRArrowExporter::indexOf(Dictionary& dictionary, const std::string& value) {
+    std::pair<std::unordered_map<std::string, int32_t>::iterator, bool> inserted = dictionary.indices.insert(std::make_pair(value, (int32_t)dictionary.count));
+    if(inserted.second) {
+        dictionary.count++;
+        dictionary.pendingValues += value;
+        dictionary.pendingOffsets.push_back((int32_t)dictionary.pendingValues.size());
+    }
+    return inserted.first->second;
+}
+
+void MRArrowExporter::appendIndex(Column& column, int32_t index) {
+    appendValidity(column, index >= 0);
+    appendLittleEndian(column.values, index >= 0 ? (uint32_t)index : 0, column.type == kColumnMode ? 1 : 4);
+}
+
+void MRArrowExporter::appendString(Column& column, const std::string& value) {
+    if(value.empty()) {
+        appendIndex(column, -1);
+        return;
+    }
+    if(column.lastIndex < 0 || value != column.last) {
+        column.lastIndex = indexOf(_dictionaries[column.dictionary], value);
+        column.last = value;
+    }
+    appendIndex(column, column.lastIndex);
+}
+
+void MRArrowExporter::appendValue(Column& column, bool valid, uint64_t value) {
+    appendValidity(column, valid);
+    appendLittleEndian(column.values, valid ? value : 0, column.type == kColumnInt32 ? 4 : 8);
+}
+
+void MRArrowExporter::appendBool(Column& column, bool value) {
+    if(_rows % 8 == 0) column.values += '\0';
+    if(value) column.values[_rows / 8] |= (char)(1 << (_rows % 8));
+    appendValidity(column, true);
+}
+
+int MRArrowExporter::write(const MRVersionedSnapshot& versioned) {
+    if(_failed || _fd < 0) return -1;
+    const MRNowPlayingSnapshot& snapshot = versioned.snapshot;
+    for(size_t i = 0; i < _columns.size(); i++) {
+        Column& column = _columns[i];
+        switch(kColumns[i].field) {
+            case kFieldVersion:
+                appendValue(column, true, versioned.version);
+                break;
+            case kFieldTimestamp:
+                appendValue(column, snapshot.timestamp > 0, (uint64_t)std::llround(snapshot.timestamp * 1e6));
+                break;
+            case kFieldHasInfo:
+                appendBool(column, snapshot.hasInfo);
+                break;
+            case kFieldStale:
+                appendBool(column, snapshot.stale);
+                break;
+            case kFieldProvisional:
+                appendBool(column, snapshot.provisional);
+                break;
+            case kFieldTitle:
+                appendString(column, snapshot.title);
+                break;
+            case kFieldArtist:
+                appendString(column, snapshot.artist);
+                break;
+            case kFieldAlbumTitle:
+                appendString(column, snapshot.albumTitle);
+                break;
+            case kFieldComposer:
+                appendString(column, snapshot.composer);
+                break;
+            case kFieldGenre:
+                appendString(column, snapshot.genre);
+                break;
+            case kFieldMediaType:
+                appendString(column, snapshot.mediaType);
+                break;
+            case kFieldContentItemIdentifier:
+                appendString(column, snapshot.contentItemIdentifier);
+                break;
+            case kFieldDuration:
+                appendValue(column, snapshot.hasInfo && snapshot.duration > 0, doubleBits(snapshot.duration));
+                break;
+            case kFieldElapsedTime:
+                appendValue(column, snapshot.hasInfo, doubleBits(snapshot.elapsedTime));
+                break;
+            case kFieldPlaybackRate:
+                appendValue(column, snapshot.hasInfo && snapshot.playbackRate >= 0, doubleBits(snapshot.playbackRate));
+                break;
+            case kFieldTrackNumber:
+                appendValue(column, snapshot.hasInfo, (uint32_t)snapshot.trackNumber);
+                break;
+            case kFieldQueueIndex:
+                appendValue(column, snapshot.hasInfo, (uint32_t)snapshot.queueIndex);
+                break;
+            case kFieldUniqueIdentifier:
+                appendValue(column, snapshot.uniqueIdentifier != 0, snapshot.uniqueIdentifier);
+                break;
+            case kFieldITunesStoreIdentifier:
+                appendValue(column, snapshot.iTunesStoreIdentifier != 0, snapshot.iTunesStoreIdentifier);
+                break;
+            case kFieldRepeatMode:
+                appendIndex(column, snapshot.repeatMode < kRepeatModeCount ? (int32_t)snapshot.repeatMode : -1);
+                break;
+            case kFieldShuffleMode:
+                appendIndex(column, snapshot.shuffleMode < kShuffleModeCount ? (int32_t)snapshot.shuffleMode : -1);
+                break;
+        }
+    }
+    _rows++;
+    if(_rows >= _batchSize && writeBatch() != 0) return -1;
+    return 0;
+}
+
+int MRArrowExporter::writeDictionary(size_t id) {
+    Dictionary& dictionary = _dictionaries[id];
+    size_t length = dictionary.pendingOffsets.size() - 1;
+    std::string body;
+    std::vector<std::pair<uint64_t, uint64_t>> buffers;
+    std::string offsets;
+    offsets.reserve(dictionary.pendingOffsets.size() * 4);
+    for(size_t i = 0; i < dictionary.pendingOffsets.size(); i++) appendLittleEndian(offsets, (uint32_t)dictionary.pendingOffsets[i], 4);
+    addBuffer(body, buffers, std::string());
+    addBuffer(body, buffers, offsets);
+    addBuffer(body, buffers, dictionary.pendingValues);
+
+    MRFlatBufferBuilder builder;
+    size_t header = message(builder, kHeaderDictionaryBatch, body.size());
+    MRFlatBufferBuilder::Table batch;
+    batch.scalar(0, id, 8);
+    batch.offset(1);
+    batch.scalar(2, dictionary.inFile ? 1 : 0, 1);
+    builder.patch(header, builder.table(batch));
+    builder.patch(batch.at(1), recordBatch(builder, length, std::vector<std::pair<uint64_t, uint64_t>>(1, std::make_pair((uint64_t)length, (uint64_t)0)), buffers));
+    if(writeMessage(builder.finish(), body, _dictionaryBlocks) != 0) return -1;
+
+    dictionary.written += length;
+    dictionary.inFile = true;
+    dictionary.pendingValues.clear();
+    dictionary.pendingOffsets.assign(1, 0);
+    return 0;
+}
+
+int MRArrowExporter::writeBatch() {
+    if(_failed) return -1;
+    // New strings first, as deltas of the dictionaries, except the first time.
+    for(size_t i = 0; i < _dictionaries.size(); i++) {
+        if(_dictionaries[i].inFile && _dictionaries[i].pendingOffsets.size() == 1) continue;
+        if(writeDictionary(i) != 0) {
+            _failed = true;
+            return -1;
+        }
+    }
+    if(_rows == 0) return 0;
+
+    std::string body;
+    std::vector<std::pair<uint64_t, uint64_t>> nodes;
+    std::vector<std::pair<uint64_t, uint64_t>> buffers;
+    for(size_t i = 0; i < _columns.size(); i++) {
+        Column& column = _columns[i];
+        nodes.push_back(std::make_pair((uint64_t)_rows, (uint64_t)column.nulls));
+        addBuffer(body, buffers, column.nulls ? column.validity : std::string());
+        addBuffer(body, buffers, column.values);
+    }
+    MRFlatBufferBuilder builder;
+    size_t header = message(builder, kHeaderRecordBatch, body.size());
+    builder.patch(header, recordBatch(builder, _rows, nodes, buffers));
+    if(writeMessage(builder.finish(), body, _recordBatchBlocks) != 0) {
+        _failed = true;
+        return -1;
+    }
+
+    _rowsInFile += _rows;
+    _rows = 0;
+    for(size_t i = 0; i < _columns.size(); i++) {
+        _columns[i].validity.clear();
+        _columns[i].values.clear();
+        _columns[i].nulls = 0;
+    }
+    return 0;
+}
+
+std::string MRArrowExporter::trailer() const {
+    MRFlatBufferBuilder builder;
+    MRFlatBufferBuilder::Table footer;
+    footer.scalar(0, kMetadataVersionV5, 2);
+    footer.offset(1);
+    footer.offset(2);
+    footer.offset(3);
+    builder.setRoot(builder.table(footer));
+    builder.patch(footer.at(1), schema(builder));
+    const std::vector<Block>* lists[] = {&_dictionaryBlocks, &_recordBatchBlocks};
+    for(int list = 0; list < 2; list++) {
+        size_t vector = builder.vector(lists[list]->size(), 24, 8);
+        builder.patch(footer.at(2 + list), vector);
+        for(size_t i = 0; i < lists[list]->size(); i++) {
+            const Block& block = (*lists[list])[i];
+            builder.put(vector + 4 + 24 * i, block.offset, 8);
+            builder.put(vector + 4 + 24 * i + 8, block.metaDataLength, 4);
+            builder.put(vector + 4 + 24 * i + 16, block.bodyLength, 8);
+        }
+    }
+
+    std::string trailer;
+    appendLittleEndian(trailer, kContinuation, 4);
+    appendLittleEndian(trailer, 0, 4);
+    trailer += builder.finish();
+    appendLittleEndian(trailer, trailer.size() - 8, 4);
+    trailer.append(kMagic, 6);
+    return trailer;
+}
+
+int MRArrowExporter::flush() {
+    if(_failed || _fd < 0 || writeBatch() != 0) return -1;
+    // Over the previous ones.
+    std::string data = trailer();
+    if(writeAt(_end, data) != 0 || ftruncate(_fd, (off_t)(_end + data.size())) != 0) {
+        _failed = true;
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t MRArrowExporter::getRowCount() {
+    return _rowsInFile + _rows;
+}
+
+size_t MRArrowExporter::getBatchCount() {
+    return _recordBatchBlocks.size();
+}
+
+};
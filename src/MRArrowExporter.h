@@ -0,0 +1,160 @@
+#ifndef MRArrowExporter_h
+#define MRArrowExporter_h
+
+#include "nowplaying-export.h"
+#include "MRFlatBuffer.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Writes the history of the now playing information to an Arrow IPC file, without the Arrow library.
+ *
+ * The file is the Arrow IPC file format: "ARROW1", the schema, dictionary and record batch messages,
+ * an end-of-stream marker, then the footer listing the messages. The metadata are FlatBuffers written by MRFlatBufferBuilder.
+ * Batches are written over the end-of-stream marker and the footer, which \ref flush() writes again after them.
+ * When opening an existing file, the messages are read back to recover the dictionaries and the number of rows,
+ * and the footer is written again if missing, such as after a crash in the middle of a batch.
+ *
+ * Columns are buffered as their Arrow buffers (validity bits and little-endian values), so writing a batch is only copying them out.
+ */
+class MRArrowExporter : public MRArrowExporterInterface {
+private:
+
+    enum ColumnType {
+        kColumnUInt64,
+        kColumnInt32,
+        kColumnDouble,
+        kColumnBool,
+        kColumnTimestamp,
+        kColumnString,                  // dictionary<int32, utf8>
+        kColumnMode                     // dictionary<int8, utf8>, with fixed values
+    };
+
+    // What each column holds.
+    enum ColumnField {
+        kFieldVersion,
+        kFieldTimestamp,
+        kFieldHasInfo,
+        kFieldStale,
+        kFieldProvisional,
+        kFieldTitle,
+        kFieldArtist,
+        kFieldAlbumTitle,
+        kFieldComposer,
+        kFieldGenre,
+        kFieldMediaType,
+        kFieldContentItemIdentifier,
+        kFieldDuration,
+        kFieldElapsedTime,
+        kFieldPlaybackRate,
+        kFieldTrackNumber,
+        kFieldQueueIndex,
+        kFieldUniqueIdentifier,
+        kFieldITunesStoreIdentifier,
+        kFieldRepeatMode,
+        kFieldShuffleMode
+    };
+
+    struct ColumnSpec {
+        const char* name;
+        ColumnType type;
+        ColumnField field;
+    };
+
+    struct Column {
+        ColumnType type;
+        std::string validity;           // One bit per row, 1 for valid
+        std::string values;             // Little-endian values, or bits for booleans
+        size_t nulls;
+        int dictionary;                 // Index in _dictionaries, -1 for none
+        std::string last;               // Last string, as consecutive rows mostly repeat the same track
+        int32_t lastIndex;              // Its index in the dictionary, -1 for none
+    };
+
+    struct Dictionary {
+        std::unordered_map<std::string, int32_t> indices;
+        size_t count;
+        size_t written;                 // Entries in the file
+        bool inFile;                    // The first (non-delta) batch is written
+        std::string pendingValues;      // Entries not in the file yet, as Arrow utf8 buffers
+        std::vector<int32_t> pendingOffsets;
+    };
+
+    struct Block {
+        uint64_t offset;
+        uint32_t metaDataLength;
+        uint64_t bodyLength;
+    };
+
+    static const ColumnSpec kColumns[];
+
+    int _fd;
+    size_t _batchSize;
+    bool _failed;
+    uint64_t _end;                      // Offset of the end-of-stream marker
+    std::vector<Column> _columns;
+    std::vector<Dictionary> _dictionaries;
+    size_t _rows;                       // Buffered
+    uint64_t _rowsInFile;
+    std::vector<Block> _dictionaryBlocks;
+    std::vector<Block> _recordBatchBlocks;
+
+    void appendValidity(Column& column, bool valid);
+    void appendValue(Column& column, bool valid, uint64_t value);
+    void appendBool(Column& column, bool value);
+    void appendString(Column& column, const std::string& value);
+    void appendIndex(Column& column, int32_t index);
+    int32_t indexOf(Dictionary& dictionary, const std::string& value);
+
+    size_t schema(MRFlatBufferBuilder& builder) const;
+    std::string schemaMessage() const;
+    int writeAt(uint64_t offset, const std::string& data);
+    int writeMessage(const std::string& metadata, const std::string& body, std::vector<Block>& blocks);
+    int writeDictionary(size_t id);
+    int writeBatch();
+
+    // The end-of-stream marker, the footer listing the messages, its length and the magic.
+    std::string trailer() const;
+
+    int create();
+    int recover(uint64_t size);
+    int recoverMessage(const Block& block, bool isDictionary);
+
+public:
+
+    MRArrowExporter(size_t batchSize);
+
+    ~MRArrowExporter();
+
+    /**
+     * Open or create the file.
+     *
+     * @return 0 for success, -1 if it cannot be opened, or is not an export of this version.
+     */
+    int open(const std::string& path);
+
+    /**
+     * Add a row.
+     *
+     * @return 0 for success, -1 for a failure to write.
+     */
+    int write(const MRVersionedSnapshot& snapshot);
+
+    /**
+     * Write the rows buffered and the footer.
+     *
+     * @return 0 for success, -1 for a failure to write.
+     */
+    int flush();
+
+    uint64_t getRowCount();
+
+    size_t getBatchCount();
+};
+
+};
+
+#endif /* MRArrowExporter_h */
@@ -0,0 +1,424 @@
+#include "MRCatalog.h"
+#include "MRTextFolding.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace NowPlaying {
+
+namespace {
+
+// Below this, a text match is no match.
+const double kMinimumScore = 0.5;
+
+// Enough matches this good by folded title stop the lookup before the tracks of the artist.
+const double kStrongScore = 0.95;
+
+// Enough matches this good by folded title or artist stop the lookup before the trigrams.
+const double kGoodScore = 0.7;
+
+// How many tracks of the same folded title ("Intro"...) or artist are ranked at most.
+const size_t kMaximumExactCandidates = 1024;
+const size_t kMaximumArtistCandidates = 512;
+
+// How many track ids the posting lists of a fuzzy lookup may yield, and how many of the best of them are ranked.
+const size_t kPostingBudget = 4096;
+const size_t kMaximumFuzzyCandidates = 200;
+
+// How many candidates a lookup ranks at most, by title, artist and trigrams together.
+// Ranking one takes about 2 us, so this keeps a lookup under a millisecond, whatever the catalog.
+const size_t kRankBudget = 256;
+
+const double kTitleWeight = 0.6;
+const double kArtistWeight = 0.3;
+const double kAlbumTitleWeight = 0.1;
+
+uint64_t hashOf(const std::vector<uint32_t>& folded) {
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < folded.size(); i++) {
+        hash ^= folded[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t parseNumber(const char* text, size_t length) {
+    uint64_t ret = 0;
+    for(size_t i = 0; i < length && text[i] >= '0' && text[i] <= '9'; i++) ret = ret * 10 + (uint64_t)(text[i] - '0');
+    return ret;
+}
+
+void appendVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while(value >= 0x80) {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+uint32_t readVarint(const uint8_t*& bytes) {
+    uint32_t ret = 0;
+    for(int shift = 0; ; shift += 7) {
+        uint8_t byte = *bytes++;
+        ret |= (uint32_t)(byte & 0x7F) << shift;
+        if(!(byte & 0x80)) return ret;
+    }
+}
+
+// Sort `pairs` and split them into two arrays, releasing `pairs`.
+void sortedColumns(std::vector<std::pair<uint64_t, uint32_t>>& pairs, std::vector<uint64_t>& keys, std::vector<uint32_t>& values) {
+    std::sort(pairs.begin(), pairs.end());
+    keys.reserve(pairs.size());
+    values.reserve(pairs.size());
+    for(size_t i = 0; i < pairs.size(); i++) {
+        keys.push_back(pairs[i].first);
+        values.push_back(pairs[i].second);
+    }
+    std::vector<std::pair<uint64_t, uint32_t>>().swap(pairs);
+}
+
+template <typename Candidates>
+size_t countAbove(const Candidates& candidates, double score) {
+    size_t count = 0;
+    for(size_t i = 0; i < candidates.size(); i++) if(candidates[i].score >= score) count++;
+    return count;
+}
+
+template <typename T>
+size_t bytesOf(const std::vector<T>& vector) {
+    return vector.capacity() * sizeof(T);
+}
+
+}
+
+MRCatalogInterface* MRCatalogInterface::Create(const char* path) {
+    if(!path) return 0;
+    MRCatalog* catalog = new MRCatalog();
+    if(catalog->open(path) != 0) {
+        delete catalog;
+        return 0;
+    }
+    return catalog;
+}
+
+void MRCatalogInterface::Delete(MRCatalogInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRCatalog::MRCatalog() : _fd(-1), _data(0), _size(0) {
+}
+
+MRCatalog::~MRCatalog() {
+    if(_data) munmap(const_cast<char*>(_data), _size);
+    if(_fd >= 0) close(_fd);
+}
+
+int MRCatalog::open(const std::string& path) {
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if(_fd < 0) return -1;
+    struct stat status;
+    if(fstat(_fd, &status) != 0) return -1;
+    _size = (size_t)status.st_size;
+    if(_size > 0) {
+        void* data = mmap(0, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+        if(data == MAP_FAILED) {
+            _size = 0;
+            return -1;
+        }
+        _data = static_cast<const char*>(data);
+    }
+    build();
+    return 0;
+}
+
+bool MRCatalog::parse(uint64_t offset, Fields& fields) const {
+    const char* line = _data + offset;
+    const char* end = static_cast<const char*>(memchr(line, '\n', _size - offset));
+    if(!end) end = _data + _size;
+    if(end > line && end[-1] == '\r') end--;
+    if(line == end || *line == '#') return false;
+
+    const char* columns[5] = {0, 0, 0, 0, 0};
+    size_t lengths[5] = {0, 0, 0, 0, 0};
+    const char* at = line;
+    for(int i = 0; i < 5 && at <= end; i++) {
+        const char* tab = static_cast<const char*>(memchr(at, '\t', end - at));
+        if(!tab || i == 4) tab = end;
+        columns[i] = at;
+        lengths[i] = tab - at;
+        at = tab + 1;
+    }
+    if(!columns[2] || lengths[2] == 0) return false;
+    fields.identifier = parseNumber(columns[0], lengths[0]);
+    fields.iTunesStoreIdentifier = parseNumber(columns[1], lengths[1]);
+    fields.title = columns[2];
+    fields.titleLength = lengths[2];
+    fields.artist = columns[3];
+    fields.artistLength = lengths[3];
+    fields.albumTitle = columns[4];
+    fields.albumTitleLength = lengths[4];
+    return true;
+}
+
+void MRCatalog::build() {
+    struct PostingList {
+        uint64_t trigram;
+        uint32_t last;
+        uint32_t count;
+        std::vector<uint8_t> bytes;
+    };
+    std::vector<PostingList> lists;
+    std::unordered_map<uint64_t, uint32_t> listOfTrigram;
+    std::vector<std::pair<uint64_t, uint32_t>> storeIdentifiers;
+    std::vector<std::pair<uint64_t, uint32_t>> titleHashes;
+    std::vector<std::pair<uint64_t, uint32_t>> artistHashes;
+    std::vector<uint32_t> folded;
+    std::vector<uint64_t> trigrams;
+
+    for(uint64_t offset = 0; offset < _size;) {
+        const char* end = static_cast<const char*>(memchr(_data + offset, '\n', _size - offset));
+        uint64_t next = end ? end - _data + 1 : _size;
+        Fields fields;
+        if(parse(offset, fields)) {
+            uint32_t track = (uint32_t)_lines.size();
+            _lines.push_back(offset);
+            if(fields.iTunesStoreIdentifier) storeIdentifiers.push_back(std::make_pair(fields.iTunesStoreIdentifier, track));
+            MRFoldText(fields.title, fields.titleLength, folded);
+            titleHashes.push_back(std::make_pair(hashOf(folded), track));
+            MRTrigramsOf(folded, trigrams);
+            std::vector<uint32_t> foldedArtist;
+            MRFoldText(fields.artist, fields.artistLength, foldedArtist);
+            if(!foldedArtist.empty()) artistHashes.push_back(std::make_pair(hashOf(foldedArtist), track));
+            for(size_t i = 0; i < trigrams.size(); i++) {
+                std::pair<std::unordered_map<uint64_t, uint32_t>::iterator, bool> inserted = listOfTrigram.insert(std::make_pair(trigrams[i], (uint32_t)lists.size()));
+                if(inserted.second) {
+                    lists.push_back(PostingList());
+                    lists.back().trigram = trigrams[i];
+                    lists.back().last = 0;
+                    lists.back().count = 0;
+                }
+                PostingList& list = lists[inserted.first->second];
+                appendVarint(list.bytes, track - list.last);
+                list.last = track;
+                list.count++;
+            }
+        }
+        offset = next;
+    }
+    _lines.shrink_to_fit();
+    listOfTrigram.clear();
+
+    sortedColumns(storeIdentifiers, _storeIdentifiers, _storeTracks);
+
+    sortedColumns(titleHashes, _titleHashes, _titleTracks);
+    sortedColumns(artistHashes, _artistHashes, _artistTracks);
+
+    std::vector<uint32_t> order(lists.size());
+    size_t total = 0;
+    for(size_t i = 0; i < lists.size(); i++) {
+        order[i] = (uint32_t)i;
+        total += lists[i].bytes.size();
+    }
+    std::sort(order.begin(), order.end(), [&lists](uint32_t a, uint32_t b) { return lists[a].trigram < lists[b].trigram; });
+    _trigrams.reserve(lists.size());
+    _postingOffsets.reserve(lists.size() + 1);
+    _postingCounts.reserve(lists.size());
+    _postings.reserve(total);
+    for(size_t i = 0; i < order.size(); i++) {
+        PostingList& list = lists[order[i]];
+        _trigrams.push_back(list.trigram);
+        _postingOffsets.push_back((uint32_t)_postings.size());
+        _postingCounts.push_back(list.count);
+        _postings.insert(_postings.end(), list.bytes.begin(), list.bytes.end());
+        std::vector<uint8_t>().swap(list.bytes);
+    }
+    _postingOffsets.push_back((uint32_t)_postings.size());
+}
+
+double MRCatalog::score(uint32_t track, const Query& query, Query& scratch) const {
+    Fields fields;
+    if(!parse(_lines[track], fields)) return 0.0;
+    MRFoldText(fields.title, fields.titleLength, scratch.folded);
+    double ret = 0.0;
+    double weights = kTitleWeight;
+    if(scratch.folded == query.folded) ret += kTitleWeight;
+    else {
+        MRTrigramsOf(scratch.folded, scratch.title);
+        // Half similarity, half how much of the title asked for is found: "Halo" is close to "Halo (Remastered 2011)".
+        double similarity = MRTrigramSimilarity(query.title, scratch.title);
+        double coverage = similarity * (query.title.size() + scratch.title.size()) / (2.0 * query.title.size());
+        ret += kTitleWeight * (similarity + coverage) / 2;
+    }
+    if(!query.artist.empty()) {
+        MRFoldText(fields.artist, fields.artistLength, scratch.folded);
+        MRTrigramsOf(scratch.folded, scratch.artist);
+        ret += kArtistWeight * MRTrigramSimilarity(query.artist, scratch.artist);
+        weights += kArtistWeight;
+    }
+    if(!query.albumTitle.empty()) {
+        MRFoldText(fields.albumTitle, fields.albumTitleLength, scratch.folded);
+        MRTrigramsOf(scratch.folded, scratch.albumTitle);
+        ret += kAlbumTitleWeight * MRTrigramSimilarity(query.albumTitle, scratch.albumTitle);
+        weights += kAlbumTitleWeight;
+    }
+    return ret / weights;
+}
+
+void MRCatalog::fill(uint32_t track, double score, MRCatalogMatch& match) const {
+    Fields fields;
+    parse(_lines[track], fields);
+    match.identifier = fields.identifier;
+    match.iTunesStoreIdentifier = fields.iTunesStoreIdentifier;
+    match.title.assign(fields.title, fields.titleLength);
+    match.artist.assign(fields.artist ? fields.artist : "", fields.artistLength);
+    match.albumTitle.assign(fields.albumTitle ? fields.albumTitle : "", fields.albumTitleLength);
+    match.score = score;
+    match.byIdentifier = false;
+}
+
+void MRCatalog::fuzzyCandidates(const Query& query, size_t maximum, std::vector<uint32_t>& tracks) const {
+    // The lists of the trigrams of the title, rarest first. Trigrams missing from the index have empty lists.
+    std::vector<std::pair<uint32_t, uint32_t>> lists;      // Count and index in _trigrams
+    for(size_t i = 0; i < query.title.size(); i++) {
+        std::vector<uint64_t>::const_iterator it = std::lower_bound(_trigrams.begin(), _trigrams.end(), query.title[i]);
+        if(it == _trigrams.end() || *it != query.title[i]) lists.push_back(std::make_pair(0u, UINT32_MAX));
+        else lists.push_back(std::make_pair(_postingCounts[it - _trigrams.begin()], (uint32_t)(it - _trigrams.begin())));
+    }
+    std::sort(lists.begin(), lists.end());
+
+    // Decode the lists any title sharing half of the trigrams is in, within the budget.
+    std::vector<std::vector<uint32_t>> decoded;
+    size_t generators = lists.size() / 2 + 1;
+    size_t budget = kPostingBudget;
+    for(size_t i = 0; i < lists.size() && i < generators && budget > 0; i++) {
+        if(lists[i].second == UINT32_MAX) continue;
+        const uint8_t* bytes = &_postings[_postingOffsets[lists[i].second]];
+        uint32_t count = std::min(lists[i].first, (uint32_t)budget);
+        budget -= count;
+        decoded.push_back(std::vector<uint32_t>(count));
+        uint32_t track = 0;
+        for(uint32_t j = 0; j < count; j++) {
+            track += readVarint(bytes);
+            decoded.back()[j] = track;
+        }
+    }
+
+    // Merge the sorted lists, counting in how many each track is.
+    std::vector<std::pair<uint32_t, uint32_t>> hits;       // Count and track
+    std::vector<size_t> cursors(decoded.size(), 0);
+    for(;;) {
+        uint32_t track = UINT32_MAX;
+        for(size_t i = 0; i < decoded.size(); i++) {
+            if(cursors[i] < decoded[i].size()) track = std::min(track, decoded[i][cursors[i]]);
+        }
+        if(track == UINT32_MAX) break;
+        uint32_t count = 0;
+        for(size_t i = 0; i < decoded.size(); i++) {
+            if(cursors[i] < decoded[i].size() && decoded[i][cursors[i]] == track) {
+                cursors[i]++;
+                count++;
+            }
+        }
+        hits.push_back(std::make_pair(count, track));
+    }
+    if(hits.size() > maximum) {
+        std::nth_element(hits.begin(), hits.begin() + maximum, hits.end(), std::greater<std::pair<uint32_t, uint32_t>>());
+        hits.resize(maximum);
+    }
+    for(size_t i = 0; i < hits.size(); i++) tracks.push_back(hits[i].second);
+}
+
+void MRCatalog::rank(const std::vector<uint64_t>& hashes, const std::vector<uint32_t>& tracks, uint64_t hash, size_t maximum,
+                     const Query& query, Query& scratch, std::vector<uint32_t>& ranked, std::vector<Candidate>& candidates) const {
+    std::vector<uint64_t>::const_iterator first = std::lower_bound(hashes.begin(), hashes.end(), hash);
+    size_t end = std::min<size_t>(std::upper_bound(first, hashes.end(), hash) - hashes.begin(), (first - hashes.begin()) + maximum);
+    size_t before = ranked.size();
+    for(size_t i = first - hashes.begin(); i < end; i++) {
+        if(std::binary_search(ranked.begin(), ranked.begin() + before, tracks[i])) continue;
+        Candidate candidate = {tracks[i], score(tracks[i], query, scratch)};
+        candidates.push_back(candidate);
+        ranked.push_back(tracks[i]);
+    }
+    std::sort(ranked.begin(), ranked.end());
+}
+
+size_t MRCatalog::search(const char* title, const char* artist, const char* albumTitle, size_t limit, std::vector<MRCatalogMatch>* matches) {
+    if(!title || !matches || limit == 0) return 0;
+    Query query;
+    MRFoldText(title, strlen(title), query.folded);
+    if(query.folded.empty()) return 0;
+    MRTrigramsOf(query.folded, query.title);
+    query.titleHash = hashOf(query.folded);
+    Query scratch;
+    if(artist) {
+        MRFoldText(artist, strlen(artist), scratch.folded);
+        MRTrigramsOf(scratch.folded, query.artist);
+        query.artistHash = hashOf(scratch.folded);
+    }
+    if(albumTitle) {
+        MRFoldText(albumTitle, strlen(albumTitle), scratch.folded);
+        MRTrigramsOf(scratch.folded, query.albumTitle);
+    }
+
+    std::vector<Candidate> candidates;
+    std::vector<uint32_t> ranked;
+    rank(_titleHashes, _titleTracks, query.titleHash, std::min(kMaximumExactCandidates, kRankBudget), query, scratch, ranked, candidates);
+    if(countAbove(candidates, kStrongScore) < limit && !query.artist.empty() && candidates.size() < kRankBudget)
+        rank(_artistHashes, _artistTracks, query.artistHash, std::min(kMaximumArtistCandidates, kRankBudget - candidates.size()), query, scratch, ranked, candidates);
+    if(countAbove(candidates, kGoodScore) < limit && candidates.size() < kRankBudget) {
+        std::vector<uint32_t> tracks;
+        fuzzyCandidates(query, std::min(kMaximumFuzzyCandidates, kRankBudget - candidates.size()), tracks);
+        for(size_t i = 0; i < tracks.size(); i++) {
+            if(std::binary_search(ranked.begin(), ranked.end(), tracks[i])) continue;
+            Candidate candidate = {tracks[i], score(tracks[i], query, scratch)};
+            candidates.push_back(candidate);
+        }
+    }
+
+    size_t count = std::min(limit, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.score != b.score ? a.score > b.score : a.track < b.track;
+    });
+    size_t ret = 0;
+    for(size_t i = 0; i < count && candidates[i].score > 0; i++) {
+        matches->push_back(MRCatalogMatch());
+        fill(candidates[i].track, candidates[i].score, matches->back());
+        ret++;
+    }
+    return ret;
+}
+
+int MRCatalog::match(const MRNowPlayingSnapshot& snapshot, MRCatalogMatch* match) {
+    if(!match) return -1;
+    if(snapshot.iTunesStoreIdentifier) {
+        std::vector<uint64_t>::const_iterator it = std::lower_bound(_storeIdentifiers.begin(), _storeIdentifiers.end(), snapshot.iTunesStoreIdentifier);
+        if(it != _storeIdentifiers.end() && *it == snapshot.iTunesStoreIdentifier) {
+            fill(_storeTracks[it - _storeIdentifiers.begin()], 1.0, *match);
+            match->byIdentifier = true;
+            return 0;
+        }
+    }
+    std::vector<MRCatalogMatch> matches;
+    if(search(snapshot.title.c_str(), snapshot.artist.c_str(), snapshot.albumTitle.c_str(), 1, &matches) == 0 || matches[0].score < kMinimumScore) return -1;
+    *match = matches[0];
+    return 0;
+}
+
+size_t MRCatalog::getTrackCount() {
+    return _lines.size();
+}
+
+size_t MRCatalog::getMemoryUsage() {
+    return bytesOf(_lines) + bytesOf(_storeIdentifiers) + bytesOf(_storeTracks) + bytesOf(_titleHashes) + bytesOf(_titleTracks)
+         + bytesOf(_artistHashes) + bytesOf(_artistTracks)
+         + bytesOf(_trigrams) + bytesOf(_postingOffsets) + bytesOf(_postingCounts) + bytesOf(_postings);
+}
+
+};
@@ -0,0 +1,130 @@
+#ifndef MRCatalog_h
+#define MRCatalog_h
+
+#include "nowplaying-catalog.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Maps the now playing information onto a local catalog of tracks.
+ *
+ * The tracks stay in the mapped file: the index only keeps the offset of each line, and parses and folds the few candidates of a lookup.
+ * The index is made of sorted arrays, searched by binary search:
+ * - iTunesStoreIdentifier to track,
+ * - 64-bit hash of the folded title to tracks, and of the folded artist to tracks,
+ * - trigram of the folded titles to a posting list of tracks, delta and varint encoded.
+ *
+ * A lookup ranks the tracks of the same folded title first, then those of the same folded artist, which catches most variants
+ * of a title ("Remastered", "feat."). Only if neither matches well does it turn to the trigrams.
+ * A fuzzy lookup reads the posting lists of the rarest trigrams of the title only: a title sharing at least half of the trigrams
+ * must appear in one of the `n / 2 + 1` rarest lists (pigeonhole). The tracks found in the most lists are then ranked.
+ */
+class MRCatalog : public MRCatalogInterface {
+private:
+
+    int _fd;
+    const char* _data;
+    size_t _size;
+
+    std::vector<uint64_t> _lines;               // Offset of the line of each track
+
+    std::vector<uint64_t> _storeIdentifiers;    // Sorted, with the track of each in _storeTracks
+    std::vector<uint32_t> _storeTracks;
+
+    std::vector<uint64_t> _titleHashes;         // Sorted, with the track of each in _titleTracks
+    std::vector<uint32_t> _titleTracks;
+
+    std::vector<uint64_t> _artistHashes;        // Sorted, with the track of each in _artistTracks
+    std::vector<uint32_t> _artistTracks;
+
+    std::vector<uint64_t> _trigrams;            // Sorted
+    std::vector<uint32_t> _postingOffsets;      // Where the list of each trigram starts in _postings, and one past the end
+    std::vector<uint32_t> _postingCounts;       // How many tracks each list holds
+    std::vector<uint8_t> _postings;
+
+    struct Fields {
+        uint64_t identifier;
+        uint64_t iTunesStoreIdentifier;
+        const char* title;
+        size_t titleLength;
+        const char* artist;
+        size_t artistLength;
+        const char* albumTitle;
+        size_t albumTitleLength;
+    };
+
+    // The trigrams and folded fields of a lookup.
+    struct Query {
+        std::vector<uint32_t> folded;
+        std::vector<uint64_t> title;
+        std::vector<uint64_t> artist;
+        std::vector<uint64_t> albumTitle;
+        uint64_t titleHash;
+        uint64_t artistHash;
+
+        Query() : titleHash(0), artistHash(0) {}
+    };
+
+    struct Candidate {
+        uint32_t track;
+        double score;
+    };
+
+    // Parse the line starting at `offset`. Returns false if it is no track.
+    bool parse(uint64_t offset, Fields& fields) const;
+
+    void build();
+
+    // Rank `track` against `query`, from 0 to 1. `scratch` saves allocations between calls.
+    double score(uint32_t track, const Query& query, Query& scratch) const;
+
+    // Score the tracks whose entry in `hashes` is `hash`, at most `maximum`, unless already in `ranked` (sorted), and add them to it.
+    void rank(const std::vector<uint64_t>& hashes, const std::vector<uint32_t>& tracks, uint64_t hash, size_t maximum,
+                const Query& query, Query& scratch, std::vector<uint32_t>& ranked, std::vector<Candidate>& candidates) const;
+
+    void fill(uint32_t track, double score, MRCatalogMatch& match) const;
+
+    // Append to `tracks` at most `maximum` tracks sharing enough trigrams with the title of `query`, those sharing the most.
+    void fuzzyCandidates(const Query& query, size_t maximum, std::vector<uint32_t>& tracks) const;
+
+public:
+
+    MRCatalog();
+
+    ~MRCatalog();
+
+    /**
+     * Map and index a catalog file.
+     *
+     * @return 0 for success, -1 if the file cannot be read.
+     */
+    int open(const std::string& path);
+
+    /**
+     * Find the track of the catalog playing now.
+     *
+     * @param snapshot The now playing information.
+     * @param match Receives the track.
+     * @return 0 for success, -1 for no track matching well enough.
+     */
+    int match(const MRNowPlayingSnapshot& snapshot, MRCatalogMatch* match);
+
+    /**
+     * Find the tracks of the catalog matching a title, best first.
+     *
+     * @return The number of matches appended.
+     */
+    size_t search(const char* title, const char* artist, const char* albumTitle, size_t limit, std::vector<MRCatalogMatch>* matches);
+
+    size_t getTrackCount();
+
+    size_t getMemoryUsage();
+};
+
+};
+
+#endif /* MRCatalog_h */
@@ -0,0 +1,173 @@
+#include "MRCommandSchedule.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace NowPlaying {
+
+namespace {
+
+// A position this close past the target still fires (late), farther it is a jump over the target.
+const double kMissTolerance = 0.25;
+
+}
+
+MRCommandSchedule::MRCommandSchedule(const Executor& executor) : _executor(executor), _nextId(1), _hasPosition(false),
+                                                                 _elapsedTime(0.0), _timestamp(0.0), _rate(0.0), _duration(0.0), _totalError(0.0) {
+}
+
+double MRCommandSchedule::positionAt(double now) const {
+    double position = _elapsedTime;
+    if(_rate > 0 && now > _timestamp) position += (now - _timestamp) * _rate;
+    if(_duration > 0 && position > _duration) position = _duration;
+    return position;
+}
+
+uint64_t MRCommandSchedule::schedule(MRScheduledCommand command, double position, double seekTime, MRCommandSchedulerCallback callback, void* context, double now) {
+    if(!_hasPosition || std::isnan(position)) return 0;
+    Command scheduled = {command, position, seekTime, _track, -1, HUGE_VAL, callback, context};
+    uint64_t id = _nextId++;
+    if(!reschedule(id, scheduled, now)) return 0;
+    _commands[id] = scheduled;
+    return id;
+}
+
+int MRCommandSchedule::cancel(uint64_t id) {
+    std::map<uint64_t, Command>::iterator it = _commands.find(id);
+    if(it == _commands.end()) return -1;
+    unschedule(id, it->second);
+    _commands.erase(it);
+    return 0;
+}
+
+void MRCommandSchedule::unschedule(uint64_t id, const Command& command) {
+    if(command.deadline != HUGE_VAL) _deadlines.erase(std::make_pair(command.deadline, id));
+}
+
+bool MRCommandSchedule::reschedule(uint64_t id, Command& command, double now) {
+    unschedule(id, command);
+    command.deadline = HUGE_VAL;
+    if(!_hasPosition || command.track != _track) return false;
+    if(command.position >= 0) command.target = command.position;
+    else if(_duration > 0) command.target = std::max(_duration + command.position, 0.0);
+    if(command.target < 0) return true;
+    double position = positionAt(now);
+    if(position > command.target + kMissTolerance) return false;
+    // Reached but not sent yet: due at once, and reported late.
+    if(position >= command.target) command.deadline = now;
+    else if(_rate > 0) command.deadline = _timestamp + (command.target - _elapsedTime) / _rate;
+    if(command.deadline != HUGE_VAL) _deadlines.insert(std::make_pair(command.deadline, id));
+    return true;
+}
+
+int MRCommandSchedule::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    if(snapshot.stale) return 0;
+    _hasPosition = snapshot.hasInfo;
+    _track = snapshot.contentItemIdentifier.empty() ? snapshot.title : snapshot.contentItemIdentifier;
+    _elapsedTime = snapshot.elapsedTime;
+    _timestamp = snapshot.timestamp > 0 ? snapshot.timestamp : now;
+    _rate = snapshot.hasInfo && snapshot.playbackRate > 0 ? snapshot.playbackRate : 0.0;
+    _duration = snapshot.duration;
+
+    std::vector<uint64_t> missed;
+    for(std::map<uint64_t, Command>::iterator it = _commands.begin(); it != _commands.end(); ++it) {
+        if(!reschedule(it->first, it->second, now)) missed.push_back(it->first);
+    }
+    // Reported once the schedule is consistent, since callbacks may call back in.
+    for(size_t i = 0; i < missed.size(); i++) {
+        std::map<uint64_t, Command>::iterator it = _commands.find(missed[i]);
+        if(it == _commands.end()) continue;
+        Command command = it->second;
+        _commands.erase(it);
+        report(missed[i], command, kMRScheduledCommandMissed, now, command.track == _track ? positionAt(now) : 0.0, false);
+    }
+    return (int)missed.size();
+}
+
+size_t MRCommandSchedule::advance(double now) {
+    size_t ret = 0;
+    // One at a time: a command sent changes the playback, and so the deadlines of the others.
+    while(!_deadlines.empty() && _deadlines.begin()->first <= now) {
+        uint64_t id = _deadlines.begin()->second;
+        _deadlines.erase(_deadlines.begin());
+        std::map<uint64_t, Command>::iterator it = _commands.find(id);
+        if(it == _commands.end()) continue;
+        Command command = it->second;
+        _commands.erase(it);
+
+        double position = positionAt(now);
+        bool result = _executor(command.command, command.seekTime);
+        if(result) {
+            predict(command.command, command.seekTime, now);
+            for(std::map<uint64_t, Command>::iterator other = _commands.begin(); other != _commands.end(); ++other) {
+                // Jumped over by a seek: missed when the next snapshot confirms it.
+                reschedule(other->first, other->second, now);
+            }
+        }
+        ret++;
+        report(id, command, kMRScheduledCommandFired, now, position, result);
+    }
+    return ret;
+}
+
+void MRCommandSchedule::predict(MRScheduledCommand command, double seekTime, double now) {
+    double position = positionAt(now);
+    switch(command) {
+        case kMRScheduledCommandPlay:
+            if(_rate <= 0) _rate = 1.0;
+            break;
+        case kMRScheduledCommandPause:
+            _rate = 0.0;
+            break;
+        case kMRScheduledCommandTogglePlayPause:
+            _rate = _rate > 0 ? 0.0 : 1.0;
+            break;
+        case kMRScheduledCommandSeek:
+            position = std::max(seekTime, 0.0);
+            break;
+        case kMRScheduledCommandNextTrack:
+        case kMRScheduledCommandPreviousTrack:
+            // The next snapshot tells which track it is. Until then, nothing of this one is due.
+            _rate = 0.0;
+            break;
+    }
+    _elapsedTime = position;
+    _timestamp = now;
+}
+
+void MRCommandSchedule::report(uint64_t id, const Command& command, MRScheduledCommandOutcome outcome, double now, double position, bool result) {
+    MRScheduledCommandReport report;
+    report.id = id;
+    report.command = command.command;
+    report.outcome = outcome;
+    report.targetPosition = command.target;
+    report.time = now;
+    report.position = position;
+    report.error = outcome == kMRScheduledCommandFired ? report.position - report.targetPosition : 0.0;
+    report.result = result;
+
+    if(outcome == kMRScheduledCommandFired) {
+        _statistics.fired++;
+        _totalError += std::fabs(report.error);
+        _statistics.meanError = _totalError / _statistics.fired;
+        _statistics.maxError = std::max(_statistics.maxError, std::fabs(report.error));
+    }
+    else {
+        _statistics.missed++;
+    }
+    if(command.callback) command.callback(report, command.context);
+}
+
+double MRCommandSchedule::nextDeadline() const {
+    return _deadlines.empty() ? HUGE_VAL : _deadlines.begin()->first;
+}
+
+size_t MRCommandSchedule::getPendingCount() const {
+    return _commands.size();
+}
+
+MRCommandSchedulerStatistics MRCommandSchedule::getStatistics() const {
+    return _statistics;
+}
+
+};
@@ -0,0 +1,110 @@
+#ifndef MRCommandSchedule_h
+#define MRCommandSchedule_h
+
+#include "nowplaying-scheduler.h"
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace NowPlaying {
+
+/**
+ * The timing of MRCommandScheduler, without its thread.
+ *
+ * Each command has a target position on one track. Its deadline (a UNIX time) is where the playback of the latest snapshot
+ * reaches the target, and is recomputed by \ref feed(). The owner sleeps until \ref nextDeadline() and then calls \ref advance(),
+ * which sends the commands due.
+ *
+ * This class does no locking. Times are UNIX times (with fraction), so it can run on a simulated clock.
+ */
+class MRCommandSchedule {
+public:
+
+    /**
+     * Sends a command.
+     *
+     * @return The result of the call.
+     */
+    typedef std::function<bool(MRScheduledCommand command, double seekTime)> Executor;
+
+    explicit MRCommandSchedule(const Executor& executor);
+
+    /// See \ref MRCommandSchedulerInterface::schedule().
+    uint64_t schedule(MRScheduledCommand command, double position, double seekTime, MRCommandSchedulerCallback callback, void* context, double now);
+
+    /// See \ref MRCommandSchedulerInterface::cancel().
+    int cancel(uint64_t id);
+
+    /**
+     * Take a new snapshot and recompute every deadline. Stale snapshots are ignored.
+     *
+     * @return The number of commands missed because of this snapshot.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Send the commands due by `now`, in the order of their deadlines. Callbacks may call any method.
+     *
+     * @return The number of commands sent.
+     */
+    size_t advance(double now);
+
+    /**
+     * Get the time the next command is due.
+     *
+     * @return The UNIX time (with fraction), or HUGE_VAL if nothing is due until the next snapshot.
+     */
+    double nextDeadline() const;
+
+    /// @return How many commands are waiting.
+    size_t getPendingCount() const;
+
+    MRCommandSchedulerStatistics getStatistics() const;
+
+private:
+
+    struct Command {
+        MRScheduledCommand command;
+        double position;            // As given: negative from the end
+        double seekTime;
+        std::string track;
+        double target;              // From the start of the track, -1 while unknown (from the end, with no duration)
+        double deadline;            // HUGE_VAL for none
+        MRCommandSchedulerCallback callback;
+        void* context;
+    };
+
+    Executor _executor;
+    uint64_t _nextId;
+    std::map<uint64_t, Command> _commands;
+    std::set<std::pair<double, uint64_t>> _deadlines;      // Commands with a deadline, soonest first
+
+    // Playback, from the latest snapshot and the commands sent since
+    bool _hasPosition;
+    std::string _track;
+    double _elapsedTime;
+    double _timestamp;
+    double _rate;
+    double _duration;
+
+    MRCommandSchedulerStatistics _statistics;
+    double _totalError;
+
+    double positionAt(double now) const;
+
+    // Recompute the deadline of `id`. Returns false if the media is already past the target.
+    bool reschedule(uint64_t id, Command& command, double now);
+
+    void unschedule(uint64_t id, const Command& command);
+
+    // Assume the effect of a command sent, until the next snapshot.
+    void predict(MRScheduledCommand command, double seekTime, double now);
+
+    void report(uint64_t id, const Command& command, MRScheduledCommandOutcome outcome, double now, double position, bool result);
+};
+
+};
+
+#endif /* MRCommandSchedule_h */
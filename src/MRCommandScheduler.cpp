@@ -0,0 +1,91 @@
+#include "MRCommandScheduler.h"
+#include <chrono>
+#include <cmath>
+
+namespace NowPlaying {
+
+namespace {
+
+// Sleeping stops this long before a deadline, and the rest is spun.
+const double kSpinMargin = 0.002;
+
+double currentTime() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+void MRCommandSchedulerInterface::Delete(MRCommandSchedulerInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRCommandScheduler::MRCommandScheduler(const MRCommandSchedule::Executor& executor) : _schedule(executor), _stopping(false) {
+    _thread = std::thread(&MRCommandScheduler::run, this);
+}
+
+MRCommandScheduler::~MRCommandScheduler() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(_lock);
+        _stopping = true;
+    }
+    _changed.notify_one();
+    _thread.join();
+}
+
+void MRCommandScheduler::run() {
+    std::unique_lock<std::recursive_mutex> lock(_lock);
+    while(!_stopping) {
+        double deadline = _schedule.nextDeadline();
+        double now = currentTime();
+        if(deadline == HUGE_VAL) {
+            _changed.wait(lock);
+        }
+        else if(deadline - now > kSpinMargin) {
+            std::chrono::duration<double> sinceEpoch(deadline - kSpinMargin);
+            _changed.wait_until(lock, std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceEpoch)));
+        }
+        else if(now < deadline) {
+            // Let feed() and schedule() in while spinning: they may move the deadline.
+            lock.unlock();
+            while(currentTime() < deadline) std::this_thread::yield();
+            lock.lock();
+        }
+        else {
+            _schedule.advance(now);
+        }
+    }
+}
+
+void MRCommandScheduler::reschedule(double deadline) {
+    if(_schedule.nextDeadline() < deadline) _changed.notify_one();
+}
+
+int MRCommandScheduler::feed(const MRNowPlayingSnapshot& snapshot) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    double deadline = _schedule.nextDeadline();
+    int ret = _schedule.feed(snapshot, currentTime());
+    reschedule(deadline);
+    return ret;
+}
+
+uint64_t MRCommandScheduler::schedule(MRScheduledCommand command, double position, double seekTime, MRCommandSchedulerCallback callback, void* context) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    double deadline = _schedule.nextDeadline();
+    uint64_t ret = _schedule.schedule(command, position, seekTime, callback, context, currentTime());
+    reschedule(deadline);
+    return ret;
+}
+
+int MRCommandScheduler::cancel(uint64_t id) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    // A later deadline only costs the thread one early wakeup, so there is no need to wake it now.
+    return _schedule.cancel(id);
+}
+
+MRCommandSchedulerStatistics MRCommandScheduler::getStatistics() {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    return _schedule.getStatistics();
+}
+
+};
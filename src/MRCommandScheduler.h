@@ -0,0 +1,80 @@
+#ifndef MRCommandScheduler_h
+#define MRCommandScheduler_h
+
+#include "nowplaying-scheduler.h"
+#include "MRCommandSchedule.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace NowPlaying {
+
+/**
+ * Sends commands when the media playing now reaches a position, from one thread.
+ *
+ * The thread sleeps until shortly before the next deadline (see MRCommandSchedule), then spins without the lock until the deadline,
+ * since waking up from a sleep may take longer than the accuracy wanted. It is woken up early when a snapshot or a command
+ * makes something due sooner.
+ */
+class MRCommandScheduler : public MRCommandSchedulerInterface {
+private:
+
+    // Recursive, so that callbacks (run on the thread with the lock held) may call back in.
+    std::recursive_mutex _lock;
+    std::condition_variable_any _changed;
+    MRCommandSchedule _schedule;
+    bool _stopping;
+    std::thread _thread;
+
+    void run();
+
+    // Wake the thread if `deadline` (the one it sleeps until) is no longer the next one. Called with the lock held.
+    void reschedule(double deadline);
+
+public:
+
+    /**
+     * @param executor Sends the commands, on the thread of the instance.
+     */
+    explicit MRCommandScheduler(const MRCommandSchedule::Executor& executor);
+
+    ~MRCommandScheduler();
+
+    /**
+     * Take a new snapshot. Stale snapshots are ignored.
+     *
+     * @param snapshot The now playing information.
+     * @return The number of commands missed because of this snapshot.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot);
+
+    /**
+     * Schedule a command on the track playing now, as known from the latest snapshot.
+     *
+     * @param command The command to send.
+     * @param position The position (seconds) to send it at. Negative for a position from the end of the track, for example -5.
+     * @param seekTime Where to seek to, for \ref kMRScheduledCommandSeek. Ignored for the other commands.
+     * @param callback Called once the command was fired or missed. May be NULL.
+     * @param context Passed to `callback`.
+     * @return The identifier of the command, or 0 if no track is known or the position has already passed.
+     */
+    uint64_t schedule(MRScheduledCommand command, double position, double seekTime, MRCommandSchedulerCallback callback, void* context);
+
+    /**
+     * Cancel a command. It is neither sent nor reported after this returns.
+     *
+     * @return 0 for success, -1 for unknown command (or already fired or missed).
+     */
+    int cancel(uint64_t id);
+
+    /**
+     * Get to know how accurately the commands were fired.
+     *
+     * @return The counts and errors since the creation of the instance.
+     */
+    MRCommandSchedulerStatistics getStatistics();
+};
+
+};
+
+#endif /* MRCommandScheduler_h */
@@ -4,6 +4,8 @@
 #import <Foundation/Foundation.h>
 #import "nowplaying.h"
 #import "typedefs.h"
+#import "MRMediaRemoteHub.h"
+#include <memory>
 
 namespace NowPlaying {
 
@@ -21,10 +23,8 @@ namespace NowPlaying {
 class MRCommander : public MRCommanderInterface {
 private:
     
-    CFBundleRef _bundle;
-    
-    MRMediaRemoteSendCommandFunction MRMediaRemoteSendCommand;
-    MRMediaRemoteSetElapsedTimeFunction MRMediaRemoteSetElapsedTime;
+    // Holds the MediaRemote symbols, resolved once per process.
+    std::shared_ptr<MRMediaRemoteHub> _hub;
 
 public:
 
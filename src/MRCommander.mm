@@ -1,7 +1,10 @@
 #import "nowplaying.h"
 #import "MRCommander.h"
+#import "MRCommandScheduler.h"
 #import "MRMediaRemoteCommands.h"
 #import "typedefs.h"
+#import "MRMediaRemoteHub.h"
+#import "MRTrace.h"
 #import <Foundation/Foundation.h>
 
 namespace NowPlaying {
@@ -15,43 +18,77 @@ void MRCommanderInterface::Delete(MRCommanderInterface* instance) {
     instance = 0;
 }
 
-MRCommander::MRCommander() {
-    // Load MediaRemote.framework
-    CFURLRef ref = (__bridge CFURLRef) [NSURL fileURLWithPath:@"/System/Library/PrivateFrameworks/MediaRemote.framework"];
-    CFBundleRef _bundle = CFBundleCreate(kCFAllocatorDefault, ref);
+void MRCommanderInterface::SetOptimisticUpdates(bool enabled, double timeout) {
+    MRMediaRemoteHub::SetOptimisticUpdates(enabled, timeout);
+}
+
+MROptimisticStatistics MRCommanderInterface::GetOptimisticStatistics() {
+    return MRMediaRemoteHub::Acquire()->getOptimisticStatistics();
+}
 
-    MRMediaRemoteSendCommand = (MRMediaRemoteSendCommandFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteSendCommand"));
-    MRMediaRemoteSetElapsedTime = (MRMediaRemoteSetElapsedTimeFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteSetElapsedTime"));
+MRCommandSchedulerInterface* MRCommandSchedulerInterface::Create(MRCommanderInterface* commander) {
+    return new MRCommandScheduler([commander](MRScheduledCommand command, double seekTime) -> bool {
+        switch(command) {
+            case kMRScheduledCommandPlay:
+                return commander->play();
+            case kMRScheduledCommandPause:
+                return commander->pause();
+            case kMRScheduledCommandTogglePlayPause:
+                return commander->togglePlayPause();
+            case kMRScheduledCommandNextTrack:
+                return commander->nextTrack();
+            case kMRScheduledCommandPreviousTrack:
+                return commander->previousTrack();
+            case kMRScheduledCommandSeek:
+                commander->seekTo(seekTime);
+                return true;
+        }
+        return false;
+    });
+}
+
+MRCommander::MRCommander() {
+    _hub = MRMediaRemoteHub::Acquire();
 }
 
 MRCommander::~MRCommander() {
-    if (_bundle) {
-        CFRelease(_bundle);
-    }
 }
 
 bool MRCommander::play() {
-    return MRMediaRemoteSendCommand(MRMediaRemoteCommandPlay, nil);
+    MR_TRACE_SPAN("MRCommander", "play");
+    bool ret = _hub->MRMediaRemoteSendCommand(MRMediaRemoteCommandPlay, nil);
+    if(ret) _hub->speculate(MROptimisticState::kActionPlay, 0);
+    return ret;
 }
 
 bool MRCommander::pause() {
-    return MRMediaRemoteSendCommand(MRMediaRemoteCommandPause, nil);
+    MR_TRACE_SPAN("MRCommander", "pause");
+    bool ret = _hub->MRMediaRemoteSendCommand(MRMediaRemoteCommandPause, nil);
+    if(ret) _hub->speculate(MROptimisticState::kActionPause, 0);
+    return ret;
 }
 
 bool MRCommander::togglePlayPause() {
-    return MRMediaRemoteSendCommand(MRMediaRemoteCommandTogglePlayPause, nil);
+    MR_TRACE_SPAN("MRCommander", "togglePlayPause");
+    bool ret = _hub->MRMediaRemoteSendCommand(MRMediaRemoteCommandTogglePlayPause, nil);
+    if(ret) _hub->speculate(MROptimisticState::kActionTogglePlayPause, 0);
+    return ret;
 }
 
 bool MRCommander::nextTrack() {
-    return MRMediaRemoteSendCommand(MRMediaRemoteCommandNextTrack, nil);
+    MR_TRACE_SPAN("MRCommander", "nextTrack");
+    return _hub->MRMediaRemoteSendCommand(MRMediaRemoteCommandNextTrack, nil);
 }
 
 bool MRCommander::previousTrack() {
-    return MRMediaRemoteSendCommand(MRMediaRemoteCommandPreviousTrack, nil);
+    MR_TRACE_SPAN("MRCommander", "previousTrack");
+    return _hub->MRMediaRemoteSendCommand(MRMediaRemoteCommandPreviousTrack, nil);
 }
 
 void MRCommander::seekTo(double seekTime) {
-    MRMediaRemoteSetElapsedTime(seekTime);
+    MR_TRACE_SPAN("MRCommander", "seekTo");
+    _hub->MRMediaRemoteSetElapsedTime(seekTime);
+    _hub->speculate(MROptimisticState::kActionSeek, seekTime);
 }
 
 }
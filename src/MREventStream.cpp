@@ -0,0 +1,134 @@
+#include "MREventStream.h"
+#include <cmath>
+
+namespace NowPlaying {
+
+MREventStreamInterface* MREventStreamInterface::Create(const MREventStreamConfig& config) {
+    return new MREventStream(config);
+}
+
+void MREventStreamInterface::Delete(MREventStreamInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MREventStream::MREventStream(const MREventStreamConfig& config) : _config(config), _nextId(1), _timestamp(0.0), _ended(false), _duplicates(0) {
+}
+
+MREventStream::~MREventStream() {
+}
+
+bool MREventStream::isSameTrack(const MRNowPlayingSnapshot& snapshot) const {
+    if(!snapshot.contentItemIdentifier.empty() || !_previous.contentItemIdentifier.empty()) {
+        return snapshot.contentItemIdentifier == _previous.contentItemIdentifier;
+    }
+    // Some players do not report an identifier.
+    return snapshot.title == _previous.title && snapshot.artist == _previous.artist && snapshot.albumTitle == _previous.albumTitle;
+}
+
+bool MREventStream::isAtEnd(double position, double duration) const {
+    return duration > 0 && position >= duration - _config.endTolerance;
+}
+
+double MREventStream::predictedPosition(double now) const {
+    if(!_previous.hasInfo) return 0.0;
+    double position = _previous.elapsedTime;
+    if(_previous.playbackRate > 0 && now > _timestamp) position += (now - _timestamp) * _previous.playbackRate;
+    if(_previous.duration > 0 && position > _previous.duration) position = _previous.duration;
+    return position;
+}
+
+int MREventStream::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    if(snapshot.stale || snapshot.provisional) return 0;
+    double timestamp = snapshot.timestamp > 0 ? snapshot.timestamp : now;
+    bool playing = snapshot.hasInfo && snapshot.playbackRate > 0;
+    bool wasPlaying = _previous.hasInfo && _previous.playbackRate > 0;
+    double position = 0.0;
+    if(snapshot.hasInfo) {
+        position = snapshot.elapsedTime + (playing && now > timestamp ? (now - timestamp) * snapshot.playbackRate : 0.0);
+        if(snapshot.duration > 0 && position > snapshot.duration) position = snapshot.duration;
+    }
+    double predicted = predictedPosition(now);
+
+    std::vector<MRPlaybackEventType> types;
+    bool ended = _ended;
+    if(!_previous.hasInfo && !snapshot.hasInfo) {
+        // Still nothing playing.
+    }
+    else if(!_previous.hasInfo || !snapshot.hasInfo || !isSameTrack(snapshot)) {
+        if(_previous.hasInfo && !_ended && isAtEnd(predicted, _previous.duration)) types.push_back(kMRPlaybackEventEnded);
+        types.push_back(kMRPlaybackEventTrackChanged);
+        ended = snapshot.hasInfo && !playing && isAtEnd(position, snapshot.duration);
+    }
+    else {
+        bool jumped = std::fabs(position - predicted) > _config.seekTolerance;
+        // Played to the end, then either repeated (a jump back from the end) or stopped there.
+        if(!_ended && ((jumped && isAtEnd(predicted, _previous.duration)) || (!playing && isAtEnd(position, snapshot.duration)))) {
+            types.push_back(kMRPlaybackEventEnded);
+            ended = true;
+        }
+        if(jumped) {
+            types.push_back(kMRPlaybackEventSeeked);
+            if(!isAtEnd(position, snapshot.duration)) ended = false;
+        }
+    }
+    if(wasPlaying && !playing) types.push_back(kMRPlaybackEventPaused);
+    if(!wasPlaying && playing) {
+        // Resumed, so it can end again.
+        types.push_back(kMRPlaybackEventStarted);
+        ended = false;
+    }
+
+    MRNowPlayingSnapshot previous = _previous;
+    _previous = snapshot;
+    _timestamp = timestamp;
+    _ended = ended;
+    if(types.empty()) {
+        _duplicates++;
+        return 0;
+    }
+
+    std::vector<MRPlaybackEvent> events;
+    for(size_t i = 0; i < types.size(); i++) {
+        MRPlaybackEvent event = {types[i], now, position, predicted, &snapshot, &previous};
+        events.push_back(event);
+    }
+    emit(events);
+    return (int)events.size();
+}
+
+void MREventStream::emit(const std::vector<MRPlaybackEvent>& events) {
+    // Callbacks may subscribe or unsubscribe anyone, so walk a copy of the identifiers and look each one up again.
+    std::vector<uint64_t> ids;
+    for(std::map<uint64_t, Subscription>::const_iterator it = _subscriptions.begin(); it != _subscriptions.end(); ++it) ids.push_back(it->first);
+    for(size_t i = 0; i < events.size(); i++) {
+        for(size_t j = 0; j < ids.size(); j++) {
+            std::map<uint64_t, Subscription>::const_iterator it = _subscriptions.find(ids[j]);
+            if(it == _subscriptions.end() || !(it->second.types & events[i].type)) continue;
+            Subscription subscription = it->second;
+            subscription.callback(events[i], subscription.context);
+        }
+    }
+}
+
+uint64_t MREventStream::subscribe(unsigned types, MRPlaybackEventCallback callback, void* context) {
+    if(!callback || !(types & kMRPlaybackEventAll)) return 0;
+    Subscription subscription = {types, callback, context};
+    uint64_t id = _nextId++;
+    _subscriptions[id] = subscription;
+    return id;
+}
+
+int MREventStream::unsubscribe(uint64_t id) {
+    return _subscriptions.erase(id) ? 0 : -1;
+}
+
+bool MREventStream::isPlaying() {
+    return _previous.hasInfo && _previous.playbackRate > 0;
+}
+
+uint64_t MREventStream::getDuplicateCount() {
+    return _duplicates;
+}
+
+};
@@ -0,0 +1,77 @@
+#ifndef MREventStream_h
+#define MREventStream_h
+
+#include "nowplaying-events.h"
+#include <map>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Derives what happened to the playback from the now playing snapshots.
+ *
+ * The state is the latest accepted snapshot and whether its track has ended. Each snapshot predicts the position
+ * from that state, compares it with the reported one, and emits the events of the differences to the subscribers of their type.
+ *
+ * An instance is not thread-safe. Stale and provisional snapshots are ignored.
+ */
+class MREventStream : public MREventStreamInterface {
+private:
+
+    struct Subscription {
+        unsigned types;
+        MRPlaybackEventCallback callback;
+        void* context;
+    };
+
+    MREventStreamConfig _config;
+
+    uint64_t _nextId;
+    std::map<uint64_t, Subscription> _subscriptions;
+
+    MRNowPlayingSnapshot _previous;     // The latest accepted snapshot. hasInfo is false before the first one.
+    double _timestamp;                  // Of _previous, or the time it was received if it has none
+    bool _ended;                        // The track of _previous has emitted ended
+
+    uint64_t _duplicates;
+
+    bool isSameTrack(const MRNowPlayingSnapshot& snapshot) const;
+    bool isAtEnd(double position, double duration) const;
+    double predictedPosition(double now) const;
+    void emit(const std::vector<MRPlaybackEvent>& events);
+
+public:
+
+    MREventStream(const MREventStreamConfig& config);
+
+    ~MREventStream();
+
+    /**
+     * Take a new snapshot, and call the subscribers of the events it causes.
+     *
+     * @return The number of events emitted.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Subscribe to some types of events.
+     *
+     * @return The identifier of the subscription, or 0 for invalid arguments.
+     */
+    uint64_t subscribe(unsigned types, MRPlaybackEventCallback callback, void* context);
+
+    /**
+     * Cancel a subscription.
+     *
+     * @return 0 for success, -1 for unknown subscription.
+     */
+    int unsubscribe(uint64_t id);
+
+    bool isPlaying();
+
+    uint64_t getDuplicateCount();
+};
+
+};
+
+#endif /* MREventStream_h */
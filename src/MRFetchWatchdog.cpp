@@ -0,0 +1,79 @@
+#include "MRFetchWatchdog.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+MRFetchWatchdog::MRFetchWatchdog(const MRFetchWatchdogConfig& config) : _config(config), _random(config.seed ^ 0x9e3779b97f4a7c15ull), _waiting(false), _sequence(0),
+                                                                        _issuedAt(0.0), _deadline(HUGE_VAL), _retryAt(HUGE_VAL), _retriedUpTo(0), _attempts(0) {
+}
+
+void MRFetchWatchdog::fetchIssued(uint64_t sequence, double now) {
+    _statistics.fetches++;
+    _waiting = true;
+    _sequence = sequence;
+    _issuedAt = now;
+    _deadline = now + _config.timeout;
+    _retryAt = HUGE_VAL;
+}
+
+MRFetchWatchdog::Reply MRFetchWatchdog::replyReceived(uint64_t sequence, double now) {
+    (void)now;
+    _statistics.staleSince = 0.0;
+    if(sequence == _sequence && _waiting) {
+        _waiting = false;
+        _deadline = HUGE_VAL;
+        _retryAt = HUGE_VAL;
+        _attempts = 0;
+        return kReplyAwaited;
+    }
+    if(sequence <= _retriedUpTo) {
+        _statistics.lateReplies++;
+        return kReplyLate;
+    }
+    return kReplySuperseded;
+}
+
+bool MRFetchWatchdog::advance(double now) {
+    if(!_waiting) return false;
+    if(now >= _deadline) {
+        _statistics.stuckFetches++;
+        if(_statistics.staleSince == 0.0) _statistics.staleSince = _issuedAt;
+        _retriedUpTo = _sequence;
+        _deadline = HUGE_VAL;
+        _retryAt = now + backoff();
+    }
+    if(now < _retryAt) return false;
+    _retryAt = HUGE_VAL;
+    _attempts++;
+    _statistics.retries++;
+    return true;
+}
+
+double MRFetchWatchdog::backoff() {
+    // xorshift64*, enough to spread the retries.
+    _random ^= _random >> 12;
+    _random ^= _random << 25;
+    _random ^= _random >> 27;
+    double uniform = (double)((_random * 0x2545f4914f6cdd1dull) >> 11) / 9007199254740992.0;
+    double wait = std::min(_config.initialBackoff * std::pow(2.0, _attempts), _config.maxBackoff);
+    return wait * (1.0 - _config.jitter * uniform);
+}
+
+double MRFetchWatchdog::nextDeadline() const {
+    return _waiting ? std::min(_deadline, _retryAt) : HUGE_VAL;
+}
+
+bool MRFetchWatchdog::isWaiting() const {
+    return _waiting;
+}
+
+double MRFetchWatchdog::getStaleSince() const {
+    return _statistics.staleSince;
+}
+
+const MRFetchStatistics& MRFetchWatchdog::getStatistics() const {
+    return _statistics;
+}
+
+};
@@ -0,0 +1,88 @@
+#ifndef MRFetchWatchdog_h
+#define MRFetchWatchdog_h
+
+#include "nowplaying-snapshot.h"
+#include <cstdint>
+
+namespace NowPlaying {
+
+/**
+ * The timings of MRFetchWatchdog, in seconds.
+ */
+struct MRFetchWatchdogConfig {
+    double timeout;             /*!< A fetch not answered this long after being issued is stuck. */
+    double initialBackoff;      /*!< Wait before the first retry of a stuck fetch. */
+    double maxBackoff;          /*!< Longest wait before a retry. The wait doubles from `initialBackoff` with each retry. */
+    double jitter;              /*!< Fraction of each wait (0 to 1) taken off at random, so that processes do not retry in lockstep. */
+    uint64_t seed;              /*!< Seed of the jitter. */
+
+    MRFetchWatchdogConfig() : timeout(3.0), initialBackoff(0.5), maxBackoff(30.0), jitter(0.5), seed(0) {}
+};
+
+/**
+ * Notices the fetches of now playing information the system never answers, and decides when to retry them.
+ *
+ * Only the latest fetch issued is awaited: an earlier one in flight is superseded by it (see \ref MRUpdateSequencer).
+ * Once its deadline passes, the fetch is stuck and the information is stale since it was issued. It is retried after a backoff,
+ * doubling with each retry up to `maxBackoff`, with jitter. A retry is a new fetch, with a newer sequence number,
+ * so when it is answered first, the answer of the stuck fetch is older than the information applied and gets ignored.
+ * Any answer, even a late one, shows the system answers again, and the information is no longer stale.
+ *
+ * MRMediaRemoteHub feeds it each fetch and reply on its queue, and issues the retries from a timer set to \ref nextDeadline().
+ */
+class MRFetchWatchdog {
+public:
+
+    typedef enum {
+        kReplyAwaited,          // Answers the latest fetch.
+        kReplySuperseded,       // Answers an earlier fetch, issued before the latest one was.
+        kReplyLate              // Answers a fetch which got stuck and was retried.
+    } Reply;
+
+    explicit MRFetchWatchdog(const MRFetchWatchdogConfig& config = MRFetchWatchdogConfig());
+
+    /// Record that a fetch was issued, whatever the reason, including the retries asked by \ref advance().
+    void fetchIssued(uint64_t sequence, double now);
+
+    /// Record the answer of a fetch.
+    Reply replyReceived(uint64_t sequence, double now);
+
+    /**
+     * Check the deadline of the awaited fetch, and whether to retry it.
+     *
+     * @return true if a fetch should be issued now to retry. Report it to \ref fetchIssued().
+     */
+    bool advance(double now);
+
+    /// @return The UNIX time \ref advance() has something to do at, HUGE_VAL if none.
+    double nextDeadline() const;
+
+    /// @return true if a fetch is awaited.
+    bool isWaiting() const;
+
+    /// @return The UNIX time of the stuck fetch not answered since, 0 if none.
+    double getStaleSince() const;
+
+    const MRFetchStatistics& getStatistics() const;
+
+private:
+
+    MRFetchWatchdogConfig _config;
+    uint64_t _random;
+
+    bool _waiting;
+    uint64_t _sequence;         // The latest fetch issued.
+    double _issuedAt;
+    double _deadline;           // HUGE_VAL once stuck.
+    double _retryAt;            // HUGE_VAL unless stuck.
+    uint64_t _retriedUpTo;      // The fetches up to this one got stuck and were retried.
+    int _attempts;              // Retries since the latest answer.
+
+    MRFetchStatistics _statistics;
+
+    double backoff();
+};
+
+};
+
+#endif /* MRFetchWatchdog_h */
@@ -0,0 +1,170 @@
+#include "MRFlatBuffer.h"
+#include <algorithm>
+
+namespace NowPlaying {
+
+MRFlatBufferBuilder::Table::Table() {
+}
+
+void MRFlatBufferBuilder::Table::scalar(uint16_t id, uint64_t value, size_t size) {
+    Field field = {id, size, value, false, 0};
+    _fields.push_back(field);
+}
+
+void MRFlatBufferBuilder::Table::offset(uint16_t id) {
+    Field field = {id, 4, 0, true, 0};
+    _fields.push_back(field);
+}
+
+size_t MRFlatBufferBuilder::Table::at(uint16_t id) const {
+    for(size_t i = 0; i < _fields.size(); i++) if(_fields[i].id == id) return _fields[i].position;
+    return 0;
+}
+
+MRFlatBufferBuilder::MRFlatBufferBuilder() : _buffer(4, '\0') {
+}
+
+void MRFlatBufferBuilder::align(size_t alignment) {
+    _buffer.resize((_buffer.size() + alignment - 1) / alignment * alignment, '\0');
+}
+
+void MRFlatBufferBuilder::put(size_t position, uint64_t value, size_t size) {
+    for(size_t i = 0; i < size; i++) _buffer[position + i] = (char)(value >> (8 * i));
+}
+
+size_t MRFlatBufferBuilder::table(Table& table) {
+    // Lay the fields out after the offset to the vtable, largest first, each aligned to its size.
+    std::vector<size_t> order(table._fields.size());
+    for(size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&table](size_t a, size_t b) {
+        return table._fields[a].size > table._fields[b].size;
+    });
+    std::vector<size_t> offsets(table._fields.size());
+    size_t size = 4;
+    size_t alignment = 4;
+    uint16_t slots = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        const Table::Field& field = table._fields[order[i]];
+        size = (size + field.size - 1) / field.size * field.size;
+        offsets[order[i]] = size;
+        size += field.size;
+        alignment = std::max(alignment, field.size);
+        slots = std::max<uint16_t>(slots, field.id + 1);
+    }
+
+    align(2);
+    size_t vtable = _buffer.size();
+    _buffer.resize(vtable + 4 + 2 * slots, '\0');
+    put(vtable, 4 + 2 * slots, 2);
+    put(vtable + 2, size, 2);
+    for(size_t i = 0; i < table._fields.size(); i++) put(vtable + 4 + 2 * table._fields[i].id, offsets[i], 2);
+
+    align(alignment);
+    size_t position = _buffer.size();
+    _buffer.resize(position + size, '\0');
+    put(position, position - vtable, 4);
+    for(size_t i = 0; i < table._fields.size(); i++) {
+        Table::Field& field = table._fields[i];
+        field.position = position + offsets[i];
+        if(!field.isOffset) put(field.position, field.value, field.size);
+    }
+    return position;
+}
+
+size_t MRFlatBufferBuilder::string(const std::string& text) {
+    align(4);
+    size_t position = _buffer.size();
+    _buffer.resize(position + 4, '\0');
+    put(position, text.size(), 4);
+    _buffer += text;
+    _buffer += '\0';
+    return position;
+}
+
+size_t MRFlatBufferBuilder::vector(size_t count, size_t elementSize, size_t alignment) {
+    alignment = std::max<size_t>(alignment, 4);
+    // The elements are aligned, and the length comes right before them.
+    while((_buffer.size() + 4) % alignment) _buffer += '\0';
+    size_t position = _buffer.size();
+    _buffer.resize(position + 4 + count * elementSize, '\0');
+    put(position, count, 4);
+    return position;
+}
+
+void MRFlatBufferBuilder::patch(size_t position, size_t target) {
+    put(position, target - position, 4);
+}
+
+void MRFlatBufferBuilder::setRoot(size_t position) {
+    patch(0, position);
+}
+
+const std::string& MRFlatBufferBuilder::finish() {
+    align(8);
+    return _buffer;
+}
+
+MRFlatBufferTable::MRFlatBufferTable() : _data(0), _size(0), _position(0), _vtable(0), _vtableSize(0) {
+}
+
+MRFlatBufferTable::MRFlatBufferTable(const uint8_t* data, size_t size, size_t position) : _data(data), _size(size), _position(position), _vtable(0), _vtableSize(0) {
+    if(position + 4 > size) {
+        _data = 0;
+        return;
+    }
+    int64_t vtable = (int64_t)position - (int32_t)read(position, 4);
+    if(vtable < 0 || (uint64_t)vtable + 4 > size) {
+        _data = 0;
+        return;
+    }
+    _vtable = (size_t)vtable;
+    _vtableSize = (size_t)read(_vtable, 2);
+    if(_vtableSize < 4 || _vtable + _vtableSize > size) _data = 0;
+}
+
+MRFlatBufferTable MRFlatBufferTable::Root(const uint8_t* data, size_t size) {
+    if(!data || size < 4) return MRFlatBufferTable();
+    size_t root = (size_t)data[0] | (size_t)data[1] << 8 | (size_t)data[2] << 16 | (size_t)data[3] << 24;
+    return MRFlatBufferTable(data, size, root);
+}
+
+bool MRFlatBufferTable::isValid() const {
+    return _data != 0;
+}
+
+uint64_t MRFlatBufferTable::read(size_t position, size_t size) const {
+    if(!_data || position + size > _size) return 0;
+    uint64_t value = 0;
+    for(size_t i = 0; i < size; i++) value |= (uint64_t)_data[position + i] << (8 * i);
+    return value;
+}
+
+size_t MRFlatBufferTable::field(uint16_t id, size_t size) const {
+    if(!_data || 4 + 2 * (size_t)id + 2 > _vtableSize) return 0;
+    size_t offset = (size_t)read(_vtable + 4 + 2 * id, 2);
+    if(offset == 0 || _position + offset + size > _size) return 0;
+    return _position + offset;
+}
+
+uint64_t MRFlatBufferTable::scalar(uint16_t id, size_t size, uint64_t defaultValue) const {
+    size_t position = field(id, size);
+    return position ? read(position, size) : defaultValue;
+}
+
+MRFlatBufferTable MRFlatBufferTable::table(uint16_t id) const {
+    size_t position = field(id, 4);
+    if(!position) return MRFlatBufferTable();
+    return MRFlatBufferTable(_data, _size, position + (size_t)read(position, 4));
+}
+
+bool MRFlatBufferTable::vector(uint16_t id, size_t elementSize, size_t& elements, size_t& count) const {
+    size_t position = field(id, 4);
+    if(!position) return false;
+    size_t vector = position + (size_t)read(position, 4);
+    if(vector + 4 > _size) return false;
+    count = (size_t)read(vector, 4);
+    elements = vector + 4;
+    return count <= (_size - elements) / std::max<size_t>(elementSize, 1);
+}
+
+};
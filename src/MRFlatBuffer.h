@@ -0,0 +1,140 @@
+#ifndef MRFlatBuffer_h
+#define MRFlatBuffer_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Writes FlatBuffers without the flatc compiler or its library, for the metadata of the Arrow IPC format.
+ *
+ * Only what that metadata needs is supported: tables of scalars and offsets, strings, and vectors of structs or offsets.
+ * Objects are written front to back: a table first, then the objects its offsets point to, which FlatBuffers allows
+ * since an offset only has to point forward. The buffer starts with the offset of the root table, see \ref setRoot().
+ * Every object is aligned to its size from the start of the buffer, as verifiers require. All values are little-endian.
+ */
+class MRFlatBufferBuilder {
+public:
+
+    /**
+     * The fields of one table, added in any order, then written by \ref MRFlatBufferBuilder::table().
+     */
+    class Table {
+    public:
+        Table();
+
+        /// Add a scalar field of `size` bytes (1, 2, 4 or 8).
+        void scalar(uint16_t id, uint64_t value, size_t size);
+
+        /// Add an offset field, to be pointed by \ref MRFlatBufferBuilder::patch() once its object is written.
+        void offset(uint16_t id);
+
+        /// @return The position of the offset field `id` in the buffer, once the table is written.
+        size_t at(uint16_t id) const;
+
+    private:
+        friend class MRFlatBufferBuilder;
+
+        struct Field {
+            uint16_t id;
+            size_t size;
+            uint64_t value;
+            bool isOffset;
+            size_t position;        // In the buffer, once written
+        };
+
+        std::vector<Field> _fields;
+    };
+
+    MRFlatBufferBuilder();
+
+    /**
+     * Write a table.
+     *
+     * @return The position of the table in the buffer.
+     */
+    size_t table(Table& table);
+
+    /// Write a string. @return Its position.
+    size_t string(const std::string& text);
+
+    /**
+     * Write a vector of `count` elements of `elementSize` bytes, left zeroed, aligned to `alignment`.
+     *
+     * @return The position of the vector. Its first element is 4 bytes further.
+     */
+    size_t vector(size_t count, size_t elementSize, size_t alignment);
+
+    /// Point the offset at `position` to the object at `target`, written after it.
+    void patch(size_t position, size_t target);
+
+    /// Make the table at `position` the root.
+    void setRoot(size_t position);
+
+    /// Write `size` bytes of `value` at `position`.
+    void put(size_t position, uint64_t value, size_t size);
+
+    /// @return The buffer, padded to a multiple of 8 bytes.
+    const std::string& finish();
+
+private:
+
+    std::string _buffer;
+
+    void align(size_t alignment);
+};
+
+/**
+ * Reads a table of a FlatBuffer, checking every access against the bounds of the buffer.
+ * A missing field, or one pointing outside the buffer, reads as its default.
+ */
+class MRFlatBufferTable {
+public:
+
+    /// A table which is not valid, with every field missing.
+    MRFlatBufferTable();
+
+    /// @return The root table of a buffer, or an invalid table.
+    static MRFlatBufferTable Root(const uint8_t* data, size_t size);
+
+    bool isValid() const;
+
+    /// @return The scalar field `id` of `size` bytes, or `defaultValue` if missing.
+    uint64_t scalar(uint16_t id, size_t size, uint64_t defaultValue) const;
+
+    /// @return The table the field `id` points to, or an invalid table.
+    MRFlatBufferTable table(uint16_t id) const;
+
+    /**
+     * Find the vector the field `id` points to.
+     *
+     * @param elementSize The size of an element, to check the vector is in bounds.
+     * @param elements Receives the position of the first element in the buffer.
+     * @param count Receives the number of elements.
+     * @return true if found and in bounds.
+     */
+    bool vector(uint16_t id, size_t elementSize, size_t& elements, size_t& count) const;
+
+    /// @return `size` bytes at `position` of the buffer, as read by \ref vector().
+    uint64_t read(size_t position, size_t size) const;
+
+private:
+
+    const uint8_t* _data;
+    size_t _size;
+    size_t _position;
+    size_t _vtable;
+    size_t _vtableSize;
+
+    MRFlatBufferTable(const uint8_t* data, size_t size, size_t position);
+
+    // Position of the field `id`, or 0 if missing.
+    size_t field(uint16_t id, size_t size) const;
+};
+
+};
+
+#endif /* MRFlatBuffer_h */
@@ -0,0 +1,346 @@
+#include "MRLyrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace NowPlaying {
+
+namespace {
+
+// Positions closer than this to the extrapolated one are the same playback.
+const double kJumpTolerance = 0.25;
+
+// Absorbs the rounding of the deadlines, so waking up at a deadline always reaches its event.
+const double kBoundaryEpsilon = 1e-6;
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Parse "mm:ss", "mm:ss.xx" or "mm:ss.xxx" (some files use ':' before the fraction). Returns milliseconds, or -1 if no time.
+int64_t parseTime(const char* begin, const char* end) {
+    const char* p = begin;
+    int64_t minutes = 0;
+    int digits = 0;
+    for(; p < end && isDigit(*p) && digits < 5; p++, digits++) minutes = minutes * 10 + (*p - '0');
+    if(digits == 0 || p == end || *p != ':') return -1;
+    p++;
+    int64_t seconds = 0;
+    digits = 0;
+    for(; p < end && isDigit(*p) && digits < 2; p++, digits++) seconds = seconds * 10 + (*p - '0');
+    if(digits == 0 || seconds >= 60) return -1;
+    int64_t milliseconds = 0;
+    if(p < end && (*p == '.' || *p == ':')) {
+        p++;
+        int64_t scale = 100;
+        digits = 0;
+        for(; p < end && isDigit(*p); p++, digits++, scale /= 10) milliseconds += (*p - '0') * scale;
+        if(digits == 0) return -1;
+    }
+    if(p != end) return -1;
+    int64_t time = (minutes * 60 + seconds) * 1000 + milliseconds;
+    return time <= UINT32_MAX ? time : -1;
+}
+
+// The position in whole milliseconds, with the slack of kBoundaryEpsilon. Negative before the start.
+int64_t millisecondsOf(double position) {
+    return (int64_t)std::floor((position + kBoundaryEpsilon) * 1e3);
+}
+
+struct ParsedWord {
+    int64_t time;
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct ParsedLine {
+    int64_t time;
+    uint32_t offset;
+    uint32_t length;
+    std::vector<ParsedWord> words;
+};
+
+}
+
+MRLyricsInterface* MRLyricsInterface::Create() {
+    return new MRLyrics();
+}
+
+void MRLyricsInterface::Delete(MRLyricsInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRLyrics::MRLyrics() : _cursor(0), _hasPosition(false), _elapsedTime(0.0), _timestamp(0.0), _rate(0.0), _duration(0.0),
+                       _jumped(false), _jumpTime(0.0) {
+}
+
+MRLyrics::~MRLyrics() {
+}
+
+void MRLyrics::clear() {
+    _text.clear();
+    _lines.clear();
+    _words.clear();
+    _events.clear();
+    _cursor = 0;
+}
+
+int MRLyrics::load(const char* text, size_t length) {
+    clear();
+    _jumped = _hasPosition;
+    if(!text || length >= kWordFlag) return -1;
+
+    const char* p = text;
+    const char* end = text + length;
+    if(length >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+    int64_t offset = 0;
+    std::vector<ParsedLine> parsed;
+    std::vector<int64_t> times;
+    std::vector<std::pair<int64_t, uint32_t>> marks;
+    _text.reserve(length);
+
+    while(p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(!lineEnd) lineEnd = end;
+        const char* next = lineEnd < end ? lineEnd + 1 : end;
+        if(lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+
+        // Leading tags: times, or metadata such as [ar:...] and [offset:...] on a line of its own.
+        times.clear();
+        bool metadata = false;
+        while(p < lineEnd && *p == '[') {
+            const char* close = static_cast<const char*>(memchr(p, ']', lineEnd - p));
+            if(!close) break;
+            int64_t time = parseTime(p + 1, close);
+            if(time < 0) {
+                if(times.empty()) {
+                    metadata = true;
+                    if(close - p > 8 && strncmp(p + 1, "offset:", 7) == 0) offset = strtol(std::string(p + 8, close).c_str(), 0, 10);
+                }
+                break;
+            }
+            times.push_back(time);
+            p = close + 1;
+        }
+        if(metadata || times.empty()) {
+            p = next;
+            continue;
+        }
+
+        // The text, with the word times of enhanced LRC taken out.
+        uint32_t textBegin = (uint32_t)_text.size();
+        marks.clear();
+        while(p < lineEnd) {
+            if(*p == '<') {
+                const char* close = static_cast<const char*>(memchr(p, '>', lineEnd - p));
+                int64_t time = close ? parseTime(p + 1, close) : -1;
+                if(time >= 0) {
+                    marks.push_back(std::make_pair(time, (uint32_t)_text.size()));
+                    p = close + 1;
+                    continue;
+                }
+            }
+            _text += *p++;
+        }
+        uint32_t textEnd = (uint32_t)_text.size();
+
+        ParsedLine line;
+        line.offset = textBegin;
+        line.length = textEnd - textBegin;
+        while(line.length > 0 && isSpace(_text[line.offset])) line.offset++, line.length--;
+        while(line.length > 0 && isSpace(_text[line.offset + line.length - 1])) line.length--;
+        for(size_t i = 0; i < marks.size(); i++) {
+            uint32_t begin = marks[i].second;
+            uint32_t wordEnd = i + 1 < marks.size() ? marks[i + 1].second : textEnd;
+            while(begin < wordEnd && isSpace(_text[begin])) begin++;
+            while(wordEnd > begin && isSpace(_text[wordEnd - 1])) wordEnd--;
+            // A time with no text after it only ends the previous word.
+            if(begin == wordEnd) continue;
+            ParsedWord word = {marks[i].first, begin, wordEnd - begin};
+            line.words.push_back(word);
+        }
+        // A line with several times repeats, and its word times are relative to the first one.
+        for(size_t i = 0; i < times.size(); i++) {
+            line.time = times[i];
+            parsed.push_back(line);
+            for(size_t j = 0; j < line.words.size(); j++) parsed.back().words[j].time += times[i] - times[0];
+        }
+        p = next;
+    }
+    if(parsed.empty() || parsed.size() >= kWordFlag) {
+        clear();
+        return -1;
+    }
+
+    std::stable_sort(parsed.begin(), parsed.end(), [](const ParsedLine& a, const ParsedLine& b) {
+        return a.time < b.time;
+    });
+    _lines.reserve(parsed.size());
+    for(size_t i = 0; i < parsed.size(); i++) {
+        // A positive offset shows the lyrics earlier.
+        uint32_t time = (uint32_t)std::min<int64_t>(std::max<int64_t>(parsed[i].time - offset, 0), UINT32_MAX);
+        Line line = {time, parsed[i].offset, parsed[i].length, (uint32_t)_words.size(), 0};
+        for(size_t j = 0; j < parsed[i].words.size() && _words.size() + 1 < kWordFlag; j++) {
+            const ParsedWord& parsedWord = parsed[i].words[j];
+            // Words never start before their line or the word before them.
+            uint32_t wordTime = (uint32_t)std::min<int64_t>(std::max<int64_t>(parsedWord.time - offset, 0), UINT32_MAX);
+            wordTime = std::max(wordTime, line.wordCount ? _words.back().time : time);
+            Word word = {wordTime, parsedWord.offset, parsedWord.length, (uint32_t)i};
+            _words.push_back(word);
+            line.wordCount++;
+        }
+        _lines.push_back(line);
+    }
+
+    _events.reserve(_lines.size() + _words.size());
+    for(size_t i = 0; i < _lines.size(); i++) {
+        Event event = {_lines[i].time, (uint32_t)i};
+        _events.push_back(event);
+        for(uint32_t j = 0; j < _lines[i].wordCount; j++) {
+            uint32_t word = _lines[i].firstWord + j;
+            Event wordEvent = {_words[word].time, word | kWordFlag};
+            _events.push_back(wordEvent);
+        }
+    }
+    // Words may run past the start of the next line. A stable sort keeps each line before its first word.
+    std::stable_sort(_events.begin(), _events.end(), [](const Event& a, const Event& b) {
+        return a.time < b.time;
+    });
+    std::string(_text).swap(_text);
+    return 0;
+}
+
+double MRLyrics::positionAt(double now) const {
+    double position = _elapsedTime;
+    if(_rate > 0 && now > _timestamp) position += (now - _timestamp) * _rate;
+    if(_duration > 0 && position > _duration) position = _duration;
+    return position;
+}
+
+int MRLyrics::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    bool hasPosition = snapshot.hasInfo && !snapshot.stale;
+    std::string track = snapshot.contentItemIdentifier.empty() ? snapshot.title : snapshot.contentItemIdentifier;
+    double rate = hasPosition && snapshot.playbackRate > 0 ? snapshot.playbackRate : 0.0;
+    double timestamp = snapshot.timestamp > 0 ? snapshot.timestamp : now;
+
+    bool jumped = hasPosition && (!_hasPosition || track != _track);
+    if(hasPosition && !jumped) {
+        double position = snapshot.elapsedTime + (rate > 0 && now > timestamp ? (now - timestamp) * rate : 0.0);
+        if(snapshot.duration > 0 && position > snapshot.duration) position = snapshot.duration;
+        jumped = std::fabs(position - positionAt(now)) > kJumpTolerance;
+    }
+
+    _hasPosition = hasPosition;
+    _track = track;
+    _elapsedTime = snapshot.elapsedTime;
+    _timestamp = timestamp;
+    _rate = rate;
+    _duration = snapshot.duration;
+    if(jumped) _jumpTime = now;
+    _jumped = hasPosition && (_jumped || jumped);
+    return jumped ? 1 : 0;
+}
+
+MRLyricsEvent MRLyrics::eventOf(uint32_t index, bool jumped) const {
+    MRLyricsEvent event;
+    if(index & kWordFlag) {
+        const Word& word = _words[index & ~kWordFlag];
+        event.type = kMRLyricsEventWord;
+        event.line = (int)word.line;
+        event.word = (int)((index & ~kWordFlag) - _lines[word.line].firstWord);
+        event.time = word.time / 1e3;
+        event.text = _text.data() + word.offset;
+        event.length = word.length;
+    }
+    else {
+        const Line& line = _lines[index];
+        event.type = kMRLyricsEventLine;
+        event.line = (int)index;
+        event.word = -1;
+        event.time = line.time / 1e3;
+        event.text = _text.data() + line.offset;
+        event.length = line.length;
+    }
+    event.jumped = jumped;
+    return event;
+}
+
+size_t MRLyrics::advance(double now, MRLyricsCallback callback, void* context) {
+    if(!_hasPosition || _lines.empty()) return 0;
+    int64_t reached = millisecondsOf(positionAt(now));
+
+    if(_jumped) {
+        // Only the line and word showing now, found by binary search.
+        _jumped = false;
+        _cursor = std::upper_bound(_events.begin(), _events.end(), reached, [](int64_t time, const Event& event) {
+            return time < (int64_t)event.time;
+        }) - _events.begin();
+        MRLyricsEvent events[2];
+        size_t count = 1;
+        int line = getLineAt(reached / 1e3);
+        if(line < 0) {
+            MRLyricsEvent none = {kMRLyricsEventLine, -1, -1, 0.0, _text.data(), 0, true};
+            events[0] = none;
+        }
+        else {
+            events[0] = eventOf((uint32_t)line, true);
+            const Word* first = _words.data() + _lines[line].firstWord;
+            const Word* word = std::upper_bound(first, first + _lines[line].wordCount, reached, [](int64_t time, const Word& word) {
+                return time < (int64_t)word.time;
+            });
+            if(word != first) events[count++] = eventOf((uint32_t)(word - 1 - _words.data()) | kWordFlag, true);
+        }
+        // The events are copied first, since callbacks may load other lyrics.
+        for(size_t i = 0; i < count && callback; i++) callback(events[i], context);
+        return count;
+    }
+
+    size_t ret = 0;
+    while(_cursor < _events.size() && _events[_cursor].time <= reached) {
+        MRLyricsEvent event = eventOf(_events[_cursor].index, false);
+        _cursor++;
+        ret++;
+        if(callback) callback(event, context);
+        // A callback fed a jump or loaded other lyrics: the next advance() starts over.
+        if(_jumped) break;
+    }
+    return ret;
+}
+
+double MRLyrics::nextDeadline() {
+    if(!_hasPosition || _lines.empty()) return HUGE_VAL;
+    if(_jumped) return _jumpTime;
+    if(_rate <= 0 || _cursor >= _events.size()) return HUGE_VAL;
+    double time = _events[_cursor].time / 1e3;
+    if(_duration > 0 && time > _duration) return HUGE_VAL;
+    return _timestamp + (time - _elapsedTime) / _rate;
+}
+
+size_t MRLyrics::getLineCount() {
+    return _lines.size();
+}
+
+int MRLyrics::getLine(size_t index, MRLyricsLine* line) {
+    if(!line || index >= _lines.size()) return -1;
+    line->time = _lines[index].time / 1e3;
+    line->endTime = index + 1 < _lines.size() ? _lines[index + 1].time / 1e3 : HUGE_VAL;
+    line->text.assign(_text, _lines[index].offset, _lines[index].length);
+    line->wordCount = _lines[index].wordCount;
+    return 0;
+}
+
+int MRLyrics::getLineAt(double position) {
+    int64_t reached = millisecondsOf(position);
+    std::vector<Line>::const_iterator it = std::upper_bound(_lines.begin(), _lines.end(), reached, [](int64_t time, const Line& line) {
+        return time < (int64_t)line.time;
+    });
+    return (int)(it - _lines.begin()) - 1;
+}
+
+};
@@ -0,0 +1,104 @@
+#ifndef MRLyrics_h
+#define MRLyrics_h
+
+#include "nowplaying-lyrics.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Follows time-synced lyrics along the playback.
+ *
+ * The lyrics are kept as one string of texts without time tags, lines and words pointing into it,
+ * and one array of events (a line or word start, 8 bytes each) sorted by time.
+ * The cursor is the index of the next event in that array: it steps forward while playing, and is found again by binary search on jumps.
+ *
+ * Times of the lyrics are whole milliseconds. An instance is not thread-safe.
+ */
+class MRLyrics : public MRLyricsInterface {
+private:
+
+    struct Line {
+        uint32_t time;                  // Milliseconds
+        uint32_t offset;                // Of the text in _text
+        uint32_t length;
+        uint32_t firstWord;             // Index in _words
+        uint32_t wordCount;
+    };
+
+    struct Word {
+        uint32_t time;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t line;
+    };
+
+    struct Event {
+        uint32_t time;
+        uint32_t index;                 // Of the line, or of the word with kWordFlag
+    };
+
+    static const uint32_t kWordFlag = 0x80000000u;
+
+    std::string _text;
+    std::vector<Line> _lines;
+    std::vector<Word> _words;
+    std::vector<Event> _events;
+    size_t _cursor;                     // Next event to emit
+
+    // Playback, from the latest snapshot
+    bool _hasPosition;
+    std::string _track;
+    double _elapsedTime;
+    double _timestamp;
+    double _rate;
+    double _duration;
+    bool _jumped;                       // The next advance() emits the current line and word
+    double _jumpTime;
+
+    double positionAt(double now) const;
+    MRLyricsEvent eventOf(uint32_t index, bool jumped) const;
+    void clear();
+
+public:
+
+    MRLyrics();
+
+    ~MRLyrics();
+
+    /**
+     * Parse and replace the lyrics.
+     *
+     * @return 0 for success, -1 for no timed line.
+     */
+    int load(const char* text, size_t length);
+
+    /**
+     * Take a new snapshot.
+     *
+     * @return 1 if the position jumped, 0 if not.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Emit the lines and words reached by `now`.
+     *
+     * @return The number of events emitted.
+     */
+    size_t advance(double now, MRLyricsCallback callback, void* context);
+
+    /// @return The UNIX time the next event is due, or HUGE_VAL for none.
+    double nextDeadline();
+
+    size_t getLineCount();
+
+    int getLine(size_t index, MRLyricsLine* line);
+
+    int getLineAt(double position);
+};
+
+};
+
+#endif /* MRLyrics_h */
@@ -0,0 +1,195 @@
+#ifndef MRMediaRemoteHub_h
+#define MRMediaRemoteHub_h
+
+#import <Foundation/Foundation.h>
+#import "typedefs.h"
+#import "MRFetchWatchdog.h"
+#import "MRNotificationFastPath.h"
+#import "MRNotificationObserver.h"
+#import "MROptimisticState.h"
+#import "MRRefreshScheduler.h"
+#import "MRSnapshotHub.h"
+#import "MRSnapshotStore.h"
+#include <memory>
+
+namespace NowPlaying {
+
+/**
+ * The process-wide connection to the MediaRemote bundle, shared by all MRNowPlayingInfo and MRCommander instances.
+ *
+ * The bundle is loaded and its symbols resolved once. The now playing notifications are observed once,
+ * and every change is fetched once, whatever the number of instances. The fetched dictionary is shared by all instances without copying.
+ *
+ * Where the notifications get lost, the hub polls while observing, see \ref MRRefreshScheduler.
+ * Fetches the system does not answer in time are retried, see \ref MRFetchWatchdog.
+ * Notifications describing the whole change may be applied without a fetch, see \ref MRNotificationFastPath.
+ *
+ * All the work is done on one serial dispatch queue, which is also where the callbacks of the instances run.
+ * The hub lives as long as someone holds it, see \ref Acquire().
+ */
+class MRMediaRemoteHub : public MRSnapshotHub<NSDictionary*>::Source, public std::enable_shared_from_this<MRMediaRemoteHub> {
+public:
+
+    typedef MRSnapshotHub<NSDictionary*>::Callback Callback;
+
+    /**
+     * An instance receiving the now playing information.
+     */
+    class Subscriber : public MRSnapshotHub<NSDictionary*>::Subscriber {
+    public:
+        /// Take the `userInfo` of a change notification. Only called while observing.
+        virtual void applyNotification(NSDictionary* userInfo) = 0;
+
+        /// Take information which has not been fetched for this subscriber. Only called when attaching.
+        virtual void applyStaleSnapshot(NSDictionary* snapshot) = 0;
+    };
+
+    MRMediaRemoteSendCommandFunction MRMediaRemoteSendCommand;
+    MRMediaRemoteSetElapsedTimeFunction MRMediaRemoteSetElapsedTime;
+    MRMediaRemoteGetNowPlayingInfoFunction MRMediaRemoteGetNowPlayingInfo;
+    MRMediaRemoteRegisterForNowPlayingNotificationsFunction MRMediaRemoteRegisterForNowPlayingNotifications;
+    MRMediaRemoteUnregisterForNowPlayingNotificationsFunction MRMediaRemoteUnregisterForNowPlayingNotifications;
+
+    /**
+     * Get the hub of this process, creating it if nobody holds it.
+     *
+     * @return A reference to the hub. The hub is released with the last reference.
+     */
+    static std::shared_ptr<MRMediaRemoteHub> Acquire();
+
+    /**
+     * Set the file keeping the latest information between runs. Read when the hub is created, written after each fetch.
+     *
+     * @param path Path of the file. NULL to disable.
+     */
+    static void SetSnapshotCachePath(const char* path);
+
+    /**
+     * Enable or disable polling when the change notifications get lost. Disabled by default. Applies from the next start of observing.
+     */
+    static void SetPollingFallback(bool enabled);
+
+    /**
+     * Enable or disable the provisional snapshots of \ref speculate(). Disabled by default.
+     *
+     * @param timeout Seconds to wait for the system to settle a provisional snapshot before rolling it back.
+     */
+    static void SetOptimisticUpdates(bool enabled, double timeout);
+
+    /**
+     * Set how long the system has to answer a fetch before it is retried. Disabled by default.
+     * Applies to the hubs created afterwards.
+     *
+     * @param timeout Seconds, 3 being a reasonable value. 0 to never retry.
+     */
+    static void SetFetchDeadline(double timeout);
+
+    /**
+     * Enable or disable applying notifications without a fetch when they describe the whole change. Disabled by default.
+     * Applies to the hubs created afterwards.
+     */
+    static void SetNotificationFastPath(bool enabled);
+
+    ~MRMediaRemoteHub();
+
+    /**
+     * See \ref MRSnapshotHub::attach(). Blocks until done.
+     * The subscriber is given the latest information known at once, fetched for another subscriber or read from the snapshot cache.
+     */
+    uint64_t attach(Subscriber* subscriber);
+
+    /// See \ref MRSnapshotHub::detach(). Blocks until done, after which the subscriber is never called again.
+    void detach(uint64_t id);
+
+    /// See \ref MRSnapshotHub::observe(). Blocks until done.
+    int observe(uint64_t id, const Callback& callback);
+
+    /// See \ref MRSnapshotHub::unobserve(). Blocks until done.
+    int unobserve(uint64_t id);
+
+    /// See \ref MRSnapshotHub::isObserving(). Blocks until done.
+    bool isObserving(uint64_t id);
+
+    /// See \ref MRSnapshotHub::update(). Returns at once.
+    void update(uint64_t id, const Callback& callback);
+
+    /**
+     * Hand the observers the predicted result of a command sent to MediaRemote, marked provisional, if optimistic updates are enabled.
+     * The prediction is settled by the next fetches, or rolled back after the timeout. See \ref MROptimisticState. Returns at once.
+     */
+    void speculate(MROptimisticState::Action action, double position);
+
+    /**
+     * @return true if the snapshot handed to the subscribers now is a prediction of \ref speculate().
+     * Only call it on the queue of the hub, such as from Subscriber::applySnapshot().
+     */
+    bool isProvisional() const;
+
+    /// @return How the predictions of this hub turned out. Blocks until done.
+    MROptimisticStatistics getOptimisticStatistics();
+
+    /// @return How the fetches of this hub went. Blocks until done.
+    MRFetchStatistics getFetchStatistics();
+
+    /// @return How the notifications of this hub were handled. Blocks until done.
+    MRNotificationStatistics getNotificationStatistics();
+
+    // MRSnapshotHub::Source, called on the queue of the hub.
+    void startObserving();
+    void stopObserving();
+    void fetch(uint64_t sequence);
+
+private:
+
+    CFBundleRef _bundle;
+    dispatch_queue_t _queue;
+    MRNotificationObserver* _notificationObserver = 0;
+    MRSnapshotHub<NSDictionary*> _hub;
+    
+    std::unique_ptr<MRSnapshotStore> _snapshotStore;
+    NSDictionary* _cachedSnapshot = 0;
+
+    MRRefreshScheduler _refreshScheduler;
+    dispatch_source_t _refreshTimer = 0;
+
+    MROptimisticState _optimistic;
+
+    MRFetchWatchdog _watchdog;
+    dispatch_source_t _watchdogTimer = 0;
+
+    MRNotificationFastPath _fastPath;
+    dispatch_source_t _fastPathTimer = 0;
+    int _snapshotProcessIdentifier = 0;     // PID of the application the latest snapshot came from, 0 if unknown.
+
+    MRMediaRemoteHub();
+
+    // Run `block` on the queue and wait for it. Runs it directly if already on the queue, so callbacks may call back in.
+    void perform(void (^block)(void));
+
+    void onNotification(NSDictionary* userInfo, double receivedAt);
+
+    // Arm the refresh timer for the next poll of the scheduler.
+    void scheduleRefresh();
+    void onRefreshTimer();
+
+    // Settle the pending prediction against a fetched snapshot about to be applied. Returns true if settled.
+    bool settleSpeculation(const MRNowPlayingSnapshot& snapshot);
+    void expireSpeculation();
+
+    // Start retrying the fetches not answered within `timeout`.
+    void startWatchdog(double timeout);
+    // Arm the watchdog timer for the next deadline of the watchdog.
+    void scheduleWatchdog();
+    void onWatchdogTimer();
+
+    // Set the notification fast path up, with a timer for its deferred fetches if enabled.
+    void startFastPath(bool enabled);
+    // Apply a notification without a fetch if it describes the whole change. Returns true if applied.
+    bool applyNotificationFast(const MRNotificationPayload& payload, double receivedAt);
+    void scheduleFastPath();
+    void onFastPathTimer();
+};
+
+};
+
+#endif /* MRMediaRemoteHub_h */
@@ -0,0 +1,429 @@
+#import "MRMediaRemoteHub.h"
+#import "MRNotificationObserver.h"
+#import "MRSnapshotDictionary.h"
+#import "MRSnapshotStore.h"
+#import "MRTrace.h"
+#import "typedefs.h"
+#import <Foundation/Foundation.h>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace NowPlaying {
+
+static char kMRMediaRemoteHubQueueKey;
+
+static std::mutex sharedHubLock;
+static std::string snapshotCachePath;
+static bool pollingFallback = false;
+static bool optimisticUpdates = false;
+static double optimisticTimeout = 2.0;
+static double fetchDeadline = 0.0;
+static bool notificationFastPath = false;
+
+static double currentTime() {
+    return [[NSDate date] timeIntervalSince1970];
+}
+
+void MRMediaRemoteHub::SetSnapshotCachePath(const char* path) {
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    snapshotCachePath = path ? path : "";
+}
+
+void MRMediaRemoteHub::SetPollingFallback(bool enabled) {
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    pollingFallback = enabled;
+}
+
+void MRMediaRemoteHub::SetOptimisticUpdates(bool enabled, double timeout) {
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    optimisticUpdates = enabled;
+    optimisticTimeout = timeout;
+}
+
+void MRMediaRemoteHub::SetFetchDeadline(double timeout) {
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    fetchDeadline = timeout;
+}
+
+void MRMediaRemoteHub::SetNotificationFastPath(bool enabled) {
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    notificationFastPath = enabled;
+}
+
+std::shared_ptr<MRMediaRemoteHub> MRMediaRemoteHub::Acquire() {
+    static std::weak_ptr<MRMediaRemoteHub> sharedHub;
+
+    std::lock_guard<std::mutex> lock(sharedHubLock);
+    std::shared_ptr<MRMediaRemoteHub> hub = sharedHub.lock();
+    if(!hub) {
+        hub.reset(new MRMediaRemoteHub);
+        if(!snapshotCachePath.empty()) {
+            hub->_snapshotStore.reset(new MRSnapshotStore(snapshotCachePath));
+            MRNowPlayingSnapshot snapshot;
+            if(hub->_snapshotStore->load(snapshot) == 0) hub->_cachedSnapshot = MRSnapshotToDictionary(snapshot);
+        }
+        if(fetchDeadline > 0) hub->startWatchdog(fetchDeadline);
+        hub->startFastPath(notificationFastPath);
+        sharedHub = hub;
+    }
+    return hub;
+}
+
+MRMediaRemoteHub::MRMediaRemoteHub() : _hub(this) {
+    // Load MediaRemote.framework
+    CFURLRef ref = (__bridge CFURLRef) [NSURL fileURLWithPath:@"/System/Library/PrivateFrameworks/MediaRemote.framework"];
+    _bundle = CFBundleCreate(kCFAllocatorDefault, ref);
+
+    MRMediaRemoteSendCommand = (MRMediaRemoteSendCommandFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteSendCommand"));
+    MRMediaRemoteSetElapsedTime = (MRMediaRemoteSetElapsedTimeFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteSetElapsedTime"));
+    MRMediaRemoteGetNowPlayingInfo = (MRMediaRemoteGetNowPlayingInfoFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteGetNowPlayingInfo"));
+    MRMediaRemoteRegisterForNowPlayingNotifications = (MRMediaRemoteRegisterForNowPlayingNotificationsFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteRegisterForNowPlayingNotifications"));
+    MRMediaRemoteUnregisterForNowPlayingNotifications = (MRMediaRemoteUnregisterForNowPlayingNotificationsFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteUnregisterForNowPlayingNotifications"));
+
+    _queue = dispatch_queue_create("libnowplaying.MRMediaRemoteHub", DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_set_specific(_queue, &kMRMediaRemoteHubQueueKey, this, NULL);
+}
+
+MRMediaRemoteHub::~MRMediaRemoteHub() {
+    _notificationObserver = 0;
+    if (_refreshTimer) {
+        dispatch_source_cancel(_refreshTimer);
+    }
+    if (_watchdogTimer) {
+        dispatch_source_cancel(_watchdogTimer);
+    }
+    if (_fastPathTimer) {
+        dispatch_source_cancel(_fastPathTimer);
+    }
+    if (_bundle) {
+        CFRelease(_bundle);
+    }
+}
+
+void MRMediaRemoteHub::perform(void (^block)(void)) {
+    if(dispatch_get_specific(&kMRMediaRemoteHubQueueKey) == this) block();
+    else dispatch_sync(_queue, block);
+}
+
+uint64_t MRMediaRemoteHub::attach(Subscriber* subscriber) {
+    __block uint64_t ret = 0;
+    perform(^{
+        ret = _hub.attach(subscriber);
+        if(_hub.hasLatest()) subscriber->applyStaleSnapshot(_hub.getLatest());
+        else if(_cachedSnapshot) subscriber->applyStaleSnapshot(_cachedSnapshot);
+    });
+    return ret;
+}
+
+void MRMediaRemoteHub::detach(uint64_t id) {
+    perform(^{
+        _hub.detach(id);
+    });
+}
+
+int MRMediaRemoteHub::observe(uint64_t id, const Callback& callback) {
+    __block int ret = -1;
+    perform(^{
+        ret = _hub.observe(id, callback);
+    });
+    return ret;
+}
+
+int MRMediaRemoteHub::unobserve(uint64_t id) {
+    __block int ret = -1;
+    perform(^{
+        ret = _hub.unobserve(id);
+    });
+    return ret;
+}
+
+bool MRMediaRemoteHub::isObserving(uint64_t id) {
+    __block bool ret = false;
+    perform(^{
+        ret = _hub.isObserving(id);
+    });
+    return ret;
+}
+
+void MRMediaRemoteHub::update(uint64_t id, const Callback& callback) {
+    std::shared_ptr<MRMediaRemoteHub> hub = shared_from_this();
+    dispatch_async(_queue, ^{
+        hub->_hub.update(id, callback);
+    });
+}
+
+void MRMediaRemoteHub::startObserving() {
+    std::weak_ptr<MRMediaRemoteHub> weakHub = shared_from_this();
+    _notificationObserver = [[MRNotificationObserver alloc] initWithRegisterFunction:MRMediaRemoteRegisterForNowPlayingNotifications
+                                                                  unregisterFunction:MRMediaRemoteUnregisterForNowPlayingNotifications
+                                                                            callback:^(NSString *notificationName, NSDictionary * userInfo) {
+        if(![notificationName isEqualToString:@"kMRMediaRemoteNowPlayingInfoDidChangeNotification"]) return;
+        double receivedAt = currentTime();
+        std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+        if(hub) hub->onNotification(userInfo, receivedAt);
+    }];
+
+    bool polling;
+    {
+        std::lock_guard<std::mutex> lock(sharedHubLock);
+        polling = pollingFallback;
+    }
+    if(!polling) return;
+    _refreshScheduler = MRRefreshScheduler();
+    if(_hub.hasLatest()) _refreshScheduler.snapshotFetched(MRSnapshotFromDictionary(_hub.getLatest()), currentTime());
+    _refreshTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    dispatch_source_set_event_handler(_refreshTimer, ^{
+        std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+        if(hub) hub->onRefreshTimer();
+    });
+    scheduleRefresh();
+    dispatch_resume(_refreshTimer);
+}
+
+void MRMediaRemoteHub::stopObserving() {
+    _notificationObserver = 0;
+    if(_refreshTimer) {
+        dispatch_source_cancel(_refreshTimer);
+        _refreshTimer = 0;
+    }
+}
+
+void MRMediaRemoteHub::fetch(uint64_t sequence) {
+    std::shared_ptr<MRMediaRemoteHub> hub = shared_from_this();
+    MR_TRACE_ASYNC_BEGIN("MRMediaRemoteHub", "MRMediaRemoteGetNowPlayingInfo", sequence);
+    _watchdog.fetchIssued(sequence, currentTime());
+    if(_watchdogTimer) scheduleWatchdog();
+    _fastPath.fetchIssued();
+    if(_fastPathTimer) scheduleFastPath();
+    MRMediaRemoteGetNowPlayingInfo(_queue, ^(NSDictionary* information) {
+        MR_TRACE_ASYNC_END("MRMediaRemoteHub", "MRMediaRemoteGetNowPlayingInfo", sequence);
+        MR_TRACE_SPAN("MRMediaRemoteHub", "fetch reply");
+        hub->_watchdog.replyReceived(sequence, currentTime());
+        if(hub->_watchdogTimer) hub->scheduleWatchdog();
+        // Copied once here, then shared by every subscriber.
+        NSDictionary* snapshot = nil;
+        if(information) {
+            MR_TRACE_SPAN("MRMediaRemoteHub", "copy");
+            snapshot = [information copy];
+        }
+        if(!hub->_hub.accepts(sequence)) {
+            hub->_hub.deliver(sequence, snapshot);
+            return;
+        }
+        bool convert = hub->_snapshotStore || hub->_refreshTimer || hub->_optimistic.isPending();
+        MRNowPlayingSnapshot converted;
+        if(convert) converted = MRSnapshotFromDictionary(snapshot);
+
+        bool settled = hub->settleSpeculation(converted);
+        uint64_t fanOuts = hub->_hub.getFanOutCount();
+        hub->_hub.deliver(sequence, snapshot);
+        // The observers were shown the prediction: show them how it was settled, unless this fetch already did.
+        if(settled && hub->_hub.getFanOutCount() == fanOuts) hub->_hub.publish();
+
+        if(hub->_snapshotStore) hub->_snapshotStore->save(converted);
+        if(hub->_refreshTimer) {
+            hub->_refreshScheduler.snapshotFetched(converted, currentTime());
+            hub->scheduleRefresh();
+        }
+    });
+}
+
+void MRMediaRemoteHub::onNotification(NSDictionary* userInfo, double receivedAt) {
+    std::shared_ptr<MRMediaRemoteHub> hub = shared_from_this();
+    dispatch_async(_queue, ^{
+        MR_TRACE_SPAN("MRMediaRemoteHub", "onNotification");
+        if(hub->_refreshTimer) hub->_refreshScheduler.notificationReceived(currentTime());
+        hub->_hub.forEachObserver([userInfo](MRSnapshotHub<NSDictionary*>::Subscriber* subscriber) {
+            static_cast<Subscriber*>(subscriber)->applyNotification(userInfo);
+        });
+        MRNotificationPayload payload;
+        if(hub->_fastPath.isEnabled()) {
+            MR_TRACE_SPAN("MRMediaRemoteHub", "read notification");
+            payload = MRNotificationPayloadFromUserInfo(userInfo);
+        }
+        if(hub->applyNotificationFast(payload, receivedAt)) return;
+        // The snapshot fetched for this notification comes from the application it names.
+        int processIdentifier = payload.processIdentifier;
+        std::weak_ptr<MRMediaRemoteHub> weakHub = hub;
+        hub->_hub.notify([weakHub, processIdentifier]() {
+            std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+            if(!hub) return;
+            hub->_snapshotProcessIdentifier = processIdentifier;
+            hub->_fastPath.delivered(currentTime());
+        });
+    });
+}
+
+bool MRMediaRemoteHub::applyNotificationFast(const MRNotificationPayload& payload, double receivedAt) {
+    // A fetch in flight may answer with what the system had before the change, and a prediction is only settled by fetches.
+    bool canApply = _fastPath.isEnabled() && _hub.hasLatest() && !_hub.isFetching() && !_optimistic.isPending();
+    MRNowPlayingSnapshot current;
+    if(canApply) current = MRSnapshotFromDictionary(_hub.getLatest());
+    MRNowPlayingSnapshot updated;
+    if(_fastPath.notificationReceived(current, _snapshotProcessIdentifier, canApply, payload, receivedAt, updated) != MRNotificationFastPath::kDecisionApply) return false;
+
+    _hub.amend(MRDictionaryWithPlayback(_hub.getLatest(), updated));
+    _fastPath.delivered(currentTime());
+    if(_snapshotStore) _snapshotStore->save(updated);
+    if(_refreshTimer) {
+        _refreshScheduler.snapshotFetched(updated, currentTime());
+        scheduleRefresh();
+    }
+    scheduleFastPath();
+    return true;
+}
+
+void MRMediaRemoteHub::scheduleRefresh() {
+    double now = currentTime();
+    double delay = std::max(_refreshScheduler.nextPoll(now) - now, 0.0);
+    // Let the system coalesce the wakeup with others, within a tenth of the delay (at most a second).
+    double leeway = std::min(delay / 10, 1.0);
+    dispatch_source_set_timer(_refreshTimer, dispatch_walltime(NULL, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, (uint64_t)(leeway * NSEC_PER_SEC));
+}
+
+void MRMediaRemoteHub::speculate(MROptimisticState::Action action, double position) {
+    double timeout;
+    {
+        std::lock_guard<std::mutex> lock(sharedHubLock);
+        if(!optimisticUpdates) return;
+        timeout = optimisticTimeout;
+    }
+    double now = currentTime();
+    std::weak_ptr<MRMediaRemoteHub> weakHub = shared_from_this();
+    dispatch_async(_queue, ^{
+        std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+        if(!hub) return;
+        NSDictionary* current = hub->_hub.current();
+        MRNowPlayingSnapshot provisional;
+        hub->_optimistic.setTimeout(timeout);
+        if(hub->_optimistic.speculate(MRSnapshotFromDictionary(current), action, position, now, provisional) != 0) return;
+        hub->_hub.setOverlay(MRDictionaryWithPlayback(current, provisional));
+        hub->_hub.publish();
+        dispatch_after(dispatch_walltime(NULL, (int64_t)(timeout * NSEC_PER_SEC)), hub->_queue, ^{
+            std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+            if(hub) hub->expireSpeculation();
+        });
+    });
+}
+
+bool MRMediaRemoteHub::isProvisional() const {
+    // Only predictions are overlaid.
+    return _hub.hasOverlay();
+}
+
+MROptimisticStatistics MRMediaRemoteHub::getOptimisticStatistics() {
+    __block MROptimisticStatistics ret;
+    perform(^{
+        ret = _optimistic.getStatistics();
+    });
+    return ret;
+}
+
+MRFetchStatistics MRMediaRemoteHub::getFetchStatistics() {
+    __block MRFetchStatistics ret;
+    perform(^{
+        ret = _watchdog.getStatistics();
+    });
+    return ret;
+}
+
+MRNotificationStatistics MRMediaRemoteHub::getNotificationStatistics() {
+    __block MRNotificationStatistics ret;
+    perform(^{
+        ret = _fastPath.getStatistics();
+    });
+    return ret;
+}
+
+bool MRMediaRemoteHub::settleSpeculation(const MRNowPlayingSnapshot& snapshot) {
+    if(!_optimistic.isPending()) return false;
+    if(_optimistic.reconcile(snapshot, currentTime()) == MROptimisticState::kOutcomePending) return false;
+    _hub.clearOverlay();
+    return true;
+}
+
+void MRMediaRemoteHub::expireSpeculation() {
+    if(!_optimistic.expire(currentTime())) return;
+    // Roll back to what the system says now.
+    _hub.clearOverlay();
+    _hub.notify();
+}
+
+void MRMediaRemoteHub::onRefreshTimer() {
+    if(!_refreshTimer) return;
+    _refreshScheduler.pollIssued(currentTime());
+    // Most polls find nothing new: leave the observers alone then.
+    _hub.poll([](NSDictionary* before, NSDictionary* after) {
+        return before == after || [before isEqualToDictionary:after];
+    });
+    scheduleRefresh();
+}
+
+void MRMediaRemoteHub::startWatchdog(double timeout) {
+    MRFetchWatchdogConfig config;
+    config.timeout = timeout;
+    config.seed = arc4random();
+    _watchdog = MRFetchWatchdog(config);
+
+    std::weak_ptr<MRMediaRemoteHub> weakHub = shared_from_this();
+    _watchdogTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    dispatch_source_set_event_handler(_watchdogTimer, ^{
+        std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+        if(hub) hub->onWatchdogTimer();
+    });
+    dispatch_source_set_timer(_watchdogTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_watchdogTimer);
+}
+
+void MRMediaRemoteHub::scheduleWatchdog() {
+    double deadline = _watchdog.nextDeadline();
+    if(deadline == HUGE_VAL) {
+        dispatch_source_set_timer(_watchdogTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    double delay = std::max(deadline - currentTime(), 0.0);
+    dispatch_source_set_timer(_watchdogTimer, dispatch_walltime(NULL, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, (uint64_t)(0.05 * NSEC_PER_SEC));
+}
+
+void MRMediaRemoteHub::onWatchdogTimer() {
+    MR_TRACE_SPAN("MRMediaRemoteHub", "onWatchdogTimer");
+    // Retrying issues a fetch, which arms the timer again.
+    if(_watchdog.advance(currentTime())) _hub.retry();
+    else scheduleWatchdog();
+}
+
+void MRMediaRemoteHub::startFastPath(bool enabled) {
+    MRNotificationFastPathConfig config;
+    config.enabled = enabled;
+    _fastPath = MRNotificationFastPath(config);
+    if(!enabled) return;
+
+    std::weak_ptr<MRMediaRemoteHub> weakHub = shared_from_this();
+    _fastPathTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    dispatch_source_set_event_handler(_fastPathTimer, ^{
+        std::shared_ptr<MRMediaRemoteHub> hub = weakHub.lock();
+        if(hub) hub->onFastPathTimer();
+    });
+    dispatch_source_set_timer(_fastPathTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_fastPathTimer);
+}
+
+void MRMediaRemoteHub::scheduleFastPath() {
+    double deadline = _fastPath.nextDeadline();
+    if(deadline == HUGE_VAL) {
+        dispatch_source_set_timer(_fastPathTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    double delay = std::max(deadline - currentTime(), 0.0);
+    // Only a check, so let the system coalesce it with other wakeups.
+    dispatch_source_set_timer(_fastPathTimer, dispatch_walltime(NULL, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, (uint64_t)(0.25 * NSEC_PER_SEC));
+}
+
+void MRMediaRemoteHub::onFastPathTimer() {
+    // The fetch cancels the deferred one and arms the timer again.
+    if(_fastPath.advance(currentTime())) _hub.notify();
+    else scheduleFastPath();
+}
+
+};
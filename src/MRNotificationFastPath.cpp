@@ -0,0 +1,73 @@
+#include "MRNotificationFastPath.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+MRNotificationFastPath::MRNotificationFastPath(const MRNotificationFastPathConfig& config) : _config(config), _fetchAt(HUGE_VAL),
+                                                                                            _appliedDelivered(0), _fetchedDelivered(0) {
+}
+
+MRNotificationFastPath::Decision MRNotificationFastPath::notificationReceived(const MRNowPlayingSnapshot& current, int processIdentifier, bool canApply, const MRNotificationPayload& payload,
+                                                                              double now, MRNowPlayingSnapshot& updated) {
+    _statistics.notifications++;
+    // Another application playing is another track, even when the notification names none.
+    bool apply = _config.enabled && canApply && current.hasInfo && !current.stale && !payload.hasOtherInfo &&
+                 payload.processIdentifier == processIdentifier &&
+                 (payload.hasPlaybackRate || payload.hasIsPlaying || payload.hasElapsedTime) &&
+                 (payload.contentItemIdentifier.empty() || payload.contentItemIdentifier == current.contentItemIdentifier);
+    _waiting.push_back(std::make_pair(now, apply));
+    if(!apply) return kDecisionFetch;
+
+    updated = current;
+    updated.provisional = false;
+    // Re-anchor the clock at the moment of the change.
+    double timestamp = payload.timestamp > 0 ? payload.timestamp : now;
+    updated.elapsedTime = payload.hasElapsedTime ? payload.elapsedTime : current.elapsedTimeAt(timestamp);
+    updated.timestamp = timestamp;
+    if(payload.hasPlaybackRate) updated.playbackRate = payload.playbackRate;
+    else if(payload.hasIsPlaying) updated.playbackRate = payload.isPlaying ? (current.playbackRate > 0 ? current.playbackRate : 1.0) : 0.0;
+
+    _statistics.applied++;
+    _statistics.fetchesAvoided = _statistics.applied - _statistics.deferredFetches;
+    if(_fetchAt == HUGE_VAL && _config.confirmDelay >= 0) _fetchAt = now + _config.confirmDelay;
+    return kDecisionApply;
+}
+
+void MRNotificationFastPath::delivered(double now) {
+    for(size_t i = 0; i < _waiting.size(); i++) {
+        double latency = std::max(now - _waiting[i].first, 0.0);
+        double& mean = _waiting[i].second ? _statistics.meanAppliedLatency : _statistics.meanFetchedLatency;
+        uint64_t& count = _waiting[i].second ? _appliedDelivered : _fetchedDelivered;
+        count++;
+        mean += (latency - mean) / count;
+        _statistics.maxLatency = std::max(_statistics.maxLatency, latency);
+    }
+    _waiting.clear();
+}
+
+void MRNotificationFastPath::fetchIssued() {
+    _fetchAt = HUGE_VAL;
+}
+
+bool MRNotificationFastPath::advance(double now) {
+    if(now < _fetchAt) return false;
+    _fetchAt = HUGE_VAL;
+    _statistics.deferredFetches++;
+    _statistics.fetchesAvoided = _statistics.applied - _statistics.deferredFetches;
+    return true;
+}
+
+double MRNotificationFastPath::nextDeadline() const {
+    return _fetchAt;
+}
+
+bool MRNotificationFastPath::isEnabled() const {
+    return _config.enabled;
+}
+
+const MRNotificationStatistics& MRNotificationFastPath::getStatistics() const {
+    return _statistics;
+}
+
+};
@@ -0,0 +1,112 @@
+#ifndef MRNotificationFastPath_h
+#define MRNotificationFastPath_h
+
+#include "nowplaying-snapshot.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * What a change notification of the system says about the media, from its `userInfo`.
+ */
+struct MRNotificationPayload {
+    bool hasPlaybackRate;
+    double playbackRate;
+    bool hasIsPlaying;
+    bool isPlaying;
+    bool hasElapsedTime;
+    double elapsedTime;
+    double timestamp;                   /*!< UNIX time (with fraction) the playback fields are at. 0 if not carried. */
+    std::string contentItemIdentifier;  /*!< Empty if not carried. */
+    int processIdentifier;              /*!< PID of the application now playing. 0 if not carried. */
+    bool hasOtherInfo;                  /*!< Carries anything else (metadata, artwork, unknown keys), which only a fetch applies. */
+
+    MRNotificationPayload() : hasPlaybackRate(false), playbackRate(0.0), hasIsPlaying(false), isPlaying(false),
+                              hasElapsedTime(false), elapsedTime(0.0), timestamp(0.0), processIdentifier(0), hasOtherInfo(false) {}
+};
+
+/**
+ * The settings of MRNotificationFastPath.
+ */
+struct MRNotificationFastPathConfig {
+    bool enabled;               /*!< Apply notifications at all. Disabled, every notification is fetched, and only the latencies are measured. */
+    double confirmDelay;        /*!< Seconds after applying a notification to fetch anyway, in case it missed something. Negative to never fetch. */
+
+    MRNotificationFastPathConfig() : enabled(true), confirmDelay(10.0) {}
+};
+
+/**
+ * Applies the change notifications which describe the whole change, such as a pause or a seek, without fetching the information.
+ *
+ * A notification carrying only the playback status (rate, elapsed time, timestamp) of the track shown now is applied
+ * to the latest snapshot at once. Anything else, or a notification naming another track or coming from another application, needs a fetch.
+ * A fetch is still issued `confirmDelay` after applying a notification, unless another one came meanwhile;
+ * all the notifications applied in between share it.
+ *
+ * Also measures the time from each notification to the callbacks, see \ref delivered().
+ *
+ * MRMediaRemoteHub asks it about each notification on its queue, before fetching, and issues the deferred fetch from its own timer.
+ */
+class MRNotificationFastPath {
+public:
+
+    typedef enum {
+        kDecisionApply,         // Hand the updated snapshot out, without fetching.
+        kDecisionFetch
+    } Decision;
+
+    explicit MRNotificationFastPath(const MRNotificationFastPathConfig& config = MRNotificationFastPathConfig());
+
+    /**
+     * Decide how to handle a change notification.
+     *
+     * @param current The latest snapshot from the system.
+     * @param processIdentifier PID of the application `current` came from, 0 if unknown.
+     *                          A notification is only applied if it carries the same PID, or none when unknown.
+     * @param canApply false if `current` must not be amended: a fetch in flight may answer with what the system had before the change,
+     *                 or a prediction is pending.
+     * @param payload What the notification says.
+     * @param updated Receives `current` with the change applied, for kDecisionApply.
+     */
+    Decision notificationReceived(const MRNowPlayingSnapshot& current, int processIdentifier, bool canApply, const MRNotificationPayload& payload, double now,
+                                  MRNowPlayingSnapshot& updated);
+
+    /// Record that the callbacks ran for every notification received until now.
+    void delivered(double now);
+
+    /// Record that a fetch was issued, whatever the reason. It makes the pending deferred fetch useless.
+    void fetchIssued();
+
+    /**
+     * Check whether the deferred fetch is due.
+     *
+     * @return true if a fetch should be issued now.
+     */
+    bool advance(double now);
+
+    /// @return The UNIX time of the deferred fetch, HUGE_VAL if none.
+    double nextDeadline() const;
+
+    /// @return true if notifications are applied.
+    bool isEnabled() const;
+
+    const MRNotificationStatistics& getStatistics() const;
+
+private:
+
+    MRNotificationFastPathConfig _config;
+    double _fetchAt;
+
+    // Notifications whose callbacks have not run yet: when received, and whether applied.
+    std::vector<std::pair<double, bool>> _waiting;
+
+    MRNotificationStatistics _statistics;
+    uint64_t _appliedDelivered;
+    uint64_t _fetchedDelivered;
+};
+
+};
+
+#endif /* MRNotificationFastPath_h */
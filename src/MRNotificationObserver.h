@@ -5,14 +5,15 @@
 #import "typedefs.h"
 
 @interface MRNotificationObserver : NSObject {
-    CFBundleRef bundle;
     NowPlaying::MRMediaRemoteRegisterForNowPlayingNotificationsFunction MRMediaRemoteRegisterForNowPlayingNotifications;
     NowPlaying::MRMediaRemoteUnregisterForNowPlayingNotificationsFunction MRMediaRemoteUnregisterForNowPlayingNotifications;
 }
 
 @property (nonatomic, copy) void (^ _Nullable callback)(NSString * _Nullable notificationName, NSDictionary * _Nullable userInfo);
 
-- (instancetype _Nullable )initWithCallback:(void (^_Nullable)(NSString * _Nullable notificationName, NSDictionary * _Nullable userInfo))callback;
+- (instancetype _Nullable )initWithRegisterFunction:(NowPlaying::MRMediaRemoteRegisterForNowPlayingNotificationsFunction _Nonnull)registerFunction
+                                 unregisterFunction:(NowPlaying::MRMediaRemoteUnregisterForNowPlayingNotificationsFunction _Nonnull)unregisterFunction
+                                           callback:(void (^_Nullable)(NSString * _Nullable notificationName, NSDictionary * _Nullable userInfo))callback;
 - (void)startObserving;
 - (void)stopObserving;
 
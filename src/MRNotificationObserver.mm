@@ -1,22 +1,22 @@
 #import "MRNotificationObserver.h"
+#import "MRTrace.h"
 #import <Foundation/Foundation.h>
 
 @implementation MRNotificationObserver
 
-- (instancetype)initWithCallback:(void (^)(NSString *notificationName, NSDictionary * userInfo))callback {
+- (instancetype)initWithRegisterFunction:(NowPlaying::MRMediaRemoteRegisterForNowPlayingNotificationsFunction)registerFunction
+                     unregisterFunction:(NowPlaying::MRMediaRemoteUnregisterForNowPlayingNotificationsFunction)unregisterFunction
+                               callback:(void (^)(NSString *notificationName, NSDictionary * userInfo))callback {
     self = [super init];
     _callback = [callback copy];
-    CFURLRef ref = (__bridge CFURLRef) [NSURL fileURLWithPath:@"/System/Library/PrivateFrameworks/MediaRemote.framework"];
-    bundle = CFBundleCreate(kCFAllocatorDefault, ref);
-    MRMediaRemoteRegisterForNowPlayingNotifications = (NowPlaying::MRMediaRemoteRegisterForNowPlayingNotificationsFunction) CFBundleGetFunctionPointerForName(bundle, CFSTR("MRMediaRemoteRegisterForNowPlayingNotifications"));
-    MRMediaRemoteUnregisterForNowPlayingNotifications = (NowPlaying::MRMediaRemoteUnregisterForNowPlayingNotificationsFunction) CFBundleGetFunctionPointerForName(bundle, CFSTR("MRMediaRemoteUnregisterForNowPlayingNotifications"));
+    MRMediaRemoteRegisterForNowPlayingNotifications = registerFunction;
+    MRMediaRemoteUnregisterForNowPlayingNotifications = unregisterFunction;
     [self startObserving];
     return self;
 }
 
 - (void)dealloc {
     [self stopObserving];
-    if(bundle) CFRelease(bundle);
 }
 
 - (void)startObserving {
@@ -35,6 +35,7 @@
 }
 
 - (void)onChange:(NSNotification *)notification {
+    MR_TRACE_SPAN("MRNotificationObserver", "onChange:");
     self.callback(notification.name, notification.userInfo);
 }
 
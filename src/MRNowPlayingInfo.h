@@ -4,7 +4,9 @@
 #import <Foundation/Foundation.h>
 #import "nowplaying.h"
 #import "typedefs.h"
-#import "MRNotificationObserver.h"
+#import "MRMediaRemoteHub.h"
+#import "MRSnapshotHistory.h"
+#include <memory>
 
 namespace NowPlaying {
 
@@ -23,15 +25,21 @@ namespace NowPlaying {
  *
  * Please be careful with C style data. Most of the getters return a copy of real data, so you have to free them manually.
  */
-class MRNowPlayingInfo : public MRNowPlayingInfoInterface {
+class MRNowPlayingInfo : public MRNowPlayingInfoInterface, public MRMediaRemoteHub::Subscriber {
 private:
     
-    CFBundleRef _bundle;
-    MRMediaRemoteGetNowPlayingInfoFunction MRMediaRemoteGetNowPlayingInfo;
-    MRNotificationObserver* notificationObserver = 0;
+    // Shared by all instances. Fetches are issued and their replies applied on its serial queue, in order.
+    std::shared_ptr<MRMediaRemoteHub> _hub;
+    uint64_t _subscriberId;
     
     NSDictionary* _data;
+    bool _stale = false;
+    bool _provisional = false;      // Kept beside the dictionary, which only holds what MediaRemote sent.
     NSLock* _dataLock = [[NSLock alloc] init];
+    void lockData();
+    
+    // Written on the queue of the hub only, read from anywhere without locking. Null if disabled.
+    std::unique_ptr<MRSnapshotHistory> _history;
     
     struct {
         NSString* displayName = @"";
@@ -40,6 +48,11 @@ private:
     NSLock* _clientAppInfoLock = [[NSLock alloc] init];
     void updateClientAppInfo(NSDictionary* userInfo);
     
+    // MRMediaRemoteHub::Subscriber
+    void applySnapshot(NSDictionary* const& snapshot);
+    void applyStaleSnapshot(NSDictionary* snapshot);
+    void applyNotification(NSDictionary* userInfo);
+    
 public:
     
     MRNowPlayingInfo();
@@ -66,8 +79,9 @@ public:
      * @note
      * This method communicates asynchronously with the system API.
      * You may need to wait for the system to send back updated information after calling this method.
-     * Your `callback` function will be executed in the system global dispatch queue (in brief, another thread hosted by system).
+     * Your `callback` function will be executed in the serial dispatch queue shared by all instances (in brief, another thread hosted by system).
      * Therefore, you program may need an event loop like [NSApp run].
+     * If a fetch is already in progress (for any instance), this call joins it and `callback` runs when it completes.
      */
     void update(void (*callback)(MRNowPlayingInfoInterface*));
     
@@ -84,7 +98,7 @@ public:
      * and call `callback` after each update.
      * Each MRNowPlayingInfo instance can only register once. Calling this method again after registeration will cause error.
      *
-     * @param callback The callback function to run after each update. It will be executed in the system dispatch queue.
+     * @param callback The callback function to run after each update. It will be executed in the serial dispatch queue shared by all instances.
      * @return 0 for success, -1 for already registered.
      */
     int registerAutoUpdate(void (*callback)(MRNowPlayingInfoInterface*));
@@ -110,6 +124,59 @@ public:
      */
     bool hasInfo();
     
+    /**
+     * Get to know whether the information is stale or not.
+     * Stale information was served when this instance was created (see \ref SetSnapshotCache()),
+     * and has not been replaced by an update from the system yet.
+     *
+     * @note While stale, the artwork data is not available. Its identifier, MIME type and size are.
+     * @return true for stale information, false for information received from the system.
+     */
+    bool isStale();
+    
+    /**
+     * Get to know whether the information is provisional or not.
+     * Provisional information is what a command of MRCommander is expected to result in (see MRCommanderInterface::SetOptimisticUpdates()),
+     * and has not been confirmed or contradicted by the system yet.
+     *
+     * @return true for provisional information, false for information received from the system.
+     */
+    bool isProvisional();
+    
+    /**
+     * Get all the information at once, in plain C++ types.
+     * Cheaper than calling each getter, and consistent: all fields come from the same update.
+     *
+     * @return A copy of the information. `hasInfo` is false if no info.
+     */
+    MRNowPlayingSnapshot getSnapshot();
+    
+    /**
+     * Get the version of the information, see \ref SetHistoryCapacity().
+     *
+     * @return The latest version. 0 if the history is disabled or nothing was applied yet.
+     */
+    uint64_t getVersion();
+    
+    /**
+     * Get one version of the information, see \ref SetHistoryCapacity(). Never blocks.
+     *
+     * @param version The version to get.
+     * @param snapshot Receives the information.
+     * @return 0 for success, -1 if the version is not kept (too old, not applied yet, or the history is disabled).
+     */
+    int getSnapshotAt(uint64_t version, MRNowPlayingSnapshot* snapshot);
+    
+    /**
+     * Get the versions newer than one, oldest first, see \ref SetHistoryCapacity(). Never blocks.
+     * Versions no longer kept are skipped, so a gap in the versions returned means some were missed.
+     *
+     * @param version The latest version already seen. 0 for all the versions kept.
+     * @param snapshots Receives the versions, appended.
+     * @return The number of versions appended.
+     */
+    size_t getSnapshotsSince(uint64_t version, std::vector<MRVersionedSnapshot>* snapshots);
+    
     /**
      * Get the information in raw NSDictionary format.
      *
@@ -1,11 +1,16 @@
 #import "nowplaying.h"
 #import "MRNowPlayingInfo.h"
-#import "MRNotificationObserver.h"
+#import "MRMediaRemoteHub.h"
+#import "MRSnapshotDictionary.h"
+#import "MRTrace.h"
 #import "typedefs.h"
 #import <Foundation/Foundation.h>
+#include <atomic>
 
 namespace NowPlaying {
 
+static std::atomic<size_t> historyCapacity(0);
+
 MRNowPlayingInfoInterface* MRNowPlayingInfoInterface::Create() {
     return new MRNowPlayingInfo;
 }
@@ -15,21 +20,45 @@ void MRNowPlayingInfoInterface::Delete(MRNowPlayingInfoInterface* instance) {
     instance = 0;
 }
 
+void MRNowPlayingInfoInterface::SetSnapshotCache(const char* path) {
+    MRMediaRemoteHub::SetSnapshotCachePath(path);
+}
+
+void MRNowPlayingInfoInterface::SetPollingFallback(bool enabled) {
+    MRMediaRemoteHub::SetPollingFallback(enabled);
+}
+
+void MRNowPlayingInfoInterface::SetHistoryCapacity(size_t capacity) {
+    historyCapacity = capacity;
+}
+
+void MRNowPlayingInfoInterface::SetFetchDeadline(double timeout) {
+    MRMediaRemoteHub::SetFetchDeadline(timeout);
+}
+
+MRFetchStatistics MRNowPlayingInfoInterface::GetFetchStatistics() {
+    return MRMediaRemoteHub::Acquire()->getFetchStatistics();
+}
+
+void MRNowPlayingInfoInterface::SetNotificationFastPath(bool enabled) {
+    MRMediaRemoteHub::SetNotificationFastPath(enabled);
+}
+
+MRNotificationStatistics MRNowPlayingInfoInterface::GetNotificationStatistics() {
+    return MRMediaRemoteHub::Acquire()->getNotificationStatistics();
+}
+
 MRNowPlayingInfo::MRNowPlayingInfo() {
-    // Load MediaRemote.framework
-    CFURLRef ref = (__bridge CFURLRef) [NSURL fileURLWithPath:@"/System/Library/PrivateFrameworks/MediaRemote.framework"];
-    _bundle = CFBundleCreate(kCFAllocatorDefault, ref);
-    
-    MRMediaRemoteGetNowPlayingInfo = (MRMediaRemoteGetNowPlayingInfoFunction) CFBundleGetFunctionPointerForName(_bundle, CFSTR("MRMediaRemoteGetNowPlayingInfo"));
+    size_t capacity = historyCapacity;
+    if(capacity) _history.reset(new MRSnapshotHistory(capacity));
+    _hub = MRMediaRemoteHub::Acquire();
+    _subscriberId = _hub->attach(this);
     
     update();
 }
 
 MRNowPlayingInfo::~MRNowPlayingInfo() {
-    unregisterAutoUpdate();
-    if (_bundle) {
-        CFRelease(_bundle);
-    }
+    _hub->detach(_subscriberId);
 }
 
 void MRNowPlayingInfo::updateClientAppInfo(NSDictionary* userInfo) {
@@ -39,18 +68,54 @@ void MRNowPlayingInfo::updateClientAppInfo(NSDictionary* userInfo) {
     [_clientAppInfoLock unlock];
 }
 
+void MRNowPlayingInfo::lockData() {
+    // Shows how long getters and updates wait for each other.
+    MR_TRACE_SPAN("MRNowPlayingInfo", "_dataLock wait");
+    [_dataLock lock];
+}
+
+void MRNowPlayingInfo::applySnapshot(NSDictionary* const& snapshot) {
+    MR_TRACE_SPAN("MRNowPlayingInfo", "applySnapshot");
+    bool provisional = _hub->isProvisional();
+    lockData();
+    _data = snapshot;
+    _stale = false;
+    _provisional = provisional;
+    [_dataLock unlock];
+    if(_history) {
+        MRNowPlayingSnapshot converted = MRSnapshotFromDictionary(snapshot);
+        converted.stale = false;
+        converted.provisional = provisional;
+        _history->publish(converted);
+    }
+}
+
+void MRNowPlayingInfo::applyStaleSnapshot(NSDictionary* snapshot) {
+    lockData();
+    _data = snapshot;
+    _stale = true;
+    _provisional = false;
+    [_dataLock unlock];
+    if(_history) {
+        MRNowPlayingSnapshot converted = MRSnapshotFromDictionary(snapshot);
+        converted.stale = true;
+        _history->publish(converted);
+    }
+}
+
+void MRNowPlayingInfo::applyNotification(NSDictionary* userInfo) {
+    updateClientAppInfo(userInfo);
+}
+
 void MRNowPlayingInfo::update() {
     update(nil);
 }
 
 void MRNowPlayingInfo::update(void (*callback)(MRNowPlayingInfoInterface*)) {
-    MRMediaRemoteGetNowPlayingInfo(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(NSDictionary* information) {
-        [_dataLock lock];
-        if(information) _data = [information copy];
-        else _data = 0;
-        [_dataLock unlock];
-        if(callback != nil) callback(this);
-    });
+    MR_TRACE_SPAN("MRNowPlayingInfo", "update");
+    MRMediaRemoteHub::Callback done;
+    if(callback != nil) done = [this, callback]() { callback(this); };
+    _hub->update(_subscriberId, done);
 }
 
 int MRNowPlayingInfo::registerAutoUpdate() {
@@ -58,40 +123,82 @@ int MRNowPlayingInfo::registerAutoUpdate() {
 }
 
 int MRNowPlayingInfo::registerAutoUpdate(void (*callback)(MRNowPlayingInfoInterface*)) {
-    if(notificationObserver) return -1;
-    notificationObserver = [[MRNotificationObserver alloc] initWithCallback: ^(NSString *notificationName, NSDictionary * userInfo) {
-        if([notificationName isEqualToString:@"kMRMediaRemoteNowPlayingInfoDidChangeNotification"]) {
-            updateClientAppInfo(userInfo);
-            update(callback);
-        }
-    }];
-    return 0;
+    MRMediaRemoteHub::Callback done;
+    if(callback != nil) done = [this, callback]() { callback(this); };
+    return _hub->observe(_subscriberId, done);
 }
 
 bool MRNowPlayingInfo::isAutoUpdated() {
-    if(notificationObserver) return true;
-    else return false;
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    return _hub->isObserving(_subscriberId);
 }
 
 int MRNowPlayingInfo::unregisterAutoUpdate() {
-    if(!notificationObserver) return -1;
-    notificationObserver = 0;
-    return 0;
+    return _hub->unobserve(_subscriberId);
 }
 
 bool MRNowPlayingInfo::hasInfo() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     return (_data ? true : false);
 }
 
+bool MRNowPlayingInfo::isStale() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    bool ret = false;
+    lockData();
+    ret = _stale;
+    [_dataLock unlock];
+    return ret;
+}
+
+bool MRNowPlayingInfo::isProvisional() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    bool ret = false;
+    lockData();
+    ret = _provisional;
+    [_dataLock unlock];
+    return ret;
+}
+
+MRNowPlayingSnapshot MRNowPlayingInfo::getSnapshot() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    MRNowPlayingSnapshot ret;
+    lockData();
+    ret = MRSnapshotFromDictionary(_data);
+    ret.stale = _stale;
+    ret.provisional = _provisional;
+    [_dataLock unlock];
+    return ret;
+}
+
+uint64_t MRNowPlayingInfo::getVersion() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    return _history ? _history->getLatestVersion() : 0;
+}
+
+int MRNowPlayingInfo::getSnapshotAt(uint64_t version, MRNowPlayingSnapshot* snapshot) {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    if(!_history || !snapshot) return -1;
+    return _history->snapshotAt(version, *snapshot);
+}
+
+size_t MRNowPlayingInfo::getSnapshotsSince(uint64_t version, std::vector<MRVersionedSnapshot>* snapshots) {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
+    if(!_history || !snapshots) return 0;
+    return _history->since(version, *snapshots);
+}
+
 NSDictionary* MRNowPlayingInfo::getRawInfo() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     NSDictionary* ret = 0;
-    [_dataLock lock];
+    lockData();
     if(_data) ret = [_data copy];
     [_dataLock unlock];
     return ret;
 }
 
 char* MRNowPlayingInfo::getClientAppDisplayName() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
     [_clientAppInfoLock lock];
     ret = strdup([_clientAppInfo.displayName UTF8String]);
@@ -100,6 +207,7 @@ char* MRNowPlayingInfo::getClientAppDisplayName() {
 }
 
 int MRNowPlayingInfo::getClientAppPID() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
     [_clientAppInfoLock lock];
     ret = [_clientAppInfo.pid intValue];
@@ -108,8 +216,9 @@ int MRNowPlayingInfo::getClientAppPID() {
 }
 
 char* MRNowPlayingInfo::getAlbumTitle() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* albumTitle = _data[@"kMRMediaRemoteNowPlayingInfoAlbum"];
     if(albumTitle) ret = strdup([albumTitle UTF8String]);
     [_dataLock unlock];
@@ -117,8 +226,9 @@ char* MRNowPlayingInfo::getAlbumTitle() {
 }
 
 uint64_t MRNowPlayingInfo::getAlbumiTunesStoreAdamIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint64_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* adamIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoAlbumiTunesStoreAdamIdentifier"];
     if(adamIdentifier) ret = [adamIdentifier unsignedLongLongValue];
     [_dataLock unlock];
@@ -126,8 +236,9 @@ uint64_t MRNowPlayingInfo::getAlbumiTunesStoreAdamIdentifier() {
 }
 
 char* MRNowPlayingInfo::getArtist() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* artist = _data[@"kMRMediaRemoteNowPlayingInfoArtist"];
     if(artist) ret = strdup([artist UTF8String]);
     [_dataLock unlock];
@@ -135,8 +246,9 @@ char* MRNowPlayingInfo::getArtist() {
 }
 
 uint64_t MRNowPlayingInfo::getArtistiTunesStoreAdamIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint64_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* adamIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoArtistiTunesStoreAdamIdentifier"];
     if(adamIdentifier) ret = [adamIdentifier unsignedLongLongValue];
     [_dataLock unlock];
@@ -144,8 +256,9 @@ uint64_t MRNowPlayingInfo::getArtistiTunesStoreAdamIdentifier() {
 }
 
 char* MRNowPlayingInfo::getComposer() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* composer = _data[@"kMRMediaRemoteNowPlayingInfoComposer"];
     if(composer) ret = strdup([composer UTF8String]);
     [_dataLock unlock];
@@ -153,9 +266,10 @@ char* MRNowPlayingInfo::getComposer() {
 }
 
 int MRNowPlayingInfo::getArtworkByteArray(uint8_t** data, size_t* length) {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint8_t* retData = 0;
     size_t retLength = 0;
-    [_dataLock lock];
+    lockData();
     NSData* artwork = _data[@"kMRMediaRemoteNowPlayingInfoArtworkData"];
     try {
         if(artwork) {
@@ -180,8 +294,9 @@ int MRNowPlayingInfo::getArtworkByteArray(uint8_t** data, size_t* length) {
 }
 
 char* MRNowPlayingInfo::getArtworkBase64() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSData* artwork = _data[@"kMRMediaRemoteNowPlayingInfoArtworkData"];
     if(artwork) {
         NSString* base64Str = [artwork base64EncodedStringWithOptions:0];
@@ -192,8 +307,9 @@ char* MRNowPlayingInfo::getArtworkBase64() {
 }
 
 int MRNowPlayingInfo::getArtworkHeight() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* height = _data[@"kMRMediaRemoteNowPlayingInfoArtworkDataHeight"];
     ret = [height intValue];
     [_dataLock unlock];
@@ -201,8 +317,9 @@ int MRNowPlayingInfo::getArtworkHeight() {
 }
 
 int MRNowPlayingInfo::getArtworkWidth() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* width = _data[@"kMRMediaRemoteNowPlayingInfoArtworkDataWidth"];
     ret = [width intValue];
     [_dataLock unlock];
@@ -210,8 +327,9 @@ int MRNowPlayingInfo::getArtworkWidth() {
 }
 
 char* MRNowPlayingInfo::getArtworkMIMEType() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* MIMEType = _data[@"kMRMediaRemoteNowPlayingInfoArtworkMIMEType"];
     if(MIMEType) ret = strdup([MIMEType UTF8String]);
     [_dataLock unlock];
@@ -219,8 +337,9 @@ char* MRNowPlayingInfo::getArtworkMIMEType() {
 }
 
 char* MRNowPlayingInfo::getArtworkIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* artworkIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoArtworkIdentifier"];
     if(artworkIdentifier) ret = strdup([artworkIdentifier UTF8String]);
     [_dataLock unlock];
@@ -228,8 +347,9 @@ char* MRNowPlayingInfo::getArtworkIdentifier() {
 }
 
 double MRNowPlayingInfo::getDuration() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     double ret = 0.0;
-    [_dataLock lock];
+    lockData();
     NSString* duration = _data[@"kMRMediaRemoteNowPlayingInfoDuration"];
     if(duration) ret = [duration doubleValue];
     [_dataLock unlock];
@@ -237,8 +357,9 @@ double MRNowPlayingInfo::getDuration() {
 }
 
 double MRNowPlayingInfo::getElapsedTime() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     double ret = 0.0;
-    [_dataLock lock];
+    lockData();
     NSString* elapsedTime = _data[@"kMRMediaRemoteNowPlayingInfoElapsedTime"];
     if(elapsedTime) ret = [elapsedTime doubleValue];
     [_dataLock unlock];
@@ -246,8 +367,9 @@ double MRNowPlayingInfo::getElapsedTime() {
 }
 
 char* MRNowPlayingInfo::getGenre() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* genre = _data[@"kMRMediaRemoteNowPlayingInfoGenre"];
     if(genre) ret = strdup([genre UTF8String]);
     [_dataLock unlock];
@@ -255,8 +377,9 @@ char* MRNowPlayingInfo::getGenre() {
 }
 
 bool MRNowPlayingInfo::isMusicApp() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     bool ret = false;
-    [_dataLock lock];
+    lockData();
     NSNumber* isMusicApp = _data[@"kMRMediaRemoteNowPlayingInfoIsMusicApp"];
     if(isMusicApp) ret = [isMusicApp boolValue];
     [_dataLock unlock];
@@ -264,8 +387,9 @@ bool MRNowPlayingInfo::isMusicApp() {
 }
 
 char* MRNowPlayingInfo::getMediaType() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* mediaType = _data[@"kMRMediaRemoteNowPlayingInfoMediaType"];
     if(mediaType) {
         NSString* mediaTypeSimplified = [mediaType substringFromIndex:22];  // 22 for enum prefix "MRMediaRemoteMediaType"
@@ -276,8 +400,9 @@ char* MRNowPlayingInfo::getMediaType() {
 }
 
 int MRNowPlayingInfo::getPlaybackRate() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = -1;
-    [_dataLock lock];
+    lockData();
     NSNumber* playbackRate = _data[@"kMRMediaRemoteNowPlayingInfoPlaybackRate"];
     if(playbackRate) ret = [playbackRate intValue];
     [_dataLock unlock];
@@ -285,8 +410,9 @@ int MRNowPlayingInfo::getPlaybackRate() {
 }
 
 int MRNowPlayingInfo::getQueueIndex() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* queueIndex = _data[@"kMRMediaRemoteNowPlayingInfoQueueIndex"];
     if(queueIndex) ret = [queueIndex intValue];
     [_dataLock unlock];
@@ -294,8 +420,9 @@ int MRNowPlayingInfo::getQueueIndex() {
 }
 
 int MRNowPlayingInfo::getTotalQueueCount() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* totalQueueCount = _data[@"kMRMediaRemoteNowPlayingInfoTotalQueueCount"];
     if(totalQueueCount) ret = [totalQueueCount intValue];
     [_dataLock unlock];
@@ -303,8 +430,9 @@ int MRNowPlayingInfo::getTotalQueueCount() {
 }
 
 int MRNowPlayingInfo::getTotalTrackCount() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* totalTrackCount = _data[@"kMRMediaRemoteNowPlayingInfoTotalTrackCount"];
     if(totalTrackCount) ret = [totalTrackCount intValue];
     [_dataLock unlock];
@@ -312,8 +440,9 @@ int MRNowPlayingInfo::getTotalTrackCount() {
 }
 
 time_t MRNowPlayingInfo::getTimestamp() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     time_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSDate* timestamp = _data[@"kMRMediaRemoteNowPlayingInfoTimestamp"];
     if(timestamp) {
         NSTimeInterval interval = [timestamp timeIntervalSince1970];
@@ -324,8 +453,9 @@ time_t MRNowPlayingInfo::getTimestamp() {
 }
 
 char* MRNowPlayingInfo::getTitle() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* title = _data[@"kMRMediaRemoteNowPlayingInfoTitle"];
     if(title) ret = strdup([title UTF8String]);
     [_dataLock unlock];
@@ -333,8 +463,9 @@ char* MRNowPlayingInfo::getTitle() {
 }
 
 int MRNowPlayingInfo::getTrackNumber() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     int ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* trackNumber = _data[@"kMRMediaRemoteNowPlayingInfoTrackNumber"];
     if(trackNumber) ret = [trackNumber intValue];
     [_dataLock unlock];
@@ -342,8 +473,9 @@ int MRNowPlayingInfo::getTrackNumber() {
 }
 
 char* MRNowPlayingInfo::getContentItemIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     char* ret = 0;
-    [_dataLock lock];
+    lockData();
     NSString* contentItemIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoContentItemIdentifier"];
     if(contentItemIdentifier) ret = strdup([contentItemIdentifier UTF8String]);
     [_dataLock unlock];
@@ -351,8 +483,9 @@ char* MRNowPlayingInfo::getContentItemIdentifier() {
 }
 
 uint64_t MRNowPlayingInfo::getUniqueIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint64_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* uniqueIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoUniqueIdentifier"];
     if(uniqueIdentifier) ret = [uniqueIdentifier unsignedLongLongValue];
     [_dataLock unlock];
@@ -360,8 +493,9 @@ uint64_t MRNowPlayingInfo::getUniqueIdentifier() {
 }
 
 uint64_t MRNowPlayingInfo::getiTunesStoreIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint64_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* iTunesStoreIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoiTunesStoreIdentifier"];
     if(iTunesStoreIdentifier) ret = [iTunesStoreIdentifier unsignedLongLongValue];
     [_dataLock unlock];
@@ -369,8 +503,9 @@ uint64_t MRNowPlayingInfo::getiTunesStoreIdentifier() {
 }
 
 uint64_t MRNowPlayingInfo::getiTunesStoreSubscriptionAdamIdentifier() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     uint64_t ret = 0;
-    [_dataLock lock];
+    lockData();
     NSNumber* iTunesStoreSubscriptionAdamIdentifier = _data[@"kMRMediaRemoteNowPlayingInfoiTunesStoreSubscriptionAdamIdentifier"];
     if(iTunesStoreSubscriptionAdamIdentifier) ret = [iTunesStoreSubscriptionAdamIdentifier unsignedLongLongValue];
     [_dataLock unlock];
@@ -378,8 +513,9 @@ uint64_t MRNowPlayingInfo::getiTunesStoreSubscriptionAdamIdentifier() {
 }
 
 MRNowPlayingInfoRepeatMode MRNowPlayingInfo::getRepeatMode() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     MRNowPlayingInfoRepeatMode ret = kMRNowPlayingInfoRepeatModeUnknown;
-    [_dataLock lock];
+    lockData();
     NSNumber* mode = _data[@"kMRMediaRemoteNowPlayingInfoRepeatMode"];
     switch([mode intValue]) {
         case 1:
@@ -400,8 +536,9 @@ MRNowPlayingInfoRepeatMode MRNowPlayingInfo::getRepeatMode() {
 }
 
 MRNowPlayingInfoShuffleMode MRNowPlayingInfo::getShuffleMode() {
+    MR_TRACE_SPAN("MRNowPlayingInfo", __func__);
     MRNowPlayingInfoShuffleMode ret = kMRNowPlayingInfoShuffleModeUnknown;
-    [_dataLock lock];
+    lockData();
     NSNumber* mode = _data[@"kMRMediaRemoteNowPlayingInfoShuffleMode"];
     switch([mode intValue]) {
         case 1:
@@ -0,0 +1,104 @@
+#include "MROptimisticState.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+MROptimisticState::MROptimisticState(double timeout, double positionTolerance) : _timeout(timeout), _positionTolerance(positionTolerance),
+                                                                                 _pending(false), _issued(0.0), _confirmationTime(0.0) {
+}
+
+int MROptimisticState::speculate(const MRNowPlayingSnapshot& current, Action action, double position, double now, MRNowPlayingSnapshot& provisional) {
+    if(!current.hasInfo) return -1;
+    provisional = current;
+    provisional.stale = false;
+    provisional.provisional = true;
+    // Re-anchor the clock: the elapsed time is the one at `now`.
+    provisional.elapsedTime = current.elapsedTimeAt(now);
+    provisional.timestamp = now;
+
+    bool playing = current.playbackRate > 0;
+    switch(action) {
+        case kActionPlay:
+            playing = true;
+            break;
+        case kActionPause:
+            playing = false;
+            break;
+        case kActionTogglePlayPause:
+            playing = !playing;
+            break;
+        case kActionSeek:
+            provisional.elapsedTime = std::max(position, 0.0);
+            if(provisional.duration > 0) provisional.elapsedTime = std::min(provisional.elapsedTime, provisional.duration);
+            break;
+    }
+    if(playing != (current.playbackRate > 0)) provisional.playbackRate = playing ? 1.0 : 0.0;
+
+    if(_pending) _statistics.superseded++;
+    _pending = true;
+    _provisional = provisional;
+    _issued = now;
+    _statistics.speculations++;
+    return 0;
+}
+
+MROptimisticState::Outcome MROptimisticState::reconcile(const MRNowPlayingSnapshot& authoritative, double now) {
+    if(!_pending) return kOutcomeNone;
+    if(authoritative.stale) return kOutcomePending;
+
+    bool sameTrack = authoritative.hasInfo && authoritative.contentItemIdentifier == _provisional.contentItemIdentifier &&
+                     authoritative.title == _provisional.title && authoritative.artist == _provisional.artist;
+    if(!sameTrack) {
+        rollBack();
+        return kOutcomeRolledBack;
+    }
+
+    bool agrees = (authoritative.playbackRate > 0) == (_provisional.playbackRate > 0) &&
+                  std::fabs(authoritative.elapsedTimeAt(now) - _provisional.elapsedTimeAt(now)) <= _positionTolerance;
+    if(agrees) {
+        _pending = false;
+        double elapsed = std::max(now - _issued, 0.0);
+        _statistics.confirmations++;
+        _confirmationTime += elapsed;
+        _statistics.meanConfirmationTime = _confirmationTime / _statistics.confirmations;
+        _statistics.maxConfirmationTime = std::max(_statistics.maxConfirmationTime, elapsed);
+        return kOutcomeConfirmed;
+    }
+    // Information from before the command says nothing about its result.
+    if(authoritative.timestamp > _issued) {
+        rollBack();
+        return kOutcomeRolledBack;
+    }
+    return kOutcomePending;
+}
+
+bool MROptimisticState::expire(double now) {
+    if(!_pending || now < _issued + _timeout) return false;
+    _statistics.timeouts++;
+    rollBack();
+    return true;
+}
+
+void MROptimisticState::rollBack() {
+    _pending = false;
+    _statistics.rollbacks++;
+}
+
+void MROptimisticState::setTimeout(double timeout) {
+    _timeout = timeout;
+}
+
+bool MROptimisticState::isPending() const {
+    return _pending;
+}
+
+double MROptimisticState::getDeadline() const {
+    return _issued + _timeout;
+}
+
+const MROptimisticStatistics& MROptimisticState::getStatistics() const {
+    return _statistics;
+}
+
+};
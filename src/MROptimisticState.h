@@ -0,0 +1,93 @@
+#ifndef MROptimisticState_h
+#define MROptimisticState_h
+
+#include "nowplaying-snapshot.h"
+
+namespace NowPlaying {
+
+/**
+ * Predicts the result of playback commands, and settles the prediction against the information of the system.
+ *
+ * \ref speculate() derives a provisional snapshot from the current one. The prediction is then pending until:
+ * - a snapshot from the system agrees with it (confirmed);
+ * - a snapshot from the system which changed after the command disagrees with it, or shows another track (rolled back);
+ * - the timeout passes (rolled back).
+ * Snapshots from the system older than the command neither confirm nor contradict it, so the prediction stays.
+ *
+ * This class does no locking. Times are UNIX times (with fraction), so it can run on a simulated clock.
+ */
+class MROptimisticState {
+public:
+
+    typedef enum {
+        kActionPlay,
+        kActionPause,
+        kActionTogglePlayPause,
+        kActionSeek
+    } Action;
+
+    typedef enum {
+        kOutcomeNone,           // Nothing was pending.
+        kOutcomePending,
+        kOutcomeConfirmed,
+        kOutcomeRolledBack
+    } Outcome;
+
+    /**
+     * @param timeout Seconds to wait for the system before rolling back.
+     * @param positionTolerance A position closer than this (seconds) to the predicted one agrees with it.
+     */
+    explicit MROptimisticState(double timeout = 2.0, double positionTolerance = 1.0);
+
+    /**
+     * Predict the result of a command, replacing the pending prediction if any.
+     *
+     * @param current The information shown now: the pending prediction if any, else the latest from the system.
+     * @param action The command sent.
+     * @param position The target of kActionSeek (seconds). Ignored otherwise.
+     * @param provisional Receives the predicted snapshot, marked provisional.
+     * @return 0 for success, -1 if `current` has no info (nothing to predict from).
+     */
+    int speculate(const MRNowPlayingSnapshot& current, Action action, double position, double now, MRNowPlayingSnapshot& provisional);
+
+    /**
+     * Settle the pending prediction against a snapshot from the system.
+     */
+    Outcome reconcile(const MRNowPlayingSnapshot& authoritative, double now);
+
+    /**
+     * Roll the pending prediction back if its timeout has passed.
+     *
+     * @return true if rolled back.
+     */
+    bool expire(double now);
+
+    /// Change the timeout, from the next check of \ref expire() on.
+    void setTimeout(double timeout);
+
+    /// @return true if a prediction is pending.
+    bool isPending() const;
+
+    /// @return The UNIX time the pending prediction times out at.
+    double getDeadline() const;
+
+    const MROptimisticStatistics& getStatistics() const;
+
+private:
+
+    double _timeout;
+    double _positionTolerance;
+
+    bool _pending;
+    MRNowPlayingSnapshot _provisional;
+    double _issued;
+    double _confirmationTime;   // Total, for the mean
+
+    MROptimisticStatistics _statistics;
+
+    void rollBack();
+};
+
+};
+
+#endif /* MROptimisticState_h */
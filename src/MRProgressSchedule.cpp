@@ -0,0 +1,155 @@
+#include "MRProgressSchedule.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+namespace {
+
+// Positions closer than this to the extrapolated one are the same playback.
+const double kJumpTolerance = 0.25;
+
+// Absorbs the rounding of position / interval, so a tick right on a boundary never schedules that boundary again.
+const double kBoundaryEpsilon = 1e-6;
+
+}
+
+MRProgressSchedule::MRProgressSchedule(double origin) : _origin(origin), _wheel(0), _nextId(1), _hasPosition(false),
+                                                        _elapsedTime(0.0), _timestamp(0.0), _rate(0.0), _duration(0.0) {
+}
+
+uint64_t MRProgressSchedule::subscribe(double interval, MRProgressTickerCallback callback, void* context, double now) {
+    if(!callback || !(interval >= 0.001)) return 0;
+    uint64_t key = (uint64_t)std::llround(interval * 1e6);
+    std::map<uint64_t, Group>::iterator it = _groups.find(key);
+    if(it == _groups.end()) {
+        Group group;
+        group.interval = interval;
+        group.timer = MRTimerWheel::kInvalidHandle;
+        group.jumped = false;
+        it = _groups.insert(std::make_pair(key, group)).first;
+        schedule(key, it->second, now);
+    }
+    Subscription subscription = {_nextId++, callback, context};
+    it->second.subscriptions.push_back(subscription);
+    _subscriptions[subscription.id] = key;
+    return subscription.id;
+}
+
+int MRProgressSchedule::unsubscribe(uint64_t id) {
+    std::unordered_map<uint64_t, uint64_t>::iterator it = _subscriptions.find(id);
+    if(it == _subscriptions.end()) return -1;
+    Group& group = _groups[it->second];
+    for(size_t i = 0; i < group.subscriptions.size(); i++) {
+        if(group.subscriptions[i].id != id) continue;
+        group.subscriptions.erase(group.subscriptions.begin() + i);
+        break;
+    }
+    if(group.subscriptions.empty()) {
+        if(group.timer != MRTimerWheel::kInvalidHandle) _wheel.cancel(group.timer);
+        _groups.erase(it->second);
+    }
+    _subscriptions.erase(it);
+    return 0;
+}
+
+double MRProgressSchedule::positionAt(double now) const {
+    double position = _elapsedTime;
+    if(_rate > 0 && now > _timestamp) position += (now - _timestamp) * _rate;
+    if(_duration > 0 && position > _duration) position = _duration;
+    return position;
+}
+
+uint64_t MRProgressSchedule::tickAt(double time, bool roundUp) const {
+    // With a microsecond of slack, so that waking up at a deadline converted back to a time always reaches its tick.
+    double ticks = (time - _origin) * 1e3;
+    ticks = roundUp ? std::ceil(ticks - 1e-3) : std::floor(ticks + 1e-3);
+    return ticks > 0 ? (uint64_t)ticks : 0;
+}
+
+int MRProgressSchedule::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    bool hasPosition = snapshot.hasInfo && !snapshot.stale;
+    std::string track = snapshot.contentItemIdentifier.empty() ? snapshot.title : snapshot.contentItemIdentifier;
+    double rate = hasPosition && snapshot.playbackRate > 0 ? snapshot.playbackRate : 0.0;
+    double timestamp = snapshot.timestamp > 0 ? snapshot.timestamp : now;
+
+    bool jumped = hasPosition && (!_hasPosition || track != _track || (rate > 0) != (_rate > 0));
+    if(hasPosition && !jumped) {
+        double position = snapshot.elapsedTime + (rate > 0 && now > timestamp ? (now - timestamp) * rate : 0.0);
+        if(snapshot.duration > 0 && position > snapshot.duration) position = snapshot.duration;
+        jumped = std::fabs(position - positionAt(now)) > kJumpTolerance;
+    }
+
+    _hasPosition = hasPosition;
+    _track = track;
+    _elapsedTime = snapshot.elapsedTime;
+    _timestamp = timestamp;
+    _rate = rate;
+    _duration = snapshot.duration;
+
+    for(std::map<uint64_t, Group>::iterator it = _groups.begin(); it != _groups.end(); ++it) {
+        it->second.jumped = hasPosition && (it->second.jumped || jumped);
+        schedule(it->first, it->second, now);
+    }
+    return jumped ? 1 : 0;
+}
+
+void MRProgressSchedule::schedule(uint64_t key, Group& group, double now) {
+    if(group.timer != MRTimerWheel::kInvalidHandle) _wheel.cancel(group.timer);
+    group.timer = MRTimerWheel::kInvalidHandle;
+    if(!_hasPosition) return;
+    if(group.jumped) {
+        group.timer = _wheel.schedule(tickAt(now, false), key);
+        return;
+    }
+    if(_rate <= 0) return;
+    double boundary = (std::floor(positionAt(now) / group.interval + kBoundaryEpsilon) + 1) * group.interval;
+    if(_duration > 0 && boundary > _duration) return;
+    uint64_t tick = tickAt(_timestamp + (boundary - _elapsedTime) / _rate, true);
+    group.timer = _wheel.schedule(std::max(tick, _wheel.getCurrent() + 1), key);
+}
+
+size_t MRProgressSchedule::advance(double now) {
+    std::vector<uint64_t> expired;
+    _wheel.advance(tickAt(now, false), expired);
+    size_t ret = 0;
+    for(size_t i = 0; i < expired.size(); i++) {
+        std::map<uint64_t, Group>::iterator it = _groups.find(expired[i]);
+        if(it == _groups.end()) continue;
+        Group& group = it->second;
+        group.timer = MRTimerWheel::kInvalidHandle;
+
+        // A late wakeup (for example after sleep) ticks once, at the latest boundary passed.
+        double position = positionAt(now);
+        if(!group.jumped) position = std::floor(position / group.interval + kBoundaryEpsilon) * group.interval;
+        group.jumped = false;
+        schedule(it->first, group, now);
+
+        // Callbacks may unsubscribe anyone, so walk a copy and check each one is still there.
+        uint64_t key = it->first;
+        std::vector<Subscription> subscriptions = group.subscriptions;
+        for(size_t j = 0; j < subscriptions.size(); j++) {
+            std::unordered_map<uint64_t, uint64_t>::iterator subscription = _subscriptions.find(subscriptions[j].id);
+            if(subscription == _subscriptions.end() || subscription->second != key) continue;
+            subscriptions[j].callback(position, subscriptions[j].context);
+            ret++;
+        }
+    }
+    return ret;
+}
+
+double MRProgressSchedule::nextDeadline() const {
+    uint64_t tick = _wheel.nextExpiry();
+    if(tick == UINT64_MAX) return HUGE_VAL;
+    return _origin + tick / 1e3;
+}
+
+size_t MRProgressSchedule::getSubscriberCount() const {
+    return _subscriptions.size();
+}
+
+size_t MRProgressSchedule::getGroupCount() const {
+    return _groups.size();
+}
+
+};
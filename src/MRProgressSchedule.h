@@ -0,0 +1,98 @@
+#ifndef MRProgressSchedule_h
+#define MRProgressSchedule_h
+
+#include "nowplaying-ticker.h"
+#include "MRTimerWheel.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * The timing of MRProgressTicker, without its thread.
+ *
+ * Subscribers with the same interval form a group sharing one timer of an MRTimerWheel with 1 ms ticks.
+ * The owner sleeps until \ref nextDeadline() and then calls \ref advance(), which runs the callbacks due.
+ *
+ * This class does no locking. Times are UNIX times (with fraction), so it can run on a simulated clock.
+ */
+class MRProgressSchedule {
+public:
+
+    /**
+     * @param origin The UNIX time of the first tick of the wheel. Earlier deadlines are treated as due.
+     */
+    explicit MRProgressSchedule(double origin);
+
+    /// See \ref MRProgressTickerInterface::subscribe().
+    uint64_t subscribe(double interval, MRProgressTickerCallback callback, void* context, double now);
+
+    /// See \ref MRProgressTickerInterface::unsubscribe().
+    int unsubscribe(uint64_t id);
+
+    /**
+     * Take a new snapshot and reschedule every group.
+     *
+     * @return 1 if the position jumped and every group is due at once, 0 if not.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Run the callbacks due by `now`. Callbacks may call any method.
+     *
+     * @return The number of callbacks run.
+     */
+    size_t advance(double now);
+
+    /**
+     * Get the time the next group is due.
+     *
+     * @return The UNIX time (with fraction), or HUGE_VAL if nothing will tick until the next snapshot or subscription.
+     */
+    double nextDeadline() const;
+
+    /// @return How many subscriptions there are.
+    size_t getSubscriberCount() const;
+
+    /// @return How many groups (distinct intervals) there are, each with at most one timer.
+    size_t getGroupCount() const;
+
+private:
+
+    struct Subscription {
+        uint64_t id;
+        MRProgressTickerCallback callback;
+        void* context;
+    };
+
+    struct Group {
+        double interval;
+        MRTimerWheel::Handle timer;
+        bool jumped;                                // Due at once with the exact position
+        std::vector<Subscription> subscriptions;
+    };
+
+    double _origin;
+    MRTimerWheel _wheel;
+    uint64_t _nextId;
+    std::map<uint64_t, Group> _groups;              // By interval in microseconds
+    std::unordered_map<uint64_t, uint64_t> _subscriptions;     // Id to group
+
+    // Playback, from the latest snapshot
+    bool _hasPosition;
+    std::string _track;
+    double _elapsedTime;
+    double _timestamp;
+    double _rate;
+    double _duration;
+
+    double positionAt(double now) const;
+    uint64_t tickAt(double time, bool roundUp) const;
+    void schedule(uint64_t key, Group& group, double now);
+};
+
+};
+
+#endif /* MRProgressSchedule_h */
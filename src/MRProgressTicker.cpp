@@ -0,0 +1,85 @@
+#include "MRProgressTicker.h"
+#include <chrono>
+#include <cmath>
+
+namespace NowPlaying {
+
+namespace {
+
+double currentTime() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+MRProgressTickerInterface* MRProgressTickerInterface::Create() {
+    return new MRProgressTicker();
+}
+
+void MRProgressTickerInterface::Delete(MRProgressTickerInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRProgressTicker::MRProgressTicker() : _schedule(currentTime()), _stopping(false), _wakeups(0) {
+    _thread = std::thread(&MRProgressTicker::run, this);
+}
+
+MRProgressTicker::~MRProgressTicker() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(_lock);
+        _stopping = true;
+    }
+    _changed.notify_one();
+    _thread.join();
+}
+
+void MRProgressTicker::run() {
+    std::unique_lock<std::recursive_mutex> lock(_lock);
+    while(!_stopping) {
+        double deadline = _schedule.nextDeadline();
+        if(deadline == HUGE_VAL) {
+            _changed.wait(lock);
+        }
+        else {
+            std::chrono::duration<double> sinceEpoch(deadline);
+            _changed.wait_until(lock, std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceEpoch)));
+        }
+        if(_stopping) break;
+        _wakeups++;
+        _schedule.advance(currentTime());
+    }
+}
+
+void MRProgressTicker::reschedule(double deadline) {
+    if(_schedule.nextDeadline() < deadline) _changed.notify_one();
+}
+
+int MRProgressTicker::feed(const MRNowPlayingSnapshot& snapshot) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    double deadline = _schedule.nextDeadline();
+    int ret = _schedule.feed(snapshot, currentTime());
+    reschedule(deadline);
+    return ret;
+}
+
+uint64_t MRProgressTicker::subscribe(double interval, MRProgressTickerCallback callback, void* context) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    double deadline = _schedule.nextDeadline();
+    uint64_t ret = _schedule.subscribe(interval, callback, context, currentTime());
+    reschedule(deadline);
+    return ret;
+}
+
+int MRProgressTicker::unsubscribe(uint64_t id) {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    // A later deadline only costs the thread one early wakeup, so there is no need to wake it now.
+    return _schedule.unsubscribe(id);
+}
+
+uint64_t MRProgressTicker::getWakeupCount() {
+    std::lock_guard<std::recursive_mutex> lock(_lock);
+    return _wakeups;
+}
+
+};
@@ -0,0 +1,75 @@
+#ifndef MRProgressTicker_h
+#define MRProgressTicker_h
+
+#include "nowplaying-ticker.h"
+#include "MRProgressSchedule.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace NowPlaying {
+
+/**
+ * Ticks the progress of the media playing now to many subscribers, from one thread.
+ *
+ * The thread sleeps until the next group of subscribers is due (see MRProgressSchedule), and is only woken up early
+ * when a snapshot or a subscription makes something due sooner.
+ */
+class MRProgressTicker : public MRProgressTickerInterface {
+private:
+
+    // Recursive, so that callbacks (run on the thread with the lock held) may call back in.
+    std::recursive_mutex _lock;
+    std::condition_variable_any _changed;
+    MRProgressSchedule _schedule;
+    bool _stopping;
+    uint64_t _wakeups;
+    std::thread _thread;
+
+    void run();
+
+    // Wake the thread if `deadline` (the one it sleeps until) is no longer the next one. Called with the lock held.
+    void reschedule(double deadline);
+
+public:
+
+    MRProgressTicker();
+
+    ~MRProgressTicker();
+
+    /**
+     * Take a new snapshot.
+     *
+     * @param snapshot The now playing information. Nothing ticks for stale snapshots or snapshots without information.
+     * @return 1 if the position jumped (and every subscriber will tick at once), 0 if not.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot);
+
+    /**
+     * Subscribe to the ticks.
+     *
+     * @param interval The resolution (seconds of media), for example 1 for whole seconds or 0.1 for 10 Hz. At least 0.001.
+     * @param callback The function to call on each tick.
+     * @param context Passed to `callback`.
+     * @return The identifier of the subscription, or 0 for invalid arguments.
+     */
+    uint64_t subscribe(double interval, MRProgressTickerCallback callback, void* context);
+
+    /**
+     * Cancel a subscription. Its callback is never called after this returns.
+     *
+     * @return 0 for success, -1 for unknown subscription.
+     */
+    int unsubscribe(uint64_t id);
+
+    /**
+     * Get to know how many times the thread woke up, to see what the ticker costs.
+     *
+     * @return The number of wakeups since the creation of the instance.
+     */
+    uint64_t getWakeupCount();
+};
+
+};
+
+#endif /* MRProgressTicker_h */
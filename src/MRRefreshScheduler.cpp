@@ -0,0 +1,89 @@
+#include "MRRefreshScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+MRRefreshScheduler::MRRefreshScheduler(const MRRefreshSchedulerConfig& config) : _config(config), _polling(false), _hasSnapshot(false), _notified(false),
+                                                                                 _snapshotTime(0.0), _lastCheck(0.0), _missedAt(0.0), _pollCount(0), _missedCount(0) {
+}
+
+void MRRefreshScheduler::notificationReceived(double now) {
+    // The change was fetched before its notification came, not missed.
+    if(_polling && now - _missedAt <= _config.notificationGrace) _missedCount--;
+    _notified = true;
+    _polling = false;
+}
+
+void MRRefreshScheduler::pollIssued(double now) {
+    _pollCount++;
+    _lastCheck = std::max(_lastCheck, now);
+}
+
+void MRRefreshScheduler::snapshotFetched(const MRNowPlayingSnapshot& snapshot, double now) {
+    if(snapshot.stale) return;
+    if(_hasSnapshot && !_notified && isChange(snapshot, now)) {
+        _missedCount++;
+        _missedAt = now;
+        _polling = true;
+    }
+    _hasSnapshot = true;
+    _notified = false;
+    _snapshot = snapshot;
+    _snapshotTime = now;
+    _lastCheck = std::max(_lastCheck, now);
+}
+
+bool MRRefreshScheduler::isChange(const MRNowPlayingSnapshot& snapshot, double now) const {
+    if(snapshot.hasInfo != _snapshot.hasInfo) return true;
+    if(!snapshot.hasInfo) return false;
+    if(!snapshot.contentItemIdentifier.empty() || !_snapshot.contentItemIdentifier.empty()) {
+        if(snapshot.contentItemIdentifier != _snapshot.contentItemIdentifier) return true;
+    }
+    else if(snapshot.title != _snapshot.title || snapshot.artist != _snapshot.artist || snapshot.albumTitle != _snapshot.albumTitle) return true;
+    if((snapshot.playbackRate > 0) != (_snapshot.playbackRate > 0)) return true;
+    // Without timestamps the positions cannot be extrapolated to the same moment.
+    if(snapshot.timestamp > 0 && _snapshot.timestamp > 0) {
+        return std::fabs(snapshot.elapsedTimeAt(now) - _snapshot.elapsedTimeAt(now)) > _config.positionTolerance;
+    }
+    return false;
+}
+
+double MRRefreshScheduler::predictedEnd() const {
+    if(!_snapshot.hasInfo || _snapshot.playbackRate <= 0 || _snapshot.duration <= 0) return HUGE_VAL;
+    double reference = _snapshot.timestamp > 0 ? _snapshot.timestamp : _snapshotTime;
+    return reference + std::max(_snapshot.duration - _snapshot.elapsedTime, 0.0) / _snapshot.playbackRate;
+}
+
+double MRRefreshScheduler::nextPoll(double now) const {
+    double base = std::max(_lastCheck, _snapshotTime);
+    if(!_hasSnapshot) return std::max(base, now) + (_polling ? _config.idleInterval : _config.probeInterval);
+    double end = predictedEnd();
+
+    if(!_polling) {
+        double next = base + _config.probeInterval;
+        if(end + _config.probeDelay > base) next = std::min(next, end + _config.probeDelay);
+        return next;
+    }
+
+    if(!_snapshot.hasInfo || _snapshot.playbackRate <= 0) return base + _config.idleInterval;
+    if(end == HUGE_VAL) return base + _config.playingInterval;
+    if(base < end + _config.boundaryMargin) return std::min(base + _config.playingInterval, end + _config.boundaryMargin);
+    // Past the predicted end and still the same track: the next one is about to show up.
+    if(base < end + _config.boundaryTimeout) return base + _config.boundaryInterval;
+    return base + _config.playingInterval;
+}
+
+bool MRRefreshScheduler::isPolling() const {
+    return _polling;
+}
+
+uint64_t MRRefreshScheduler::getPollCount() const {
+    return _pollCount;
+}
+
+uint64_t MRRefreshScheduler::getMissedCount() const {
+    return _missedCount;
+}
+
+};
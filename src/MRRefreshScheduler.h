@@ -0,0 +1,94 @@
+#ifndef MRRefreshScheduler_h
+#define MRRefreshScheduler_h
+
+#include "nowplaying-snapshot.h"
+#include <cstdint>
+
+namespace NowPlaying {
+
+/**
+ * The timings of MRRefreshScheduler, in seconds.
+ */
+struct MRRefreshSchedulerConfig {
+    double probeInterval;       /*!< While notifications are trusted, check anyway after this long without any fetch. */
+    double probeDelay;          /*!< While notifications are trusted, check this long after the predicted end of the track if nothing came. */
+    double idleInterval;        /*!< While polling, interval when nothing is playing. */
+    double playingInterval;     /*!< While polling, longest interval when playing, which bounds how late a skip or a pause is seen. */
+    double boundaryMargin;      /*!< While polling, poll this long after the predicted end of the track. */
+    double boundaryInterval;    /*!< While polling, interval after the predicted end until another track shows up. */
+    double boundaryTimeout;     /*!< While polling, go back to `playingInterval` this long after the predicted end. */
+    double positionTolerance;   /*!< A position farther than this from the predicted one is a change. */
+    double notificationGrace;   /*!< A change fetched (by an update, say) this long before its notification came was not missed. */
+
+    MRRefreshSchedulerConfig() : probeInterval(300.0), probeDelay(2.0), idleInterval(60.0), playingInterval(15.0),
+                                 boundaryMargin(0.5), boundaryInterval(1.0), boundaryTimeout(10.0), positionTolerance(2.0),
+                                 notificationGrace(1.0) {}
+};
+
+/**
+ * Decides when to poll the now playing information, for the systems where the change notifications stop coming.
+ *
+ * While notifications are trusted, it only checks once after the predicted end of each track if no notification came,
+ * and after a long time without any fetch. When a fetch finds a change which no notification announced, notifications are
+ * considered lost and it polls adaptively: rarely when nothing is playing, at `playingInterval` while playing, and right after
+ * the predicted end of the track (from the duration, elapsed time and rate of the latest snapshot).
+ * It stops polling as soon as a notification comes again, and a notification coming within `notificationGrace` of the change
+ * takes the change back from the missed ones.
+ *
+ * This class does no locking and calls nothing by itself. Times are UNIX times (with fraction), so it can run on a simulated clock.
+ */
+class MRRefreshScheduler {
+public:
+
+    explicit MRRefreshScheduler(const MRRefreshSchedulerConfig& config = MRRefreshSchedulerConfig());
+
+    /// Record a change notification.
+    void notificationReceived(double now);
+
+    /// Record that a poll was issued, because \ref nextPoll() was reached.
+    void pollIssued(double now);
+
+    /**
+     * Record a fetched snapshot, whatever caused the fetch.
+     * A change since the previous snapshot which no notification announced starts the polling.
+     */
+    void snapshotFetched(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Get the time of the next poll.
+     *
+     * @return The UNIX time (with fraction) to poll at. May be in the past, meaning at once.
+     */
+    double nextPoll(double now) const;
+
+    /// @return true if notifications are considered lost and polling is on.
+    bool isPolling() const;
+
+    /// @return How many polls were issued.
+    uint64_t getPollCount() const;
+
+    /// @return How many changes were found by fetches without a notification.
+    uint64_t getMissedCount() const;
+
+private:
+
+    MRRefreshSchedulerConfig _config;
+
+    bool _polling;
+    bool _hasSnapshot;
+    bool _notified;             // A notification came since the latest snapshot.
+    MRNowPlayingSnapshot _snapshot;
+    double _snapshotTime;
+    double _lastCheck;          // Latest poll or fetch.
+    double _missedAt;           // When the latest missed change was fetched.
+
+    uint64_t _pollCount;
+    uint64_t _missedCount;
+
+    bool isChange(const MRNowPlayingSnapshot& snapshot, double now) const;
+    double predictedEnd() const;
+};
+
+};
+
+#endif /* MRRefreshScheduler_h */
@@ -0,0 +1,136 @@
+#include "MRScrobbler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NowPlaying {
+
+MRScrobblerInterface* MRScrobblerInterface::Create(const MRScrobblerConfig& config) {
+    return new MRScrobbler(config);
+}
+
+void MRScrobblerInterface::Delete(MRScrobblerInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRScrobbler::MRScrobbler(const MRScrobblerConfig& config) : _config(config), _active(false), _rate(0.0) {
+}
+
+MRScrobbler::~MRScrobbler() {
+}
+
+bool MRScrobbler::isSameTrack(const MRNowPlayingSnapshot& snapshot) const {
+    if(!snapshot.contentItemIdentifier.empty() || !_session.contentItemIdentifier.empty()) {
+        return snapshot.contentItemIdentifier == _session.contentItemIdentifier;
+    }
+    // Some players do not report an identifier.
+    return snapshot.title == _session.title && snapshot.artist == _session.artist && snapshot.albumTitle == _session.albumTitle;
+}
+
+bool MRScrobbler::countsAsPlay(const MRListeningSession& session) const {
+    double threshold = _config.maximumThreshold;
+    if(session.duration > 0) {
+        if(session.duration < _config.minimumDuration) return false;
+        threshold = std::min(session.duration * _config.playedFraction, threshold);
+    }
+    return session.listenedTime >= threshold;
+}
+
+void MRScrobbler::advance(double time) {
+    if(time <= _session.endTime) return;
+    if(_session.playing) {
+        _session.listenedTime += time - _session.endTime;
+        _session.position += (time - _session.endTime) * _rate;
+        if(_session.duration > 0 && _session.position > _session.duration) _session.position = _session.duration;
+    }
+    _session.endTime = time;
+}
+
+void MRScrobbler::start(const MRNowPlayingSnapshot& snapshot, double time, double position) {
+    _active = true;
+    _session = MRListeningSession();
+    _session.contentItemIdentifier = snapshot.contentItemIdentifier;
+    _session.title = snapshot.title;
+    _session.artist = snapshot.artist;
+    _session.albumTitle = snapshot.albumTitle;
+    _session.duration = snapshot.duration;
+    _session.startTime = time;
+    _session.endTime = time;
+    _session.position = position;
+    _session.playing = snapshot.playbackRate > 0;
+    _rate = snapshot.playbackRate > 0 ? snapshot.playbackRate : 0.0;
+}
+
+int MRScrobbler::end(double time) {
+    if(!_active) return 0;
+    advance(time);
+    _active = false;
+    if(!countsAsPlay(_session)) return 0;
+    _plays.push_back(_session);
+    return 1;
+}
+
+int MRScrobbler::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    if(snapshot.stale || snapshot.provisional) return 0;
+    if(!snapshot.hasInfo) return end(now);
+
+    // The snapshot says when its status changed, which is more precise than when it was received.
+    double time = now;
+    if(_active && snapshot.timestamp > _session.endTime && snapshot.timestamp < now) time = snapshot.timestamp;
+    double position = snapshot.elapsedTimeAt(time);
+
+    if(!_active || !isSameTrack(snapshot)) {
+        int completed = end(time);
+        start(snapshot, time, position);
+        return completed;
+    }
+
+    advance(time);
+    if(std::fabs(position - _session.position) > _config.seekTolerance) {
+        bool wasAtEnd = _session.duration > 0 && _session.position >= _session.duration - _config.seekTolerance;
+        if(wasAtEnd && position <= _config.seekTolerance) {
+            // Played again from the beginning (repeat), which is another session.
+            int completed = end(time);
+            start(snapshot, time, position);
+            return completed;
+        }
+        _session.seekCount++;
+    }
+    bool playing = snapshot.playbackRate > 0;
+    if(_session.playing && !playing) _session.pauseCount++;
+    _session.playing = playing;
+    _session.position = position;
+    if(snapshot.duration > 0) _session.duration = snapshot.duration;
+    _rate = playing ? snapshot.playbackRate : 0.0;
+    return 0;
+}
+
+int MRScrobbler::flush(double now) {
+    return end(now);
+}
+
+int MRScrobbler::getCurrentSession(MRListeningSession* session, double now) {
+    if(!_active) return -1;
+    MRListeningSession current = _session;
+    if(current.playing && now > current.endTime) {
+        current.listenedTime += now - current.endTime;
+        current.position += (now - current.endTime) * _rate;
+        if(current.duration > 0 && current.position > current.duration) current.position = current.duration;
+        current.endTime = now;
+    }
+    *session = current;
+    return 0;
+}
+
+size_t MRScrobbler::getPlayCount() {
+    return _plays.size();
+}
+
+int MRScrobbler::popPlay(MRListeningSession* play) {
+    if(_plays.empty()) return -1;
+    *play = _plays.front();
+    _plays.pop_front();
+    return 0;
+}
+
+};
@@ -0,0 +1,85 @@
+#ifndef MRScrobbler_h
+#define MRScrobbler_h
+
+#include "nowplaying-scrobbler.h"
+#include <deque>
+
+namespace NowPlaying {
+
+/**
+ * Derives listening sessions and completed plays ("scrobbles") from the now playing snapshots.
+ *
+ * Every snapshot costs constant time, whatever the length of the session.
+ * A session ends when another track (or nothing) is playing, or when a track restarts from its beginning (repeat).
+ * Sessions meeting the thresholds of MRScrobblerConfig are then queued as plays, see \ref popPlay().
+ *
+ * An instance is not thread-safe. Stale and provisional snapshots (see MRNowPlayingInfoInterface::isStale() and isProvisional()) are ignored.
+ */
+class MRScrobbler : public MRScrobblerInterface {
+private:
+
+    MRScrobblerConfig _config;
+
+    bool _active;
+    MRListeningSession _session;
+    double _rate;
+
+    std::deque<MRListeningSession> _plays;
+
+    bool isSameTrack(const MRNowPlayingSnapshot& snapshot) const;
+    bool countsAsPlay(const MRListeningSession& session) const;
+    void advance(double time);
+    void start(const MRNowPlayingSnapshot& snapshot, double time, double position);
+    int end(double time);
+
+public:
+
+    MRScrobbler(const MRScrobblerConfig& config);
+
+    ~MRScrobbler();
+
+    /**
+     * Take a new snapshot.
+     *
+     * @param snapshot The now playing information.
+     * @param now The UNIX time (with fraction) the snapshot was received. Must not go backwards.
+     * @return The number of plays completed by this snapshot (0 or 1).
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * End the current session, for example when quitting.
+     *
+     * @param now The UNIX time (with fraction) of now.
+     * @return The number of plays completed (0 or 1).
+     */
+    int flush(double now);
+
+    /**
+     * Get the session in progress.
+     *
+     * @param session Receives the session, extrapolated to `now` if playing.
+     * @param now The UNIX time (with fraction) of now.
+     * @return 0 for success, -1 for no session in progress.
+     */
+    int getCurrentSession(MRListeningSession* session, double now);
+
+    /**
+     * Get to know how many completed plays are waiting to be taken by \ref popPlay().
+     *
+     * @return The number of plays queued.
+     */
+    size_t getPlayCount();
+
+    /**
+     * Take the oldest completed play.
+     *
+     * @param play Receives the session which counted as a play.
+     * @return 0 for success, -1 for no play queued.
+     */
+    int popPlay(MRListeningSession* play);
+};
+
+};
+
+#endif /* MRScrobbler_h */
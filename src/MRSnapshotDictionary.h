@@ -0,0 +1,42 @@
+#ifndef MRSnapshotDictionary_h
+#define MRSnapshotDictionary_h
+
+#import <Foundation/Foundation.h>
+#import "nowplaying-snapshot.h"
+#import "MRNotificationFastPath.h"
+
+namespace NowPlaying {
+
+/**
+ * Convert the now playing info dictionary of MediaRemote to a snapshot.
+ *
+ * @param information The dictionary. nil for no info.
+ * @return The snapshot, with `stale` and `provisional` unset.
+ */
+MRNowPlayingSnapshot MRSnapshotFromDictionary(NSDictionary* information);
+
+/**
+ * Copy a now playing info dictionary with the playback status (elapsed time, playback rate and timestamp) of a snapshot.
+ *
+ * @param information The dictionary, with its artwork data.
+ * @param snapshot The playback status to take.
+ * @return The copy.
+ */
+NSDictionary* MRDictionaryWithPlayback(NSDictionary* information, const MRNowPlayingSnapshot& snapshot);
+
+/**
+ * Convert a snapshot back to a now playing info dictionary, as MediaRemote would have sent it (without the artwork data).
+ *
+ * @return The dictionary. nil if the snapshot has no info.
+ */
+NSDictionary* MRSnapshotToDictionary(const MRNowPlayingSnapshot& snapshot);
+
+/**
+ * Read what the `userInfo` of a kMRMediaRemoteNowPlayingInfoDidChangeNotification says about the media.
+ * Of the keys describing the application, only the PID is kept. Any key not understood counts as other info.
+ */
+MRNotificationPayload MRNotificationPayloadFromUserInfo(NSDictionary* userInfo);
+
+};
+
+#endif /* MRSnapshotDictionary_h */
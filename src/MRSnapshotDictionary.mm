@@ -0,0 +1,189 @@
+#import "MRSnapshotDictionary.h"
+#import <Foundation/Foundation.h>
+
+namespace NowPlaying {
+
+static NSString* const kMediaTypePrefix = @"MRMediaRemoteMediaType";
+
+static std::string stringValue(NSDictionary* information, NSString* key) {
+    NSString* value = information[key];
+    if(![value isKindOfClass:[NSString class]]) return std::string();
+    const char* utf8 = [value UTF8String];
+    return utf8 ? std::string(utf8) : std::string();
+}
+
+static void setString(NSMutableDictionary* information, NSString* key, const std::string& value) {
+    if(!value.empty()) information[key] = [NSString stringWithUTF8String:value.c_str()];
+}
+
+MRNowPlayingSnapshot MRSnapshotFromDictionary(NSDictionary* information) {
+    MRNowPlayingSnapshot snapshot;
+    if(!information) return snapshot;
+    snapshot.hasInfo = true;
+
+    snapshot.title = stringValue(information, @"kMRMediaRemoteNowPlayingInfoTitle");
+    snapshot.artist = stringValue(information, @"kMRMediaRemoteNowPlayingInfoArtist");
+    snapshot.albumTitle = stringValue(information, @"kMRMediaRemoteNowPlayingInfoAlbum");
+    snapshot.composer = stringValue(information, @"kMRMediaRemoteNowPlayingInfoComposer");
+    snapshot.genre = stringValue(information, @"kMRMediaRemoteNowPlayingInfoGenre");
+    snapshot.contentItemIdentifier = stringValue(information, @"kMRMediaRemoteNowPlayingInfoContentItemIdentifier");
+    snapshot.artworkIdentifier = stringValue(information, @"kMRMediaRemoteNowPlayingInfoArtworkIdentifier");
+    snapshot.artworkMIMEType = stringValue(information, @"kMRMediaRemoteNowPlayingInfoArtworkMIMEType");
+    snapshot.mediaType = stringValue(information, @"kMRMediaRemoteNowPlayingInfoMediaType");
+    if(snapshot.mediaType.compare(0, [kMediaTypePrefix length], [kMediaTypePrefix UTF8String]) == 0) snapshot.mediaType.erase(0, [kMediaTypePrefix length]);
+
+    snapshot.artworkWidth = [information[@"kMRMediaRemoteNowPlayingInfoArtworkDataWidth"] intValue];
+    snapshot.artworkHeight = [information[@"kMRMediaRemoteNowPlayingInfoArtworkDataHeight"] intValue];
+    snapshot.queueIndex = [information[@"kMRMediaRemoteNowPlayingInfoQueueIndex"] intValue];
+    snapshot.totalQueueCount = [information[@"kMRMediaRemoteNowPlayingInfoTotalQueueCount"] intValue];
+    snapshot.totalTrackCount = [information[@"kMRMediaRemoteNowPlayingInfoTotalTrackCount"] intValue];
+    snapshot.trackNumber = [information[@"kMRMediaRemoteNowPlayingInfoTrackNumber"] intValue];
+    snapshot.isMusicApp = [information[@"kMRMediaRemoteNowPlayingInfoIsMusicApp"] boolValue];
+
+    snapshot.duration = [information[@"kMRMediaRemoteNowPlayingInfoDuration"] doubleValue];
+    snapshot.elapsedTime = [information[@"kMRMediaRemoteNowPlayingInfoElapsedTime"] doubleValue];
+    NSNumber* playbackRate = information[@"kMRMediaRemoteNowPlayingInfoPlaybackRate"];
+    if(playbackRate) snapshot.playbackRate = [playbackRate doubleValue];
+    NSDate* timestamp = information[@"kMRMediaRemoteNowPlayingInfoTimestamp"];
+    if(timestamp) snapshot.timestamp = [timestamp timeIntervalSince1970];
+
+    snapshot.uniqueIdentifier = [information[@"kMRMediaRemoteNowPlayingInfoUniqueIdentifier"] unsignedLongLongValue];
+    snapshot.iTunesStoreIdentifier = [information[@"kMRMediaRemoteNowPlayingInfoiTunesStoreIdentifier"] unsignedLongLongValue];
+    snapshot.iTunesStoreSubscriptionAdamIdentifier = [information[@"kMRMediaRemoteNowPlayingInfoiTunesStoreSubscriptionAdamIdentifier"] unsignedLongLongValue];
+    snapshot.albumiTunesStoreAdamIdentifier = [information[@"kMRMediaRemoteNowPlayingInfoAlbumiTunesStoreAdamIdentifier"] unsignedLongLongValue];
+    snapshot.artistiTunesStoreAdamIdentifier = [information[@"kMRMediaRemoteNowPlayingInfoArtistiTunesStoreAdamIdentifier"] unsignedLongLongValue];
+
+    switch([information[@"kMRMediaRemoteNowPlayingInfoRepeatMode"] intValue]) {
+        case 1:
+            snapshot.repeatMode = kMRNowPlayingInfoRepeatModeRepeatOff;
+            break;
+        case 2:
+            snapshot.repeatMode = kMRNowPlayingInfoRepeatModeRepeatCurrent;
+            break;
+        case 3:
+            snapshot.repeatMode = kMRNowPlayingInfoRepeatModeRepeatAll;
+            break;
+        default:
+            snapshot.repeatMode = kMRNowPlayingInfoRepeatModeUnknown;
+            break;
+    }
+    switch([information[@"kMRMediaRemoteNowPlayingInfoShuffleMode"] intValue]) {
+        case 1:
+            snapshot.shuffleMode = kMRNowPlayingInfoShuffleModeOff;
+            break;
+        case 3:
+            snapshot.shuffleMode = kMRNowPlayingInfoShuffleModeOn;
+            break;
+        default:
+            snapshot.shuffleMode = kMRNowPlayingInfoShuffleModeUnknown;
+            break;
+    }
+    return snapshot;
+}
+
+NSDictionary* MRDictionaryWithPlayback(NSDictionary* information, const MRNowPlayingSnapshot& snapshot) {
+    NSMutableDictionary* copy = information ? [information mutableCopy] : [NSMutableDictionary dictionary];
+    copy[@"kMRMediaRemoteNowPlayingInfoElapsedTime"] = @(snapshot.elapsedTime);
+    if(snapshot.playbackRate >= 0) copy[@"kMRMediaRemoteNowPlayingInfoPlaybackRate"] = @(snapshot.playbackRate);
+    else [copy removeObjectForKey:@"kMRMediaRemoteNowPlayingInfoPlaybackRate"];
+    if(snapshot.timestamp > 0) copy[@"kMRMediaRemoteNowPlayingInfoTimestamp"] = [NSDate dateWithTimeIntervalSince1970:snapshot.timestamp];
+    return [copy copy];
+}
+
+NSDictionary* MRSnapshotToDictionary(const MRNowPlayingSnapshot& snapshot) {
+    if(!snapshot.hasInfo) return nil;
+    NSMutableDictionary* information = [NSMutableDictionary dictionary];
+
+    setString(information, @"kMRMediaRemoteNowPlayingInfoTitle", snapshot.title);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoArtist", snapshot.artist);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoAlbum", snapshot.albumTitle);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoComposer", snapshot.composer);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoGenre", snapshot.genre);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoContentItemIdentifier", snapshot.contentItemIdentifier);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoArtworkIdentifier", snapshot.artworkIdentifier);
+    setString(information, @"kMRMediaRemoteNowPlayingInfoArtworkMIMEType", snapshot.artworkMIMEType);
+    if(!snapshot.mediaType.empty()) setString(information, @"kMRMediaRemoteNowPlayingInfoMediaType", [kMediaTypePrefix UTF8String] + snapshot.mediaType);
+
+    if(snapshot.artworkWidth) information[@"kMRMediaRemoteNowPlayingInfoArtworkDataWidth"] = @(snapshot.artworkWidth);
+    if(snapshot.artworkHeight) information[@"kMRMediaRemoteNowPlayingInfoArtworkDataHeight"] = @(snapshot.artworkHeight);
+    information[@"kMRMediaRemoteNowPlayingInfoQueueIndex"] = @(snapshot.queueIndex);
+    information[@"kMRMediaRemoteNowPlayingInfoTotalQueueCount"] = @(snapshot.totalQueueCount);
+    information[@"kMRMediaRemoteNowPlayingInfoTotalTrackCount"] = @(snapshot.totalTrackCount);
+    information[@"kMRMediaRemoteNowPlayingInfoTrackNumber"] = @(snapshot.trackNumber);
+    information[@"kMRMediaRemoteNowPlayingInfoIsMusicApp"] = @(snapshot.isMusicApp);
+
+    information[@"kMRMediaRemoteNowPlayingInfoDuration"] = @(snapshot.duration);
+    information[@"kMRMediaRemoteNowPlayingInfoElapsedTime"] = @(snapshot.elapsedTime);
+    if(snapshot.playbackRate >= 0) information[@"kMRMediaRemoteNowPlayingInfoPlaybackRate"] = @(snapshot.playbackRate);
+    if(snapshot.timestamp > 0) information[@"kMRMediaRemoteNowPlayingInfoTimestamp"] = [NSDate dateWithTimeIntervalSince1970:snapshot.timestamp];
+
+    if(snapshot.uniqueIdentifier) information[@"kMRMediaRemoteNowPlayingInfoUniqueIdentifier"] = @(snapshot.uniqueIdentifier);
+    if(snapshot.iTunesStoreIdentifier) information[@"kMRMediaRemoteNowPlayingInfoiTunesStoreIdentifier"] = @(snapshot.iTunesStoreIdentifier);
+    if(snapshot.iTunesStoreSubscriptionAdamIdentifier) information[@"kMRMediaRemoteNowPlayingInfoiTunesStoreSubscriptionAdamIdentifier"] = @(snapshot.iTunesStoreSubscriptionAdamIdentifier);
+    if(snapshot.albumiTunesStoreAdamIdentifier) information[@"kMRMediaRemoteNowPlayingInfoAlbumiTunesStoreAdamIdentifier"] = @(snapshot.albumiTunesStoreAdamIdentifier);
+    if(snapshot.artistiTunesStoreAdamIdentifier) information[@"kMRMediaRemoteNowPlayingInfoArtistiTunesStoreAdamIdentifier"] = @(snapshot.artistiTunesStoreAdamIdentifier);
+
+    switch(snapshot.repeatMode) {
+        case kMRNowPlayingInfoRepeatModeRepeatOff:
+            information[@"kMRMediaRemoteNowPlayingInfoRepeatMode"] = @1;
+            break;
+        case kMRNowPlayingInfoRepeatModeRepeatCurrent:
+            information[@"kMRMediaRemoteNowPlayingInfoRepeatMode"] = @2;
+            break;
+        case kMRNowPlayingInfoRepeatModeRepeatAll:
+            information[@"kMRMediaRemoteNowPlayingInfoRepeatMode"] = @3;
+            break;
+        default:
+            break;
+    }
+    switch(snapshot.shuffleMode) {
+        case kMRNowPlayingInfoShuffleModeOff:
+            information[@"kMRMediaRemoteNowPlayingInfoShuffleMode"] = @1;
+            break;
+        case kMRNowPlayingInfoShuffleModeOn:
+            information[@"kMRMediaRemoteNowPlayingInfoShuffleMode"] = @3;
+            break;
+        default:
+            break;
+    }
+    return [information copy];
+}
+
+MRNotificationPayload MRNotificationPayloadFromUserInfo(NSDictionary* userInfo) {
+    MRNotificationPayload payload;
+    for(id key in userInfo) {
+        id value = userInfo[key];
+        // The PID tells the application; its name and bundle identifier go with it.
+        if([key isEqual:@"kMRMediaRemoteNowPlayingApplicationDisplayNameUserInfoKey"] || [key isEqual:@"kMRMediaRemoteNowPlayingApplicationDisplayIDUserInfoKey"] ||
+           [key isEqual:@"kMRMediaRemoteOriginUserInfoKey"]) {
+            continue;
+        }
+        if([key isEqual:@"kMRMediaRemoteNowPlayingApplicationPIDUserInfoKey"] && [value isKindOfClass:[NSNumber class]]) {
+            payload.processIdentifier = [value intValue];
+        }
+        else if([key isEqual:@"kMRMediaRemoteNowPlayingInfoPlaybackRate"] && [value isKindOfClass:[NSNumber class]]) {
+            payload.hasPlaybackRate = true;
+            payload.playbackRate = [value doubleValue];
+        }
+        else if([key isEqual:@"kMRMediaRemoteNowPlayingApplicationIsPlayingUserInfoKey"] && [value isKindOfClass:[NSNumber class]]) {
+            payload.hasIsPlaying = true;
+            payload.isPlaying = [value boolValue];
+        }
+        else if([key isEqual:@"kMRMediaRemoteNowPlayingInfoElapsedTime"] && [value isKindOfClass:[NSNumber class]]) {
+            payload.hasElapsedTime = true;
+            payload.elapsedTime = [value doubleValue];
+        }
+        else if([key isEqual:@"kMRMediaRemoteNowPlayingInfoTimestamp"] && [value isKindOfClass:[NSDate class]]) {
+            payload.timestamp = [value timeIntervalSince1970];
+        }
+        else if([key isEqual:@"kMRMediaRemoteNowPlayingInfoContentItemIdentifier"] && [value isKindOfClass:[NSString class]]) {
+            payload.contentItemIdentifier = stringValue(userInfo, key);
+        }
+        else {
+            payload.hasOtherInfo = true;
+        }
+    }
+    return payload;
+}
+
+};
@@ -0,0 +1,114 @@
+#include "MRSnapshotHistory.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace NowPlaying {
+
+const size_t MRSnapshotHistory::kMaxReaders;
+const size_t MRSnapshotHistory::kMaxRetired;
+
+MRSnapshotHistory::Guard::Guard(const MRSnapshotHistory& history) : _slot(history.pin()) {
+}
+
+MRSnapshotHistory::Guard::~Guard() {
+    _slot.epoch.store(0, std::memory_order_release);
+}
+
+MRSnapshotHistory::MRSnapshotHistory(size_t capacity) : _capacity(std::max(capacity, (size_t)1)), _ring(new std::atomic<Entry*>[_capacity]), _latest(0), _epoch(1) {
+    for(size_t i = 0; i < _capacity; i++) _ring[i].store(nullptr);
+    for(size_t i = 0; i < kMaxReaders; i++) _readers[i].epoch.store(0);
+}
+
+MRSnapshotHistory::~MRSnapshotHistory() {
+    for(size_t i = 0; i < _capacity; i++) delete _ring[i].load();
+    for(size_t i = 0; i < _retired.size(); i++) delete _retired[i].second;
+}
+
+MRSnapshotHistory::ReaderSlot& MRSnapshotHistory::pin() const {
+    // Each thread starts from the slot it got last time, so it nearly always gets it at the first try.
+    static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for(size_t attempt = 0; ; attempt++) {
+        ReaderSlot& slot = _readers[(hint + attempt) % kMaxReaders];
+        uint64_t free = 0;
+        // Announcing the epoch is sequentially consistent, so it is visible before any entry is read.
+        if(slot.epoch.load(std::memory_order_relaxed) == 0 && slot.epoch.compare_exchange_strong(free, _epoch.load())) {
+            hint = (hint + attempt) % kMaxReaders;
+            return slot;
+        }
+        if(attempt % kMaxReaders == kMaxReaders - 1) std::this_thread::yield();
+    }
+}
+
+uint64_t MRSnapshotHistory::publish(const MRNowPlayingSnapshot& snapshot) {
+    uint64_t version = _latest.load(std::memory_order_relaxed) + 1;
+    Entry* entry = new Entry;
+    entry->version = version;
+    entry->snapshot = snapshot;
+    Entry* replaced = _ring[version % _capacity].exchange(entry);
+    _latest.store(version, std::memory_order_release);
+    if(replaced) _retired.push_back(std::make_pair(_epoch.load(), replaced));
+    reclaim();
+    // A reader preempted while pinned stops the reclamation. Wait for it rather than keep more.
+    while(_retired.size() > kMaxRetired) {
+        std::this_thread::yield();
+        reclaim();
+    }
+    return version;
+}
+
+void MRSnapshotHistory::reclaim() {
+    if(_retired.empty()) return;
+    // The epoch only advances once every pinned reader has seen it.
+    uint64_t epoch = _epoch.load();
+    for(size_t i = 0; i < kMaxReaders; i++) {
+        uint64_t pinned = _readers[i].epoch.load();
+        if(pinned != 0 && pinned != epoch) return;
+    }
+    _epoch.store(++epoch);
+    // Readers are now in epoch - 1 at the earliest, so they cannot hold anything retired before it.
+    while(!_retired.empty() && _retired.front().first + 2 <= epoch) {
+        delete _retired.front().second;
+        _retired.pop_front();
+    }
+}
+
+int MRSnapshotHistory::snapshotAt(uint64_t version, MRNowPlayingSnapshot& snapshot) const {
+    if(version == 0 || version > _latest.load(std::memory_order_acquire)) return -1;
+    Guard guard(*this);
+    Entry* entry = _ring[version % _capacity].load();
+    if(!entry || entry->version != version) return -1;
+    snapshot = entry->snapshot;
+    return 0;
+}
+
+size_t MRSnapshotHistory::since(uint64_t version, std::vector<MRVersionedSnapshot>& snapshots) const {
+    uint64_t latest = _latest.load(std::memory_order_acquire);
+    uint64_t first = std::max(version + 1, latest >= _capacity ? latest - _capacity + 1 : (uint64_t)1);
+    size_t ret = 0;
+    Guard guard(*this);
+    for(uint64_t current = first; current <= latest; current++) {
+        Entry* entry = _ring[current % _capacity].load();
+        // Replaced since `latest` was read: the writer is ahead, so later versions are there.
+        if(!entry || entry->version != current) continue;
+        snapshots.push_back(MRVersionedSnapshot());
+        snapshots.back().version = current;
+        snapshots.back().snapshot = entry->snapshot;
+        ret++;
+    }
+    return ret;
+}
+
+uint64_t MRSnapshotHistory::getLatestVersion() const {
+    return _latest.load(std::memory_order_acquire);
+}
+
+size_t MRSnapshotHistory::getCapacity() const {
+    return _capacity;
+}
+
+size_t MRSnapshotHistory::getRetiredCount() const {
+    return _retired.size();
+}
+
+};
@@ -0,0 +1,115 @@
+#ifndef MRSnapshotHistory_h
+#define MRSnapshotHistory_h
+
+#include "nowplaying-snapshot.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * The last N snapshots of an instance, in a fixed-size ring indexed by version.
+ *
+ * One writer publishes, and any number of threads read without locks. Each slot of the ring points to an immutable entry,
+ * which the writer swaps when it reuses the slot. Replaced entries are freed by epoch-based reclamation (Fraser, 2004):
+ * a reader pins the current epoch for the duration of a read, the writer only advances the epoch once every pinned reader
+ * has seen it, and an entry retired in epoch e is freed once the epoch reaches e + 2, when no reader can still hold it.
+ *
+ * Up to \ref kMaxReaders threads read at the same time without waiting. More wait for one of them to finish.
+ * A reader preempted while pinned holds the epoch back, so replaced entries pile up: past \ref kMaxRetired of them,
+ * \ref publish() waits for the readers rather than let them grow without bound.
+ */
+class MRSnapshotHistory {
+public:
+
+    /// Threads reading at the same time without waiting.
+    static const size_t kMaxReaders = 64;
+
+    /// Replaced entries kept for the readers, at most.
+    static const size_t kMaxRetired = 256;
+
+    /**
+     * @param capacity How many snapshots are kept. At least 1.
+     */
+    explicit MRSnapshotHistory(size_t capacity);
+
+    ~MRSnapshotHistory();
+
+    /**
+     * Add a snapshot, replacing the oldest one if full. Must only be called by one thread at a time.
+     * Waits for the readers while more than \ref kMaxRetired replaced entries are kept.
+     *
+     * @return The version of the snapshot.
+     */
+    uint64_t publish(const MRNowPlayingSnapshot& snapshot);
+
+    /**
+     * Get one snapshot.
+     *
+     * @param version The version to get.
+     * @param snapshot Receives the snapshot.
+     * @return 0 for success, -1 if `version` is not in the history (not published yet, or replaced).
+     */
+    int snapshotAt(uint64_t version, MRNowPlayingSnapshot& snapshot) const;
+
+    /**
+     * Get the snapshots newer than a version, oldest first.
+     * If some were replaced already, the first one returned is newer than `version + 1`.
+     *
+     * @param version The version already known. 0 for all.
+     * @param snapshots Receives the snapshots, appended.
+     * @return The number of snapshots appended.
+     */
+    size_t since(uint64_t version, std::vector<MRVersionedSnapshot>& snapshots) const;
+
+    /// @return The version of the latest snapshot. 0 if none.
+    uint64_t getLatestVersion() const;
+
+    size_t getCapacity() const;
+
+    /// @return How many replaced entries wait for the readers to be freed. Only for the writer.
+    size_t getRetiredCount() const;
+
+private:
+
+    struct Entry {
+        uint64_t version;
+        MRNowPlayingSnapshot snapshot;
+    };
+
+    // The epoch a reader pinned, 0 if none. One per cache line, so readers do not slow each other down.
+    struct ReaderSlot {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    // Pins the current epoch while in scope.
+    class Guard {
+    public:
+        explicit Guard(const MRSnapshotHistory& history);
+        ~Guard();
+    private:
+        ReaderSlot& _slot;
+    };
+
+    size_t _capacity;
+    std::unique_ptr<std::atomic<Entry*>[]> _ring;
+    std::atomic<uint64_t> _latest;
+    std::atomic<uint64_t> _epoch;
+    mutable ReaderSlot _readers[kMaxReaders];
+
+    // Replaced entries with the epoch they were retired in. Only for the writer.
+    std::deque<std::pair<uint64_t, Entry*>> _retired;
+
+    ReaderSlot& pin() const;
+    void reclaim();
+};
+
+};
+
+#endif /* MRSnapshotHistory_h */
@@ -0,0 +1,312 @@
+#ifndef MRSnapshotHub_h
+#define MRSnapshotHub_h
+
+#include "MRTrace.h"
+#include "MRUpdateSequencer.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Shares one source of now playing snapshots between many subscribers.
+ *
+ * The source is observed while at least one subscriber observes, however many do.
+ * A change notification causes one fetch, and the resulting snapshot is handed to every observing subscriber.
+ * Manual updates of any subscriber join the fetch in flight, see \ref MRUpdateSequencer.
+ *
+ * Subscribers only receive the snapshots they asked for: every snapshot while observing, and the one answering each \ref update().
+ * An overlay (see \ref setOverlay()) is handed out instead of the fetched snapshots while it is set.
+ *
+ * This class does no locking. It must only be used from one serial executor, and the source must deliver its replies there too.
+ */
+template <typename Snapshot>
+class MRSnapshotHub {
+public:
+
+    typedef std::function<void()> Callback;
+
+    /**
+     * Where the snapshots come from.
+     */
+    class Source {
+    public:
+        virtual ~Source() {}
+
+        /// Start delivering change notifications to \ref MRSnapshotHub::notify().
+        virtual void startObserving() = 0;
+
+        /// Stop delivering change notifications.
+        virtual void stopObserving() = 0;
+
+        /// Fetch the current snapshot and pass it to \ref MRSnapshotHub::deliver() with `sequence`.
+        virtual void fetch(uint64_t sequence) = 0;
+    };
+
+    /**
+     * Receives the snapshots of the hub.
+     */
+    class Subscriber {
+    public:
+        virtual ~Subscriber() {}
+
+        /// Take `snapshot` as the current information. Snapshots are shared, so they must not be modified.
+        virtual void applySnapshot(const Snapshot& snapshot) = 0;
+    };
+
+    explicit MRSnapshotHub(Source* source) : _source(source), _nextSubscriberId(1), _latest(), _hasOverlay(false), _overlay(), _fanOuts(0) {
+    }
+
+    /**
+     * Add a subscriber. It receives nothing until it observes or updates.
+     *
+     * @return The identifier of the subscriber, used by all other methods.
+     */
+    uint64_t attach(Subscriber* subscriber) {
+        uint64_t id = _nextSubscriberId++;
+        _subscribers[id] = subscriber;
+        return id;
+    }
+
+    /**
+     * Remove a subscriber. It will never be called again, even for updates still in flight.
+     */
+    void detach(uint64_t id) {
+        unobserve(id);
+        _subscribers.erase(id);
+    }
+
+    /**
+     * Let a subscriber receive every snapshot fetched because of a change notification.
+     *
+     * @param callback Run after each snapshot has been applied to the subscriber. May be empty.
+     * @return 0 for success, -1 for already observing or unknown subscriber.
+     */
+    int observe(uint64_t id, const Callback& callback) {
+        if(_subscribers.find(id) == _subscribers.end() || _observers.find(id) != _observers.end()) return -1;
+        _observers[id] = callback;
+        if(_observers.size() == 1) _source->startObserving();
+        return 0;
+    }
+
+    /**
+     * Stop a subscriber from observing.
+     *
+     * @return 0 for success, -1 for not observing.
+     */
+    int unobserve(uint64_t id) {
+        if(_observers.erase(id) == 0) return -1;
+        if(_observers.empty()) _source->stopObserving();
+        return 0;
+    }
+
+    bool isObserving(uint64_t id) const {
+        return _observers.find(id) != _observers.end();
+    }
+
+    /**
+     * Get the latest snapshot for one subscriber, joining the fetch in flight if there is one.
+     *
+     * @param callback Run after the snapshot has been applied to the subscriber. May be empty.
+     */
+    void update(uint64_t id, const Callback& callback) {
+        request([this, id, callback]() {
+            typename std::map<uint64_t, Subscriber*>::iterator it = _subscribers.find(id);
+            if(it == _subscribers.end()) return;
+            MR_TRACE_SPAN("MRSnapshotHub", "update reply");
+            it->second->applySnapshot(current());
+            if(callback) {
+                MR_TRACE_SPAN("MRSnapshotHub", "callback");
+                callback();
+            }
+        }, false);
+    }
+
+    /**
+     * Tell the hub that the source changed. Fetches once and fans the snapshot out to all observers.
+     *
+     * @param done Run after the observers. May be empty.
+     */
+    void notify(const Callback& done = Callback()) {
+        request([this, done]() {
+            fanOut();
+            if(done) done();
+        }, true);
+    }
+
+    /**
+     * Fetch in case the source changed without notifying. The snapshot is fanned out to the observers only if it differs
+     * from the latest one, as told by `equal(before, after)`.
+     */
+    template <typename Equal>
+    void poll(Equal equal) {
+        Snapshot before = _latest;
+        request([this, before, equal]() {
+            if(!equal(before, _latest)) fanOut();
+        }, true);
+    }
+
+    /**
+     * Replace the latest snapshot with one the source described without being fetched, and fan it out to all observers.
+     * Must not be used while a fetch is in flight, as its reply could be older than `snapshot`, see \ref isFetching().
+     */
+    void amend(const Snapshot& snapshot) {
+        _latest = snapshot;
+        fanOut();
+    }
+
+    /**
+     * Fetch again, because the fetch in flight got stuck. Whatever waits for it is run by whichever of the two replies first;
+     * the other reply is then older than the applied snapshot and gets dropped.
+     */
+    void retry() {
+        request(MRUpdateSequencer::Waiter(), true);
+    }
+
+    /**
+     * @return true if \ref deliver() would apply the reply of the fetch `sequence` now.
+     */
+    bool accepts(uint64_t sequence) const {
+        return _sequencer.accepts(sequence);
+    }
+
+    /**
+     * Reply of \ref Source::fetch(). Older replies than the latest applied one are dropped.
+     *
+     * @return true if `snapshot` was applied, false if it was dropped.
+     */
+    bool deliver(uint64_t sequence, const Snapshot& snapshot) {
+        std::vector<MRUpdateSequencer::Waiter> ready;
+        bool applied = _sequencer.complete(sequence, ready);
+        if(applied) _latest = snapshot;
+        for(size_t i = 0; i < ready.size(); i++) ready[i]();
+        return applied;
+    }
+
+    /**
+     * Hand `overlay` to the subscribers instead of the fetched snapshots, until \ref clearOverlay().
+     * Fetches still go on and update the latest snapshot. Nothing is handed out until the next fetch or \ref publish().
+     */
+    void setOverlay(const Snapshot& overlay) {
+        _overlay = overlay;
+        _hasOverlay = true;
+    }
+
+    /// Go back to handing out the fetched snapshots.
+    void clearOverlay() {
+        _hasOverlay = false;
+        _overlay = Snapshot();
+    }
+
+    /// @return true if an overlay is set.
+    bool hasOverlay() const {
+        return _hasOverlay;
+    }
+
+    /// @return The snapshot handed out now: the overlay if set, else the latest fetched.
+    const Snapshot& current() const {
+        return _hasOverlay ? _overlay : _latest;
+    }
+
+    /**
+     * Hand the current snapshot to every observer and run their callbacks, without fetching.
+     */
+    void publish() {
+        fanOut();
+    }
+
+    /**
+     * Call `function` with each observing subscriber.
+     */
+    template <typename Function>
+    void forEachObserver(Function function) {
+        std::vector<uint64_t> ids = observerIds();
+        for(size_t i = 0; i < ids.size(); i++) {
+            if(!isObserving(ids[i])) continue;
+            function(_subscribers[ids[i]]);
+        }
+    }
+
+    /// @return true if a snapshot has been fetched and applied.
+    bool hasLatest() const {
+        return _sequencer.getAppliedSequence() != 0;
+    }
+
+    /// @return The latest applied snapshot.
+    const Snapshot& getLatest() const {
+        return _latest;
+    }
+
+    /// @return true if a fetch has not replied yet.
+    bool isFetching() const {
+        return _sequencer.isFetching();
+    }
+
+    /// @return How many fetches were issued to the source.
+    uint64_t getFetchCount() const {
+        return _sequencer.getIssuedSequence();
+    }
+
+    /// @return How many times the observers were handed a snapshot, by a notification or by \ref publish().
+    uint64_t getFanOutCount() const {
+        return _fanOuts;
+    }
+
+    /// @return How many subscribers are attached.
+    size_t getSubscriberCount() const {
+        return _subscribers.size();
+    }
+
+    /// @return How many subscribers are observing.
+    size_t getObserverCount() const {
+        return _observers.size();
+    }
+
+private:
+
+    Source* _source;
+    MRUpdateSequencer _sequencer;
+    uint64_t _nextSubscriberId;
+    std::map<uint64_t, Subscriber*> _subscribers;
+    std::map<uint64_t, Callback> _observers;
+    Snapshot _latest;
+    bool _hasOverlay;
+    Snapshot _overlay;
+    uint64_t _fanOuts;
+
+    void request(const MRUpdateSequencer::Waiter& waiter, bool invalidate) {
+        uint64_t sequence = _sequencer.request(waiter, invalidate);
+        if(sequence != 0) _source->fetch(sequence);
+    }
+
+    std::vector<uint64_t> observerIds() const {
+        std::vector<uint64_t> ids;
+        for(typename std::map<uint64_t, Callback>::const_iterator it = _observers.begin(); it != _observers.end(); ++it) ids.push_back(it->first);
+        return ids;
+    }
+
+    void fanOut() {
+        MR_TRACE_SPAN("MRSnapshotHub", "fan out");
+        // Callbacks may register or unregister subscribers, so walk a copy and look each one up again.
+        _fanOuts++;
+        std::vector<uint64_t> ids = observerIds();
+        for(size_t i = 0; i < ids.size(); i++) {
+            typename std::map<uint64_t, Callback>::iterator observer = _observers.find(ids[i]);
+            if(observer == _observers.end()) continue;
+            Callback callback = observer->second;
+            _subscribers[ids[i]]->applySnapshot(current());
+            if(callback) {
+                MR_TRACE_SPAN("MRSnapshotHub", "callback");
+                callback();
+            }
+        }
+    }
+};
+
+};
+
+#endif /* MRSnapshotHub_h */
@@ -0,0 +1,205 @@
+#include "MRSnapshotStore.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace NowPlaying {
+
+namespace {
+
+const char kMagic[4] = {'N', 'P', 'S', 'S'};
+const uint32_t kVersion = 1;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t payloadSize;   // Bytes following the header
+    uint32_t checksum;      // FNV-1a of the payload
+};
+
+struct Numbers {
+    double duration;
+    double elapsedTime;
+    double playbackRate;
+    double timestamp;
+    uint64_t uniqueIdentifier;
+    uint64_t iTunesStoreIdentifier;
+    uint64_t iTunesStoreSubscriptionAdamIdentifier;
+    uint64_t albumiTunesStoreAdamIdentifier;
+    uint64_t artistiTunesStoreAdamIdentifier;
+    int32_t artworkWidth;
+    int32_t artworkHeight;
+    int32_t queueIndex;
+    int32_t totalQueueCount;
+    int32_t totalTrackCount;
+    int32_t trackNumber;
+    int32_t repeatMode;
+    int32_t shuffleMode;
+    uint8_t hasInfo;
+    uint8_t isMusicApp;
+    uint8_t reserved[6];
+};
+
+uint32_t checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The strings of a snapshot, in file order.
+template <typename Snapshot, typename String>
+void forEachString(Snapshot& snapshot, String (&strings)[9]) {
+    strings[0] = &snapshot.title;
+    strings[1] = &snapshot.artist;
+    strings[2] = &snapshot.albumTitle;
+    strings[3] = &snapshot.composer;
+    strings[4] = &snapshot.genre;
+    strings[5] = &snapshot.mediaType;
+    strings[6] = &snapshot.contentItemIdentifier;
+    strings[7] = &snapshot.artworkIdentifier;
+    strings[8] = &snapshot.artworkMIMEType;
+}
+
+}
+
+MRSnapshotStore::MRSnapshotStore(const std::string& path) : _path(path) {
+}
+
+const std::string& MRSnapshotStore::getPath() const {
+    return _path;
+}
+
+int MRSnapshotStore::save(const MRNowPlayingSnapshot& snapshot) {
+    Numbers numbers;
+    memset(&numbers, 0, sizeof(numbers));
+    numbers.duration = snapshot.duration;
+    numbers.elapsedTime = snapshot.elapsedTime;
+    numbers.playbackRate = snapshot.playbackRate;
+    numbers.timestamp = snapshot.timestamp;
+    numbers.uniqueIdentifier = snapshot.uniqueIdentifier;
+    numbers.iTunesStoreIdentifier = snapshot.iTunesStoreIdentifier;
+    numbers.iTunesStoreSubscriptionAdamIdentifier = snapshot.iTunesStoreSubscriptionAdamIdentifier;
+    numbers.albumiTunesStoreAdamIdentifier = snapshot.albumiTunesStoreAdamIdentifier;
+    numbers.artistiTunesStoreAdamIdentifier = snapshot.artistiTunesStoreAdamIdentifier;
+    numbers.artworkWidth = snapshot.artworkWidth;
+    numbers.artworkHeight = snapshot.artworkHeight;
+    numbers.queueIndex = snapshot.queueIndex;
+    numbers.totalQueueCount = snapshot.totalQueueCount;
+    numbers.totalTrackCount = snapshot.totalTrackCount;
+    numbers.trackNumber = snapshot.trackNumber;
+    numbers.repeatMode = snapshot.repeatMode;
+    numbers.shuffleMode = snapshot.shuffleMode;
+    numbers.hasInfo = snapshot.hasInfo;
+    numbers.isMusicApp = snapshot.isMusicApp;
+
+    std::string payload((const char*)&numbers, sizeof(numbers));
+    const std::string* strings[9];
+    forEachString(snapshot, strings);
+    for(size_t i = 0; i < 9; i++) {
+        uint32_t length = (uint32_t)strings[i]->size();
+        payload.append((const char*)&length, sizeof(length));
+        payload.append(*strings[i]);
+    }
+
+    Header header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.payloadSize = (uint32_t)payload.size();
+    header.checksum = checksum(payload.data(), payload.size());
+    std::string contents((const char*)&header, sizeof(header));
+    contents.append(payload);
+    if(contents == _saved) return 0;
+
+    std::string temporaryPath = _path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if(!file) return -1;
+    bool written = fwrite(contents.data(), contents.size(), 1, file) == 1;
+    if(fclose(file) != 0) written = false;
+    if(!written || rename(temporaryPath.c_str(), _path.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        _saved.clear();
+        return -1;
+    }
+    _saved.swap(contents);
+    return 0;
+}
+
+int MRSnapshotStore::load(MRNowPlayingSnapshot& snapshot) const {
+    int fd = open(_path.c_str(), O_RDONLY);
+    if(fd < 0) return -1;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) return -1;
+
+    const char* data = (const char*)mapping;
+    int ret = -1;
+    try {
+        Header header;
+        memcpy(&header, data, sizeof(header));
+        if(memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) throw -1;
+        if(header.payloadSize != size - sizeof(header) || header.payloadSize < sizeof(Numbers)) throw -1;
+        const char* payload = data + sizeof(header);
+        if(checksum(payload, header.payloadSize) != header.checksum) throw -1;
+
+        Numbers numbers;
+        memcpy(&numbers, payload, sizeof(numbers));
+        if(numbers.repeatMode < kMRNowPlayingInfoRepeatModeRepeatOff || numbers.repeatMode > kMRNowPlayingInfoRepeatModeUnknown) throw -1;
+        if(numbers.shuffleMode < kMRNowPlayingInfoShuffleModeOff || numbers.shuffleMode > kMRNowPlayingInfoShuffleModeUnknown) throw -1;
+
+        MRNowPlayingSnapshot loaded;
+        size_t offset = sizeof(numbers);
+        std::string* strings[9];
+        forEachString(loaded, strings);
+        for(size_t i = 0; i < 9; i++) {
+            uint32_t length;
+            if(header.payloadSize - offset < sizeof(length)) throw -1;
+            memcpy(&length, payload + offset, sizeof(length));
+            offset += sizeof(length);
+            if(header.payloadSize - offset < length) throw -1;
+            strings[i]->assign(payload + offset, length);
+            offset += length;
+        }
+
+        loaded.hasInfo = numbers.hasInfo != 0;
+        loaded.stale = true;
+        loaded.duration = numbers.duration;
+        loaded.elapsedTime = numbers.elapsedTime;
+        loaded.playbackRate = numbers.playbackRate;
+        loaded.timestamp = numbers.timestamp;
+        loaded.uniqueIdentifier = numbers.uniqueIdentifier;
+        loaded.iTunesStoreIdentifier = numbers.iTunesStoreIdentifier;
+        loaded.iTunesStoreSubscriptionAdamIdentifier = numbers.iTunesStoreSubscriptionAdamIdentifier;
+        loaded.albumiTunesStoreAdamIdentifier = numbers.albumiTunesStoreAdamIdentifier;
+        loaded.artistiTunesStoreAdamIdentifier = numbers.artistiTunesStoreAdamIdentifier;
+        loaded.artworkWidth = numbers.artworkWidth;
+        loaded.artworkHeight = numbers.artworkHeight;
+        loaded.queueIndex = numbers.queueIndex;
+        loaded.totalQueueCount = numbers.totalQueueCount;
+        loaded.totalTrackCount = numbers.totalTrackCount;
+        loaded.trackNumber = numbers.trackNumber;
+        loaded.repeatMode = (MRNowPlayingInfoRepeatMode)numbers.repeatMode;
+        loaded.shuffleMode = (MRNowPlayingInfoShuffleMode)numbers.shuffleMode;
+        loaded.isMusicApp = numbers.isMusicApp != 0;
+        snapshot = loaded;
+        ret = 0;
+    }
+    catch(int) {
+        ret = -1;
+    }
+    munmap(mapping, size);
+    return ret;
+}
+
+};
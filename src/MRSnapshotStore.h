@@ -0,0 +1,48 @@
+#ifndef MRSnapshotStore_h
+#define MRSnapshotStore_h
+
+#include "nowplaying-snapshot.h"
+#include <string>
+
+namespace NowPlaying {
+
+/**
+ * Keeps one MRNowPlayingSnapshot in a small file, to serve it at the next start before the system answers.
+ *
+ * The file is a fixed header and numeric block followed by length-prefixed strings, read back through mmap() without any parsing library.
+ * It is written to a temporary file and renamed over the old one, so a reader never sees a partially written snapshot.
+ * It uses the native byte order and is only meant to be read on the machine that wrote it.
+ */
+class MRSnapshotStore {
+public:
+
+    explicit MRSnapshotStore(const std::string& path);
+
+    /**
+     * Write `snapshot` to the file, replacing the previous one.
+     * The `stale` flag is not stored. Nothing is written if the file holds it already, as saved last by this instance:
+     * the hub saves after each fetch and notification, most of which leave the snapshot as it was.
+     *
+     * @return 0 for success, -1 for failure.
+     */
+    int save(const MRNowPlayingSnapshot& snapshot);
+
+    /**
+     * Read the snapshot of the file.
+     *
+     * @param snapshot Receives the snapshot, with `stale` set. Unchanged on failure.
+     * @return 0 for success, -1 for no file, or a file which is damaged or of another version.
+     */
+    int load(MRNowPlayingSnapshot& snapshot) const;
+
+    const std::string& getPath() const;
+
+private:
+
+    std::string _path;
+    std::string _saved;         // Contents of the file as last written, empty if not written yet
+};
+
+};
+
+#endif /* MRSnapshotStore_h */
@@ -0,0 +1,115 @@
+#include "MRSpaceSaving.h"
+#include <algorithm>
+
+namespace NowPlaying {
+
+namespace {
+
+bool greaterCount(const MRSpaceSaving::Counter* a, const MRSpaceSaving::Counter* b) {
+    if(a->count != b->count) return a->count > b->count;
+    return a->error < b->error;
+}
+
+}
+
+MRSpaceSaving::MRSpaceSaving(size_t capacity) : _capacity(capacity > 0 ? capacity : 1), _total(0), _evicted(false) {
+    _heap.reserve(_capacity);
+    _index.reserve(_capacity);
+}
+
+void MRSpaceSaving::swapCounters(size_t a, size_t b) {
+    std::swap(_heap[a], _heap[b]);
+    _index[_heap[a].key] = a;
+    _index[_heap[b].key] = b;
+}
+
+void MRSpaceSaving::siftDown(size_t position) {
+    // Counts only grow, so a counter can only move down (away from the minimum).
+    size_t size = _heap.size();
+    while(true) {
+        size_t smallest = position;
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+        if(left < size && _heap[left].count < _heap[smallest].count) smallest = left;
+        if(right < size && _heap[right].count < _heap[smallest].count) smallest = right;
+        if(smallest == position) return;
+        swapCounters(position, smallest);
+        position = smallest;
+    }
+}
+
+void MRSpaceSaving::add(const std::string& key, uint64_t weight) {
+    _total += weight;
+    std::unordered_map<std::string, size_t>::iterator it = _index.find(key);
+    if(it != _index.end()) {
+        _heap[it->second].count += weight;
+        siftDown(it->second);
+        return;
+    }
+    if(_heap.size() < _capacity) {
+        // A new counter of the smallest possible count goes up from the bottom.
+        Counter counter = {key, weight, 0};
+        _heap.push_back(counter);
+        size_t position = _heap.size() - 1;
+        _index[key] = position;
+        while(position > 0) {
+            size_t parent = (position - 1) / 2;
+            if(_heap[parent].count <= _heap[position].count) break;
+            swapCounters(position, parent);
+            position = parent;
+        }
+        return;
+    }
+    // Take over the smallest counter.
+    _evicted = true;
+    _index.erase(_heap[0].key);
+    _heap[0].error = _heap[0].count;
+    _heap[0].count += weight;
+    _heap[0].key = key;
+    _index[key] = 0;
+    siftDown(0);
+}
+
+std::vector<MRSpaceSaving::Counter> MRSpaceSaving::top(size_t k) const {
+    // Rank pointers, so only the `k` counters returned have their key copied.
+    std::vector<const Counter*> counters(_heap.size());
+    for(size_t i = 0; i < _heap.size(); i++) counters[i] = &_heap[i];
+    k = std::min(k, counters.size());
+    std::partial_sort(counters.begin(), counters.begin() + k, counters.end(), greaterCount);
+    std::vector<Counter> ret;
+    ret.reserve(k);
+    for(size_t i = 0; i < k; i++) ret.push_back(*counters[i]);
+    return ret;
+}
+
+void MRSpaceSaving::clear() {
+    _heap.clear();
+    _index.clear();
+    _total = 0;
+    _evicted = false;
+}
+
+uint64_t MRSpaceSaving::getTotal() const {
+    return _total;
+}
+
+uint64_t MRSpaceSaving::getErrorBound() const {
+    return _evicted ? _total / _capacity : 0;
+}
+
+size_t MRSpaceSaving::getCapacity() const {
+    return _capacity;
+}
+
+size_t MRSpaceSaving::getSize() const {
+    return _heap.size();
+}
+
+size_t MRSpaceSaving::getMemoryUsage() const {
+    size_t bytes = sizeof(*this) + _heap.capacity() * sizeof(Counter);
+    bytes += _index.bucket_count() * sizeof(void*) + _index.size() * (sizeof(std::string) + sizeof(size_t) + 2 * sizeof(void*));
+    for(size_t i = 0; i < _heap.size(); i++) bytes += 2 * _heap[i].key.capacity();     // The key and its copy in the index
+    return bytes;
+}
+
+};
@@ -0,0 +1,72 @@
+#ifndef MRSpaceSaving_h
+#define MRSpaceSaving_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * The Space-Saving heavy hitters sketch (Metwally, Agrawal and El Abbadi, 2005), with string keys.
+ *
+ * It keeps at most `capacity` counters whatever the number of distinct keys. When full, a new key takes over the smallest counter,
+ * inheriting its count as error. With N the total of all increments and m the capacity:
+ *
+ * - a reported count is never below the true count, and at most `error` above it, with error <= N / m;
+ * - every key whose true count is above N / m is in the sketch.
+ *
+ * Counters are kept in a min-heap indexed by a hash table, so \ref add() costs O(log m).
+ */
+class MRSpaceSaving {
+public:
+
+    struct Counter {
+        std::string key;
+        uint64_t count;     /*!< Upper bound of the true count. */
+        uint64_t error;     /*!< The true count is at least count - error. */
+    };
+
+    explicit MRSpaceSaving(size_t capacity);
+
+    /// Count `weight` occurrences of `key`.
+    void add(const std::string& key, uint64_t weight = 1);
+
+    /**
+     * Get the `k` keys with the largest counts, largest first.
+     */
+    std::vector<Counter> top(size_t k) const;
+
+    /// Forget everything.
+    void clear();
+
+    /// @return The total of all increments (N).
+    uint64_t getTotal() const;
+
+    /// @return The maximum error of any count: N / m, or 0 while the sketch never had to evict.
+    uint64_t getErrorBound() const;
+
+    size_t getCapacity() const;
+
+    size_t getSize() const;
+
+    /// @return An estimate of the memory used, in bytes.
+    size_t getMemoryUsage() const;
+
+private:
+
+    size_t _capacity;
+    uint64_t _total;
+    bool _evicted;
+    std::vector<Counter> _heap;
+    std::unordered_map<std::string, size_t> _index;
+
+    void siftDown(size_t position);
+    void swapCounters(size_t a, size_t b);
+};
+
+};
+
+#endif /* MRSpaceSaving_h */
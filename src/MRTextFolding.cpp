@@ -0,0 +1,133 @@
+#include "MRTextFolding.h"
+#include <algorithm>
+
+namespace NowPlaying {
+
+namespace {
+
+// Base letters of U+00C0 to U+00FF. Digits stand for expansions, see kExpansions.
+const char kLatin1[] = "aaaaaa1ceeeeiiiidnooooo ouuuuy34aaaaaa1ceeeeiiiidnooooo ouuuuy3y";
+
+// Base letters of U+0100 to U+017F (Latin Extended-A).
+const char kLatinExtendedA[] = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii55jjkkkllllllllllnnnnnnnnnoooooo66rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+const char* const kExpansions[] = {0, "ae", 0, "th", "ss", "ij", "oe"};
+
+const uint32_t kSpace = ' ';
+
+// Decode the code point at `text[i]`, advancing `i`. Returns UINT32_MAX for an invalid sequence, skipping its first byte.
+uint32_t decode(const unsigned char* text, size_t length, size_t& i) {
+    unsigned char c = text[i];
+    size_t extra = c < 0x80 ? 0 : (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : 4;
+    if(extra == 4 || i + extra >= length + (extra ? 0 : 1)) {
+        i++;
+        return UINT32_MAX;
+    }
+    uint32_t ret = extra == 0 ? c : c & (0x3F >> extra);
+    for(size_t j = 1; j <= extra; j++) {
+        if((text[i + j] & 0xC0) != 0x80) {
+            i++;
+            return UINT32_MAX;
+        }
+        ret = (ret << 6) | (text[i + j] & 0x3F);
+    }
+    i += extra + 1;
+    return ret;
+}
+
+void append(std::vector<uint32_t>& folded, uint32_t c) {
+    if(c == kSpace && (folded.empty() || folded.back() == kSpace)) return;
+    folded.push_back(c);
+}
+
+void appendLetter(std::vector<uint32_t>& folded, char letter) {
+    if(letter == ' ') {
+        append(folded, kSpace);
+        return;
+    }
+    if(letter >= '1' && letter <= '6') {
+        for(const char* c = kExpansions[letter - '0']; *c; c++) folded.push_back((uint32_t)*c);
+        return;
+    }
+    folded.push_back((uint32_t)letter);
+}
+
+uint32_t foldGreek(uint32_t c) {
+    if(c >= 0x0391 && c <= 0x03A9) return c + 0x20;
+    switch(c) {
+        case 0x0386: case 0x03AC: return 0x03B1;
+        case 0x0388: case 0x03AD: return 0x03B5;
+        case 0x0389: case 0x03AE: return 0x03B7;
+        case 0x038A: case 0x03AF: case 0x03AA: case 0x03CA: case 0x0390: return 0x03B9;
+        case 0x038C: case 0x03CC: return 0x03BF;
+        case 0x038E: case 0x03CD: case 0x03AB: case 0x03CB: case 0x03B0: return 0x03C5;
+        case 0x038F: case 0x03CE: return 0x03C9;
+        case 0x03C2: return 0x03C3;
+        default: return c;
+    }
+}
+
+uint32_t foldCyrillic(uint32_t c) {
+    if(c >= 0x0410 && c <= 0x042F) return c + 0x20;
+    if(c >= 0x0400 && c <= 0x040F) c += 0x50;
+    if(c == 0x0451) return 0x0435;
+    return c;
+}
+
+}
+
+void MRFoldText(const char* text, size_t length, std::vector<uint32_t>& folded) {
+    folded.clear();
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text);
+    for(size_t i = 0; i < length;) {
+        uint32_t c = decode(bytes, length, i);
+        if(c == UINT32_MAX) continue;
+        if(c >= 0xFF01 && c <= 0xFF5E) c -= 0xFEE0;
+
+        if(c < 0x80) {
+            if(c >= 'A' && c <= 'Z') folded.push_back(c + 0x20);
+            else if((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) folded.push_back(c);
+            else if(c != '\'') append(folded, kSpace);
+        }
+        else if(c < 0xC0) append(folded, kSpace);
+        else if(c < 0x100) appendLetter(folded, kLatin1[c - 0xC0]);
+        else if(c < 0x180) appendLetter(folded, kLatinExtendedA[c - 0x100]);
+        else if(c >= 0x0300 && c <= 0x036F) continue;           // Combining diacritical marks
+        else if(c >= 0x0370 && c <= 0x03FF) folded.push_back(foldGreek(c));
+        else if(c >= 0x0400 && c <= 0x04FF) folded.push_back(foldCyrillic(c));
+        else if(c == 0x2018 || c == 0x2019) continue;           // Typographic apostrophes
+        else if((c >= 0x2000 && c <= 0x206F) || (c >= 0x3000 && c <= 0x3003) || c == 0xFEFF) append(folded, kSpace);
+        else folded.push_back(c);
+    }
+    if(!folded.empty() && folded.back() == kSpace) folded.pop_back();
+}
+
+void MRTrigramsOf(const std::vector<uint32_t>& folded, std::vector<uint64_t>& trigrams) {
+    trigrams.clear();
+    if(folded.empty()) return;
+    uint64_t window = kSpace;
+    for(size_t i = 0; i <= folded.size(); i++) {
+        uint64_t c = i < folded.size() ? folded[i] : kSpace;
+        window = ((window << 21) | c) & ((1ull << 63) - 1);
+        if(i >= 1) trigrams.push_back(window);
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+double MRTrigramSimilarity(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b) {
+    if(a.empty() && b.empty()) return 1.0;
+    size_t common = 0;
+    for(size_t i = 0, j = 0; i < a.size() && j < b.size();) {
+        if(a[i] < b[j]) i++;
+        else if(b[j] < a[i]) j++;
+        else {
+            common++;
+            i++;
+            j++;
+        }
+    }
+    return 2.0 * common / (a.size() + b.size());
+}
+
+};
@@ -0,0 +1,41 @@
+#ifndef MRTextFolding_h
+#define MRTextFolding_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Fold UTF-8 text for matching: "Beyoncé – Halo (Live)" and "BEYONCE halo live" fold to the same code points.
+ *
+ * Letters are lowercased and their diacritics removed, for Latin (up to Latin Extended-A), Greek and Cyrillic,
+ * whether precomposed or followed by combining marks (as in the decomposed file names of macOS). Ligatures are expanded
+ * (æ to "ae", ß to "ss") and fullwidth forms narrowed. Apostrophes are dropped ("don't" matches "dont"),
+ * other punctuation and symbols of ASCII, Latin-1 and General Punctuation become spaces,
+ * and runs of spaces are collapsed and trimmed. Other scripts are kept as they are. Invalid UTF-8 bytes are dropped.
+ *
+ * @param text The text, in UTF-8.
+ * @param length Its length in bytes.
+ * @param folded Receives the code points of the folded text, replacing its contents.
+ */
+void MRFoldText(const char* text, size_t length, std::vector<uint32_t>& folded);
+
+/**
+ * Get the trigrams of folded text, sorted and without duplicates.
+ * The text is padded with a space on each side, so that even one character has a trigram and word boundaries count.
+ *
+ * @param folded Code points from MRFoldText().
+ * @param trigrams Receives the trigrams, each packing 3 code points of 21 bits, replacing its contents.
+ */
+void MRTrigramsOf(const std::vector<uint32_t>& folded, std::vector<uint64_t>& trigrams);
+
+/**
+ * @return The similarity of two trigram sets from MRTrigramsOf(), from 0 (nothing in common) to 1 (equal): 2 |a ∩ b| / (|a| + |b|).
+ */
+double MRTrigramSimilarity(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b);
+
+};
+
+#endif /* MRTextFolding_h */
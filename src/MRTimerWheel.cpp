@@ -0,0 +1,148 @@
+#include "MRTimerWheel.h"
+#include <algorithm>
+
+namespace NowPlaying {
+
+const MRTimerWheel::Handle MRTimerWheel::kInvalidHandle;
+
+MRTimerWheel::MRTimerWheel(uint64_t now) : _current(now), _size(0) {
+    std::fill(_heads, _heads + kLevels * kSlots, kInvalidHandle);
+}
+
+MRTimerWheel::Handle MRTimerWheel::schedule(uint64_t expires, uint64_t payload) {
+    Handle handle;
+    if(!_free.empty()) {
+        handle = _free.back();
+        _free.pop_back();
+    }
+    else {
+        handle = _nodes.size();
+        _nodes.push_back(Node());
+    }
+    _nodes[handle].expires = expires;
+    _nodes[handle].payload = payload;
+    place(handle);
+    _size++;
+    return handle;
+}
+
+int MRTimerWheel::cancel(Handle handle) {
+    if(handle >= _nodes.size() || _nodes[handle].slot < 0) return -1;
+    unlink(handle);
+    _free.push_back(handle);
+    _size--;
+    return 0;
+}
+
+void MRTimerWheel::place(Handle handle) {
+    Node& node = _nodes[handle];
+    // Past timers go to the current slot, expiring at the next advance.
+    uint64_t expires = std::max(node.expires, _current);
+    uint64_t delta = expires - _current;
+    int level = 0;
+    while(level < kLevels - 1 && delta >= ((uint64_t)1 << (kSlotBits * (level + 1)))) level++;
+    if(delta >= ((uint64_t)1 << (kSlotBits * kLevels))) {
+        // Beyond the reach of the wheel: wait in the farthest slot, then be placed again.
+        expires = _current + ((uint64_t)1 << (kSlotBits * kLevels)) - 1;
+    }
+    int index = (int)((expires >> (kSlotBits * level)) & (kSlots - 1));
+    node.slot = level * kSlots + index;
+    node.previous = kInvalidHandle;
+    node.next = _heads[node.slot];
+    if(node.next != kInvalidHandle) _nodes[node.next].previous = handle;
+    _heads[node.slot] = handle;
+}
+
+void MRTimerWheel::unlink(Handle handle) {
+    Node& node = _nodes[handle];
+    if(node.previous != kInvalidHandle) _nodes[node.previous].next = node.next;
+    else _heads[node.slot] = node.next;
+    if(node.next != kInvalidHandle) _nodes[node.next].previous = node.previous;
+    node.slot = -1;
+}
+
+void MRTimerWheel::cascade(int level) {
+    int slot = level * kSlots + (int)((_current >> (kSlotBits * level)) & (kSlots - 1));
+    Handle handle = _heads[slot];
+    _heads[slot] = kInvalidHandle;
+    while(handle != kInvalidHandle) {
+        Handle next = _nodes[handle].next;
+        place(handle);
+        handle = next;
+    }
+}
+
+void MRTimerWheel::advance(uint64_t now, std::vector<uint64_t>& expired) {
+    // Timers only move down when cascading, so the earliest expiry only changes when timers expire.
+    uint64_t next = nextExpiry();
+    while(true) {
+        // Expire the current slot, including timers scheduled in the past since the last advance.
+        int slot = (int)(_current & (kSlots - 1));
+        Handle handle = _heads[slot];
+        if(handle != kInvalidHandle) {
+            _heads[slot] = kInvalidHandle;
+            while(handle != kInvalidHandle) {
+                Handle following = _nodes[handle].next;
+                expired.push_back(_nodes[handle].payload);
+                _nodes[handle].slot = -1;
+                _free.push_back(handle);
+                _size--;
+                handle = following;
+            }
+            next = nextExpiry();
+        }
+        if(_current >= now) return;
+        if(_size == 0) {
+            _current = now;
+            return;
+        }
+
+        // Nothing expires before `next`, and no timer moves down before the next cascade: jump to the earliest.
+        _current = std::max(_current + 1, std::min(std::min(now, next), nextCascade()));
+        if((_current & (kSlots - 1)) == 0) {
+            for(int level = 1; level < kLevels; level++) {
+                cascade(level);
+                if(((_current >> (kSlotBits * level)) & (kSlots - 1)) != 0) break;
+            }
+        }
+    }
+}
+
+uint64_t MRTimerWheel::nextCascade() const {
+    uint64_t ret = UINT64_MAX;
+    for(int level = 1; level < kLevels; level++) {
+        // A slot cascades when the wheel reaches its first tick. The current one has turned already, so it comes last.
+        uint64_t turn = _current >> (kSlotBits * level);
+        for(uint64_t i = 1; i <= kSlots; i++) {
+            if(_heads[level * kSlots + ((turn + i) & (kSlots - 1))] == kInvalidHandle) continue;
+            ret = std::min(ret, (turn + i) << (kSlotBits * level));
+            break;
+        }
+    }
+    return ret;
+}
+
+uint64_t MRTimerWheel::nextExpiry() const {
+    uint64_t ret = UINT64_MAX;
+    for(int level = 0; level < kLevels; level++) {
+        // The current slot of level 0 holds the timers due now. Those of the upper levels hold timers a whole turn away, so they come last.
+        int current = (int)((_current >> (kSlotBits * level)) & (kSlots - 1));
+        for(int i = level == 0 ? 0 : 1; i < (level == 0 ? kSlots : kSlots + 1); i++) {
+            Handle handle = _heads[level * kSlots + ((current + i) & (kSlots - 1))];
+            if(handle == kInvalidHandle) continue;
+            for(; handle != kInvalidHandle; handle = _nodes[handle].next) ret = std::min(ret, _nodes[handle].expires);
+            break;
+        }
+    }
+    return ret == UINT64_MAX ? ret : std::max(ret, _current);
+}
+
+uint64_t MRTimerWheel::getCurrent() const {
+    return _current;
+}
+
+size_t MRTimerWheel::getSize() const {
+    return _size;
+}
+
+};
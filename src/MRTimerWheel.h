@@ -0,0 +1,99 @@
+#ifndef MRTimerWheel_h
+#define MRTimerWheel_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * A hierarchical timing wheel (Varghese and Lauck, 1987) of integer ticks.
+ *
+ * Five levels of 64 slots cover 2^30 ticks ahead. Timers farther away wait in the last level and are placed again when it turns.
+ * Scheduling and cancelling cost O(1). Advancing jumps from one non-empty slot to the next, whatever the level,
+ * so it costs O(1) per slot reached plus O(1) per timer moved down a level or expired, and empty ticks and turns are skipped in one step.
+ * \ref nextExpiry() tells how far the owner may sleep.
+ *
+ * This class does no locking.
+ */
+class MRTimerWheel {
+public:
+
+    /// Identifies a scheduled timer. Stays valid until the timer expires or is cancelled.
+    typedef size_t Handle;
+
+    static const Handle kInvalidHandle = (Handle)-1;
+
+    /**
+     * @param now The tick the wheel starts at.
+     */
+    explicit MRTimerWheel(uint64_t now = 0);
+
+    /**
+     * Schedule a timer.
+     *
+     * @param expires The tick to expire at. Timers in the past expire at the next \ref advance().
+     * @param payload Given back when the timer expires.
+     * @return The handle of the timer.
+     */
+    Handle schedule(uint64_t expires, uint64_t payload);
+
+    /**
+     * Cancel a timer.
+     *
+     * @return 0 for success, -1 for unknown handle.
+     */
+    int cancel(Handle handle);
+
+    /**
+     * Move the wheel to `now`, expiring the timers due by then.
+     *
+     * @param expired Receives the payloads of the expired timers, tick by tick.
+     */
+    void advance(uint64_t now, std::vector<uint64_t>& expired);
+
+    /**
+     * Get the tick of the earliest timer.
+     *
+     * @return The tick (the current one for timers in the past), or UINT64_MAX if no timer is scheduled.
+     */
+    uint64_t nextExpiry() const;
+
+    /// @return The tick the wheel is at.
+    uint64_t getCurrent() const;
+
+    /// @return How many timers are scheduled.
+    size_t getSize() const;
+
+private:
+
+    static const int kLevels = 5;
+    static const int kSlotBits = 6;
+    static const int kSlots = 1 << kSlotBits;
+
+    struct Node {
+        uint64_t expires;
+        uint64_t payload;
+        Handle previous;
+        Handle next;
+        int slot;               // level * kSlots + index, or -1 when free
+    };
+
+    uint64_t _current;
+    size_t _size;
+    std::vector<Node> _nodes;
+    std::vector<Handle> _free;
+    Handle _heads[kLevels * kSlots];
+
+    void place(Handle handle);
+    void unlink(Handle handle);
+    void cascade(int level);
+
+    // The next tick after the current one at which a non-empty slot of the upper levels cascades, or UINT64_MAX.
+    uint64_t nextCascade() const;
+};
+
+};
+
+#endif /* MRTimerWheel_h */
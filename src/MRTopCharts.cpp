@@ -0,0 +1,110 @@
+#include "MRTopCharts.h"
+#include <cmath>
+
+namespace NowPlaying {
+
+namespace {
+
+// Separates the fields of album and track keys. Cannot appear in the UTF-8 text of a tag.
+const char kSeparator = '\x1f';
+
+void splitKey(const std::string& key, MRTopChartsEntry& entry) {
+    std::string* fields[3] = {&entry.artist, &entry.albumTitle, &entry.title};
+    size_t field = 0;
+    size_t begin = 0;
+    while(field < 3) {
+        size_t end = key.find(kSeparator, begin);
+        fields[field++]->assign(key, begin, end == std::string::npos ? std::string::npos : end - begin);
+        if(end == std::string::npos) break;
+        begin = end + 1;
+    }
+}
+
+}
+
+MRTopChartsInterface* MRTopChartsInterface::Create(const MRTopChartsConfig& config) {
+    return new MRTopCharts(config);
+}
+
+void MRTopChartsInterface::Delete(MRTopChartsInterface* instance) {
+    delete instance;
+    instance = 0;
+}
+
+MRTopCharts::MRTopCharts(const MRTopChartsConfig& config) : _config(config) {
+    const double lengths[3] = {3600.0, 86400.0, 0.0};
+    for(int i = 0; i < 3; i++) {
+        _windows[i].length = lengths[i];
+        _windows[i].start = 0.0;
+        for(int category = 0; category < 3; category++) _windows[i].charts.push_back(MRSpaceSaving(config.capacity));
+    }
+}
+
+MRTopCharts::~MRTopCharts() {
+}
+
+MRTopCharts::Window& MRTopCharts::roll(MRTopChartsWindow window, double now) {
+    Window& ret = _windows[window];
+    if(ret.length <= 0) return ret;
+    double start = std::floor((now + _config.utcOffset) / ret.length) * ret.length - _config.utcOffset;
+    if(start > ret.start) {
+        ret.start = start;
+        for(size_t i = 0; i < ret.charts.size(); i++) ret.charts[i].clear();
+    }
+    return ret;
+}
+
+int MRTopCharts::feed(const MRNowPlayingSnapshot& snapshot, double now) {
+    if(snapshot.stale || snapshot.provisional) return 0;
+    if(!snapshot.hasInfo) {
+        _lastTrack.clear();
+        return 0;
+    }
+    if(snapshot.playbackRate <= 0) return 0;
+    std::string track = snapshot.contentItemIdentifier;
+    if(track.empty()) track = snapshot.artist + kSeparator + snapshot.albumTitle + kSeparator + snapshot.title;
+    if(track == _lastTrack) return 0;
+    _lastTrack = track;
+    addPlay(snapshot.artist, snapshot.albumTitle, snapshot.title, now);
+    return 1;
+}
+
+void MRTopCharts::addPlay(const std::string& artist, const std::string& albumTitle, const std::string& title, double now) {
+    std::string album = artist + kSeparator + albumTitle;
+    std::string track = album + kSeparator + title;
+    for(int i = 0; i < 3; i++) {
+        Window& window = roll((MRTopChartsWindow)i, now);
+        window.charts[kMRTopChartsCategoryArtist].add(artist);
+        window.charts[kMRTopChartsCategoryAlbum].add(album);
+        window.charts[kMRTopChartsCategoryTrack].add(track);
+    }
+}
+
+std::vector<MRTopChartsEntry> MRTopCharts::getTop(MRTopChartsCategory category, MRTopChartsWindow window, size_t k, double now) {
+    std::vector<MRSpaceSaving::Counter> counters = roll(window, now).charts[category].top(k);
+    std::vector<MRTopChartsEntry> ret(counters.size());
+    for(size_t i = 0; i < counters.size(); i++) {
+        splitKey(counters[i].key, ret[i]);
+        ret[i].count = counters[i].count;
+        ret[i].error = counters[i].error;
+    }
+    return ret;
+}
+
+uint64_t MRTopCharts::getPlayCount(MRTopChartsWindow window, double now) {
+    return roll(window, now).charts[kMRTopChartsCategoryArtist].getTotal();
+}
+
+uint64_t MRTopCharts::getErrorBound(MRTopChartsCategory category, MRTopChartsWindow window, double now) {
+    return roll(window, now).charts[category].getErrorBound();
+}
+
+size_t MRTopCharts::getMemoryUsage() {
+    size_t ret = sizeof(*this);
+    for(int i = 0; i < 3; i++) {
+        for(size_t category = 0; category < _windows[i].charts.size(); category++) ret += _windows[i].charts[category].getMemoryUsage();
+    }
+    return ret;
+}
+
+};
@@ -0,0 +1,94 @@
+#ifndef MRTopCharts_h
+#define MRTopCharts_h
+
+#include "nowplaying-charts.h"
+#include "MRSpaceSaving.h"
+#include <string>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Ranks the most played artists, albums and tracks of this hour, this day and all time, in bounded memory.
+ *
+ * Each chart is a Space-Saving sketch (see MRSpaceSaving) of `capacity` counters.
+ * A play is counted when a track starts playing. Resuming or re-reporting the same track does not count again.
+ *
+ * An instance is not thread-safe.
+ */
+class MRTopCharts : public MRTopChartsInterface {
+private:
+
+    struct Window {
+        double length;                      // Seconds. 0 for all time.
+        double start;
+        std::vector<MRSpaceSaving> charts;  // Indexed by MRTopChartsCategory
+    };
+
+    MRTopChartsConfig _config;
+    Window _windows[3];                     // Indexed by MRTopChartsWindow
+    std::string _lastTrack;
+
+    Window& roll(MRTopChartsWindow window, double now);
+
+public:
+
+    MRTopCharts(const MRTopChartsConfig& config);
+
+    ~MRTopCharts();
+
+    /**
+     * Take a new snapshot, counting a play if a new track started playing.
+     *
+     * @param snapshot The now playing information. Stale and provisional snapshots are ignored.
+     * @param now The UNIX time (with fraction) the snapshot was received.
+     * @return 1 if a play was counted, 0 if not.
+     */
+    int feed(const MRNowPlayingSnapshot& snapshot, double now);
+
+    /**
+     * Count a play.
+     *
+     * @param artist UTF-8 name of the artist.
+     * @param albumTitle UTF-8 title of the album.
+     * @param title UTF-8 title of the track.
+     * @param now The UNIX time (with fraction) of the play.
+     */
+    void addPlay(const std::string& artist, const std::string& albumTitle, const std::string& title, double now);
+
+    /**
+     * Get the top of a chart.
+     *
+     * @param category What to rank.
+     * @param window The period to rank.
+     * @param k The maximum number of entries.
+     * @param now The UNIX time (with fraction) of now. The hour and day charts are empty once their period is over.
+     * @return Up to `k` entries, most played first.
+     */
+    std::vector<MRTopChartsEntry> getTop(MRTopChartsCategory category, MRTopChartsWindow window, size_t k, double now);
+
+    /**
+     * Get the number of plays counted in a period.
+     *
+     * @return The number of plays (N) in `window` at `now`.
+     */
+    uint64_t getPlayCount(MRTopChartsWindow window, double now);
+
+    /**
+     * Get the largest possible overestimation of the counts of a chart.
+     *
+     * @return N / m, or 0 if the chart never had to forget anything (its counts are then exact).
+     */
+    uint64_t getErrorBound(MRTopChartsCategory category, MRTopChartsWindow window, double now);
+
+    /**
+     * Get an estimate of the memory used by all the charts.
+     *
+     * @return The memory used, in bytes.
+     */
+    size_t getMemoryUsage();
+};
+
+};
+
+#endif /* MRTopCharts_h */
@@ -0,0 +1,175 @@
+#include "MRTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+namespace NowPlaying {
+
+namespace {
+
+std::atomic<bool> enabled(false);
+
+const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+// Every buffer ever created. Buffers outlive their threads, so that their events can still be exported:
+// there is one per thread which recorded, which the thread pools of the system keep bounded.
+std::mutex buffersLock;
+std::vector<MRTraceBuffer*>& buffers() {
+    static std::vector<MRTraceBuffer*>* ret = new std::vector<MRTraceBuffer*>;
+    return *ret;
+}
+
+MRTraceBuffer* threadBuffer() {
+    static thread_local MRTraceBuffer* buffer = 0;
+    if(!buffer) {
+        std::lock_guard<std::mutex> lock(buffersLock);
+        buffer = new MRTraceBuffer(buffers().size() + 1);
+        buffers().push_back(buffer);
+    }
+    return buffer;
+}
+
+void appendString(std::string& json, const char* value) {
+    json += '"';
+    for(const char* c = value ? value : ""; *c; c++) {
+        if(*c == '"' || *c == '\\') json += '\\';
+        if((unsigned char)*c < 0x20) continue;
+        json += *c;
+    }
+    json += '"';
+}
+
+}
+
+MRTraceBuffer::MRTraceBuffer(uint64_t thread) : _thread(thread), _slots(new Slot[kCapacity]), _written(0), _cleared(0) {
+    for(size_t i = 0; i < kCapacity; i++) _slots[i].sequence.store(0, std::memory_order_relaxed);
+}
+
+void MRTraceBuffer::record(const Event& event) {
+    uint64_t index = _written.load(std::memory_order_relaxed);
+    Slot& slot = _slots[index % kCapacity];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.phase.store(event.phase, std::memory_order_relaxed);
+    slot.category.store(event.category, std::memory_order_relaxed);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.begin.store(event.begin, std::memory_order_relaxed);
+    slot.duration.store(event.duration, std::memory_order_relaxed);
+    slot.id.store(event.id, std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    _written.store(index + 1, std::memory_order_release);
+}
+
+size_t MRTraceBuffer::exportJSON(std::string& json, int pid) const {
+    uint64_t written = _written.load(std::memory_order_acquire);
+    uint64_t first = written > kCapacity ? written - kCapacity : 0;
+    first = std::max(first, _cleared.load(std::memory_order_relaxed));
+    size_t ret = 0;
+    char number[160];
+    for(uint64_t index = first; index < written; index++) {
+        const Slot& slot = _slots[index % kCapacity];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if(sequence != 2 * index + 2) continue;
+        Event event = {slot.phase.load(std::memory_order_relaxed), slot.category.load(std::memory_order_relaxed), slot.name.load(std::memory_order_relaxed),
+                       slot.begin.load(std::memory_order_relaxed), slot.duration.load(std::memory_order_relaxed), slot.id.load(std::memory_order_relaxed)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // Overwritten while reading: skip it.
+        if(slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+        json += "{\"name\":";
+        appendString(json, event.name);
+        json += ",\"cat\":";
+        appendString(json, event.category);
+        snprintf(number, sizeof(number), ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%llu", event.phase, event.begin / 1e3, pid, (unsigned long long)_thread);
+        json += number;
+        if(event.phase == 'X') snprintf(number, sizeof(number), ",\"dur\":%.3f},", event.duration / 1e3);
+        else snprintf(number, sizeof(number), ",\"id\":\"0x%llx\"},", (unsigned long long)event.id);
+        json += number;
+        ret++;
+    }
+    return ret;
+}
+
+void MRTraceBuffer::clear() {
+    _cleared.store(_written.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+uint64_t MRTraceBuffer::getOverwrittenCount() const {
+    uint64_t written = _written.load(std::memory_order_acquire);
+    uint64_t cleared = _cleared.load(std::memory_order_relaxed);
+    return written - cleared > kCapacity ? written - cleared - kCapacity : 0;
+}
+
+bool MRTraceIsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t MRTraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void MRTraceRecord(const MRTraceBuffer::Event& event) {
+    threadBuffer()->record(event);
+}
+
+void MRTraceRecordAsync(char phase, const char* category, const char* name, uint64_t id) {
+    if(!MRTraceIsEnabled()) return;
+    MRTraceBuffer::Event event = {phase, category, name, MRTraceNow(), 0, id};
+    MRTraceRecord(event);
+}
+
+bool MRTrace::IsCompiled() {
+#ifdef NOWPLAYING_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MRTrace::SetEnabled(bool enable) {
+    enabled.store(enable);
+}
+
+bool MRTrace::IsEnabled() {
+    return MRTraceIsEnabled();
+}
+
+void MRTrace::Clear() {
+    std::lock_guard<std::mutex> lock(buffersLock);
+    for(size_t i = 0; i < buffers().size(); i++) buffers()[i]->clear();
+}
+
+std::string MRTrace::ExportJSON() {
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    int pid = (int)getpid();
+    size_t events = 0;
+    {
+        std::lock_guard<std::mutex> lock(buffersLock);
+        for(size_t i = 0; i < buffers().size(); i++) events += buffers()[i]->exportJSON(json, pid);
+    }
+    if(events) json.erase(json.size() - 1);
+    json += "]}\n";
+    return json;
+}
+
+int MRTrace::WriteJSON(const char* path) {
+    if(!path) return -1;
+    std::string json = ExportJSON();
+    FILE* file = fopen(path, "wb");
+    if(!file) return -1;
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    if(fclose(file) != 0) written = false;
+    return written ? 0 : -1;
+}
+
+uint64_t MRTrace::GetOverwrittenCount() {
+    std::lock_guard<std::mutex> lock(buffersLock);
+    uint64_t ret = 0;
+    for(size_t i = 0; i < buffers().size(); i++) ret += buffers()[i]->getOverwrittenCount();
+    return ret;
+}
+
+};
@@ -0,0 +1,132 @@
+#ifndef MRTrace_h
+#define MRTrace_h
+
+#include "nowplaying-trace.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Instrumentation of the library, see MRTrace. Names and categories must be string literals (or live as long as the process).
+ *
+ *     MR_TRACE_SPAN("MRNowPlayingInfo", "update");                     // From here to the end of the scope
+ *     MR_TRACE_ASYNC_BEGIN("MRMediaRemoteHub", "fetch", sequence);     // Ends in another scope or thread, matched by id
+ *     MR_TRACE_ASYNC_END("MRMediaRemoteHub", "fetch", sequence);
+ *
+ * Without NOWPLAYING_TRACING defined, these expand to nothing. It must be defined (or not) for the whole build, not per file,
+ * as templates such as MRSnapshotHub trace in the files including them: the Xcode project defines it for all the targets.
+ */
+#ifdef NOWPLAYING_TRACING
+#define MR_TRACE_CONCAT_(a, b) a##b
+#define MR_TRACE_CONCAT(a, b) MR_TRACE_CONCAT_(a, b)
+#define MR_TRACE_SPAN(category, name) NowPlaying::MRTraceSpan MR_TRACE_CONCAT(_traceSpan, __LINE__)(category, name)
+#define MR_TRACE_ASYNC_BEGIN(category, name, id) NowPlaying::MRTraceRecordAsync('b', category, name, id)
+#define MR_TRACE_ASYNC_END(category, name, id) NowPlaying::MRTraceRecordAsync('e', category, name, id)
+#else
+#define MR_TRACE_SPAN(category, name) do {} while(0)
+#define MR_TRACE_ASYNC_BEGIN(category, name, id) do {} while(0)
+#define MR_TRACE_ASYNC_END(category, name, id) do {} while(0)
+#endif
+
+namespace NowPlaying {
+
+/**
+ * The events recorded by one thread, in a ring of fixed size.
+ *
+ * Only its thread writes. Any thread may read at the same time: each event is guarded by a sequence number (a seqlock),
+ * so a reader skips the events being overwritten instead of waiting.
+ */
+class MRTraceBuffer {
+public:
+
+    static const size_t kCapacity = 8192;
+
+    struct Event {
+        char phase;             // 'X' complete, 'b' and 'e' async begin and end
+        const char* category;
+        const char* name;
+        uint64_t begin;         // Nanoseconds since the origin of the trace
+        uint64_t duration;      // Nanoseconds, for 'X'
+        uint64_t id;            // For 'b' and 'e'
+    };
+
+    explicit MRTraceBuffer(uint64_t thread);
+
+    /// Add an event. Only called by the thread of the buffer.
+    void record(const Event& event);
+
+    /**
+     * Append the JSON of the events kept, each followed by a comma.
+     *
+     * @return The number of events appended.
+     */
+    size_t exportJSON(std::string& json, int pid) const;
+
+    /// Forget the events recorded so far.
+    void clear();
+
+    /// @return How many events were overwritten since the last clear.
+    uint64_t getOverwrittenCount() const;
+
+private:
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;     // 2 * index + 1 while writing event `index`, 2 * index + 2 once written
+        std::atomic<char> phase;
+        std::atomic<const char*> category;
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> begin;
+        std::atomic<uint64_t> duration;
+        std::atomic<uint64_t> id;
+    };
+
+    uint64_t _thread;
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _cleared;         // Events before this index are forgotten
+};
+
+/// @return Whether recording is enabled. Cheap enough for every span.
+bool MRTraceIsEnabled();
+
+/// @return Nanoseconds since the origin of the trace.
+uint64_t MRTraceNow();
+
+/// Record an event on the buffer of the calling thread.
+void MRTraceRecord(const MRTraceBuffer::Event& event);
+
+/// Record the begin ('b') or end ('e') of an asynchronous span, if enabled.
+void MRTraceRecordAsync(char phase, const char* category, const char* name, uint64_t id);
+
+/**
+ * Records a complete span from its construction to its destruction, if enabled when constructed.
+ */
+class MRTraceSpan {
+public:
+
+    MRTraceSpan(const char* category, const char* name) : _category(category), _name(name), _begin(0) {
+        if(MRTraceIsEnabled()) _begin = MRTraceNow();
+        else _name = 0;
+    }
+
+    ~MRTraceSpan() {
+        if(!_name) return;
+        MRTraceBuffer::Event event = {'X', _category, _name, _begin, MRTraceNow() - _begin, 0};
+        MRTraceRecord(event);
+    }
+
+private:
+
+    const char* _category;
+    const char* _name;
+    uint64_t _begin;
+
+    MRTraceSpan(const MRTraceSpan&);
+    MRTraceSpan& operator=(const MRTraceSpan&);
+};
+
+};
+
+#endif /* MRTrace_h */
@@ -0,0 +1,57 @@
+#include "MRUpdateSequencer.h"
+
+namespace NowPlaying {
+
+MRUpdateSequencer::MRUpdateSequencer() : _issued(0), _applied(0), _joined(0), _discarded(0) {
+}
+
+uint64_t MRUpdateSequencer::request(const Waiter& waiter, bool invalidate) {
+    uint64_t sequence = 0;
+    if(isFetching() && !invalidate) {
+        _joined++;
+    }
+    else {
+        sequence = ++_issued;
+    }
+    if(waiter) _waiters.push_back(std::make_pair(_issued, waiter));
+    return sequence;
+}
+
+bool MRUpdateSequencer::accepts(uint64_t sequence) const {
+    return sequence > _applied && sequence <= _issued;
+}
+
+bool MRUpdateSequencer::complete(uint64_t sequence, std::vector<Waiter>& ready) {
+    if(!accepts(sequence)) {
+        _discarded++;
+        return false;
+    }
+    _applied = sequence;
+    while(!_waiters.empty() && _waiters.front().first <= _applied) {
+        ready.push_back(_waiters.front().second);
+        _waiters.pop_front();
+    }
+    return true;
+}
+
+bool MRUpdateSequencer::isFetching() const {
+    return _issued > _applied;
+}
+
+uint64_t MRUpdateSequencer::getIssuedSequence() const {
+    return _issued;
+}
+
+uint64_t MRUpdateSequencer::getAppliedSequence() const {
+    return _applied;
+}
+
+uint64_t MRUpdateSequencer::getJoinedCount() const {
+    return _joined;
+}
+
+uint64_t MRUpdateSequencer::getDiscardedCount() const {
+    return _discarded;
+}
+
+};
@@ -0,0 +1,87 @@
+#ifndef MRUpdateSequencer_h
+#define MRUpdateSequencer_h
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace NowPlaying {
+
+/**
+ * Orders the fetches of now playing information issued by an update executor.
+ *
+ * Every fetch is given an increasing sequence number. A reply is only applied when it is newer than the last applied one,
+ * so a slow reply can never overwrite the data of a faster, more recent one.
+ * Requests made while a fetch is in flight join it instead of issuing another fetch.
+ *
+ * This class does no locking and calls nothing by itself. It must only be used from one serial executor.
+ */
+class MRUpdateSequencer {
+public:
+
+    /// Work to run once the information a request asked for has been applied.
+    typedef std::function<void()> Waiter;
+
+    MRUpdateSequencer();
+
+    /**
+     * Request the latest information.
+     *
+     * @param waiter Run (by \ref complete()) once a reply at least as new as this request has been applied. May be empty.
+     * @param invalidate Set when the information is known to have changed (for example, by a notification).
+     * An in-flight fetch may have been issued before the change, so a new fetch is always issued in this case.
+     * @return The sequence number to fetch with, or 0 if the request joined the fetch already in flight.
+     */
+    uint64_t request(const Waiter& waiter, bool invalidate);
+
+    /**
+     * Record the reply of a fetch.
+     *
+     * @param sequence The sequence number returned by \ref request() when the fetch was issued.
+     * @param ready Filled with the waiters which are satisfied now. The caller runs them after applying the reply.
+     * @return true if the reply should be applied, false if it is older than the information already applied.
+     */
+    bool complete(uint64_t sequence, std::vector<Waiter>& ready);
+
+    /**
+     * Get to know whether the reply of a fetch would be applied, without recording it.
+     *
+     * @return true if \ref complete() would return true for `sequence` now.
+     */
+    bool accepts(uint64_t sequence) const;
+
+    /**
+     * Get to know whether a fetch is in flight or not.
+     *
+     * @return true if the latest issued fetch has not replied yet.
+     */
+    bool isFetching() const;
+
+    /// @return The sequence number of the latest issued fetch. 0 if none.
+    uint64_t getIssuedSequence() const;
+
+    /// @return The sequence number of the latest applied reply. 0 if none.
+    uint64_t getAppliedSequence() const;
+
+    /// @return How many requests joined a fetch in flight instead of issuing one.
+    uint64_t getJoinedCount() const;
+
+    /// @return How many replies were discarded for being older than the applied information.
+    uint64_t getDiscardedCount() const;
+
+private:
+
+    uint64_t _issued;
+    uint64_t _applied;
+    uint64_t _joined;
+    uint64_t _discarded;
+
+    // Waiters with the sequence number they wait for, in nondecreasing order.
+    std::deque<std::pair<uint64_t, Waiter>> _waiters;
+};
+
+};
+
+#endif /* MRUpdateSequencer_h */
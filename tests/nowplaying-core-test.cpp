@@ -0,0 +1,2689 @@
+// Tests of the platform independent parts of libnowplaying.
+// These do not need MediaRemote, so they also run on Linux:
+//
+//     c++ -std=c++11 -O2 -DNOWPLAYING_TRACING=1 -Iinclude -Isrc tests/nowplaying-core-test.cpp src/*.cpp -o nowplaying-core-test -lpthread
+//     ./nowplaying-core-test
+//     ./nowplaying-core-test --bench     (also runs the benchmarks)
+//
+// NOWPLAYING_TRACING is defined for every file at once, as the Xcode project does: the spans of MRSnapshotHub are in a template.
+
+#include "MRArrowExporter.h"
+#include "MRCatalog.h"
+#include "MRCommandSchedule.h"
+#include "MRCommandScheduler.h"
+#include "MREventStream.h"
+#include "MRFetchWatchdog.h"
+#include "MRFlatBuffer.h"
+#include "MRLyrics.h"
+#include "MRNotificationFastPath.h"
+#include "MROptimisticState.h"
+#include "MRProgressSchedule.h"
+#include "MRProgressTicker.h"
+#include "MRRefreshScheduler.h"
+#include "MRScrobbler.h"
+#include "MRSnapshotHistory.h"
+#include "MRSnapshotHub.h"
+#include "MRSnapshotStore.h"
+#include "MRTextFolding.h"
+#include "MRTimerWheel.h"
+#include "MRTopCharts.h"
+#include "MRTrace.h"
+#include "MRUpdateSequencer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(expr) do { \
+    if(!(expr)) { \
+        printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #expr); \
+        failures++; \
+    } \
+} while(0)
+
+// Stands in for MRMediaRemoteGetNowPlayingInfo: holds the replies back and lets the test deliver them in any order.
+struct FakeSource {
+    struct Pending {
+        uint64_t sequence;
+        int value;
+    };
+    std::vector<Pending> pending;
+    int systemValue = 0;
+    int fetches = 0;
+
+    void fetch(uint64_t sequence) {
+        fetches++;
+        pending.push_back({sequence, systemValue});
+    }
+};
+
+struct SequencedInfo {
+    NowPlaying::MRUpdateSequencer sequencer;
+    FakeSource source;
+    int data = -1;
+    int callbacks = 0;
+
+    void update(bool invalidate) {
+        uint64_t sequence = sequencer.request([this]() { callbacks++; }, invalidate);
+        if(sequence != 0) source.fetch(sequence);
+    }
+
+    void deliver(size_t index) {
+        FakeSource::Pending reply = source.pending[index];
+        source.pending.erase(source.pending.begin() + index);
+        std::vector<NowPlaying::MRUpdateSequencer::Waiter> ready;
+        if(sequencer.complete(reply.sequence, ready)) data = reply.value;
+        for(size_t i = 0; i < ready.size(); i++) ready[i]();
+    }
+};
+
+static void testUpdateSequencer() {
+    // Concurrent update() calls join the fetch in flight.
+    {
+        SequencedInfo info;
+        info.source.systemValue = 1;
+        info.update(false);
+        info.update(false);
+        info.update(false);
+        CHECK(info.source.fetches == 1);
+        CHECK(info.sequencer.getJoinedCount() == 2);
+        info.deliver(0);
+        CHECK(info.data == 1);
+        CHECK(info.callbacks == 3);
+        CHECK(!info.sequencer.isFetching());
+        info.update(false);
+        CHECK(info.source.fetches == 2);
+    }
+
+    // An older reply arriving after a newer one is discarded.
+    {
+        SequencedInfo info;
+        info.source.systemValue = 1;
+        info.update(true);
+        info.source.systemValue = 2;
+        info.update(true);
+        info.source.systemValue = 3;
+        info.update(false);     // Joins the second fetch
+        CHECK(info.source.fetches == 2);
+        info.deliver(1);
+        CHECK(info.data == 2);
+        CHECK(info.callbacks == 3);
+        info.deliver(0);
+        CHECK(info.data == 2);
+        CHECK(info.sequencer.getDiscardedCount() == 1);
+        CHECK(info.callbacks == 3);
+    }
+
+    // Replies delivered in reverse order: only the newest one is ever applied.
+    {
+        SequencedInfo info;
+        for(int i = 1; i <= 8; i++) {
+            info.source.systemValue = i;
+            info.update(true);
+        }
+        while(!info.source.pending.empty()) {
+            info.deliver(info.source.pending.size() - 1);
+            CHECK(info.data == 8);
+        }
+        CHECK(info.sequencer.getDiscardedCount() == 7);
+        CHECK(info.callbacks == 8);
+    }
+
+    // A reply between the applied and the latest issued one is still newer, so it is applied.
+    {
+        SequencedInfo info;
+        info.source.systemValue = 1;
+        info.update(true);
+        info.source.systemValue = 2;
+        info.update(true);
+        info.deliver(0);
+        CHECK(info.data == 1);
+        CHECK(info.callbacks == 1);
+        CHECK(info.sequencer.isFetching());
+        info.deliver(0);
+        CHECK(info.data == 2);
+        CHECK(info.callbacks == 2);
+    }
+}
+
+// Stands in for MediaRemote behind the hub. Replies are held back until the test delivers them.
+struct StandInSource : public NowPlaying::MRSnapshotHub<int>::Source {
+    NowPlaying::MRSnapshotHub<int>* hub = 0;
+    std::vector<uint64_t> pending;
+    int systemValue = 0;
+    int fetches = 0;
+    bool observing = false;
+    int observeCalls = 0;
+
+    void startObserving() { observing = true; observeCalls++; }
+    void stopObserving() { observing = false; }
+    void fetch(uint64_t sequence) { fetches++; pending.push_back(sequence); }
+
+    void deliverAll() {
+        std::vector<uint64_t> replies;
+        replies.swap(pending);
+        for(size_t i = 0; i < replies.size(); i++) hub->deliver(replies[i], systemValue);
+    }
+};
+
+struct HubInstance : public NowPlaying::MRSnapshotHub<int>::Subscriber {
+    int data = -1;
+    int applied = 0;
+    int callbacks = 0;
+    void applySnapshot(const int& snapshot) { data = snapshot; applied++; }
+};
+
+static void testSnapshotHub() {
+    StandInSource source;
+    NowPlaying::MRSnapshotHub<int> hub(&source);
+    source.hub = &hub;
+
+    const int instanceCount = 20;
+    HubInstance instances[instanceCount];
+    uint64_t ids[instanceCount];
+    for(int i = 0; i < instanceCount; i++) ids[i] = hub.attach(&instances[i]);
+    CHECK(hub.getSubscriberCount() == instanceCount);
+
+    // Observed once, however many instances register.
+    for(int i = 0; i < instanceCount; i++) {
+        HubInstance* instance = &instances[i];
+        CHECK(hub.observe(ids[i], [instance]() { instance->callbacks++; }) == 0);
+    }
+    CHECK(hub.observe(ids[0], NowPlaying::MRSnapshotHub<int>::Callback()) == -1);
+    CHECK(source.observing);
+    CHECK(source.observeCalls == 1);
+
+    // One change, one fetch, fanned out to everyone.
+    source.systemValue = 7;
+    hub.notify();
+    CHECK(source.fetches == 1);
+    source.deliverAll();
+    for(int i = 0; i < instanceCount; i++) {
+        CHECK(instances[i].data == 7);
+        CHECK(instances[i].callbacks == 1);
+    }
+
+    // Repeated manual updates share one fetch, and only the asking instance receives the reply.
+    hub.unobserve(ids[0]);
+    hub.unobserve(ids[1]);
+    source.systemValue = 8;
+    hub.update(ids[0], NowPlaying::MRSnapshotHub<int>::Callback());
+    hub.update(ids[0], NowPlaying::MRSnapshotHub<int>::Callback());
+    CHECK(source.fetches == 2);
+    source.deliverAll();
+    CHECK(instances[0].data == 8);
+    CHECK(instances[1].data == 7);
+    CHECK(instances[2].data == 7);
+    CHECK(instances[2].callbacks == 1);
+
+    // A detached instance is not called for fetches still in flight.
+    source.systemValue = 9;
+    hub.notify();
+    hub.update(ids[0], NowPlaying::MRSnapshotHub<int>::Callback());
+    hub.detach(ids[0]);
+    hub.detach(ids[2]);
+    int appliedBefore = instances[0].applied;
+    source.deliverAll();
+    CHECK(instances[0].applied == appliedBefore);
+    CHECK(instances[2].data == 7);
+    CHECK(instances[3].data == 9);
+
+    // An overlay is handed out instead of the fetched snapshots until cleared, while the latest keeps following the source.
+    int callbacksBefore = instances[3].callbacks;
+    hub.setOverlay(42);
+    hub.publish();
+    CHECK(instances[3].data == 42 && instances[3].callbacks == callbacksBefore + 1);
+    CHECK(instances[1].data == 7);
+    source.systemValue = 10;
+    hub.notify();
+    source.deliverAll();
+    CHECK(instances[3].data == 42 && hub.getLatest() == 10);
+    hub.update(ids[1], NowPlaying::MRSnapshotHub<int>::Callback());
+    CHECK(hub.accepts(hub.getFetchCount()) && !hub.accepts(hub.getFetchCount() - 1));
+    source.deliverAll();
+    CHECK(instances[1].data == 42);
+    hub.clearOverlay();
+    uint64_t fanOuts = hub.getFanOutCount();
+    hub.publish();
+    CHECK(instances[3].data == 10 && hub.getFanOutCount() == fanOuts + 1);
+
+    // A poll finding nothing new runs no callback; one finding a change fans it out.
+    callbacksBefore = instances[3].callbacks;
+    hub.poll(std::equal_to<int>());
+    source.deliverAll();
+    CHECK(instances[3].callbacks == callbacksBefore && hub.getFanOutCount() == fanOuts + 1);
+    source.systemValue = 11;
+    hub.poll(std::equal_to<int>());
+    source.deliverAll();
+    CHECK(instances[3].data == 11 && instances[3].callbacks == callbacksBefore + 1);
+
+    // The source is released with the last observer.
+    for(int i = 3; i < instanceCount; i++) hub.unobserve(ids[i]);
+    CHECK(!source.observing);
+    CHECK(hub.getObserverCount() == 0);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string temporaryPath(const char* name) {
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/nowplaying-core-test-%d-%s", (int)getpid(), name);
+    return path;
+}
+
+static NowPlaying::MRNowPlayingSnapshot syntheticSnapshot(int index) {
+    NowPlaying::MRNowPlayingSnapshot snapshot;
+    char buffer[64];
+    snapshot.hasInfo = true;
+    snprintf(buffer, sizeof(buffer), "Track %d", index);
+    snapshot.title = buffer;
+    snprintf(buffer, sizeof(buffer), "Artist %d", index % 37);
+    snapshot.artist = buffer;
+    snprintf(buffer, sizeof(buffer), "Album %d", index % 101);
+    snapshot.albumTitle = buffer;
+    snprintf(buffer, sizeof(buffer), "item-%d", index);
+    snapshot.contentItemIdentifier = buffer;
+    snapshot.artworkIdentifier = "artwork-" + snapshot.contentItemIdentifier;
+    snapshot.artworkMIMEType = "image/jpeg";
+    snapshot.mediaType = "Music";
+    snapshot.artworkWidth = 600;
+    snapshot.artworkHeight = 600;
+    snapshot.trackNumber = index % 12 + 1;
+    snapshot.duration = 180.0 + index % 120;
+    snapshot.elapsedTime = 12.5;
+    snapshot.playbackRate = 1.0;
+    snapshot.timestamp = 1700000000.25 + index;
+    snapshot.uniqueIdentifier = 1000 + index;
+    snapshot.iTunesStoreIdentifier = 5000000000ull + index;
+    snapshot.repeatMode = NowPlaying::kMRNowPlayingInfoRepeatModeRepeatAll;
+    snapshot.shuffleMode = NowPlaying::kMRNowPlayingInfoShuffleModeOn;
+    return snapshot;
+}
+
+static void testSnapshotStore() {
+    std::string path = temporaryPath("snapshot");
+    NowPlaying::MRSnapshotStore store(path);
+    NowPlaying::MRNowPlayingSnapshot loaded;
+
+    unlink(path.c_str());
+    CHECK(store.load(loaded) == -1);
+    CHECK(!loaded.hasInfo);
+
+    NowPlaying::MRNowPlayingSnapshot saved = syntheticSnapshot(42);
+    saved.composer = "Compos\xc3\xa9r";
+    CHECK(store.save(saved) == 0);
+    CHECK(store.load(loaded) == 0);
+    CHECK(loaded.hasInfo);
+    CHECK(loaded.stale);
+    CHECK(loaded.title == saved.title);
+    CHECK(loaded.artist == saved.artist);
+    CHECK(loaded.albumTitle == saved.albumTitle);
+    CHECK(loaded.composer == saved.composer);
+    CHECK(loaded.genre.empty());
+    CHECK(loaded.contentItemIdentifier == saved.contentItemIdentifier);
+    CHECK(loaded.artworkIdentifier == saved.artworkIdentifier);
+    CHECK(loaded.artworkMIMEType == saved.artworkMIMEType);
+    CHECK(loaded.mediaType == saved.mediaType);
+    CHECK(loaded.artworkWidth == 600);
+    CHECK(loaded.trackNumber == saved.trackNumber);
+    CHECK(loaded.duration == saved.duration);
+    CHECK(loaded.elapsedTime == saved.elapsedTime);
+    CHECK(loaded.playbackRate == saved.playbackRate);
+    CHECK(loaded.timestamp == saved.timestamp);
+    CHECK(loaded.iTunesStoreIdentifier == saved.iTunesStoreIdentifier);
+    CHECK(loaded.repeatMode == NowPlaying::kMRNowPlayingInfoRepeatModeRepeatAll);
+    CHECK(loaded.shuffleMode == NowPlaying::kMRNowPlayingInfoShuffleModeOn);
+    CHECK(loaded.elapsedTimeAt(saved.timestamp + 10) == 22.5);
+
+    // A damaged file is refused rather than served.
+    FILE* file = fopen(path.c_str(), "r+b");
+    CHECK(file != 0);
+    if(file) {
+        fseek(file, -3, SEEK_END);
+        fputc('#', file);
+        fclose(file);
+    }
+    NowPlaying::MRNowPlayingSnapshot untouched;
+    CHECK(store.load(untouched) == -1);
+    CHECK(!untouched.hasInfo);
+
+    // Saving the snapshot saved last writes nothing (so the damage stays), a change writes it again.
+    CHECK(store.save(saved) == 0);
+    CHECK(store.load(untouched) == -1);
+    saved.elapsedTime = 13;
+    CHECK(store.save(saved) == 0);
+    CHECK(store.load(loaded) == 0 && loaded.elapsedTime == 13);
+
+    unlink(path.c_str());
+}
+
+static NowPlaying::MRNowPlayingSnapshot trackSnapshot(const char* identifier, double duration, double elapsedTime, double playbackRate, double timestamp) {
+    NowPlaying::MRNowPlayingSnapshot snapshot;
+    snapshot.hasInfo = true;
+    snapshot.contentItemIdentifier = identifier;
+    snapshot.title = std::string("Title of ") + identifier;
+    snapshot.duration = duration;
+    snapshot.elapsedTime = elapsedTime;
+    snapshot.playbackRate = playbackRate;
+    snapshot.timestamp = timestamp;
+    return snapshot;
+}
+
+static void testScrobbler() {
+    NowPlaying::MRListeningSession play;
+
+    // Listened past half of the track, then the next track starts.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        CHECK(scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1000), 1000) == 0);
+        CHECK(scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1000), 1050) == 0);   // Spurious notification
+        CHECK(scrobbler.feed(trackSnapshot("b", 200, 0, 1, 1110), 1110.3) == 1);
+        CHECK(scrobbler.popPlay(&play) == 0);
+        CHECK(play.contentItemIdentifier == "a");
+        CHECK(play.title == "Title of a");
+        CHECK(std::fabs(play.listenedTime - 110) < 1e-6);
+        CHECK(play.startTime == 1000);
+        CHECK(play.endTime == 1110);
+        CHECK(play.seekCount == 0);
+        CHECK(play.pauseCount == 0);
+        CHECK(scrobbler.popPlay(&play) == -1);
+    }
+
+    // Pauses do not count as listening.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1000), 1000);
+        scrobbler.feed(trackSnapshot("a", 200, 50, 0, 1050), 1050.1);
+        CHECK(scrobbler.getCurrentSession(&play, 2000) == 0);
+        CHECK(std::fabs(play.listenedTime - 50) < 1e-6);
+        CHECK(!play.playing);
+        scrobbler.feed(trackSnapshot("a", 200, 50, 1, 1300), 1300);
+        CHECK(scrobbler.getCurrentSession(&play, 1320) == 0);
+        CHECK(std::fabs(play.listenedTime - 70) < 1e-6);
+        CHECK(std::fabs(play.position - 70) < 1e-6);
+        CHECK(scrobbler.feed(trackSnapshot("b", 200, 0, 1, 1340), 1340) == 0);  // 90 seconds, short of 100
+        scrobbler.feed(trackSnapshot("b", 200, 0, 1, 1340), 1340);
+        CHECK(scrobbler.feed(NowPlaying::MRNowPlayingSnapshot(), 1500) == 1);
+        CHECK(scrobbler.getPlayCount() == 1);
+        CHECK(scrobbler.popPlay(&play) == 0);
+        CHECK(play.contentItemIdentifier == "b");
+        CHECK(scrobbler.getCurrentSession(&play, 1500) == -1);
+    }
+
+    // Seeking forward skips the middle of the track, which is not listened to.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1000), 1000);
+        scrobbler.feed(trackSnapshot("a", 200, 150, 1, 1020), 1020);
+        CHECK(scrobbler.feed(trackSnapshot("b", 200, 0, 1, 1060), 1060) == 0);
+        scrobbler.flush(1060);
+        CHECK(scrobbler.getPlayCount() == 0);
+
+        NowPlaying::MRScrobbler seeking((NowPlaying::MRScrobblerConfig()));
+        seeking.feed(trackSnapshot("a", 200, 0, 1, 1000), 1000);
+        seeking.feed(trackSnapshot("a", 200, 150, 1, 1020), 1020);
+        seeking.getCurrentSession(&play, 1030);
+        CHECK(play.seekCount == 1);
+        CHECK(std::fabs(play.listenedTime - 30) < 1e-6);
+        CHECK(std::fabs(play.position - 160) < 1e-6);
+    }
+
+    // Long tracks count after four minutes, short ones never.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        scrobbler.feed(trackSnapshot("long", 3600, 0, 1, 1000), 1000);
+        CHECK(scrobbler.feed(trackSnapshot("short", 20, 0, 1, 1250), 1250) == 1);
+        CHECK(scrobbler.feed(trackSnapshot("other", 200, 0, 1, 1270), 1270) == 0);
+        CHECK(scrobbler.popPlay(&play) == 0);
+        CHECK(play.contentItemIdentifier == "long");
+    }
+
+    // Configurable thresholds.
+    {
+        NowPlaying::MRScrobblerConfig config;
+        config.playedFraction = 0.9;
+        config.maximumThreshold = 1e9;
+        NowPlaying::MRScrobbler scrobbler(config);
+        scrobbler.feed(trackSnapshot("a", 100, 0, 1, 1000), 1000);
+        CHECK(scrobbler.feed(trackSnapshot("b", 100, 0, 1, 1080), 1080) == 0);
+        CHECK(scrobbler.feed(trackSnapshot("c", 100, 0, 1, 1175), 1175) == 1);
+    }
+
+    // Repeating one track makes a session per repetition.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        scrobbler.feed(trackSnapshot("a", 60, 0, 1, 1000), 1000);
+        CHECK(scrobbler.feed(trackSnapshot("a", 60, 0, 1, 1060), 1060.5) == 1);
+        CHECK(scrobbler.feed(trackSnapshot("a", 60, 0, 1, 1120), 1120.5) == 1);
+        CHECK(scrobbler.getPlayCount() == 2);
+    }
+
+    // A stale snapshot from a previous run is ignored; seeking back is not mistaken for a repeat.
+    {
+        NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+        NowPlaying::MRNowPlayingSnapshot stale = trackSnapshot("old", 200, 0, 1, 10);
+        stale.stale = true;
+        CHECK(scrobbler.feed(stale, 1000) == 0);
+        CHECK(scrobbler.getCurrentSession(&play, 1000) == -1);
+        scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1000), 1000);
+        scrobbler.feed(trackSnapshot("a", 200, 0, 1, 1080), 1080);
+        CHECK(scrobbler.getCurrentSession(&play, 1110) == 0);
+        CHECK(play.seekCount == 1);
+        CHECK(std::fabs(play.listenedTime - 110) < 1e-6);
+        CHECK(scrobbler.flush(1110) == 1);
+    }
+}
+
+// Draws from a Zipf distribution over `size` ranks, like plays over a music library.
+class ZipfTrace {
+public:
+    ZipfTrace(size_t size, double exponent, unsigned seed) : _random(seed) {
+        double sum = 0;
+        for(size_t i = 0; i < size; i++) {
+            sum += 1.0 / std::pow(i + 1.0, exponent);
+            _cumulative.push_back(sum);
+        }
+        for(size_t i = 0; i < size; i++) _cumulative[i] /= sum;
+    }
+
+    size_t next() {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(_random);
+        return std::lower_bound(_cumulative.begin(), _cumulative.end(), u) - _cumulative.begin();
+    }
+
+private:
+    std::mt19937 _random;
+    std::vector<double> _cumulative;
+};
+
+static std::string traceArtist(size_t track) {
+    return "Artist " + std::to_string(track % 300);
+}
+
+static std::string traceAlbum(size_t track) {
+    return "Album " + std::to_string(track % 1000);
+}
+
+static std::string traceTitle(size_t track) {
+    return "Track " + std::to_string(track);
+}
+
+static void testTopCharts() {
+    // Against an exact counter, on a skewed trace with many more distinct tracks than counters.
+    {
+        NowPlaying::MRTopChartsConfig config;
+        config.capacity = 256;
+        NowPlaying::MRTopCharts charts(config);
+        ZipfTrace trace(20000, 1.1, 42);
+        std::map<std::string, uint64_t> exact;
+        const int plays = 200000;
+        for(int i = 0; i < plays; i++) {
+            size_t track = trace.next();
+            charts.addPlay(traceArtist(track), traceAlbum(track), traceTitle(track), 1000);
+            exact[traceTitle(track)]++;
+        }
+        CHECK(charts.getPlayCount(NowPlaying::kMRTopChartsWindowAllTime, 1000) == (uint64_t)plays);
+        uint64_t bound = charts.getErrorBound(NowPlaying::kMRTopChartsCategoryTrack, NowPlaying::kMRTopChartsWindowAllTime, 1000);
+        CHECK(bound == plays / config.capacity);
+
+        std::vector<NowPlaying::MRTopChartsEntry> top = charts.getTop(NowPlaying::kMRTopChartsCategoryTrack, NowPlaying::kMRTopChartsWindowAllTime, config.capacity, 1000);
+        CHECK(top.size() == config.capacity);
+        std::map<std::string, uint64_t> reported;
+        for(size_t i = 0; i < top.size(); i++) {
+            uint64_t truth = exact[top[i].title];
+            CHECK(top[i].count >= truth);
+            CHECK(top[i].count - top[i].error <= truth);
+            CHECK(top[i].error <= bound);
+            CHECK(i == 0 || top[i - 1].count >= top[i].count);
+            reported[top[i].title] = top[i].count;
+        }
+        CHECK(top[0].artist == traceArtist(0) && top[0].albumTitle == traceAlbum(0) && top[0].title == traceTitle(0));
+        for(std::map<std::string, uint64_t>::iterator it = exact.begin(); it != exact.end(); ++it) {
+            if(it->second > bound) CHECK(reported.count(it->first) == 1);
+        }
+
+        // The head of a skewed distribution is ranked exactly.
+        std::vector<std::pair<uint64_t, std::string> > ranking;
+        for(std::map<std::string, uint64_t>::iterator it = exact.begin(); it != exact.end(); ++it) ranking.push_back(std::make_pair(it->second, it->first));
+        std::sort(ranking.rbegin(), ranking.rend());
+        top = charts.getTop(NowPlaying::kMRTopChartsCategoryTrack, NowPlaying::kMRTopChartsWindowAllTime, 10, 1000);
+        CHECK(top.size() == 10);
+        for(size_t i = 0; i < top.size(); i++) CHECK(top[i].title == ranking[i].second);
+
+        // Artists are fewer than the counters, so they are counted exactly.
+        std::vector<NowPlaying::MRTopChartsEntry> artists = charts.getTop(NowPlaying::kMRTopChartsCategoryArtist, NowPlaying::kMRTopChartsWindowAllTime, 1, 1000);
+        CHECK(artists.size() == 1 && artists[0].error == 0 && artists[0].albumTitle.empty() && artists[0].title.empty());
+        CHECK(charts.getErrorBound(NowPlaying::kMRTopChartsCategoryArtist, NowPlaying::kMRTopChartsWindowAllTime, 1000) <= plays / config.capacity);
+    }
+    // Memory does not grow with the number of distinct tracks.
+    {
+        NowPlaying::MRTopChartsConfig config;
+        config.capacity = 64;
+        NowPlaying::MRTopCharts charts(config);
+        for(int i = 0; i < 1000; i++) charts.addPlay("A", "B", "Track " + std::to_string(i), 1000);
+        size_t memory = charts.getMemoryUsage();
+        for(int i = 1000; i < 100000; i++) charts.addPlay("A", "B", "Track " + std::to_string(i), 1000);
+        CHECK(charts.getMemoryUsage() <= memory + memory / 10);
+    }
+    // Calendar windows, and counting plays from snapshots.
+    {
+        NowPlaying::MRTopChartsConfig config;
+        config.utcOffset = 3600;
+        NowPlaying::MRTopCharts charts(config);
+        const double midnight = 86400.0 * 20000 - 3600;     // Local midnight
+        NowPlaying::MRNowPlayingSnapshot snapshot = trackSnapshot("a", 200, 0, 1, midnight + 10);
+        snapshot.artist = "Artist";
+        snapshot.albumTitle = "Album";
+        snapshot.title = "Title";
+        CHECK(charts.feed(snapshot, midnight + 10) == 1);
+        CHECK(charts.feed(snapshot, midnight + 20) == 0);                 // Same track
+        snapshot.playbackRate = 0;
+        CHECK(charts.feed(snapshot, midnight + 30) == 0);                 // Paused
+        snapshot.playbackRate = 1;
+        CHECK(charts.feed(snapshot, midnight + 40) == 0);                 // Resumed
+        NowPlaying::MRNowPlayingSnapshot stale = trackSnapshot("b", 200, 0, 1, midnight + 50);
+        stale.stale = true;
+        CHECK(charts.feed(stale, midnight + 50) == 0);
+        CHECK(charts.feed(NowPlaying::MRNowPlayingSnapshot(), midnight + 60) == 0);
+        CHECK(charts.feed(snapshot, midnight + 70) == 1);                 // Played again after nothing
+        CHECK(charts.feed(trackSnapshot("b", 200, 0, 1, midnight + 3700), midnight + 3700) == 1);
+
+        CHECK(charts.getPlayCount(NowPlaying::kMRTopChartsWindowHour, midnight + 3700) == 1);
+        CHECK(charts.getPlayCount(NowPlaying::kMRTopChartsWindowDay, midnight + 3700) == 3);
+        std::vector<NowPlaying::MRTopChartsEntry> top = charts.getTop(NowPlaying::kMRTopChartsCategoryAlbum, NowPlaying::kMRTopChartsWindowDay, 5, midnight + 3700);
+        CHECK(top.size() == 2 && top[0].artist == "Artist" && top[0].albumTitle == "Album" && top[0].count == 2 && top[0].title.empty());
+        CHECK(charts.getPlayCount(NowPlaying::kMRTopChartsWindowDay, midnight + 86400) == 0);
+        CHECK(charts.getTop(NowPlaying::kMRTopChartsCategoryTrack, NowPlaying::kMRTopChartsWindowHour, 5, midnight + 86400).empty());
+        CHECK(charts.getPlayCount(NowPlaying::kMRTopChartsWindowAllTime, midnight + 86400) == 3);
+    }
+}
+
+// A player going through tracks of `trackLength` seconds from `start`, paused for good at `pauseAt`.
+struct SimulatedPlayer {
+    double start;
+    double trackLength;
+    double pauseAt;
+
+    NowPlaying::MRNowPlayingSnapshot at(double now) const {
+        double played = std::min(now, pauseAt) - start;
+        int track = (int)std::floor(played / trackLength);
+        NowPlaying::MRNowPlayingSnapshot snapshot = trackSnapshot(std::to_string(track).c_str(), trackLength, played - track * trackLength, now < pauseAt ? 1 : 0, now);
+        return snapshot;
+    }
+
+    // The next time the track changes or the player pauses, strictly after `after`.
+    double nextChange(double after) const {
+        if(after >= pauseAt) return HUGE_VAL;
+        double boundary = start + (std::floor((after - start) / trackLength) + 1) * trackLength;
+        return std::min(boundary, pauseAt);
+    }
+};
+
+struct RefreshRun {
+    uint64_t wakeups;
+    uint64_t missed;        // Changes only seen by polling
+    double worstLatency;    // Longest time from a missed change to the poll seeing it
+};
+
+// Runs `scheduler` against `player` from `from` (excluded) to `to` (included). Notifications are lost between `lostFrom` and `lostUntil`, and fetches reply at once.
+static RefreshRun simulateRefresh(NowPlaying::MRRefreshScheduler& scheduler, const SimulatedPlayer& player, double from, double to, double lostFrom, double lostUntil) {
+    RefreshRun run = {0, 0, 0.0};
+    double now = from;
+    double unseenSince = -1;
+    while(true) {
+        double poll = std::max(scheduler.nextPoll(now), now);
+        double change = player.nextChange(now);
+        if(change <= poll && change <= to) {
+            now = change;
+            if(now < lostFrom || now >= lostUntil) {
+                scheduler.notificationReceived(now);
+                scheduler.snapshotFetched(player.at(now), now);
+                unseenSince = -1;
+            }
+            else {
+                run.missed++;
+                if(unseenSince < 0) unseenSince = now;
+            }
+        }
+        else if(poll < to) {
+            now = poll;
+            scheduler.pollIssued(now);
+            scheduler.snapshotFetched(player.at(now), now);
+            run.wakeups++;
+            if(unseenSince >= 0) run.worstLatency = std::max(run.worstLatency, now - unseenSince);
+            unseenSince = -1;
+        }
+        else break;
+    }
+    return run;
+}
+
+static void testRefreshScheduler() {
+    const double t0 = 1700000000;
+    const double hour = 3600;
+    NowPlaying::MRRefreshSchedulerConfig config;
+    // Notifications work: playing costs no wakeup, paused only the probes.
+    {
+        NowPlaying::MRRefreshScheduler scheduler(config);
+        SimulatedPlayer player = {t0, 200, t0 + hour};
+        scheduler.snapshotFetched(player.at(t0), t0);
+        RefreshRun run = simulateRefresh(scheduler, player, t0, t0 + hour, HUGE_VAL, HUGE_VAL);
+        CHECK(run.wakeups == 0);
+        CHECK(!scheduler.isPolling());
+        run = simulateRefresh(scheduler, player, t0 + hour, t0 + 2 * hour, HUGE_VAL, HUGE_VAL);
+        CHECK(run.wakeups <= hour / config.probeInterval);
+        CHECK(!scheduler.isPolling());
+    }
+    // Notifications lost from the start: the first missed track change is found by the probe after the predicted end,
+    // later ones right after their predicted end. Pauses are seen within `playingInterval`.
+    {
+        NowPlaying::MRRefreshScheduler scheduler(config);
+        SimulatedPlayer player = {t0, 200, t0 + hour + 1010};
+        scheduler.snapshotFetched(player.at(t0), t0);
+        RefreshRun run = simulateRefresh(scheduler, player, t0, t0 + 210, 0, HUGE_VAL);
+        CHECK(scheduler.isPolling());
+        CHECK(run.wakeups == 1 && std::fabs(run.worstLatency - config.probeDelay) < 1e-6);
+        CHECK(scheduler.getMissedCount() == 1);
+
+        run = simulateRefresh(scheduler, player, t0 + 210, t0 + hour + 210, 0, HUGE_VAL);
+        CHECK(run.missed == 18);
+        CHECK(run.worstLatency <= config.boundaryMargin + 1e-6);
+        CHECK(run.wakeups < hour / 10);
+
+        run = simulateRefresh(scheduler, player, t0 + hour + 210, t0 + hour + 1100, 0, HUGE_VAL);
+        CHECK(run.worstLatency <= config.playingInterval + 1e-6);
+        CHECK(scheduler.isPolling());
+        run = simulateRefresh(scheduler, player, t0 + hour + 1100, t0 + 2 * hour + 1100, 0, HUGE_VAL);
+        CHECK(run.wakeups <= hour / config.idleInterval);
+    }
+    // Notifications come back: polling stops at the first one.
+    {
+        NowPlaying::MRRefreshScheduler scheduler(config);
+        SimulatedPlayer player = {t0, 200, HUGE_VAL};
+        scheduler.snapshotFetched(player.at(t0), t0);
+        simulateRefresh(scheduler, player, t0, t0 + 900, 0, HUGE_VAL);
+        CHECK(scheduler.isPolling());
+        simulateRefresh(scheduler, player, t0 + 900, t0 + 1000, 0, t0 + 1000);
+        CHECK(!scheduler.isPolling());
+        RefreshRun run = simulateRefresh(scheduler, player, t0 + 1000, t0 + 1000 + hour, 0, t0 + 1000);
+        CHECK(run.missed == 0);
+        CHECK(run.wakeups == 0);
+    }
+    // Without a duration, or without timestamps, nothing is mistaken for a change.
+    {
+        NowPlaying::MRRefreshScheduler scheduler(config);
+        NowPlaying::MRNowPlayingSnapshot stream = trackSnapshot("radio", 0, 0, 1, 0);
+        scheduler.snapshotFetched(stream, t0);
+        CHECK(scheduler.nextPoll(t0) == t0 + config.probeInterval);
+        stream.elapsedTime = 300;
+        scheduler.pollIssued(t0 + config.probeInterval);
+        scheduler.snapshotFetched(stream, t0 + config.probeInterval);
+        CHECK(!scheduler.isPolling() && scheduler.getMissedCount() == 0);
+        scheduler.snapshotFetched(trackSnapshot("other", 0, 0, 1, 0), t0 + 400);
+        CHECK(scheduler.isPolling());
+        CHECK(scheduler.nextPoll(t0 + 400) == t0 + 400 + config.playingInterval);
+    }
+    // A change fetched by an update just before its notification comes was not missed.
+    {
+        NowPlaying::MRRefreshScheduler scheduler(config);
+        SimulatedPlayer player = {t0, 200, HUGE_VAL};
+        scheduler.snapshotFetched(player.at(t0), t0);
+        scheduler.snapshotFetched(player.at(t0 + 200.1), t0 + 200.1);
+        scheduler.notificationReceived(t0 + 200.3);
+        CHECK(!scheduler.isPolling() && scheduler.getMissedCount() == 0);
+    }
+}
+
+static void testTimerWheel() {
+    // Against a sorted reference, with timers on every level, beyond the reach of the wheel, in the past and cancelled.
+    std::mt19937 random(3);
+    NowPlaying::MRTimerWheel wheel(1000);
+    std::multimap<uint64_t, uint64_t> reference;
+    std::map<uint64_t, NowPlaying::MRTimerWheel::Handle> handles;
+    for(uint64_t payload = 0; payload < 5000; payload++) {
+        uint64_t delay = random() % 5 == 0 ? random() % (1ull << 32) : random() % 100000;
+        uint64_t expires = 1000 + delay;
+        handles[payload] = wheel.schedule(expires, payload);
+        reference.insert(std::make_pair(expires, payload));
+    }
+    handles[5000] = wheel.schedule(10, 5000);
+    reference.insert(std::make_pair(1000, 5000));
+    for(uint64_t payload = 0; payload < 5000; payload += 7) {
+        CHECK(wheel.cancel(handles[payload]) == 0);
+        for(std::multimap<uint64_t, uint64_t>::iterator it = reference.begin(); it != reference.end(); ++it) {
+            if(it->second == payload) {
+                reference.erase(it);
+                break;
+            }
+        }
+    }
+    CHECK(wheel.cancel(handles[0]) == -1);
+    CHECK(wheel.getSize() == reference.size());
+
+    uint64_t now = 1000;
+    bool ordered = true;
+    while(!reference.empty()) {
+        uint64_t next = wheel.nextExpiry();
+        CHECK(next == std::max(reference.begin()->first, now));
+        if(next != std::max(reference.begin()->first, now)) break;
+        // Sometimes stop short of the next timer, sometimes go well past it.
+        now = random() % 3 == 0 ? now + (next - now) / 2 : next + random() % 3;
+        std::vector<uint64_t> expired;
+        wheel.advance(now, expired);
+        std::multiset<uint64_t> expected;
+        while(!reference.empty() && reference.begin()->first <= now) {
+            expected.insert(reference.begin()->second);
+            reference.erase(reference.begin());
+        }
+        ordered = ordered && std::multiset<uint64_t>(expired.begin(), expired.end()) == expected;
+    }
+    CHECK(ordered);
+    CHECK(wheel.getSize() == 0);
+    CHECK(wheel.nextExpiry() == UINT64_MAX);
+
+    // A far timer is reached in a few steps, not one per turn of the first level (2^30 of them here).
+    std::vector<uint64_t> expired;
+    wheel.schedule(now + (1ull << 36), 1);
+    wheel.schedule(now + (1ull << 20) + 5, 2);
+    wheel.advance(now + (1ull << 36) - 1, expired);
+    CHECK(expired.size() == 1 && expired[0] == 2);
+    CHECK(wheel.nextExpiry() == now + (1ull << 36));
+    wheel.advance(now + (1ull << 36), expired);
+    CHECK(expired.size() == 2 && expired[1] == 1 && wheel.getSize() == 0);
+}
+
+struct TickLog {
+    std::vector<double> positions;
+    NowPlaying::MRProgressSchedule* schedule = nullptr;
+    uint64_t unsubscribeOnTick = 0;
+
+    static void tick(double position, void* context) {
+        TickLog* log = static_cast<TickLog*>(context);
+        log->positions.push_back(position);
+        if(log->unsubscribeOnTick) log->schedule->unsubscribe(log->unsubscribeOnTick);
+    }
+};
+
+// Advances `schedule` deadline by deadline up to `until`, as the ticker thread does. Returns the number of wakeups.
+static int runSchedule(NowPlaying::MRProgressSchedule& schedule, double& now, double until) {
+    int wakeups = 0;
+    while(schedule.nextDeadline() <= until) {
+        now = std::max(now, schedule.nextDeadline());
+        schedule.advance(now);
+        wakeups++;
+    }
+    now = until;
+    return wakeups;
+}
+
+static void testProgressSchedule() {
+    const double t0 = 1700000000;
+    double now = t0;
+    NowPlaying::MRProgressSchedule schedule(t0);
+    TickLog seconds, tenths, jumps;
+    CHECK(schedule.subscribe(0, TickLog::tick, &seconds, now) == 0);
+    CHECK(schedule.subscribe(1, nullptr, &seconds, now) == 0);
+    schedule.subscribe(1, TickLog::tick, &seconds, now);
+    schedule.subscribe(0.1, TickLog::tick, &tenths, now);
+    uint64_t other = schedule.subscribe(1, TickLog::tick, &jumps, now);
+    CHECK(schedule.getGroupCount() == 2 && schedule.getSubscriberCount() == 3);
+    CHECK(schedule.nextDeadline() == HUGE_VAL);
+
+    // Playing from 10.3 s: ticks at once with the exact position, then on whole seconds and tenths of the position.
+    CHECK(schedule.feed(trackSnapshot("a", 20, 10.3, 1, t0), now) == 1);
+    runSchedule(schedule, now, t0 + 2.75);
+    CHECK(seconds.positions.size() == 4);
+    CHECK(std::fabs(seconds.positions[0] - 10.3) < 1e-6 && std::fabs(seconds.positions[1] - 11) < 1e-6 && std::fabs(seconds.positions[3] - 13) < 1e-6);
+    CHECK(tenths.positions.size() == 28);
+    CHECK(std::fabs(tenths.positions.back() - 13.0) < 1e-6);
+
+    // The same playback again changes nothing. Double rate halves the wall intervals, without a jump.
+    CHECK(schedule.feed(trackSnapshot("a", 20, 13.05, 1, t0 + 2.75), now) == 0);
+    CHECK(schedule.feed(trackSnapshot("a", 20, 13.05, 2, t0 + 2.75), now) == 0);
+    seconds.positions.clear();
+    runSchedule(schedule, now, t0 + 3.75);
+    CHECK(seconds.positions.size() == 2 && std::fabs(seconds.positions[1] - 15) < 1e-6);
+
+    // Paused: one tick with the paused position, then nothing.
+    seconds.positions.clear();
+    CHECK(schedule.feed(trackSnapshot("a", 20, 15.2, 0, t0 + 3.8), now) == 1);
+    CHECK(runSchedule(schedule, now, t0 + 100) == 1);
+    CHECK(seconds.positions.size() == 1 && std::fabs(seconds.positions[0] - 15.2) < 1e-6);
+    CHECK(schedule.nextDeadline() == HUGE_VAL);
+
+    // Resumed near the end: ticks stop after the last whole second of the track.
+    seconds.positions.clear();
+    CHECK(schedule.feed(trackSnapshot("a", 20, 17.5, 1, t0 + 100), now) == 1);
+    runSchedule(schedule, now, t0 + 110);
+    CHECK(seconds.positions.size() == 4 && std::fabs(seconds.positions.back() - 20) < 1e-6);
+    CHECK(schedule.nextDeadline() == HUGE_VAL);
+
+    // A seek, then a late wakeup: one tick at the latest boundary passed.
+    seconds.positions.clear();
+    CHECK(schedule.feed(trackSnapshot("b", 300, 100, 1, t0 + 110), now) == 1);
+    runSchedule(schedule, now, t0 + 110);
+    CHECK(seconds.positions.size() == 1 && std::fabs(seconds.positions[0] - 100) < 1e-6);
+    now = t0 + 115.5;
+    schedule.advance(now);
+    CHECK(seconds.positions.size() == 2 && std::fabs(seconds.positions[1] - 105) < 1e-6);
+
+    // Unsubscribing from a callback, in the same group: the other subscriber is not called any more.
+    size_t before = jumps.positions.size();
+    seconds.schedule = &schedule;
+    seconds.unsubscribeOnTick = other;
+    runSchedule(schedule, now, t0 + 116.5);
+    CHECK(jumps.positions.size() == before);
+    CHECK(schedule.unsubscribe(other) == -1);
+
+    // Stale or missing information never ticks.
+    NowPlaying::MRNowPlayingSnapshot stale = trackSnapshot("b", 300, 100, 1, now);
+    stale.stale = true;
+    CHECK(schedule.feed(stale, now) == 0);
+    CHECK(schedule.nextDeadline() == HUGE_VAL);
+}
+
+static void testOptimisticState() {
+    const double t0 = 1700000000;
+    NowPlaying::MROptimisticState state(2.0, 1.0);
+    NowPlaying::MRNowPlayingSnapshot provisional;
+    CHECK(state.reconcile(trackSnapshot("a", 200, 10, 1, t0), t0) == NowPlaying::MROptimisticState::kOutcomeNone);
+    CHECK(state.speculate(NowPlaying::MRNowPlayingSnapshot(), NowPlaying::MROptimisticState::kActionPause, 0, t0, provisional) == -1);
+
+    // Pause while playing: rate flipped, clock re-anchored at the command. Older information keeps the prediction,
+    // then the system confirms it.
+    NowPlaying::MRNowPlayingSnapshot playing = trackSnapshot("a", 200, 10, 1, t0);
+    CHECK(state.speculate(playing, NowPlaying::MROptimisticState::kActionTogglePlayPause, 0, t0 + 5, provisional) == 0);
+    CHECK(provisional.provisional && provisional.playbackRate == 0);
+    CHECK(provisional.timestamp == t0 + 5 && std::fabs(provisional.elapsedTime - 15) < 1e-9);
+    CHECK(state.reconcile(playing, t0 + 5.05) == NowPlaying::MROptimisticState::kOutcomePending);
+    CHECK(state.isPending());
+    CHECK(state.reconcile(trackSnapshot("a", 200, 15.1, 0, t0 + 5.1), t0 + 5.2) == NowPlaying::MROptimisticState::kOutcomeConfirmed);
+    CHECK(!state.isPending());
+    CHECK(std::fabs(state.getStatistics().maxConfirmationTime - 0.2) < 1e-6);
+
+    // Seek: confirmed by a position close to the target.
+    NowPlaying::MRNowPlayingSnapshot paused = trackSnapshot("a", 200, 15.1, 0, t0 + 5.1);
+    CHECK(state.speculate(paused, NowPlaying::MROptimisticState::kActionSeek, 500, t0 + 10, provisional) == 0);
+    CHECK(provisional.elapsedTime == 200 && provisional.playbackRate == 0);
+    CHECK(state.speculate(paused, NowPlaying::MROptimisticState::kActionSeek, 60, t0 + 10, provisional) == 0);
+    CHECK(state.getStatistics().superseded == 1);
+    CHECK(state.reconcile(trackSnapshot("a", 200, 60.4, 0, t0 + 10.2), t0 + 10.3) == NowPlaying::MROptimisticState::kOutcomeConfirmed);
+
+    // Play, contradicted by newer information: rolled back.
+    paused = trackSnapshot("a", 200, 60.4, 0, t0 + 10.2);
+    CHECK(state.speculate(paused, NowPlaying::MROptimisticState::kActionPlay, 0, t0 + 20, provisional) == 0);
+    CHECK(provisional.playbackRate == 1);
+    CHECK(state.reconcile(trackSnapshot("a", 200, 60.4, 0, t0 + 20.1), t0 + 20.2) == NowPlaying::MROptimisticState::kOutcomeRolledBack);
+
+    // Another track shows up: rolled back.
+    CHECK(state.speculate(paused, NowPlaying::MROptimisticState::kActionPlay, 0, t0 + 30, provisional) == 0);
+    CHECK(state.reconcile(trackSnapshot("b", 200, 0, 1, t0 + 29), t0 + 30.1) == NowPlaying::MROptimisticState::kOutcomeRolledBack);
+
+    // The system says nothing: rolled back after the timeout.
+    CHECK(state.speculate(paused, NowPlaying::MROptimisticState::kActionPlay, 0, t0 + 40, provisional) == 0);
+    CHECK(state.getDeadline() == t0 + 42);
+    CHECK(!state.expire(t0 + 41.9));
+    CHECK(state.expire(t0 + 42));
+    CHECK(!state.expire(t0 + 50));
+
+    const NowPlaying::MROptimisticStatistics& statistics = state.getStatistics();
+    CHECK(statistics.speculations == 6);
+    CHECK(statistics.confirmations == 2);
+    CHECK(statistics.rollbacks == 3 && statistics.timeouts == 1);
+    CHECK(std::fabs(statistics.meanConfirmationTime - 0.25) < 1e-6);
+
+    // Consumers counting plays ignore provisional snapshots.
+    NowPlaying::MRScrobbler scrobbler((NowPlaying::MRScrobblerConfig()));
+    CHECK(scrobbler.feed(provisional, t0 + 40) == 0);
+    NowPlaying::MRListeningSession session;
+    CHECK(scrobbler.getCurrentSession(&session, t0 + 40) == -1);
+}
+
+static std::string foldedText(const char* text) {
+    std::vector<uint32_t> folded;
+    NowPlaying::MRFoldText(text, strlen(text), folded);
+    std::string ret;
+    for(size_t i = 0; i < folded.size(); i++) ret += folded[i] < 0x80 ? (char)folded[i] : '?';
+    return ret;
+}
+
+static bool foldsAlike(const char* a, const char* b) {
+    std::vector<uint32_t> foldedA, foldedB;
+    NowPlaying::MRFoldText(a, strlen(a), foldedA);
+    NowPlaying::MRFoldText(b, strlen(b), foldedB);
+    return foldedA == foldedB;
+}
+
+static NowPlaying::MRNowPlayingSnapshot catalogQuery(const char* title, const char* artist, const char* albumTitle) {
+    NowPlaying::MRNowPlayingSnapshot snapshot;
+    snapshot.hasInfo = true;
+    snapshot.title = title;
+    snapshot.artist = artist;
+    snapshot.albumTitle = albumTitle;
+    return snapshot;
+}
+
+static void testCatalog() {
+    // Folding: case, precomposed and combining diacritics, ligatures, apostrophes, punctuation, fullwidth, Greek and Cyrillic.
+    CHECK(foldedText("Beyonc\xC3\xA9 \xE2\x80\x93 HALO (Live)") == "beyonce halo live");
+    CHECK(foldsAlike("Beyonc\xC3\xA9", "Beyonce\xCC\x81"));
+    CHECK(foldedText("Stra\xC3\x9F" "e \xC3\x86on \xC5\x81\xC3\xB3" "d\xC5\xBA") == "strasse aeon lodz");
+    CHECK(foldedText("Don\xE2\x80\x99t  Stop... Me Now!") == "dont stop me now");
+    CHECK(foldedText("\xEF\xBC\xA1\xEF\xBC\xA2\xEF\xBC\xA3") == "abc");
+    CHECK(foldsAlike("\xCE\x95\xCE\xBB\xCF\x80\xCE\xAF\xCE\xB4\xCE\xB1", "\xCE\xB5\xCE\xBB\xCF\x80\xCE\xB9\xCE\xB4\xCE\xB1"));
+    CHECK(foldsAlike("\xD0\x81\xD0\xBB\xD0\xBA\xD0\xB0", "\xD0\xB5\xD0\xBB\xD0\xBA\xD0\xB0"));
+    CHECK(foldedText("a\xFF\xC3" "b") == "ab");
+    CHECK(foldedText(" -- ").empty());
+
+    std::string path = temporaryPath("catalog");
+    FILE* file = fopen(path.c_str(), "wb");
+    fputs("# identifier\tiTunesStoreIdentifier\ttitle\tartist\talbum\n"
+          "1\t1440833098\tHalo\tBeyonc\xC3\xA9\tI Am... Sasha Fierce\n"
+          "2\t0\tHalo\tDepeche Mode\tViolator\n"
+          "3\t\tBohemian Rhapsody\tQueen\tA Night at the Opera\n"
+          "\n"
+          "4\t0\tIntro\tThe xx\txx\n"
+          "5\t0\tIntro\tM83\tHurry Up, We're Dreaming\n"
+          "6\t0\tDon't Stop Me Now\tQueen\tJazz\n"
+          "7\t0\tJunk line without artist\n"
+          "8\t0\t\tNo title\tIgnored\n"
+          "9\t0\tLasse red\xC3\xA6n\tDie \xC3\x84rzte\tGer\xC3\xA4usch\r\n"
+          "10\t0\tHalo (Remastered 2011)\tDepeche Mode\tViolator\n", file);
+    fclose(file);
+
+    CHECK(NowPlaying::MRCatalogInterface::Create("/nonexistent/catalog.tsv") == 0);
+    NowPlaying::MRCatalogInterface* catalog = NowPlaying::MRCatalogInterface::Create(path.c_str());
+    CHECK(catalog != 0);
+    if(!catalog) return;
+    CHECK(catalog->getTrackCount() == 9);
+    CHECK(catalog->getMemoryUsage() > 0);
+
+    // The store identifier wins over the text.
+    NowPlaying::MRCatalogMatch match;
+    NowPlaying::MRNowPlayingSnapshot snapshot = catalogQuery("Something Else", "", "");
+    snapshot.iTunesStoreIdentifier = 1440833098;
+    CHECK(catalog->match(snapshot, &match) == 0 && match.identifier == 1 && match.byIdentifier && match.score == 1);
+    CHECK(match.artist == "Beyonc\xC3\xA9" && match.albumTitle == "I Am... Sasha Fierce");
+
+    // The same title by several artists: the artist decides, whatever the case and diacritics.
+    CHECK(catalog->match(catalogQuery("HALO", "beyonce", ""), &match) == 0 && match.identifier == 1 && !match.byIdentifier && match.score == 1);
+    CHECK(catalog->match(catalogQuery("Halo", "Depeche Mode", "Violator"), &match) == 0 && match.identifier == 2);
+    CHECK(catalog->match(catalogQuery("Intro", "M83", ""), &match) == 0 && match.identifier == 5);
+
+    // Typos and extra words.
+    CHECK(catalog->match(catalogQuery("Bohemian Rapsody", "Queen", ""), &match) == 0 && match.identifier == 3);
+    CHECK(match.score >= 0.5 && match.score < 1);
+    CHECK(catalog->match(catalogQuery("Halo - Remastered 2011", "Depeche Mode", ""), &match) == 0 && match.identifier == 10);
+    CHECK(catalog->match(catalogQuery("Dont stop me now", "", ""), &match) == 0 && match.identifier == 6);
+
+    // Carriage returns are not part of the album.
+    CHECK(catalog->match(catalogQuery("Lasse redaen", "die arzte", "gerausch"), &match) == 0 && match.identifier == 9 && match.albumTitle == "Ger\xC3\xA4usch");
+
+    CHECK(catalog->match(catalogQuery("Completely Different Song", "Nobody", ""), &match) == -1);
+    CHECK(catalog->match(catalogQuery("", "Queen", ""), &match) == -1);
+
+    std::vector<NowPlaying::MRCatalogMatch> matches;
+    CHECK(catalog->search("intro", 0, 0, 5, &matches) == 2);
+    CHECK(matches[0].score == 1 && matches[1].score == 1 && matches[0].identifier == 4);
+    matches.clear();
+    CHECK(catalog->search("halo", "depeche mode", 0, 2, &matches) == 2);
+    CHECK(matches[0].identifier == 2 && matches[1].identifier == 10 && matches[0].score > matches[1].score);
+    NowPlaying::MRCatalogInterface::Delete(catalog);
+
+    // An empty catalog matches nothing.
+    file = fopen(path.c_str(), "wb");
+    fclose(file);
+    catalog = NowPlaying::MRCatalogInterface::Create(path.c_str());
+    CHECK(catalog != 0 && catalog->getTrackCount() == 0);
+    if(catalog) CHECK(catalog->match(catalogQuery("Halo", "", ""), &match) == -1);
+    NowPlaying::MRCatalogInterface::Delete(catalog);
+    unlink(path.c_str());
+}
+
+struct LyricsRecord {
+    NowPlaying::MRLyricsEventType type;
+    int line;
+    int word;
+    double time;
+    std::string text;
+    bool jumped;
+    double now;
+};
+
+struct LyricsRun {
+    std::vector<LyricsRecord> records;
+    double now;
+};
+
+static void recordLyricsEvent(const NowPlaying::MRLyricsEvent& event, void* context) {
+    LyricsRun* run = static_cast<LyricsRun*>(context);
+    LyricsRecord record = {event.type, event.line, event.word, event.time, std::string(event.text, event.length), event.jumped, run->now};
+    run->records.push_back(record);
+}
+
+// Wake up at each deadline until `until`, as the owner of MRLyrics would.
+static void runLyrics(NowPlaying::MRLyricsInterface* lyrics, LyricsRun& run, double until) {
+    while(lyrics->nextDeadline() <= until) {
+        run.now = std::max(run.now, lyrics->nextDeadline());
+        lyrics->advance(run.now, recordLyricsEvent, &run);
+    }
+    run.now = until;
+}
+
+static void testLyrics() {
+    const char lrc[] =
+        "\xEF\xBB\xBF[ti:Song]\r\n"
+        "[ar:Someone]\r\n"
+        "[offset:+500]\r\n"
+        "[00:01.50]First line\r\n"
+        "[00:04.00][00:12.00]<00:04.00>Cho <00:04.50>rus <00:05.20>line<00:06.00>\r\n"
+        "[00:08.0]\r\n"
+        "no time here\r\n"
+        "[00:09.123]  Last  line  \r\n";
+    NowPlaying::MRLyricsInterface* lyrics = NowPlaying::MRLyricsInterface::Create();
+    CHECK(lyrics->nextDeadline() == HUGE_VAL);
+    CHECK(lyrics->load(lrc, sizeof(lrc) - 1) == 0);
+
+    // Parsing: sorted lines, repeated lines, the offset, and the text without tags.
+    CHECK(lyrics->getLineCount() == 5);
+    const double times[] = {1.0, 3.5, 7.5, 8.623, 11.5};
+    const char* const texts[] = {"First line", "Cho rus line", "", "Last  line", "Cho rus line"};
+    for(size_t i = 0; i < 5; i++) {
+        NowPlaying::MRLyricsLine line;
+        CHECK(lyrics->getLine(i, &line) == 0);
+        CHECK(std::fabs(line.time - times[i]) < 1e-9);
+        CHECK(line.text == texts[i]);
+        CHECK(line.wordCount == (i == 1 || i == 4 ? 3u : 0u));
+        CHECK(line.endTime == (i < 4 ? times[i + 1] : HUGE_VAL));
+    }
+    NowPlaying::MRLyricsLine line;
+    CHECK(lyrics->getLine(5, &line) == -1);
+    CHECK(lyrics->getLineAt(0.5) == -1);
+    CHECK(lyrics->getLineAt(1.0) == 0);
+    CHECK(lyrics->getLineAt(7.499) == 1);
+    CHECK(lyrics->getLineAt(100) == 4);
+
+    // Playing through on a simulated clock: every event right at its boundary, in order.
+    const double t0 = 1700000000;
+    LyricsRun run;
+    run.now = t0;
+    CHECK(lyrics->feed(trackSnapshot("a", 20, 0, 1, t0), t0) == 1);
+    runLyrics(lyrics, run, t0 + 30);
+    CHECK(run.records.size() == 12);
+    if(run.records.size() == 12) {
+        CHECK(run.records[0].jumped && run.records[0].line == -1 && run.records[0].text.empty());
+        const int lines[] = {0, 1, 1, 1, 1, 2, 3, 4, 4, 4, 4};
+        const int words[] = {-1, -1, 0, 1, 2, -1, -1, -1, 0, 1, 2};
+        const double eventTimes[] = {1.0, 3.5, 3.5, 4.0, 4.7, 7.5, 8.623, 11.5, 11.5, 12.0, 12.7};
+        const char* const eventTexts[] = {"First line", "Cho rus line", "Cho", "rus", "line", "", "Last  line", "Cho rus line", "Cho", "rus", "line"};
+        for(size_t i = 0; i < 11; i++) {
+            const LyricsRecord& record = run.records[i + 1];
+            CHECK(record.line == lines[i] && record.word == words[i]);
+            CHECK(record.type == (words[i] < 0 ? NowPlaying::kMRLyricsEventLine : NowPlaying::kMRLyricsEventWord));
+            CHECK(std::fabs(record.time - eventTimes[i]) < 1e-9);
+            CHECK(std::fabs(record.now - t0 - eventTimes[i]) < 1e-5);
+            CHECK(record.text == eventTexts[i]);
+            CHECK(!record.jumped);
+        }
+    }
+    CHECK(lyrics->nextDeadline() == HUGE_VAL);
+
+    // A seek emits the current line and word at once, then playback goes on from there.
+    run.records.clear();
+    CHECK(lyrics->feed(trackSnapshot("a", 20, 4.2, 1, t0 + 30), t0 + 30) == 1);
+    CHECK(lyrics->nextDeadline() == t0 + 30);
+    runLyrics(lyrics, run, t0 + 30.6);
+    CHECK(run.records.size() == 3);
+    if(run.records.size() == 3) {
+        CHECK(run.records[0].jumped && run.records[0].line == 1 && run.records[0].word == -1);
+        CHECK(run.records[1].jumped && run.records[1].line == 1 && run.records[1].word == 1 && run.records[1].text == "rus");
+        CHECK(!run.records[2].jumped && run.records[2].word == 2 && std::fabs(run.records[2].now - (t0 + 30.5)) < 1e-5);
+    }
+
+    // Paused, nothing is due. Resuming where it paused is no jump, and twice the rate halves the wait.
+    CHECK(lyrics->feed(trackSnapshot("a", 20, 5.2, 0, t0 + 31), t0 + 31) == 0);
+    CHECK(lyrics->nextDeadline() == HUGE_VAL);
+    CHECK(lyrics->feed(trackSnapshot("a", 20, 5.2, 2, t0 + 40), t0 + 40) == 0);
+    CHECK(std::fabs(lyrics->nextDeadline() - (t0 + 40 + (7.5 - 5.2) / 2)) < 1e-6);
+
+    // Another track with its lyrics: the current line of the new lyrics at once.
+    run.records.clear();
+    run.now = t0 + 41;
+    CHECK(lyrics->feed(trackSnapshot("b", 20, 2.5, 1, t0 + 41), t0 + 41) == 1);
+    const char other[] = "[00:01.00]One\n[00:02.00]Two\n[00:03.00]Three";
+    CHECK(lyrics->load(other, sizeof(other) - 1) == 0);
+    runLyrics(lyrics, run, t0 + 43);
+    CHECK(run.records.size() == 2);
+    if(run.records.size() == 2) {
+        CHECK(run.records[0].jumped && run.records[0].text == "Two");
+        CHECK(!run.records[1].jumped && run.records[1].text == "Three" && std::fabs(run.records[1].now - (t0 + 41.5)) < 1e-5);
+    }
+
+    // No timed line: no lyrics at all.
+    const char untimed[] = "[ti:Instrumental]\nla la la\n[xx:yy]Not a time";
+    CHECK(lyrics->load(untimed, sizeof(untimed) - 1) == -1);
+    CHECK(lyrics->getLineCount() == 0);
+    CHECK(lyrics->nextDeadline() == HUGE_VAL);
+    CHECK(lyrics->advance(t0 + 50, recordLyricsEvent, &run) == 0);
+    NowPlaying::MRLyricsInterface::Delete(lyrics);
+}
+
+struct EventRecord {
+    NowPlaying::MRPlaybackEventType type;
+    double time;
+    double position;
+    double previousPosition;
+};
+
+static void recordPlaybackEvent(const NowPlaying::MRPlaybackEvent& event, void* context) {
+    EventRecord record = {event.type, event.time, event.position, event.previousPosition};
+    static_cast<std::vector<EventRecord>*>(context)->push_back(record);
+}
+
+static void countPlaybackEvent(const NowPlaying::MRPlaybackEvent&, void* context) {
+    (*static_cast<int*>(context))++;
+}
+
+struct RecordedSnapshot {
+    double now;
+    const char* identifier;     // NULL for no information
+    double duration;
+    double elapsedTime;
+    double playbackRate;
+    double timestamp;
+    unsigned expected;          // The events expected, in the order of MREventStreamInterface
+};
+
+// A session with a player, as notified: repeated notifications and re-reported positions in between the real changes.
+static const RecordedSnapshot kRecordedSession[] = {
+    {0.0, NULL, 0, 0, 0, 0, 0},
+    {10.0, "A", 200, 0, 1, 10.0, NowPlaying::kMRPlaybackEventTrackChanged | NowPlaying::kMRPlaybackEventStarted},
+    {10.05, "A", 200, 0, 1, 10.0, 0},
+    {10.3, "A", 200, 0.27, 1, 10.27, 0},
+    {40.0, "A", 200, 30.0, 0, 39.99, NowPlaying::kMRPlaybackEventPaused},
+    {40.02, "A", 200, 30.0, 0, 39.99, 0},
+    {55.0, "A", 200, 30.0, 1, 55.0, NowPlaying::kMRPlaybackEventStarted},
+    {70.0, "A", 200, 120.0, 1, 70.0, NowPlaying::kMRPlaybackEventSeeked},
+    {150.0, "B", 180, 0, 1, 150.0, NowPlaying::kMRPlaybackEventEnded | NowPlaying::kMRPlaybackEventTrackChanged},
+    {150.1, "B", 180, 0, 1, 150.0, 0},
+    {195.0, "B", 180, 45.2, 1, 195.0, 0},
+    {210.0, "B", 180, 10, 1, 210.0, NowPlaying::kMRPlaybackEventSeeked},
+    {220.0, "B", 180, 170, 0, 220.0, NowPlaying::kMRPlaybackEventSeeked | NowPlaying::kMRPlaybackEventPaused},
+    {230.0, "B", 180, 170, 1, 230.0, NowPlaying::kMRPlaybackEventStarted},
+    {240.0, "B", 180, 0, 1, 240.0, NowPlaying::kMRPlaybackEventEnded | NowPlaying::kMRPlaybackEventSeeked},
+    {300.0, NULL, 0, 0, 0, 0, NowPlaying::kMRPlaybackEventTrackChanged | NowPlaying::kMRPlaybackEventPaused},
+    {301.0, NULL, 0, 0, 0, 0, 0},
+};
+
+static NowPlaying::MRNowPlayingSnapshot recordedSnapshot(const RecordedSnapshot& recorded) {
+    if(!recorded.identifier) return NowPlaying::MRNowPlayingSnapshot();
+    return trackSnapshot(recorded.identifier, recorded.duration, recorded.elapsedTime, recorded.playbackRate, recorded.timestamp);
+}
+
+static std::vector<NowPlaying::MRPlaybackEventType> eventTypesOf(unsigned types) {
+    const NowPlaying::MRPlaybackEventType order[] = {NowPlaying::kMRPlaybackEventEnded, NowPlaying::kMRPlaybackEventTrackChanged,
+                                                     NowPlaying::kMRPlaybackEventSeeked, NowPlaying::kMRPlaybackEventPaused,
+                                                     NowPlaying::kMRPlaybackEventStarted};
+    std::vector<NowPlaying::MRPlaybackEventType> ret;
+    for(size_t i = 0; i < 5; i++) if(types & order[i]) ret.push_back(order[i]);
+    return ret;
+}
+
+static void testEventStream() {
+    // A recorded session.
+    {
+        NowPlaying::MREventStreamInterface* stream = NowPlaying::MREventStreamInterface::Create();
+        std::vector<EventRecord> records;
+        int seeks = 0;
+        CHECK(stream->subscribe(0, recordPlaybackEvent, &records) == 0);
+        CHECK(stream->subscribe(NowPlaying::kMRPlaybackEventAll, NULL, NULL) == 0);
+        stream->subscribe(NowPlaying::kMRPlaybackEventAll, recordPlaybackEvent, &records);
+        stream->subscribe(NowPlaying::kMRPlaybackEventSeeked, countPlaybackEvent, &seeks);
+        size_t duplicates = 0;
+        for(size_t i = 0; i < sizeof(kRecordedSession) / sizeof(kRecordedSession[0]); i++) {
+            const RecordedSnapshot& recorded = kRecordedSession[i];
+            records.clear();
+            std::vector<NowPlaying::MRPlaybackEventType> expected = eventTypesOf(recorded.expected);
+            CHECK(stream->feed(recordedSnapshot(recorded), recorded.now) == (int)expected.size());
+            CHECK(records.size() == expected.size());
+            for(size_t j = 0; j < records.size() && j < expected.size(); j++) {
+                CHECK(records[j].type == expected[j]);
+                CHECK(records[j].time == recorded.now);
+            }
+            if(expected.empty()) duplicates++;
+            // The seek of 70 s: predicted 45 s, reported 120 s.
+            if(recorded.now == 70.0 && records.size() == 1) CHECK(records[0].position == 120.0 && records[0].previousPosition == 45.0);
+        }
+        CHECK(seeks == 4);
+        CHECK(stream->getDuplicateCount() == duplicates);
+        CHECK(!stream->isPlaying());
+
+        // Stale and provisional snapshots are ignored.
+        NowPlaying::MRNowPlayingSnapshot stale = trackSnapshot("C", 100, 0, 1, 400);
+        stale.stale = true;
+        CHECK(stream->feed(stale, 400) == 0);
+        NowPlaying::MRNowPlayingSnapshot provisional = trackSnapshot("C", 100, 0, 1, 400);
+        provisional.provisional = true;
+        CHECK(stream->feed(provisional, 400) == 0);
+        CHECK(!stream->isPlaying());
+        NowPlaying::MREventStreamInterface::Delete(stream);
+    }
+
+    // A simulated player doing random things, notified with duplicates and jittered positions: exactly the real changes come out.
+    {
+        NowPlaying::MREventStreamInterface* stream = NowPlaying::MREventStreamInterface::Create();
+        std::vector<EventRecord> records;
+        stream->subscribe(NowPlaying::kMRPlaybackEventAll, recordPlaybackEvent, &records);
+        std::vector<NowPlaying::MRPlaybackEventType> expected;
+        std::mt19937 random(5);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        int track = 0;
+        double duration = 180;
+        double elapsed = 0;
+        double rate = 1;
+        double now = 1700000000;
+        char identifier[32];
+        size_t notifications = 0;
+
+        expected.push_back(NowPlaying::kMRPlaybackEventTrackChanged);
+        expected.push_back(NowPlaying::kMRPlaybackEventStarted);
+        for(int step = 0; step < 3000; step++) {
+            snprintf(identifier, sizeof(identifier), "track %d", track);
+            double jitter = (unit(random) - 0.5) * 0.2;
+            stream->feed(trackSnapshot(identifier, duration, std::max(0.0, elapsed + jitter), rate, now), now);
+            notifications++;
+            // Spurious notifications: the same again, or the position re-reported.
+            for(int i = (int)(random() % 3); i > 0; i--) {
+                double later = now + unit(random) * 0.5;
+                double reported = elapsed + rate * (later - now) + (unit(random) - 0.5) * 0.2;
+                stream->feed(trackSnapshot(identifier, duration, std::max(0.0, std::min(reported, duration)), rate, later), later);
+                notifications++;
+            }
+            now += 1;
+            elapsed = std::min(duration, elapsed + rate);
+
+            int action = (int)(random() % 6);
+            if(action == 0) {
+                // Wait, possibly until the end of the track, where the player goes on with the next one.
+                double wait = 5 + unit(random) * 60;
+                if(rate > 0 && elapsed + wait * rate >= duration) {
+                    now += (duration - elapsed) / rate;
+                    track++;
+                    duration = 60 + unit(random) * 240;
+                    elapsed = 0;
+                    expected.push_back(NowPlaying::kMRPlaybackEventEnded);
+                    expected.push_back(NowPlaying::kMRPlaybackEventTrackChanged);
+                }
+                else {
+                    now += wait;
+                    elapsed += wait * rate;
+                }
+            }
+            else if(action == 1 && elapsed < duration - 2) {
+                // Pausing in the last moments of a track is stopping at its end, which ends it: the player never does that either.
+                rate = rate > 0 ? 0 : 1;
+                expected.push_back(rate > 0 ? NowPlaying::kMRPlaybackEventStarted : NowPlaying::kMRPlaybackEventPaused);
+            }
+            else if(action == 2 || action == 3) {
+                // A seek from the last moments of a track cannot be told from a repeat, so the player never does that.
+                double target = unit(random) * (duration - 5);
+                if(std::fabs(target - elapsed) < 3 || elapsed >= duration - 2) continue;
+                elapsed = target;
+                expected.push_back(NowPlaying::kMRPlaybackEventSeeked);
+            }
+            else if(action == 4 && elapsed < duration - 2) {
+                track++;
+                duration = 60 + unit(random) * 240;
+                elapsed = 0;
+                expected.push_back(NowPlaying::kMRPlaybackEventTrackChanged);
+            }
+        }
+        snprintf(identifier, sizeof(identifier), "track %d", track);
+        stream->feed(trackSnapshot(identifier, duration, elapsed, rate, now), now);
+        CHECK(records.size() == expected.size());
+        size_t mismatch = 0;
+        while(mismatch < records.size() && mismatch < expected.size() && records[mismatch].type == expected[mismatch]) mismatch++;
+        CHECK(mismatch == expected.size());
+        CHECK(stream->getDuplicateCount() > notifications / 2);
+        NowPlaying::MREventStreamInterface::Delete(stream);
+    }
+}
+
+static std::string readFile(const std::string& path) {
+    std::string data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return data;
+    char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.append(buffer, read);
+    fclose(file);
+    return data;
+}
+
+static void writeFile(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return;
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+}
+
+// A message of an Arrow IPC file, as listed by its footer.
+struct ArrowBlock {
+    uint64_t offset;
+    uint64_t metadataLength;
+    uint64_t bodyLength;
+};
+
+// The blocks of the footer of `file`: `list` 2 for the dictionaries, 3 for the record batches.
+static std::vector<ArrowBlock> arrowBlocks(const std::string& file, uint16_t list) {
+    std::vector<ArrowBlock> blocks;
+    if(file.size() < 10) return blocks;
+    size_t footerLength = 0;
+    for(int i = 3; i >= 0; i--) footerLength = footerLength << 8 | (uint8_t)file[file.size() - 10 + i];
+    if(footerLength > file.size() - 10) return blocks;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+    NowPlaying::MRFlatBufferTable footer = NowPlaying::MRFlatBufferTable::Root(data + file.size() - 10 - footerLength, footerLength);
+    size_t elements, count;
+    if(!footer.vector(list, 24, elements, count)) return blocks;
+    for(size_t i = 0; i < count; i++) {
+        ArrowBlock block = {footer.read(elements + 24 * i, 8), footer.read(elements + 24 * i + 8, 4), footer.read(elements + 24 * i + 16, 8)};
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+// The header of the message of `block`: a RecordBatch, or a DictionaryBatch.
+static NowPlaying::MRFlatBufferTable arrowHeader(const std::string& file, const ArrowBlock& block) {
+    if(block.offset + block.metadataLength > file.size() || block.metadataLength < 8) return NowPlaying::MRFlatBufferTable();
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+    return NowPlaying::MRFlatBufferTable::Root(data + block.offset + 8, block.metadataLength - 8).table(2);
+}
+
+// Buffer `index` of the RecordBatch `batch` of the message of `block`.
+static std::string arrowBuffer(const std::string& file, const ArrowBlock& block, const NowPlaying::MRFlatBufferTable& batch, size_t index) {
+    size_t elements, count;
+    if(!batch.vector(2, 16, elements, count) || index >= count) return std::string();
+    uint64_t start = block.offset + block.metadataLength + batch.read(elements + 16 * index, 8);
+    uint64_t length = batch.read(elements + 16 * index + 8, 8);
+    return start + length <= file.size() ? file.substr(start, length) : std::string();
+}
+
+// The null count of column `index` of the RecordBatch `batch`.
+static uint64_t arrowNullCount(const NowPlaying::MRFlatBufferTable& batch, size_t index) {
+    size_t elements, count;
+    if(!batch.vector(1, 16, elements, count) || index >= count) return UINT64_MAX;
+    return batch.read(elements + 16 * index + 8, 8);
+}
+
+static uint64_t littleEndian(const std::string& buffer, size_t offset, size_t size) {
+    uint64_t value = 0;
+    for(size_t i = 0; i < size && offset + i < buffer.size(); i++) value |= (uint64_t)(uint8_t)buffer[offset + i] << (8 * i);
+    return value;
+}
+
+// The files can also be checked against Arrow itself, outside this test, for example with pyarrow:
+//     python3 -c "import pyarrow.feather as f; f.read_table('export.arrow').validate(full=True)"
+static void testArrowExporter() {
+    std::string path = temporaryPath("export.arrow");
+    unlink(path.c_str());
+
+    NowPlaying::MRArrowExporterInterface* exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(!exporter) return;
+    // Readable at once, with no rows.
+    std::string data = readFile(path);
+    CHECK(data.compare(0, 8, std::string("ARROW1\0\0", 8)) == 0);
+    CHECK(data.compare(data.size() - 6, 6, "ARROW1") == 0);
+    CHECK(exporter->getRowCount() == 0);
+
+    NowPlaying::MRVersionedSnapshot versioned;
+    for(int i = 0; i < 10; i++) {
+        versioned.version = i + 1;
+        versioned.snapshot = i == 5 ? NowPlaying::MRNowPlayingSnapshot() : syntheticSnapshot(i / 3);
+        CHECK(exporter->write(versioned) == 0);
+    }
+    CHECK(exporter->getRowCount() == 10);
+    CHECK(exporter->getBatchCount() == 2);
+    CHECK(exporter->flush() == 0);
+    CHECK(exporter->getBatchCount() == 3);
+    NowPlaying::MRArrowExporterInterface::Delete(exporter);
+
+    // Each string is written once, in the dictionaries, however many rows repeat it.
+    data = readFile(path);
+    size_t found = 0;
+    for(size_t at = data.find("Track 1"); at != std::string::npos; at = data.find("Track 1", at + 1)) found++;
+    CHECK(found == 1);
+
+    // Read back: the second batch holds the rows 4 to 7 (tracks 1, none, 2, 2). Each column has a validity and a values buffer.
+    std::vector<ArrowBlock> batches = arrowBlocks(data, 3);
+    std::vector<ArrowBlock> dictionaries = arrowBlocks(data, 2);
+    CHECK(batches.size() == 3);
+    if(batches.size() == 3) {
+        NowPlaying::MRFlatBufferTable batch = arrowHeader(data, batches[1]);
+        CHECK(batch.isValid() && batch.scalar(0, 8, 0) == 4);
+        std::string versions = arrowBuffer(data, batches[1], batch, 1);
+        CHECK(versions.size() == 32 && littleEndian(versions, 0, 8) == 5 && littleEndian(versions, 24, 8) == 8);
+        CHECK(arrowNullCount(batch, 2) == 0 && arrowBuffer(data, batches[1], batch, 4).empty());
+        CHECK(littleEndian(arrowBuffer(data, batches[1], batch, 5), 0, 1) == 0x0d);     // has_info, not for row 5
+        CHECK(littleEndian(arrowBuffer(data, batches[1], batch, 7), 0, 1) == 0);        // stale
+        // The titles are indices in the dictionary, null for row 5.
+        CHECK(arrowNullCount(batch, 5) == 1);
+        CHECK(littleEndian(arrowBuffer(data, batches[1], batch, 10), 0, 1) == 0x0d);
+        std::string titles = arrowBuffer(data, batches[1], batch, 11);
+        CHECK(titles.size() == 16 && littleEndian(titles, 0, 4) == 1 && littleEndian(titles, 4, 4) == 0 && littleEndian(titles, 8, 4) == 2);
+        std::string durations = arrowBuffer(data, batches[1], batch, 25);
+        double duration = 0;
+        if(durations.size() == 32) memcpy(&duration, durations.data() + 16, 8);
+        CHECK(duration == 182.0);
+        std::string repeatModes = arrowBuffer(data, batches[1], batch, 39);
+        CHECK(arrowNullCount(batch, 19) == 1 && repeatModes.size() == 4 && repeatModes[0] == 1 && repeatModes[2] == 1);
+    }
+    // "Track 2" is added to the titles (dictionary 0) by a delta before the second batch, at index 2.
+    bool delta = false;
+    for(size_t i = 0; i < dictionaries.size() && batches.size() == 3; i++) {
+        NowPlaying::MRFlatBufferTable header = arrowHeader(data, dictionaries[i]);
+        if(dictionaries[i].offset > batches[1].offset || header.scalar(0, 8, UINT64_MAX) != 0 || header.scalar(2, 1, 0) == 0) continue;
+        NowPlaying::MRFlatBufferTable batch = header.table(1);
+        std::string offsets = arrowBuffer(data, dictionaries[i], batch, 1);
+        std::string values = arrowBuffer(data, dictionaries[i], batch, 2);
+        delta = batch.scalar(0, 8, 0) == 1 && littleEndian(offsets, 4, 4) == 7 && values == "Track 2";
+    }
+    CHECK(delta);
+
+    // Reopening appends, with the strings already known.
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(!exporter) return;
+    CHECK(exporter->getRowCount() == 10);
+    CHECK(exporter->getBatchCount() == 3);
+    for(int i = 0; i < 3; i++) {
+        versioned.version = 11 + i;
+        versioned.snapshot = syntheticSnapshot(i == 2 ? 100 : 1);
+        CHECK(exporter->write(versioned) == 0);
+    }
+    NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    data = readFile(path);
+    found = 0;
+    for(size_t at = data.find("Track 1"); at != std::string::npos; at = data.find("Track 1", at + 1)) found++;
+    CHECK(found == 2);                                          // "Track 1" and "Track 100"
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(exporter) {
+        CHECK(exporter->getRowCount() == 13);
+        CHECK(exporter->getBatchCount() == 4);
+        NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    }
+
+    // Stopped in the middle of an append, after writing a batch over the footer but not the new footer,
+    // or in the middle of the batch: the whole batches are kept and the file is finished again.
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(!exporter) return;
+    for(int i = 0; i < 4; i++) {
+        versioned.version = 14 + i;
+        versioned.snapshot = syntheticSnapshot(200 + i);
+        CHECK(exporter->write(versioned) == 0);
+    }
+    std::string stopped = readFile(path);
+    NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    std::string finished = readFile(path);
+    // The messages end at the end-of-stream marker, before the footer and its length.
+    size_t footerLength = 0;
+    for(int i = 3; i >= 0; i--) footerLength = footerLength << 8 | (uint8_t)finished[finished.size() - 10 + i];
+    size_t streamEnd = finished.size() - 10 - footerLength - 8;
+    CHECK(streamEnd < stopped.size() && stopped.compare(0, streamEnd, finished, 0, streamEnd) == 0);
+    writeFile(path, stopped.substr(0, streamEnd - 10));
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(exporter) {
+        CHECK(exporter->getRowCount() == 13);
+        CHECK(exporter->getBatchCount() == 4);
+        NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    }
+    writeFile(path, stopped);
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0);
+    if(exporter) {
+        CHECK(exporter->getRowCount() == 17);
+        CHECK(exporter->getBatchCount() == 5);
+        NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    }
+    CHECK(readFile(path) == finished);
+    FILE* file = fopen(path.c_str(), "r+b");
+    CHECK(file != 0);
+    if(file) {
+        fseek(file, -3, SEEK_END);
+        fputc('#', file);
+        fclose(file);
+    }
+    exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4);
+    CHECK(exporter != 0 && exporter->getRowCount() == 17);
+    NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    CHECK(readFile(path) == finished);
+
+    // Anything else is refused rather than overwritten.
+    file = fopen(path.c_str(), "wb");
+    if(file) {
+        fputs("title,artist\n", file);
+        fclose(file);
+    }
+    CHECK(NowPlaying::MRArrowExporterInterface::Create(path.c_str(), 4) == 0);
+    CHECK(readFile(path) == "title,artist\n");
+
+    unlink(path.c_str());
+}
+
+// Stands in for a MediaRemote which drops or delays some replies, on a simulated clock, wired to the watchdog as MRMediaRemoteHub is.
+struct UnreliableSource : public NowPlaying::MRSnapshotHub<int>::Source {
+    struct Reply {
+        double time;
+        uint64_t sequence;
+        int value;
+    };
+    NowPlaying::MRSnapshotHub<int>* hub = 0;
+    NowPlaying::MRFetchWatchdog* watchdog = 0;
+    std::vector<Reply> replies;
+    std::vector<double> fetchTimes;
+    double now = 1700000000;
+    int systemValue = 0;
+    int dropNext = 0;
+    double delayNext = 0.1;
+
+    void startObserving() {}
+    void stopObserving() {}
+    void fetch(uint64_t sequence) {
+        watchdog->fetchIssued(sequence, now);
+        fetchTimes.push_back(now);
+        if(dropNext > 0) {
+            dropNext--;
+            return;
+        }
+        replies.push_back({now + delayNext, sequence, systemValue});
+        delayNext = 0.1;
+    }
+
+    // Run the clock to `until`, delivering the replies and retrying when the watchdog says so.
+    void runUntil(double until) {
+        for(;;) {
+            size_t first = replies.size();
+            for(size_t i = 0; i < replies.size(); i++) if(first == replies.size() || replies[i].time < replies[first].time) first = i;
+            double replyTime = first < replies.size() ? replies[first].time : HUGE_VAL;
+            double deadline = watchdog->nextDeadline();
+            if(std::min(replyTime, deadline) > until) break;
+            now = std::max(now, std::min(replyTime, deadline));
+            if(replyTime <= deadline) {
+                Reply reply = replies[first];
+                replies.erase(replies.begin() + first);
+                watchdog->replyReceived(reply.sequence, now);
+                hub->deliver(reply.sequence, reply.value);
+            }
+            else if(watchdog->advance(now)) {
+                hub->retry();
+            }
+        }
+        now = until;
+    }
+};
+
+static void testFetchWatchdog() {
+    NowPlaying::MRFetchWatchdogConfig config;
+    config.timeout = 3.0;
+    config.initialBackoff = 0.5;
+    config.jitter = 0.5;
+    NowPlaying::MRFetchWatchdog watchdog(config);
+    UnreliableSource source;
+    NowPlaying::MRSnapshotHub<int> hub(&source);
+    source.hub = &hub;
+    source.watchdog = &watchdog;
+    HubInstance instance;
+    uint64_t id = hub.attach(&instance);
+    int callbacks = 0;
+    NowPlaying::MRSnapshotHub<int>::Callback counted = [&callbacks]() { callbacks++; };
+
+    // Answered in time: nothing to do.
+    source.systemValue = 1;
+    hub.update(id, counted);
+    source.runUntil(source.now + 10);
+    CHECK(instance.data == 1 && callbacks == 1);
+    CHECK(watchdog.getStatistics().stuckFetches == 0 && !watchdog.isWaiting());
+    CHECK(watchdog.nextDeadline() == HUGE_VAL);
+
+    // A dropped reply: stale from the deadline on, then retried once, which answers the update.
+    double issued = source.now;
+    source.systemValue = 2;
+    source.dropNext = 1;
+    hub.update(id, counted);
+    source.runUntil(issued + 2.9);
+    CHECK(callbacks == 1 && watchdog.getStaleSince() == 0);
+    source.runUntil(issued + 3.0);
+    CHECK(watchdog.getStaleSince() == issued);
+    CHECK(watchdog.getStatistics().stuckFetches == 1 && watchdog.getStatistics().retries == 0);
+    source.runUntil(issued + 10);
+    CHECK(instance.data == 2 && callbacks == 2);
+    CHECK(watchdog.getStatistics().retries == 1);
+    CHECK(source.fetchTimes.back() >= issued + 3.25 && source.fetchTimes.back() <= issued + 3.5);
+    CHECK(watchdog.getStaleSince() == 0);
+
+    // Dropped again and again: the backoff doubles with jitter, and the system is stale since the first fetch.
+    issued = source.now;
+    size_t firstFetch = source.fetchTimes.size();
+    source.systemValue = 3;
+    source.dropNext = 5;
+    hub.update(id, counted);
+    source.runUntil(issued + 20);
+    CHECK(callbacks == 2 && watchdog.getStaleSince() == issued);
+    source.runUntil(issued + 60);
+    CHECK(instance.data == 3 && callbacks == 3);
+    CHECK(source.fetchTimes.size() - firstFetch == 6);
+    for(size_t i = 1; i < 6; i++) {
+        double backoff = source.fetchTimes[firstFetch + i] - source.fetchTimes[firstFetch + i - 1] - config.timeout;
+        double longest = config.initialBackoff * (1 << (i - 1));
+        CHECK(backoff >= longest * (1 - config.jitter) && backoff <= longest);
+    }
+    CHECK(watchdog.getStatistics().stuckFetches == 6 && watchdog.getStatistics().retries == 6);
+
+    // A reply later than the retry is older than what the retry applied, and is ignored.
+    source.systemValue = 4;
+    source.delayNext = 8.0;
+    hub.update(id, counted);
+    source.systemValue = 5;
+    source.runUntil(source.now + 5);
+    CHECK(instance.data == 5 && callbacks == 4);
+    source.runUntil(source.now + 10);
+    CHECK(instance.data == 5 && callbacks == 4 && hub.getLatest() == 5);
+    CHECK(watchdog.getStatistics().lateReplies == 1);
+
+    // A slow reply coming during the backoff answers the fetch, and nothing is retried.
+    uint64_t retries = watchdog.getStatistics().retries;
+    source.systemValue = 6;
+    source.delayNext = 3.1;
+    hub.update(id, counted);
+    source.runUntil(source.now + 10);
+    CHECK(instance.data == 6 && callbacks == 5);
+    CHECK(watchdog.getStatistics().retries == retries);
+    CHECK(watchdog.getStatistics().stuckFetches == 8 && watchdog.getStaleSince() == 0);
+    CHECK(watchdog.getStatistics().fetches == source.fetchTimes.size());
+}
+
+static NowPlaying::MRNotificationPayload playbackPayload(bool hasRate, double rate, bool hasElapsed, double elapsed, double timestamp) {
+    NowPlaying::MRNotificationPayload payload;
+    payload.hasPlaybackRate = hasRate;
+    payload.playbackRate = rate;
+    payload.hasElapsedTime = hasElapsed;
+    payload.elapsedTime = elapsed;
+    payload.timestamp = timestamp;
+    return payload;
+}
+
+static void testNotificationFastPath() {
+    typedef NowPlaying::MRNotificationFastPath FastPath;
+    const double t0 = 1700000000;
+    NowPlaying::MRNotificationFastPathConfig config;
+    config.confirmDelay = 1.0;
+    FastPath fastPath(config);
+    NowPlaying::MRNowPlayingSnapshot current = trackSnapshot("a", 200, 10, 1, t0);
+    NowPlaying::MRNowPlayingSnapshot updated;
+
+    // A pause carrying only the rate: applied at once, the clock re-anchored at the notification.
+    CHECK(fastPath.notificationReceived(current, 0, true, playbackPayload(true, 0, false, 0, 0), t0 + 5, updated) == FastPath::kDecisionApply);
+    CHECK(updated.playbackRate == 0 && updated.elapsedTime == 15 && updated.timestamp == t0 + 5);
+    CHECK(updated.title == current.title && updated.duration == 200);
+    CHECK(fastPath.nextDeadline() == t0 + 6);
+    fastPath.delivered(t0 + 5.001);
+
+    // A seek carrying the elapsed time and its timestamp, within the same second: the deferred fetch is shared.
+    current = updated;
+    CHECK(fastPath.notificationReceived(current, 0, true, playbackPayload(false, 0, true, 120, t0 + 5.4), t0 + 5.5, updated) == FastPath::kDecisionApply);
+    CHECK(updated.playbackRate == 0 && updated.elapsedTime == 120 && updated.timestamp == t0 + 5.4);
+    CHECK(fastPath.nextDeadline() == t0 + 6);
+    fastPath.delivered(t0 + 5.502);
+    CHECK(!fastPath.advance(t0 + 5.9));
+    CHECK(fastPath.advance(t0 + 6));
+    CHECK(!fastPath.advance(t0 + 7) && fastPath.nextDeadline() == HUGE_VAL);
+
+    // Resuming, told by the is-playing flag only, and naming the same track.
+    current = updated;
+    NowPlaying::MRNotificationPayload resume;
+    resume.hasIsPlaying = true;
+    resume.isPlaying = true;
+    resume.contentItemIdentifier = "a";
+    CHECK(fastPath.notificationReceived(current, 0, true, resume, t0 + 10, updated) == FastPath::kDecisionApply);
+    CHECK(updated.playbackRate == 1 && updated.elapsedTime == 120 && updated.timestamp == t0 + 10);
+    // Any fetch makes the deferred one useless.
+    fastPath.fetchIssued();
+    CHECK(fastPath.nextDeadline() == HUGE_VAL);
+    fastPath.delivered(t0 + 10.001);
+
+    // Everything else is fetched.
+    current = updated;
+    NowPlaying::MRNotificationPayload other = playbackPayload(true, 1, true, 0, t0 + 20);
+    other.contentItemIdentifier = "b";
+    CHECK(fastPath.notificationReceived(current, 0, true, other, t0 + 20, updated) == FastPath::kDecisionFetch);
+    other.contentItemIdentifier.clear();
+    other.hasOtherInfo = true;
+    CHECK(fastPath.notificationReceived(current, 0, true, other, t0 + 20, updated) == FastPath::kDecisionFetch);
+    CHECK(fastPath.notificationReceived(current, 0, true, NowPlaying::MRNotificationPayload(), t0 + 20, updated) == FastPath::kDecisionFetch);
+    CHECK(fastPath.notificationReceived(current, 0, false, playbackPayload(true, 0, false, 0, 0), t0 + 20, updated) == FastPath::kDecisionFetch);
+    NowPlaying::MRNowPlayingSnapshot stale = current;
+    stale.stale = true;
+    CHECK(fastPath.notificationReceived(stale, 0, true, playbackPayload(true, 0, false, 0, 0), t0 + 20, updated) == FastPath::kDecisionFetch);
+    CHECK(fastPath.notificationReceived(NowPlaying::MRNowPlayingSnapshot(), 0, true, playbackPayload(true, 0, false, 0, 0), t0 + 20, updated) == FastPath::kDecisionFetch);
+    CHECK(fastPath.nextDeadline() == HUGE_VAL);
+
+    // Another application starting to play says nothing of its track: applying it would show the previous track as playing.
+    NowPlaying::MRNotificationPayload playing;
+    playing.hasIsPlaying = true;
+    playing.isPlaying = true;
+    playing.processIdentifier = 812;
+    CHECK(fastPath.notificationReceived(current, 431, true, playing, t0 + 20, updated) == FastPath::kDecisionFetch);
+    playing.processIdentifier = 0;
+    CHECK(fastPath.notificationReceived(current, 431, true, playing, t0 + 20, updated) == FastPath::kDecisionFetch);
+    playing.processIdentifier = 812;
+    CHECK(fastPath.notificationReceived(current, 0, true, playing, t0 + 20, updated) == FastPath::kDecisionFetch);
+    CHECK(fastPath.notificationReceived(current, 812, true, playing, t0 + 20, updated) == FastPath::kDecisionApply);
+    fastPath.fetchIssued();
+    fastPath.delivered(t0 + 20.05);
+
+    const NowPlaying::MRNotificationStatistics& statistics = fastPath.getStatistics();
+    CHECK(statistics.notifications == 13 && statistics.applied == 4);
+    CHECK(statistics.deferredFetches == 1 && statistics.fetchesAvoided == 3);
+    CHECK(fabs(statistics.meanAppliedLatency - (0.004 + 0.05) / 4) < 1e-6);
+    CHECK(fabs(statistics.meanFetchedLatency - 0.05) < 1e-6);
+    CHECK(fabs(statistics.maxLatency - 0.05) < 1e-6);
+
+    // Disabled, nothing is applied, but the latencies are still measured.
+    config.enabled = false;
+    FastPath disabled(config);
+    CHECK(disabled.notificationReceived(current, 0, true, playbackPayload(true, 0, false, 0, 0), t0, updated) == FastPath::kDecisionFetch);
+    disabled.delivered(t0 + 0.03);
+    CHECK(disabled.getStatistics().applied == 0 && fabs(disabled.getStatistics().meanFetchedLatency - 0.03) < 1e-6);
+}
+
+// Counts the occurrences of `pattern` in `text`.
+static size_t countOf(const std::string& text, const std::string& pattern) {
+    size_t ret = 0;
+    for(size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + pattern.size())) ret++;
+    return ret;
+}
+
+// Brackets balance outside of strings, and nothing follows the document.
+static bool isWellFormedJSON(const std::string& json) {
+    std::vector<char> open;
+    bool inString = false;
+    for(size_t i = 0; i < json.size(); i++) {
+        char c = json[i];
+        if(inString) {
+            if(c == '\\') i++;
+            else if(c == '"') inString = false;
+            continue;
+        }
+        if(c == '"') inString = true;
+        else if(c == '{' || c == '[') open.push_back(c);
+        else if(c == '}' || c == ']') {
+            if(open.empty() || open.back() != (c == '}' ? '{' : '[')) return false;
+            open.pop_back();
+            if(open.empty() && json.find_first_not_of(" \n", i + 1) != std::string::npos) return false;
+        }
+    }
+    return open.empty() && !inString;
+}
+
+// A source answering on another thread, like MediaRemote, with its round trip traced.
+struct TracedSource : public StandInSource {
+    void fetch(uint64_t sequence) {
+        MR_TRACE_ASYNC_BEGIN("TracedSource", "round trip", sequence);
+        StandInSource::fetch(sequence);
+    }
+
+    void deliverLater() {
+        std::vector<uint64_t> replies;
+        replies.swap(pending);
+        std::thread([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            for(size_t i = 0; i < replies.size(); i++) MR_TRACE_ASYNC_END("TracedSource", "round trip", replies[i]);
+        }).join();
+        for(size_t i = 0; i < replies.size(); i++) hub->deliver(replies[i], systemValue);
+    }
+};
+
+static void testTrace() {
+#ifdef NOWPLAYING_TRACING
+    CHECK(NowPlaying::MRTrace::IsCompiled());
+#else
+    CHECK(!NowPlaying::MRTrace::IsCompiled());
+    return;                                             // Nothing is recorded
+#endif
+    NowPlaying::MRTrace::Clear();
+    NowPlaying::MRTrace::SetEnabled(true);
+    CHECK(NowPlaying::MRTrace::IsEnabled());
+
+    // The pipeline of the hub: a notification, the round trip, the fan out and the callbacks.
+    TracedSource source;
+    NowPlaying::MRSnapshotHub<int> hub(&source);
+    source.hub = &hub;
+    HubInstance instances[3];
+    for(int i = 0; i < 3; i++) {
+        HubInstance* instance = &instances[i];
+        hub.observe(hub.attach(instance), [instance]() {
+            MR_TRACE_SPAN("test", "user callback");
+            instance->callbacks++;
+        });
+    }
+    hub.notify();
+    source.systemValue = 5;
+    source.deliverLater();
+    CHECK(instances[2].data == 5);
+
+    std::string json = NowPlaying::MRTrace::ExportJSON();
+    CHECK(isWellFormedJSON(json));
+    CHECK(json.compare(0, 15, "{\"displayTimeUn") == 0);
+    CHECK(countOf(json, "\"name\":\"fan out\"") == 1);
+    CHECK(countOf(json, "\"name\":\"callback\"") == 3);
+    CHECK(countOf(json, "\"name\":\"user callback\"") == 3);
+    CHECK(countOf(json, "\"ph\":\"b\"") == 1 && countOf(json, "\"ph\":\"e\"") == 1);
+    CHECK(countOf(json, "\"id\":\"0x1\"") == 2);
+    CHECK(countOf(json, "\"tid\":") == 9);
+
+    // Disabled: nothing recorded. Cleared: nothing exported.
+    NowPlaying::MRTrace::SetEnabled(false);
+    {
+        MR_TRACE_SPAN("test", "disabled");
+    }
+    CHECK(countOf(NowPlaying::MRTrace::ExportJSON(), "\"name\":\"disabled\"") == 0);
+    NowPlaying::MRTrace::Clear();
+    CHECK(NowPlaying::MRTrace::ExportJSON() == "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n");
+
+    // Threads record while another exports: every event exported is whole, and a full buffer keeps the latest events.
+    NowPlaying::MRTrace::SetEnabled(true);
+    std::atomic<bool> done(false);
+    std::thread exporter([&]() {
+        while(!done.load()) CHECK(isWellFormedJSON(NowPlaying::MRTrace::ExportJSON()));
+    });
+    std::vector<std::thread> recorders;
+    for(int t = 0; t < 3; t++) {
+        recorders.push_back(std::thread([t]() {
+            int spans = t == 0 ? (int)NowPlaying::MRTraceBuffer::kCapacity + 100 : 100;
+            for(int i = 0; i < spans; i++) {
+                MR_TRACE_SPAN("test", "\"quoted\\name\"");
+            }
+        }));
+    }
+    for(size_t i = 0; i < recorders.size(); i++) recorders[i].join();
+    done = true;
+    exporter.join();
+    NowPlaying::MRTrace::SetEnabled(false);
+
+    json = NowPlaying::MRTrace::ExportJSON();
+    CHECK(isWellFormedJSON(json));
+    CHECK(countOf(json, "\"name\":\"\\\"quoted\\\\name\\\"\"") == NowPlaying::MRTraceBuffer::kCapacity + 200);
+    CHECK(NowPlaying::MRTrace::GetOverwrittenCount() == 100);
+
+    std::string path = temporaryPath("trace");
+    CHECK(NowPlaying::MRTrace::WriteJSON(path.c_str()) == 0);
+    FILE* file = fopen(path.c_str(), "rb");
+    CHECK(file != 0);
+    if(file) {
+        fseek(file, 0, SEEK_END);
+        CHECK((size_t)ftell(file) == json.size());
+        fclose(file);
+    }
+    unlink(path.c_str());
+    CHECK(NowPlaying::MRTrace::WriteJSON(0) == -1);
+    NowPlaying::MRTrace::Clear();
+}
+
+// A player on a simulated clock, obeying the commands of an MRCommandSchedule.
+struct CommandedPlayer {
+    std::string track;
+    double duration;
+    double elapsedTime;
+    double timestamp;
+    double rate;
+    const double* now;
+    std::vector<NowPlaying::MRScheduledCommand> commands;
+
+    double position() const {
+        return std::min(elapsedTime + (*now - timestamp) * rate, duration);
+    }
+
+    void start(const char* identifier, double length, double from, double playbackRate) {
+        track = identifier;
+        duration = length;
+        elapsedTime = from;
+        timestamp = *now;
+        rate = playbackRate;
+    }
+
+    void seek(double to) {
+        elapsedTime = to;
+        timestamp = *now;
+    }
+
+    NowPlaying::MRNowPlayingSnapshot snapshot() const {
+        return trackSnapshot(track.c_str(), duration, elapsedTime, rate, timestamp);
+    }
+
+    bool execute(NowPlaying::MRScheduledCommand command, double seekTime) {
+        commands.push_back(command);
+        if(command == NowPlaying::kMRScheduledCommandSeek) seek(seekTime);
+        if(command == NowPlaying::kMRScheduledCommandPause) {
+            seek(position());
+            rate = 0;
+        }
+        return true;
+    }
+};
+
+struct CommandLog {
+    std::vector<NowPlaying::MRScheduledCommandReport> reports;
+
+    static void record(const NowPlaying::MRScheduledCommandReport& report, void* context) {
+        static_cast<CommandLog*>(context)->reports.push_back(report);
+    }
+};
+
+// Wake up at each deadline until `until`, `lateness` seconds late.
+static void runCommands(NowPlaying::MRCommandSchedule& schedule, double& now, double until, double lateness) {
+    while(schedule.nextDeadline() + lateness <= until) {
+        now = std::max(now, schedule.nextDeadline() + lateness);
+        schedule.advance(now);
+    }
+    now = until;
+}
+
+static void testCommandSchedule() {
+    const double t0 = 1700000000;
+    double now = t0;
+    CommandedPlayer player;
+    player.now = &now;
+    NowPlaying::MRCommandSchedule schedule([&player](NowPlaying::MRScheduledCommand command, double seekTime) {
+        return player.execute(command, seekTime);
+    });
+    CommandLog log;
+    CHECK(schedule.schedule(NowPlaying::kMRScheduledCommandPause, 150, 0, CommandLog::record, &log, now) == 0);
+
+    // Pause at 2:30, playing from 0:10. A seek by the user moves the deadline, and it fires on the exact position.
+    player.start("a", 200, 10, 1);
+    schedule.feed(player.snapshot(), now);
+    uint64_t pause = schedule.schedule(NowPlaying::kMRScheduledCommandPause, 150, 0, CommandLog::record, &log, now);
+    CHECK(pause != 0 && schedule.nextDeadline() == t0 + 140);
+    CHECK(schedule.schedule(NowPlaying::kMRScheduledCommandPause, 5, 0, CommandLog::record, &log, now) == 0);
+    runCommands(schedule, now, t0 + 50, 0);
+    player.seek(100);
+    CHECK(schedule.feed(player.snapshot(), now) == 0);
+    CHECK(schedule.nextDeadline() == t0 + 100);
+    runCommands(schedule, now, t0 + 99.99, 0);
+    CHECK(log.reports.empty());
+    runCommands(schedule, now, t0 + 101, 0);
+    CHECK(log.reports.size() == 1 && log.reports[0].id == pause);
+    CHECK(log.reports[0].outcome == NowPlaying::kMRScheduledCommandFired && log.reports[0].result);
+    CHECK(std::fabs(log.reports[0].error) < 1e-6 && std::fabs(player.position() - 150) < 1e-6 && player.rate == 0);
+
+    // Stale snapshots are ignored. Paused, nothing is due until playing again.
+    uint64_t seek = schedule.schedule(NowPlaying::kMRScheduledCommandSeek, 160, 30, CommandLog::record, &log, now);
+    NowPlaying::MRNowPlayingSnapshot stale = trackSnapshot("b", 200, 0, 1, now);
+    stale.stale = true;
+    CHECK(schedule.feed(stale, now) == 0);
+    CHECK(schedule.nextDeadline() == HUGE_VAL && schedule.getPendingCount() == 1);
+    CHECK(schedule.cancel(seek) == 0 && schedule.cancel(seek) == -1);
+
+    // Next track 5 s before the end, at double rate, on a track whose duration is only known later.
+    // The pause after it never fires: another track plays.
+    now = t0 + 1000;
+    player.start("b", 0, 0, 2);
+    schedule.feed(player.snapshot(), now);
+    log.reports.clear();
+    uint64_t next = schedule.schedule(NowPlaying::kMRScheduledCommandNextTrack, -5, 0, CommandLog::record, &log, now);
+    uint64_t late = schedule.schedule(NowPlaying::kMRScheduledCommandPause, 96, 0, CommandLog::record, &log, now);
+    CHECK(next != 0 && late != 0 && schedule.nextDeadline() == t0 + 1048);
+    now = t0 + 1001;
+    player.duration = 100;
+    schedule.feed(player.snapshot(), now);
+    CHECK(schedule.nextDeadline() == t0 + 1047.5);
+    runCommands(schedule, now, t0 + 1060, 0);
+    CHECK(log.reports.size() == 1 && log.reports[0].id == next && log.reports[0].targetPosition == 95);
+    CHECK(player.commands.back() == NowPlaying::kMRScheduledCommandNextTrack);
+    player.start("c", 100, 0, 1);
+    CHECK(schedule.feed(player.snapshot(), now) == 1);
+    CHECK(log.reports.size() == 2 && log.reports[1].id == late && log.reports[1].outcome == NowPlaying::kMRScheduledCommandMissed);
+
+    // Jumped over by a seek: missed. Woken up late: fired, with the error reported.
+    uint64_t jumped = schedule.schedule(NowPlaying::kMRScheduledCommandPause, 50, 0, CommandLog::record, &log, now);
+    schedule.schedule(NowPlaying::kMRScheduledCommandPause, 80, 0, CommandLog::record, &log, now);
+    runCommands(schedule, now, t0 + 1070, 0);
+    player.seek(70);
+    CHECK(schedule.feed(player.snapshot(), now) == 1);
+    CHECK(log.reports.back().id == jumped && log.reports.back().outcome == NowPlaying::kMRScheduledCommandMissed);
+    runCommands(schedule, now, t0 + 1090, 0.03);
+    CHECK(log.reports.back().outcome == NowPlaying::kMRScheduledCommandFired && std::fabs(log.reports.back().error - 0.03) < 1e-6);
+    CHECK(schedule.getPendingCount() == 0);
+
+    NowPlaying::MRCommandSchedulerStatistics statistics = schedule.getStatistics();
+    CHECK(statistics.fired == 3 && statistics.missed == 2);
+    CHECK(std::fabs(statistics.maxError - 0.03) < 1e-6 && std::fabs(statistics.meanError - 0.01) < 1e-6);
+}
+
+static bool isSyntheticSnapshot(const NowPlaying::MRNowPlayingSnapshot& snapshot, uint64_t index) {
+    char title[64];
+    snprintf(title, sizeof(title), "Track %llu", (unsigned long long)index);
+    return snapshot.hasInfo && snapshot.title == title;
+}
+
+static void testSnapshotHistory() {
+    NowPlaying::MRSnapshotHistory history(4);
+    NowPlaying::MRNowPlayingSnapshot snapshot;
+    std::vector<NowPlaying::MRVersionedSnapshot> snapshots;
+    CHECK(history.getLatestVersion() == 0);
+    CHECK(history.snapshotAt(0, snapshot) == -1 && history.snapshotAt(1, snapshot) == -1);
+    CHECK(history.since(0, snapshots) == 0);
+
+    for(int i = 1; i <= 3; i++) CHECK(history.publish(syntheticSnapshot(i)) == (uint64_t)i);
+    CHECK(history.snapshotAt(2, snapshot) == 0 && isSyntheticSnapshot(snapshot, 2));
+    CHECK(history.since(1, snapshots) == 2);
+    CHECK(snapshots[0].version == 2 && snapshots[1].version == 3 && isSyntheticSnapshot(snapshots[1].snapshot, 3));
+
+    // Full: the oldest versions are replaced, and skipped by since().
+    for(int i = 4; i <= 10; i++) history.publish(syntheticSnapshot(i));
+    CHECK(history.getLatestVersion() == 10);
+    CHECK(history.snapshotAt(6, snapshot) == -1);
+    CHECK(history.snapshotAt(7, snapshot) == 0 && isSyntheticSnapshot(snapshot, 7));
+    CHECK(history.snapshotAt(11, snapshot) == -1);
+    snapshots.clear();
+    CHECK(history.since(2, snapshots) == 4);
+    CHECK(snapshots.front().version == 7 && snapshots.back().version == 10);
+    snapshots.clear();
+    CHECK(history.since(10, snapshots) == 0);
+
+    // Without readers, replaced entries are freed within two publishes.
+    CHECK(history.getRetiredCount() <= 2);
+
+    // One writer and several readers: every snapshot read is the one of its version, and since() never reorders.
+    NowPlaying::MRSnapshotHistory shared(8);
+    const uint64_t publishes = 20000;
+    std::atomic<bool> done(false);
+    std::atomic<int> mismatches(0);
+    std::atomic<uint64_t> reads(0);
+    std::vector<std::thread> readers;
+    for(int r = 0; r < 4; r++) {
+        readers.push_back(std::thread([&, r]() {
+            std::vector<NowPlaying::MRVersionedSnapshot> found;
+            NowPlaying::MRNowPlayingSnapshot read;
+            uint64_t seen = 0;
+            while(!done.load()) {
+                uint64_t latest = shared.getLatestVersion();
+                if(latest && shared.snapshotAt(latest - r % 2, read) == 0 && !isSyntheticSnapshot(read, latest - r % 2)) mismatches++;
+                found.clear();
+                shared.since(seen, found);
+                for(size_t i = 0; i < found.size(); i++) {
+                    if(!isSyntheticSnapshot(found[i].snapshot, found[i].version) || found[i].version <= seen) mismatches++;
+                    seen = found[i].version;
+                }
+                reads++;
+            }
+        }));
+    }
+    size_t maxRetired = 0;
+    for(uint64_t i = 1; i <= publishes; i++) {
+        shared.publish(syntheticSnapshot((int)i));
+        maxRetired = std::max(maxRetired, shared.getRetiredCount());
+        if(i % 64 == 0) std::this_thread::yield();
+    }
+    done = true;
+    for(size_t i = 0; i < readers.size(); i++) readers[i].join();
+    CHECK(mismatches.load() == 0);
+    CHECK(reads.load() > 0);
+    CHECK(shared.getLatestVersion() == publishes);
+    // The retired entries do not pile up while readers come and go.
+    CHECK(maxRetired <= NowPlaying::MRSnapshotHistory::kMaxRetired);
+}
+
+// Time to first usable data at startup: waiting for a source which answers after `latency`,
+// against serving the snapshot persisted by the previous run at once.
+static void benchWarmStart() {
+    const std::chrono::milliseconds latency(150);
+    std::string path = temporaryPath("warm");
+    NowPlaying::MRSnapshotStore store(path);
+    store.save(syntheticSnapshot(7));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    NowPlaying::MRNowPlayingSnapshot live;
+    std::mutex lock;
+    std::condition_variable arrived;
+    std::thread source([&]() {
+        std::this_thread::sleep_for(latency);
+        std::lock_guard<std::mutex> guard(lock);
+        live = syntheticSnapshot(7);
+        arrived.notify_one();
+    });
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        arrived.wait(guard, [&]() { return live.hasInfo; });
+    }
+    double cold = secondsSince(start);
+    source.join();
+
+    const int rounds = 10000;
+    NowPlaying::MRNowPlayingSnapshot warm;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < rounds; i++) {
+        NowPlaying::MRSnapshotStore startup(path);
+        startup.load(warm);
+    }
+    double loaded = secondsSince(start) / rounds;
+    CHECK(warm.hasInfo && warm.stale);
+
+    printf("warm start: first data after %.1f ms from the source, %.2f us from the snapshot cache\n", cold * 1e3, loaded * 1e6);
+    unlink(path.c_str());
+}
+
+// Cost of counting a play and of reading a top-10, with the default capacity.
+static void benchTopCharts() {
+    NowPlaying::MRTopCharts charts((NowPlaying::MRTopChartsConfig()));
+    ZipfTrace trace(100000, 1.1, 7);
+    const int plays = 1000000;
+    std::vector<std::string> titles(plays);
+    std::vector<size_t> tracks(plays);
+    for(int i = 0; i < plays; i++) tracks[i] = trace.next();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < plays; i++) charts.addPlay(traceArtist(tracks[i]), traceAlbum(tracks[i]), traceTitle(tracks[i]), 1000 + i);
+    double update = secondsSince(start) / plays;
+
+    const int rounds = 10000;
+    size_t entries = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < rounds; i++) entries += charts.getTop(NowPlaying::kMRTopChartsCategoryTrack, NowPlaying::kMRTopChartsWindowAllTime, 10, 1000 + plays).size();
+    double query = secondsSince(start) / rounds;
+    CHECK(entries == 10u * rounds);
+
+    printf("top charts: %.2f us per play (9 charts), %.1f us per top-10 query, %.0f KiB for 1024 counters x 9\n",
+           update * 1e6, query * 1e6, charts.getMemoryUsage() / 1024.0);
+}
+
+// Wakeups per hour of the refresh scheduler on a simulated clock, against the fixed 1 second timer it replaces (3600 per hour).
+static void benchRefreshScheduler() {
+    const double t0 = 1700000000;
+    const double hour = 3600;
+    struct Scenario {
+        const char* name;
+        double trackLength;
+        bool paused;
+        bool lost;
+    } scenarios[] = {
+        {"playing 3:20 tracks, notifications working", 200, false, false},
+        {"paused, notifications working", 200, true, false},
+        {"playing 3:20 tracks, notifications lost", 200, false, true},
+        {"playing 0:45 tracks, notifications lost", 45, false, true},
+        {"paused, notifications lost", 200, true, true},
+    };
+    for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        NowPlaying::MRRefreshScheduler scheduler;
+        // The first hour gets the scheduler into its steady state: polling if notifications are lost.
+        SimulatedPlayer player = {t0, scenarios[i].trackLength, scenarios[i].paused ? t0 + 1010 : HUGE_VAL};
+        double lostFrom = scenarios[i].lost ? 0 : HUGE_VAL;
+        scheduler.snapshotFetched(player.at(t0), t0);
+        simulateRefresh(scheduler, player, t0, t0 + hour, lostFrom, HUGE_VAL);
+        RefreshRun run = simulateRefresh(scheduler, player, t0 + hour, t0 + 2 * hour, lostFrom, HUGE_VAL);
+        printf("refresh: %-44s %4llu wakeups/hour, changes seen within %.1f s\n", scenarios[i].name, (unsigned long long)run.wakeups, run.worstLatency);
+    }
+}
+
+// Reads per second of the latest snapshot with 1 to 8 reader threads and a writer publishing 1000 times a second,
+// against the same reads behind a mutex.
+static void benchSnapshotHistory() {
+    const std::chrono::milliseconds duration(300);
+    const unsigned cores = std::thread::hardware_concurrency();
+    for(int locked = 0; locked < 2; locked++) {
+        for(int threads = 1; threads <= 8; threads *= 2) {
+            NowPlaying::MRSnapshotHistory history(64);
+            std::mutex lock;
+            NowPlaying::MRNowPlayingSnapshot latest = syntheticSnapshot(1);
+            history.publish(latest);
+            std::atomic<bool> done(false);
+            std::atomic<uint64_t> reads(0);
+            std::vector<std::thread> readers;
+            for(int r = 0; r < threads; r++) {
+                readers.push_back(std::thread([&]() {
+                    NowPlaying::MRNowPlayingSnapshot read;
+                    uint64_t count = 0;
+                    while(!done.load(std::memory_order_relaxed)) {
+                        if(locked) {
+                            std::lock_guard<std::mutex> guard(lock);
+                            read = latest;
+                        }
+                        else history.snapshotAt(history.getLatestVersion(), read);
+                        count++;
+                    }
+                    reads += count;
+                }));
+            }
+            std::thread writer([&]() {
+                for(int i = 2; !done.load(); i++) {
+                    NowPlaying::MRNowPlayingSnapshot snapshot = syntheticSnapshot(i);
+                    if(locked) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        latest = snapshot;
+                    }
+                    else history.publish(snapshot);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            std::this_thread::sleep_for(duration);
+            done = true;
+            writer.join();
+            for(size_t i = 0; i < readers.size(); i++) readers[i].join();
+            printf("snapshot history: %s, %d reader(s) on %u core(s): %.2f M reads/s\n",
+                   locked ? "mutex    " : "lock-free", threads, cores, reads.load() / (duration.count() / 1e3) / 1e6);
+        }
+    }
+}
+
+static double benchCommandTime;
+
+static bool recordCommandTime(NowPlaying::MRScheduledCommand, double) {
+    benchCommandTime = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return true;
+}
+
+// Accuracy of commands fired by the thread on the real clock, against sleeping until the deadline.
+static void benchCommandScheduler() {
+    const int commands = 20;
+    const double spacing = 0.05;
+    NowPlaying::MRCommandScheduler scheduler(recordCommandTime);
+    double start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    scheduler.feed(trackSnapshot("a", 3600, 0, 1, start));
+    // Play while playing changes nothing, so every command fires on the same playback.
+    for(int i = 1; i <= commands; i++) scheduler.schedule(NowPlaying::kMRScheduledCommandPlay, i * spacing, 0, nullptr, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds((int)((commands + 2) * spacing * 1e3)));
+    NowPlaying::MRCommandSchedulerStatistics statistics = scheduler.getStatistics();
+
+    double totalError = 0, maxError = 0;
+    start = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    for(int i = 1; i <= commands; i++) {
+        double deadline = start + i * spacing;
+        std::this_thread::sleep_until(std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(deadline))));
+        recordCommandTime(NowPlaying::kMRScheduledCommandPlay, 0);
+        totalError += benchCommandTime - deadline;
+        maxError = std::max(maxError, benchCommandTime - deadline);
+    }
+    CHECK(statistics.fired == (uint64_t)commands);
+    printf("command scheduler: %llu commands fired %.1f us late on average (max %.1f us), sleeping until the deadline: %.1f us (max %.1f us)\n",
+           (unsigned long long)statistics.fired, statistics.meanError * 1e6, statistics.maxError * 1e6, totalError / commands * 1e6, maxError * 1e6);
+}
+
+// Cost of a span on the recording thread, recording or not.
+static void benchTrace() {
+    const int spans = 1000000;
+    for(int enabled = 0; enabled < 2; enabled++) {
+        NowPlaying::MRTrace::SetEnabled(enabled != 0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int i = 0; i < spans; i++) {
+            MR_TRACE_SPAN("bench", "span");
+        }
+        double elapsed = secondsSince(start) / spans;
+        printf("trace: %.1f ns per span %s\n", elapsed * 1e9, enabled ? "while recording" : "while not recording");
+    }
+    NowPlaying::MRTrace::SetEnabled(false);
+    NowPlaying::MRTrace::Clear();
+}
+
+static uint64_t splitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Words made of syllables, some with diacritics, as in a large multilingual catalog.
+static std::string catalogWords(uint64_t seed, int count) {
+    static const char* const syllables[] = {
+        "ka", "lo", "mi", "re", "su", "na", "to", "vi", "de", "ra", "chi", "no", "bel", "mar", "s\xC3\xA9", "l\xC3\xBC",
+        "tan", "gor", "ph\xC3\xB6", "zu", "ba", "ce", "dy", "fo", "gu", "ha", "je", "ki", "ly", "mo", "nu", "pe",
+        "qui", "ro", "sa", "te", "ul", "ve", "wa", "xo", "yu", "ze", "bri", "cla", "dro", "fle", "gri", "sto",
+        "tr\xC3\xA8", "\xC3\xB1o", "ar", "en", "is", "om", "ush", "elt", "ing", "ost", "ven", "lia", "mun", "pol", "rik", "dav"};
+    std::string ret;
+    for(int w = 0; w < count; w++) {
+        if(w) ret += ' ';
+        uint64_t word = splitMix(seed + w);
+        int length = 2 + (int)(word % 3);
+        for(int i = 0; i < length; i++) ret += syllables[(word >> (8 + 6 * i)) % 64];
+    }
+    return ret;
+}
+
+struct CatalogTrack {
+    std::string title;
+    std::string artist;
+    std::string albumTitle;
+    uint64_t iTunesStoreIdentifier;
+};
+
+static CatalogTrack catalogTrack(uint64_t track) {
+    CatalogTrack ret;
+    uint64_t random = splitMix(track);
+    ret.title = catalogWords(random, 1 + (int)(random % 4));
+    uint64_t artist = random % 150000;
+    ret.artist = catalogWords(splitMix(artist + (1ull << 40)), 1 + (int)(artist % 2));
+    ret.albumTitle = catalogWords(splitMix(artist * 16 + (random >> 60)), 1 + (int)((random >> 20) % 3));
+    ret.iTunesStoreIdentifier = track % 2 ? 1000000000 + track : 0;
+    return ret;
+}
+
+static std::string uppercased(const std::string& text) {
+    std::string ret = text;
+    for(size_t i = 0; i < ret.size(); i++) if(ret[i] >= 'a' && ret[i] <= 'z') ret[i] -= 0x20;
+    return ret;
+}
+
+// Build time, memory and lookup latency on 2 million tracks.
+static void benchCatalog() {
+    const uint64_t tracks = 2000000;
+    std::string path = temporaryPath("catalog-bench");
+    FILE* file = fopen(path.c_str(), "wb");
+    for(uint64_t i = 0; i < tracks; i++) {
+        CatalogTrack track = catalogTrack(i);
+        fprintf(file, "%llu\t%llu\t%s\t%s\t%s\n", (unsigned long long)i, (unsigned long long)track.iTunesStoreIdentifier,
+                track.title.c_str(), track.artist.c_str(), track.albumTitle.c_str());
+    }
+    long size = ftell(file);
+    fclose(file);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    NowPlaying::MRCatalogInterface* catalog = NowPlaying::MRCatalogInterface::Create(path.c_str());
+    double build = secondsSince(start);
+    CHECK(catalog && catalog->getTrackCount() == tracks);
+    if(!catalog) return;
+    printf("catalog: %llu tracks (%.0f MiB file) indexed in %.2f s, %.0f MiB of index\n",
+           (unsigned long long)tracks, size / 1048576.0, build, catalog->getMemoryUsage() / 1048576.0);
+
+    const char* const kinds[] = {"by store identifier", "same text, other case", "typo and no diacritics"};
+    std::mt19937 random(11);
+    for(int kind = 0; kind < 3; kind++) {
+        const int lookups = 2000;
+        std::vector<double> latencies;
+        double worstCost = 0;
+        int found = 0;
+        for(int i = 0; i < lookups; i++) {
+            uint64_t expected = (random() % (tracks / 2)) * 2 + (kind == 0 ? 1 : 0);
+            CatalogTrack track = catalogTrack(expected);
+            NowPlaying::MRNowPlayingSnapshot snapshot = catalogQuery(track.title.c_str(), track.artist.c_str(), track.albumTitle.c_str());
+            if(kind == 0) snapshot.iTunesStoreIdentifier = track.iTunesStoreIdentifier;
+            if(kind == 1) snapshot.title = uppercased(track.title);
+            if(kind == 2) {
+                std::vector<uint32_t> folded;
+                NowPlaying::MRFoldText(track.title.data(), track.title.size(), folded);
+                snapshot.title.clear();
+                for(size_t j = 0; j < folded.size(); j++) snapshot.title += (char)folded[j];
+                snapshot.title.erase(snapshot.title.size() / 2, 1);
+            }
+            NowPlaying::MRCatalogMatch match;
+            start = std::chrono::steady_clock::now();
+            int ret = catalog->match(snapshot, &match);
+            latencies.push_back(secondsSince(start));
+            // The fastest of a few more runs is the cost of the lookup itself, without the page faults and preemptions of the first.
+            double cost = latencies.back();
+            for(int run = 0; run < 2; run++) {
+                start = std::chrono::steady_clock::now();
+                catalog->match(snapshot, &match);
+                cost = std::min(cost, secondsSince(start));
+            }
+            worstCost = std::max(worstCost, cost);
+            // Synthetic titles repeat, so a match with identical fields counts too.
+            if(ret == 0 && (match.identifier == expected || (match.title == track.title && match.artist == track.artist))) found++;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        printf("catalog: lookup %-24s p50 %.1f us, p99 %.1f us, max %.1f us (%.1f us warm), %.1f%% matched\n", kinds[kind],
+               latencies[lookups / 2] * 1e6, latencies[lookups * 99 / 100] * 1e6, latencies.back() * 1e6, worstCost * 1e6, 100.0 * found / lookups);
+        CHECK(worstCost < 1e-3);
+    }
+    NowPlaying::MRCatalogInterface::Delete(catalog);
+    unlink(path.c_str());
+}
+
+// A long enhanced LRC song followed at its deadlines, against rescanning the whole file on every 60 Hz UI tick.
+static void benchLyrics() {
+    const int lines = 120;
+    const int wordsPerLine = 8;
+    std::string lrc = "[ti:Bench]\n[ar:Bench]\n";
+    char tag[32];
+    for(int i = 0; i < lines; i++) {
+        double time = 5.0 + i * 2.5;
+        snprintf(tag, sizeof(tag), "[%02d:%06.3f]", (int)(time / 60), fmod(time, 60));
+        lrc += tag;
+        for(int j = 0; j < wordsPerLine; j++) {
+            double wordTime = time + j * 0.3;
+            snprintf(tag, sizeof(tag), "<%02d:%06.3f>", (int)(wordTime / 60), fmod(wordTime, 60));
+            lrc += tag;
+            lrc += catalogWords(i * wordsPerLine + j, 1) + " ";
+        }
+        lrc += "\n";
+    }
+    double playback = 5.0 + lines * 2.5;
+
+    NowPlaying::MRLyricsInterface* lyrics = NowPlaying::MRLyricsInterface::Create();
+    const int loads = 2000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < loads; i++) lyrics->load(lrc.data(), lrc.size());
+    double load = secondsSince(start) / loads;
+
+    const double t0 = 1700000000;
+    LyricsRun run;
+    run.now = t0;
+    lyrics->feed(trackSnapshot("a", playback, 0, 1, t0), t0);
+    int wakeups = 0;
+    start = std::chrono::steady_clock::now();
+    while(lyrics->nextDeadline() <= t0 + playback) {
+        run.now = std::max(run.now, lyrics->nextDeadline());
+        lyrics->advance(run.now, recordLyricsEvent, &run);
+        wakeups++;
+    }
+    double follow = secondsSince(start);
+    NowPlaying::MRLyricsInterface::Delete(lyrics);
+
+    double ticks = playback * 60;
+    printf("lyrics: %d lines of %d words (%zu bytes) parsed in %.1f us\n", lines, wordsPerLine, lrc.size(), load * 1e6);
+    printf("lyrics: %zu events in %d wakeups, %.1f us of CPU for the song (vs %.0f ticks rescanning, ~%.0f ms)\n",
+           run.records.size(), wakeups, follow * 1e6, ticks, ticks * load * 1e3);
+}
+
+static void benchArrowExporter() {
+    std::string path = temporaryPath("bench.arrow");
+    unlink(path.c_str());
+    // A listening history: each track is a few snapshots (start, pauses, seeks) among a few thousand tracks.
+    std::vector<NowPlaying::MRVersionedSnapshot> tracks(4000);
+    for(size_t i = 0; i < tracks.size(); i++) tracks[i].snapshot = syntheticSnapshot((int)i);
+
+    const uint64_t rows = 2000000;
+    NowPlaying::MRArrowExporterInterface* exporter = NowPlaying::MRArrowExporterInterface::Create(path.c_str());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < rows; i++) {
+        NowPlaying::MRVersionedSnapshot& versioned = tracks[(size_t)(splitMix(i / 4) % tracks.size())];
+        versioned.version = i + 1;
+        versioned.snapshot.elapsedTime = (double)(i % 4) * 30;
+        versioned.snapshot.playbackRate = (double)(i % 2);
+        exporter->write(versioned);
+    }
+    NowPlaying::MRArrowExporterInterface::Delete(exporter);
+    double elapsed = secondsSince(start);
+
+    struct stat status;
+    double size = stat(path.c_str(), &status) == 0 ? (double)status.st_size : 0;
+    unlink(path.c_str());
+    printf("arrow export: %llu rows in %.2f s (%.1f M rows/s), %.1f MB at %.0f MB/s, %.1f bytes per row\n",
+           (unsigned long long)rows, elapsed, rows / elapsed / 1e6, size / 1e6, size / 1e6 / elapsed, size / rows);
+}
+
+static void runNotificationFastPath(const NowPlaying::MRNotificationFastPathConfig& config, const char* name) {
+    // A listening session: track changes, pauses and resumes, and seeks, often in bursts while scrubbing, each notified.
+    // Fetches are assumed to take a 30 ms round trip, the fast path only the time it takes here.
+    const double roundTrip = 0.030;
+    const int notifications = 100000;
+    NowPlaying::MRNotificationFastPath fastPath(config);
+    NowPlaying::MRNowPlayingSnapshot current = trackSnapshot("track-0", 240, 0, 1, 1700000000);
+    NowPlaying::MRNowPlayingSnapshot updated;
+    double now = current.timestamp;
+    uint64_t fetches = 0;
+    int track = 0;
+    double applying = 0;
+    for(int i = 0; i < notifications; i++) {
+        uint64_t random = splitMix((uint64_t)i);
+        int kind = (int)((random >> 32) % 10);
+        // Seeks mostly come in bursts; the rest minutes apart.
+        now += kind >= 6 && (random >> 40) % 4 != 0 ? 0.05 + (double)(random % 200) / 1000 : 5 + (double)(random % 120000) / 1000;
+        if(fastPath.nextDeadline() <= now) {
+            fastPath.advance(now);
+            fastPath.fetchIssued();
+            fetches++;
+        }
+        NowPlaying::MRNotificationPayload payload;
+        if(kind < 2) {
+            payload.hasOtherInfo = true;
+        }
+        else if(kind < 6) {
+            payload.hasPlaybackRate = true;
+            payload.playbackRate = current.playbackRate > 0 ? 0 : 1;
+        }
+        else {
+            payload.hasElapsedTime = true;
+            payload.elapsedTime = (double)((random >> 16) % 240);
+            payload.timestamp = now;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        NowPlaying::MRNotificationFastPath::Decision decision = fastPath.notificationReceived(current, 0, true, payload, now, updated);
+        if(decision == NowPlaying::MRNotificationFastPath::kDecisionApply) {
+            current = updated;
+            double elapsed = secondsSince(start);
+            applying += elapsed;
+            fastPath.delivered(now + elapsed);
+        }
+        else {
+            fastPath.fetchIssued();
+            fetches++;
+            char identifier[32];
+            snprintf(identifier, sizeof(identifier), "track-%d", ++track);
+            current = trackSnapshot(identifier, 240, 0, 1, now + roundTrip);
+            fastPath.delivered(now + roundTrip);
+        }
+    }
+    const NowPlaying::MRNotificationStatistics& statistics = fastPath.getStatistics();
+    printf("notification fast path, %s: %d notifications, %llu fetches (%llu deferred), %llu avoided (%.0f%%)\n", name, notifications,
+           (unsigned long long)fetches, (unsigned long long)statistics.deferredFetches, (unsigned long long)statistics.fetchesAvoided,
+           100.0 * statistics.fetchesAvoided / notifications);
+    printf("notification fast path, %s: to the callbacks in %.2f us applied vs %.1f ms fetched (%.2f us of CPU per applied notification)\n",
+           name, statistics.meanAppliedLatency * 1e6, statistics.meanFetchedLatency * 1e3, statistics.applied ? applying / statistics.applied * 1e6 : 0.0);
+}
+
+static void benchNotificationFastPath() {
+    NowPlaying::MRNotificationFastPathConfig config;
+    runNotificationFastPath(config, "checked after 10 s");
+    config.confirmDelay = -1;
+    runNotificationFastPath(config, "never checked");
+    config.enabled = false;
+    runNotificationFastPath(config, "disabled");
+}
+
+static void countTick(double, void* context) {
+    (*static_cast<uint64_t*>(context))++;
+}
+
+// Thousands of progress subscribers, served by one timer wheel instead of one timer each.
+static void benchProgressTicker() {
+    const double t0 = 1700000000;
+    const int subscribers = 5000;
+    const double intervals[] = {1, 0.1, 0.5, 0.25, 0.05};
+    const double playback = 60;
+
+    // Simulated clock: wakeups and CPU time per minute of playback.
+    {
+        NowPlaying::MRProgressSchedule schedule(t0);
+        double now = t0;
+        uint64_t ticks = 0;
+        double perSubscriberWakeups = 0;
+        for(int i = 0; i < subscribers; i++) {
+            double interval = intervals[i % 5];
+            // A fifth of the subscribers pick their own odd interval, for distinct timers in the wheel.
+            if(i % 5 == 4) interval = 0.05 + 0.001 * (i / 5);
+            schedule.subscribe(interval, countTick, &ticks, now);
+            perSubscriberWakeups += playback / interval;
+        }
+        schedule.feed(trackSnapshot("a", 3600, 0, 1, t0), now);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int wakeups = runSchedule(schedule, now, t0 + playback);
+        double elapsed = secondsSince(start);
+        printf("progress ticker: %d subscribers in %zu groups, %d wakeups per minute (vs %.0f with a timer each), %llu ticks in %.1f ms of CPU\n",
+               subscribers, schedule.getGroupCount(), wakeups, perSubscriberWakeups, (unsigned long long)ticks, elapsed * 1e3);
+    }
+    // Real thread and clock: wakeups and lateness of 1 Hz and 10 Hz subscribers.
+    {
+        NowPlaying::MRProgressTickerInterface* ticker = NowPlaying::MRProgressTickerInterface::Create();
+        uint64_t ticks = 0;
+        for(int i = 0; i < subscribers; i++) ticker->subscribe(i % 2 ? 1.0 : 0.1, countTick, &ticks);
+        double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        ticker->feed(trackSnapshot("a", 3600, 0, 1, now));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+        uint64_t wakeups = ticker->getWakeupCount();
+        NowPlaying::MRProgressTickerInterface::Delete(ticker);
+        printf("progress ticker: %d subscribers at 1 Hz and 10 Hz on one thread, %llu wakeups and %llu ticks in 2 s\n",
+               subscribers, (unsigned long long)wakeups, (unsigned long long)ticks);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+
+    testUpdateSequencer();
+    testSnapshotHub();
+    testSnapshotStore();
+    testScrobbler();
+    testTopCharts();
+    testRefreshScheduler();
+    testTimerWheel();
+    testProgressSchedule();
+    testOptimisticState();
+    testSnapshotHistory();
+    testCommandSchedule();
+    testTrace();
+    testCatalog();
+    testLyrics();
+    testEventStream();
+    testArrowExporter();
+    testFetchWatchdog();
+    testNotificationFastPath();
+
+    if(bench) {
+        benchWarmStart();
+        benchTopCharts();
+        benchRefreshScheduler();
+        benchProgressTicker();
+        benchSnapshotHistory();
+        benchCommandScheduler();
+        benchTrace();
+        benchCatalog();
+        benchLyrics();
+        benchArrowExporter();
+        benchNotificationFastPath();
+    }
+
+    if(failures) {
+        printf("%d check(s) failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}
@@ -13,6 +13,7 @@ int main() {
          bool isInfoExists = info -> hasInfo();
          if(isInfoExists) printf("Now playing info exists! Details:\n");
          else printf("No media is being played now.\n");
+         if(info -> isStale()) printf("(Stale information from the snapshot cache.)\n");
          
          // Raw info
          NSDictionary* dict = info -> getRawInfo();